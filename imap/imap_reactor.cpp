@@ -0,0 +1,191 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#include "common/logger.h"
+#include "service/service.h"
+#include "imap_reactor.h"
+
+using namespace std;
+using namespace nestor::net;
+using namespace nestor::service;
+
+namespace nestor {
+namespace imap {
+
+ImapReactor::ImapReactor(int id, const std::string &host, unsigned short port,
+                         SqliteConnection *connection, int cpu)
+        : id_(id), cpu_(cpu), connection_(connection), statementCache_(nullptr),
+          observer_(nullptr), running_(false) {
+    if (connection_ == nullptr)
+        throw invalid_argument("ImapReactor::ImapReactor: connection is nullptr");
+    listener_ = new SocketListener(host, port);
+    listener_->setReusePort(true);
+}
+
+ImapReactor::~ImapReactor() {
+    stop();
+    join();
+    delete observer_;
+    delete listener_;
+}
+
+void ImapReactor::start() {
+    listener_->startListen();
+
+    observer_ = new IOObserver();
+    observer_->append(listener_->descriptor(), 0,
+                      [this](int) { acceptConnections(); }, nullptr, nullptr);
+
+    running_ = true;
+    thread_ = thread(&ImapReactor::run, this);
+}
+
+void ImapReactor::stop() {
+    if (running_.exchange(false) && observer_)
+        observer_->wakeUp();
+}
+
+void ImapReactor::join() {
+    if (thread_.joinable())
+        thread_.join();
+}
+
+int ImapReactor::id() const {
+    return id_;
+}
+
+void ImapReactor::run() {
+    pinThread();
+    IMAP_LOG("ImapReactor::run: reactor " << id_ << " started");
+
+    // Sessions of this thread compile each statement only once
+    statementCache_ = new SqliteStatementCache(connection_);
+
+    while (running_) {
+        observer_->wait();
+        releaseClosedSessions();
+    }
+
+    IMAP_LOG("ImapReactor::run: reactor " << id_ << " is stopping. Closing "
+             << sessions_.size() << " sessions");
+
+    IMAP_LOG("ImapReactor::run: reactor " << id_ << " accepted "
+             << listener_->acceptedCount() << " connections, accept limit reached "
+             << listener_->acceptLimitCount() << " times, accept errors "
+             << listener_->acceptErrorCount() << ", dropped "
+             << listener_->acceptDroppedCount() << " connections");
+
+    observer_->remove(listener_->descriptor());
+    listener_->close();
+
+    /* Deleting session closes its socket, which removes it from
+     * the observer. */
+    for (ImapSession *s : sessions_) {
+        s->setOnExitCallback(nullptr);
+        delete s;
+    }
+    sessions_.clear();
+    releaseClosedSessions();
+
+    IMAP_LOG("ImapReactor::run: reactor " << id_ << " compiled "
+             << statementCache_->compileCount() << " statements for "
+             << statementCache_->requestCount() << " requests");
+    delete statementCache_;
+    statementCache_ = nullptr;
+
+    IMAP_LOG("ImapReactor::run: reactor " << id_ << " finished");
+}
+
+void ImapReactor::pinThread() {
+    if (cpu_ < 0)
+        return;
+
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu_, &cpuset);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (rc != 0) {
+        IMAP_LOG_LVL(WARN, "ImapReactor::pinThread: cannot pin reactor " << id_
+                     << " to cpu " << cpu_ << ": " << strerror(rc));
+    }
+#else
+    IMAP_LOG_LVL(WARN, "ImapReactor::pinThread: thread pinning is not supported");
+#endif
+}
+
+void ImapReactor::acceptConnections() {
+    acceptedSockets_.clear();
+    listener_->acceptMany(acceptedSockets_, ACCEPT_BATCH);
+
+    for (SocketSingle *con : acceptedSockets_)
+        startSession(con);
+    acceptedSockets_.clear();
+}
+
+void ImapReactor::startSession(SocketSingle *con) {
+    IMAP_LOG("ImapReactor::startSession: reactor " << id_
+             << " accepted fd " << con->descriptor());
+
+    ImapSession *session = new ImapSession(new Service(connection_, statementCache_), con);
+    sessions_.insert(session);
+
+    auto onRead = [session](int fd) {
+        session->processData();
+        session->writeAnswers();
+    };
+    auto onWrite = [session](int fd) {
+        session->writeAnswers();
+    };
+    auto onTimeout = [session](int fd) {
+        session->autologout();
+    };
+
+    IOObserver *observer = observer_;
+    observer_->append(con->descriptor(), ImapSession::AUTOLOGOUT_TIMEOUT_MS,
+                      onRead, onWrite, onTimeout);
+    observer_->modify(con->descriptor(), session->wantRead(), session->wantWrite());
+    con->setOnCloseCallback([observer](SocketSingle *s) {
+        observer->remove(s->descriptor());
+    });
+    session->setOnIOInterestCallback([observer](ImapSession *s) {
+        observer->modify(s->socket()->descriptor(), s->wantRead(), s->wantWrite());
+    });
+
+    session->setOnExitCallback([this](ImapSession *s) {
+        sessions_.erase(s);
+        closedSessions_.push_back(s);
+    });
+    session->writeAnswers();
+}
+
+void ImapReactor::releaseClosedSessions() {
+    if (closedSessions_.size() > 0) {
+        for (ImapSession *s : closedSessions_)
+            delete s;
+        closedSessions_.clear();
+    }
+}
+
+} /* namespace imap */
+} /* namespace nestor */
@@ -0,0 +1,111 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef IMAP_REACTOR_H_
+#define IMAP_REACTOR_H_
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+
+#include "net/socket_listener.h"
+#include "net/io_observer.h"
+#include "service/sqlite_connection.h"
+#include "service/sqlite_statement_cache.h"
+#include "imap_session.h"
+
+namespace nestor {
+namespace imap {
+
+/**
+ * Event loop serving IMAP sessions in its own thread. Every reactor has
+ * its own listener bound with SO_REUSEPORT to the same address, so the
+ * kernel distributes new connections between reactors and a session
+ * lives in one thread for its whole life.
+ */
+class ImapReactor {
+public:
+    /** Maximum connections accepted per listener readiness event */
+    static const size_t ACCEPT_BATCH = 64;
+
+    /**
+     * @param id Reactor number, used for logging.
+     * @param host Address to listen on.
+     * @param port Port to listen on.
+     * @param connection Database connection used by the sessions. The
+     * reactor thread should be its only user, e.g. a reader of the
+     * SqliteConnectionPool.
+     * @param cpu CPU core to pin the reactor thread to or -1 to leave
+     * the thread unpinned.
+     */
+    ImapReactor(int id, const std::string &host, unsigned short port,
+                service::SqliteConnection *connection, int cpu = -1);
+    virtual ~ImapReactor();
+
+    /**
+     * Starts listening and spawns the reactor thread.
+     * Throws net::SocketIOException if the listener cannot be started.
+     */
+    void start();
+
+    /**
+     * Asks the reactor to close all sessions and finish.
+     * May be called from any thread.
+     */
+    void stop();
+
+    /**
+     * Waits for the reactor thread to finish.
+     */
+    void join();
+
+    int id() const;
+
+private:
+    void run();
+    void pinThread();
+    void acceptConnections();
+    void startSession(net::SocketSingle *con);
+    void releaseClosedSessions();
+
+private:
+    int id_;
+    int cpu_;
+    service::SqliteConnection *connection_;
+    /** Statements shared by all sessions of the reactor thread */
+    service::SqliteStatementCache *statementCache_;
+
+    net::SocketListener *listener_;
+    net::IOObserver *observer_;
+
+    std::unordered_set<ImapSession *> sessions_;
+    std::vector<ImapSession *> closedSessions_;
+    std::vector<net::SocketSingle *> acceptedSockets_;
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+};
+
+} /* namespace imap */
+} /* namespace nestor */
+
+#endif /* IMAP_REACTOR_H_ */
@@ -18,7 +18,6 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
  */
-#include <vector>
 #include <sstream>
 #include "common/logger.h"
 #include "imap_session.h"
@@ -32,57 +31,109 @@ using namespace nestor::net;
 namespace nestor {
 namespace imap {
 
+/* Masks of session states in which command is allowed */
+enum : unsigned int {
+    STATE_NON_AUTH = 0x01,
+    STATE_AUTH     = 0x02,
+    STATE_WORK     = 0x04,
+    STATE_ANY      = STATE_NON_AUTH | STATE_AUTH | STATE_WORK
+};
+
+/* Indexes in parserFunctions */
+enum CommandId {
+    COMMAND_CAPABILITY,
+    COMMAND_NOOP,
+    COMMAND_LOGOUT,
+    COMMAND_AUTHENTICATE,
+    COMMAND_LOGIN
+};
+
 /*
- * Map of parsing methods. Command - parsing method.
+ * Parsing methods. Command - parsing method - allowed states.
+ * Order must match CommandId.
  */
-const std::map<std::string, ImapSession::CommandParserFunction>
-ImapSession::parserFunctions = {
-        {"CAPABILITY", &ImapSession::processCapability},
-        {"NOOP", &ImapSession::processNoop},
-        {"LOGOUT", &ImapSession::processLogout},
-        {"AUTHENTICATE", &ImapSession::processAuthenticate},
-        {"LOGIN", &ImapSession::processLogin}
+const ImapSession::CommandParser ImapSession::parserFunctions[] = {
+        {"CAPABILITY", &ImapSession::processCapability, STATE_ANY},
+        {"NOOP", &ImapSession::processNoop, STATE_ANY},
+        {"LOGOUT", &ImapSession::processLogout, STATE_ANY},
+        {"AUTHENTICATE", &ImapSession::processAuthenticate, STATE_NON_AUTH},
+        {"LOGIN", &ImapSession::processLogin, STATE_NON_AUTH}
 };
 
-/**
- * Retrieves tag from command line
- * @param data command data to parse
- * @return return tag or nullptr in case of error.
- */
-static string* getCommandTag(const string &data) {
-    if (data.length() == 0 || !isalnum(data[0]))
-        return nullptr;
-    size_t spacePos = data.find(' ', 0);
-    if (spacePos == string::npos)
-        return nullptr;
-    string *result = new string();
-    result->assign(data.begin(), data.begin() + spacePos);
-    return result;
+static unsigned int stateMask(ImapSessionState state) {
+    switch (state) {
+    case ImapSessionState::NON_AUTH:
+        return STATE_NON_AUTH;
+    case ImapSessionState::AUTH:
+        return STATE_AUTH;
+    case ImapSessionState::WORK:
+        return STATE_WORK;
+    default:
+        return 0;
+    }
 }
 
+static inline char toUpperAscii(char c) {
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
 
 /**
- * Retrieves command name from command line
- * @param data command data to parse
- * @return return command name or nullptr in case of error.
+ * Finds parsing method of the command. Command length and the first
+ * letter select the only candidate, which is compared case insensitively
+ * with the raw command name, so the lookup neither allocates nor walks
+ * the whole table. New commands are added to the switch by their length.
+ * @param name Command name as client has sent it.
+ * @param state Current session state.
+ * @param allowed[out] Set to true if command is allowed in the state.
+ * @return parser or nullptr if command is unknown.
  */
-static string* getCommandName(const string &data) {
-    if (data.length() == 0)
-            return nullptr;
+const ImapSession::CommandParser *ImapSession::findParser(StringRef name,
+        ImapSessionState state, bool *allowed) {
+    int id = -1;
+    *allowed = false;
+    if (name.empty())
+        return nullptr;
+
+    char first = toUpperAscii(name[0]);
+    switch (name.length()) {
+    case 4:
+        if (first == 'N') id = COMMAND_NOOP;
+        break;
+    case 5:
+        if (first == 'L') id = COMMAND_LOGIN;
+        break;
+    case 6:
+        if (first == 'L') id = COMMAND_LOGOUT;
+        break;
+    case 10:
+        if (first == 'C') id = COMMAND_CAPABILITY;
+        break;
+    case 12:
+        if (first == 'A') id = COMMAND_AUTHENTICATE;
+        break;
+    default:
+        break;
+    }
 
-    vector<string> parts;
-    split(data, " ", parts);
+    if (id < 0)
+        return nullptr;
 
-    if (parts.size() < 2)
+    const CommandParser *parser = &parserFunctions[id];
+    if (!name.equalsIgnoreCase(parser->name))
         return nullptr;
 
-    string *result = new string(parts[1]);
-    return result;
+    *allowed = (parser->states & stateMask(state)) != 0;
+    return parser;
 }
 
 ImapSession::ImapSession(service::Service *service, net::SocketSingle *socket)
-        : state_(ImapSessionState::START), service_(service), socket_(socket),
-          onExitCallback_(nullptr) {
+        : state_(ImapSessionState::START), literalContinuationPos_(0), requiredLength_(0), outgoingOffset_(0),
+          outputLowWatermark_(DEFAULT_OUTPUT_LOW_WATERMARK),
+          outputHighWatermark_(DEFAULT_OUTPUT_HIGH_WATERMARK),
+          readPaused_(false), exitPending_(false), processing_(false),
+          notifiedWantRead_(true), notifiedWantWrite_(false),
+          service_(service), socket_(socket),
+          onExitCallback_(nullptr), onIOInterestCallback_(nullptr) {
     if (service_ == nullptr)
         throw invalid_argument("ImapSession::ImapSession: service is nullptr");
     if (socket_ == nullptr)
@@ -109,69 +160,159 @@ const service::Service* ImapSession::service() const {
 void ImapSession::processData() {
     lock_guard<mutex> lock(sessionLock_);
 
-    string data = socket_->readAll();
-    incomingData_.append(data);
-
-    bool flag = true;
-    while(flag) {
-        size_t crlfPos = incomingData_.find(CRLF);
-
-        // Checking for valid line
-        if (crlfPos == string::npos)
+    if (state_ == ImapSessionState::EXIT)
+        return;
+
+    bool connectionAlive = true;
+    if (!readPaused_ && !exitPending_)
+        connectionAlive = receiveData();
+
+    processing_ = true;
+    while(true) {
+        /* Client doesn't read our answers fast enough or has logged out,
+         * or the session is closed by a write error.
+         * Rest of the commands stay in the buffer. */
+        if (readPaused_ || exitPending_ || state_ == ImapSessionState::EXIT)
             break;
 
-        /* Getting line and parse her. Here we only do rough parsing,
-         * detailed parsing goes in process<command> methods.*/
-        string line = incomingData_.substr(0, crlfPos);
-        string *tag, *commandName;
-
-
-        tag = getCommandTag(line);
-        commandName = getCommandName(line);
-
-        if (!tag || !commandName) {
-            ImapCommand com {line, ""};
-            rejectBad(&com, "Missing command");
+        /* Commands are tokenized in place, tokens refer to the buffer */
+        StringRef data(incomingData_.data(), incomingData_.size());
+        if (data.empty() || data.length() < requiredLength_)
+            break;
 
-            incomingData_.erase(0, crlfPos + 2); // deleting wrong line from buffer
-            if (tag) delete tag;
-            if (commandName) delete commandName;
+        ImapTokenizerStatus status = tokenizer_.tokenize(data);
+        if (status == ImapTokenizerStatus::UNCOMPLETED) {
+            requiredLength_ = tokenizer_.requiredLength();
+            if (tokenizer_.literalLength() > MAX_LITERAL_LENGTH) {
+                IMAP_LOG_LVL(WARN, "Too long literal on socket " << socket_->descriptor());
+                answersData_.append("* BAD Literal too long" CRLF);
+                exitPending_ = true;
+                writeAnswers();
+            } else if (data.length() > MAX_COMMAND_LENGTH + tokenizer_.literalLength()) {
+                IMAP_LOG_LVL(WARN, "Too long command on socket " << socket_->descriptor());
+                answersData_.append("* BAD Command line too long" CRLF);
+                exitPending_ = true;
+                writeAnswers();
+            } else if (tokenizer_.literalContinuation() &&
+                       literalContinuationPos_ != tokenizer_.position()) {
+                /* Client waits for permission to send the literal */
+                literalContinuationPos_ = tokenizer_.position();
+                answersData_.append("+ Ready for literal data" CRLF);
+                writeAnswers();
+            }
+            break;
+        }
+        literalContinuationPos_ = 0;
+        requiredLength_ = 0;
+
+        ImapCommand command;
+        command.tag = "*";
+        if (tokenizer_.size() > 0 && tokenizer_[0].type == ImapTokenType::ATOM)
+            command.tag = tokenizer_[0].value;
+
+        if (status == ImapTokenizerStatus::INVALID) {
+            /* Skipping the rest of the line */
+            size_t crlfPos = data.find(CRLF, tokenizer_.position());
+            if (crlfPos == StringRef::npos) {
+                if (data.length() > MAX_COMMAND_LENGTH) {
+                    IMAP_LOG_LVL(WARN, "Too long command on socket " << socket_->descriptor());
+                    answersData_.append("* BAD Command line too long" CRLF);
+                    exitPending_ = true;
+                    writeAnswers();
+                }
+                break;
+            }
+            rejectBad(&command, "Syntax error");
+            incomingData_.consume(crlfPos + 2);
+            writeAnswers();
             continue;
         }
 
-        ImapCommand *command = new ImapCommand();
-        command->tag = *tag;
-        command->name = *commandName;
-
-        stringToUpper(command->name);
-
-        IMAP_LOG_LVL(DEBUG, "Received command: {" << command->tag << "," << command->name << "}");
+        if (!parseCommand(&command)) {
+            rejectBad(&command, "Missing command");
+            incomingData_.consume(tokenizer_.commandLength());
+            writeAnswers();
+            continue;
+        }
 
-        int commandEnd;
+        IMAP_LOG_LVL(DEBUG, "Received command: {" << command.tag << "," << command.name << "}");
 
-        if (parserFunctions.count(command->name)) {
-            CommandParserFunction func =  parserFunctions.at(command->name);
-            commandEnd = (this->*func)(command);
-            if (commandEnd >= 0) {
-                incomingData_.erase(0, commandEnd + 1);
-            } else {
-                /* Incomplete command. break */
-                flag = false;
-            }
+        bool allowed;
+        const CommandParser *parser = findParser(command.name, state_, &allowed);
+        if (parser) {
+            command.name = parser->name; // Canonical upper case name
+            if (allowed)
+                (this->*parser->function)(&command);
+            else
+                rejectNo(&command, "Wrong state");
         } else {
-            rejectUnknownCommand(command);
-            incomingData_.erase(0, crlfPos + 2); // deleting wrong line from buffer
+            rejectUnknownCommand(&command);
         }
+        incomingData_.consume(tokenizer_.commandLength());
 
         writeAnswers();
+    }
+    processing_ = false;
 
-        if (tag) delete tag;
-        if (commandName) delete commandName;
+    if (state_ == ImapSessionState::EXIT)
+        return;
 
-        if (state_ == ImapSessionState::EXIT) {
-            break;
+    if (!connectionAlive) {
+        IMAP_LOG("Connection closed by client on socket " << socket_->descriptor());
+        switchState(ImapSessionState::EXIT);
+        return;
+    }
+
+    if (incomingData_.empty())
+        incomingData_.shrink();
+}
+
+/**
+ * Fills command tag, name and arguments from the tokenized command.
+ * @return false if command has no valid tag or name.
+ */
+bool ImapSession::parseCommand(ImapCommand *command) const {
+    if (tokenizer_.size() < 2)
+        return false;
+
+    const ImapToken &tag = tokenizer_[0];
+    const ImapToken &name = tokenizer_[1];
+    if (tag.type != ImapTokenType::ATOM ||
+            !isalnum(static_cast<unsigned char>(tag.value[0])) ||
+            name.type != ImapTokenType::ATOM)
+        return false;
+
+    command->tag = tag.value;
+    command->name = name.value;
+    command->args = tokenizer_.tokens() + 2;
+    command->argCount = tokenizer_.size() - 2;
+    return true;
+}
+
+/**
+ * Reads data which has arrived to the socket into the input buffer.
+ * @return false if connection was closed by client or broken.
+ */
+bool ImapSession::receiveData() {
+    static const size_t READ_CHUNK_SIZE = 4096;
+    size_t received = 0;
+
+    try {
+        while (received < MAX_READ_PER_CALL) {
+            char *buf = incomingData_.prepare(READ_CHUNK_SIZE);
+            size_t readed = socket_->readSome(buf, incomingData_.writable());
+            if (readed == 0)
+                break;
+            incomingData_.commit(readed);
+            received += readed;
         }
+    } catch (SocketIOException &e) {
+        IMAP_LOG_LVL(WARN,
+                "Cannot read from the socket " << socket_->descriptor() << ": " << e.what());
+        return false;
     }
+
+    return !socket_->peerClosed();
 }
 
 std::string ImapSession::greetingString() const {
@@ -180,58 +321,40 @@ std::string ImapSession::greetingString() const {
 
 
 /* CAPABILITY command */
-int ImapSession::processCapability(ImapCommand* command) {
-    size_t crlfPos = incomingData_.find(CRLF);
-    string line = incomingData_.substr(0, crlfPos);
-
-    int ret = crlfPos + 1; /* last position in command */
-
+void ImapSession::processCapability(ImapCommand* command) {
     /* Check command syntax */
-    if (line.length() != command->tag.length() + 1 /* whitespace */ + command->name.length()) {
+    if (command->argCount != 0) {
         rejectUnknownCommand(command);
-        return ret;
+        return;
     }
 
-    ostringstream oss;
-    oss << "* CAPABILITY IMAP4rev1 LITERAL+ AUTH=PLAIN" << CRLF << command->tag << " OK CAPABILITY completed" << CRLF;
-    answersData_.append(oss.str());
-    return ret;
+    answersData_.append("* CAPABILITY IMAP4rev1 LITERAL+ AUTH=PLAIN" CRLF);
+    answersData_ += command->tag;
+    answersData_.append(" OK CAPABILITY completed" CRLF);
 }
 
 
 /* NOOP command */
-int ImapSession::processNoop(ImapCommand* command) {
-    size_t crlfPos = incomingData_.find(CRLF);
-    string line = incomingData_.substr(0, crlfPos);
-
-    int ret = crlfPos + 1; /* last position in command */
-
+void ImapSession::processNoop(ImapCommand* command) {
     /* Check command syntax */
-    if (line.length() != command->tag.length() + 1 /* whitespace */ +
-            command->name.length()) {
+    if (command->argCount != 0) {
         rejectUnknownCommand(command);
-        return ret;
+        return;
     }
 
-    ostringstream oss;
-    oss << command->tag << " OK " << command->name << " completed" << CRLF;
-    answersData_.append(oss.str());
-    return ret;
+    answersData_ += command->tag;
+    answersData_.append(" OK ");
+    answersData_ += command->name;
+    answersData_.append(" completed" CRLF);
 }
 
 
 /* LOGOUT command */
-int ImapSession::processLogout(ImapCommand *command) {
-    size_t crlfPos = incomingData_.find(CRLF);
-    string line = incomingData_.substr(0, crlfPos);
-
-    int ret = crlfPos + 1; /* last position in command */
-
+void ImapSession::processLogout(ImapCommand *command) {
     /* Check command syntax */
-    if (line.length() != command->tag.length() + 1 /* whitespace */ +
-            command->name.length()) {
+    if (command->argCount != 0) {
         rejectUnknownCommand(command);
-        return ret;
+        return;
     }
 
     service_->onLogout();
@@ -240,63 +363,42 @@ int ImapSession::processLogout(ImapCommand *command) {
     oss << "* BYE IMAP4rev1 Server logging out" << CRLF << command->tag
             << " OK " << command->name << " completed" << CRLF;
     answersData_.append(oss.str());
+
+    /* Session exits as soon as the answer is sent */
+    exitPending_ = true;
     writeAnswers();
-    switchState(ImapSessionState::EXIT);
-    return ret;
 }
 
 
 /* AUTHENTICATE command */
-int ImapSession::processAuthenticate(ImapCommand *command) {
-    size_t crlfPos = incomingData_.find(CRLF);
-    string line = incomingData_.substr(0, crlfPos);
-    vector<string> commandParts;
-    split(line, " ", commandParts);
+void ImapSession::processAuthenticate(ImapCommand *command) {
     ostringstream oss; // for formatting
 
-    int ret = crlfPos + 1;
-
-    if (state_ != ImapSessionState::NON_AUTH) {
-        rejectNo(command, "Wrong state");
-        return ret;
-    }
-
-    if (commandParts.size() != 3) {
+    if (command->argCount != 1 || command->args[0].type != ImapTokenType::ATOM) {
         oss << command->name << " Wrong arguments";
         rejectBad(command, oss.str());
-        return ret;
+        return;
     }
 
     /* We don't support any authentication mechanism yet */
-    oss << "Unsupported authentication " << commandParts[2];
+    oss << "Unsupported authentication " << command->args[0].value;
     rejectNo(command, oss.str());
-    return ret;
 }
 
 
 /* LOGIN command */
-int ImapSession::processLogin(ImapCommand *command) {
-    size_t crlfPos = incomingData_.find(CRLF);
-    string line = incomingData_.substr(0, crlfPos);
-    vector<string> commandParts;
-    split(line, " ", commandParts);
+void ImapSession::processLogin(ImapCommand *command) {
     ostringstream oss; // for formatting
 
-    int ret = crlfPos + 1;
-
-    if (state_ != ImapSessionState::NON_AUTH) {
-        rejectNo(command, "Wrong state");
-        return ret;
-    }
-
-    if (commandParts.size() != 4) {
+    if (command->argCount != 2 || !command->args[0].isAString() ||
+            !command->args[1].isAString()) {
         oss << command->name << " Wrong arguments";
         rejectBad(command, oss.str());
-        return ret;
+        return;
     }
 
-    string username = commandParts[2];
-    string password = commandParts[3];
+    string username = command->args[0].toString();
+    string password = command->args[1].toString();
 
     if (service_->authenticate(username, password)) {
         switchState(ImapSessionState::AUTH);
@@ -307,9 +409,6 @@ int ImapSession::processLogin(ImapCommand *command) {
     } else {
         rejectNo(command, "Invalid user name or password");
     }
-
-    return ret;
-
 }
 
 void ImapSession::rejectUnknownCommand(ImapCommand* command) {
@@ -367,18 +466,129 @@ void ImapSession::switchState(ImapSessionState newState) {
 }
 
 void ImapSession::writeAnswers() {
+    if (state_ == ImapSessionState::EXIT)
+        return;
+
     if (answersData_.length() > 0) {
-        try {
-            socket_->write(answersData_);
-        } catch (SocketIOException &e) {
-            IMAP_LOG_LVL(WARN,
-                    "Cannot write to the socket" << socket_->descriptor() << ": " << e.what());
-        } catch (SocketTimeoutException &e) {
-            IMAP_LOG_LVL(WARN,
-                    "Timeout socket " << socket_->descriptor() << "; " << e.what());
+        if (outgoingOffset_ == outgoingData_.length()) {
+            // Nothing is queued, take the answers buffer without copying
+            outgoingData_.swap(answersData_);
+            outgoingOffset_ = 0;
+        } else {
+            outgoingData_.append(answersData_);
         }
         answersData_.clear();
     }
+
+    bool wasPaused = readPaused_;
+    flushAnswers();
+    if (state_ == ImapSessionState::EXIT)
+        return;
+
+    updateIOInterest();
+
+    /* Backlog has drained. Processing commands which
+     * were waiting in the input buffer. */
+    if (wasPaused && !readPaused_ && !processing_)
+        processData();
+}
+
+/**
+ * Sends queued output until socket accepts it and updates read pause
+ * state according to the output watermarks.
+ */
+void ImapSession::flushAnswers() {
+    try {
+        while (outgoingOffset_ < outgoingData_.length()) {
+            size_t sent = socket_->writeSome(outgoingData_.data() + outgoingOffset_,
+                                             outgoingData_.length() - outgoingOffset_);
+            if (sent == 0)
+                break; // Socket buffer is full, waiting for write readiness
+            outgoingOffset_ += sent;
+        }
+    } catch (SocketIOException &e) {
+        IMAP_LOG_LVL(WARN,
+                "Cannot write to the socket " << socket_->descriptor() << ": " << e.what());
+        outgoingData_.clear();
+        outgoingOffset_ = 0;
+        switchState(ImapSessionState::EXIT);
+        return;
+    }
+
+    if (outgoingOffset_ == outgoingData_.length()) {
+        outgoingData_.clear();
+        outgoingOffset_ = 0;
+
+        if (exitPending_) {
+            switchState(ImapSessionState::EXIT);
+            return;
+        }
+    } else if (outgoingOffset_ > outgoingData_.length() / 2) {
+        // Dropping sent part, it's bigger than the rest
+        outgoingData_.erase(0, outgoingOffset_);
+        outgoingOffset_ = 0;
+    }
+
+    size_t pending = pendingOutput();
+    if (!readPaused_ && pending > outputHighWatermark_) {
+        IMAP_LOG_LVL(DEBUG, "Output backlog " << pending << " bytes on socket "
+                     << socket_->descriptor() << ". Pausing reading");
+        readPaused_ = true;
+    } else if (readPaused_ && pending <= outputLowWatermark_) {
+        readPaused_ = false;
+    }
+}
+
+void ImapSession::updateIOInterest() {
+    bool read = wantRead();
+    bool write = wantWrite();
+    if (read == notifiedWantRead_ && write == notifiedWantWrite_)
+        return;
+
+    notifiedWantRead_ = read;
+    notifiedWantWrite_ = write;
+    if (onIOInterestCallback_)
+        onIOInterestCallback_(this);
+}
+
+bool ImapSession::wantRead() const {
+    return state_ != ImapSessionState::EXIT && !readPaused_ && !exitPending_;
+}
+
+bool ImapSession::wantWrite() const {
+    return state_ != ImapSessionState::EXIT && pendingOutput() > 0;
+}
+
+size_t ImapSession::pendingOutput() const {
+    return outgoingData_.length() - outgoingOffset_;
+}
+
+void ImapSession::setOutputWatermarks(size_t lowWatermark, size_t highWatermark) {
+    if (lowWatermark > highWatermark)
+        throw invalid_argument("ImapSession::setOutputWatermarks: low watermark is above high one");
+    outputLowWatermark_ = lowWatermark;
+    outputHighWatermark_ = highWatermark;
+}
+
+void ImapSession::setOnIOInterestCallback(CallbackFunction callback) {
+    onIOInterestCallback_ = callback;
+}
+
+void ImapSession::autologout() {
+    if (state_ == ImapSessionState::EXIT)
+        return;
+
+    if (exitPending_) {
+        /* BYE is still not sent, client doesn't read at all */
+        IMAP_LOG_LVL(INFO, "Dropping stalled connection on socket " << socket_->descriptor());
+        switchState(ImapSessionState::EXIT);
+        return;
+    }
+
+    IMAP_LOG("Autologout on socket " << socket_->descriptor());
+    answersData_.append("* BYE Autologout; idle for too long" CRLF);
+    exitPending_ = true;
+    writeAnswers();
 }
 
 ImapSessionState ImapSession::state() const {
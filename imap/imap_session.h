@@ -28,7 +28,10 @@
 #include <functional>
 
 #include "net/socket_single.h"
+#include "net/input_buffer.h"
 #include "service/service.h"
+#include "utils/string_ref.h"
+#include "imap_tokenizer.h"
 
 namespace nestor {
 namespace imap {
@@ -42,15 +45,44 @@ enum class ImapSessionState {
     EXIT        // closed session
 };
 
+/**
+ * Command being processed. Fields refer to the session input buffer
+ * and are valid only while the command is processed.
+ */
 struct ImapCommand {
-    std::string tag;
-    std::string name;
+    utils::StringRef tag;
+    utils::StringRef name;
+    const ImapToken *args = nullptr; // Tokens after the command name
+    size_t argCount = 0;
 };
 
 class ImapSession {
 // typedefs
 public:
     using CallbackFunction = std::function<void (nestor::imap::ImapSession *)>;
+
+// constants
+public:
+    /**
+     * Default output backlog limits in bytes. When queued output exceeds
+     * high watermark, session stops taking new commands until the backlog
+     * drains down to low watermark.
+     */
+    static const size_t DEFAULT_OUTPUT_HIGH_WATERMARK = 256 * 1024;
+    static const size_t DEFAULT_OUTPUT_LOW_WATERMARK = 64 * 1024;
+
+    /** Bytes read from the socket per processData() call at most */
+    static const size_t MAX_READ_PER_CALL = 64 * 1024;
+    /** Maximum length of a command without its literal data, longer
+     * commands close the session */
+    static const size_t MAX_COMMAND_LENGTH = 64 * 1024;
+    /** Maximum total length of literal data of one command, larger
+     * literals close the session */
+    static const size_t MAX_LITERAL_LENGTH = 16 * 1024 * 1024;
+
+    /** Inactivity autologout timer, RFC 3501 5.4 requires at least 30 minutes */
+    static const unsigned int AUTOLOGOUT_TIMEOUT_MS = 30 * 60 * 1000;
+
 public:
 
     /**
@@ -63,6 +95,12 @@ public:
     virtual ~ImapSession();
 
     void processData();
+
+    /**
+     * Sends queued answers without blocking. Output which the socket
+     * cannot accept now stays queued until the next call, which should
+     * be made when the socket becomes writable (see wantWrite()).
+     */
     void writeAnswers();
     const net::SocketSingle *socket() const;
     const service::Service *service() const;
@@ -70,41 +108,102 @@ public:
     ImapSessionState state() const;
     void setOnExitCallback(CallbackFunction callback);
 
+    /**
+     * @return true if session accepts new commands, i.e. socket
+     * should be observed for reading.
+     */
+    bool wantRead() const;
+
+    /**
+     * @return true if there is queued output, i.e. socket should be
+     * observed for writing.
+     */
+    bool wantWrite() const;
+
+    /**
+     * @return size of output queued but not sent yet in bytes.
+     */
+    size_t pendingOutput() const;
+
+    void setOutputWatermarks(size_t lowWatermark, size_t highWatermark);
+
+    /**
+     * Sets callback which is called when wantRead() or wantWrite()
+     * result changes.
+     */
+    void setOnIOInterestCallback(CallbackFunction callback);
+
+    /**
+     * Closes the session because of client inactivity. Sends BYE first,
+     * if session is already closing the connection is dropped.
+     */
+    void autologout();
+
 private:
     std::string greetingString() const;
     void rejectUnknownCommand(ImapCommand *command);
     void rejectBad(ImapCommand *command, const std::string &comment);
     void rejectNo(ImapCommand *command, const std::string &comment);
     void switchState(ImapSessionState newState);
+    bool receiveData();
+    bool parseCommand(ImapCommand *command) const;
+    void flushAnswers();
+    void updateIOInterest();
 
     /* Command processing functions. Should meets CommandParserFunction
      * signature. After successful work every function should write command
      * answer to the answersData_. Each function shouldn't aquire mutex
      * sessionLock_ because it's already locked.
-     * Input - ImapCommand structure with filled tag and name fields.
-     * Output - last meaningful symbol position of command in incomingData_
-     * or -1 if command is incomplete.  */
-    int processCapability(ImapCommand *command);
-    int processNoop(ImapCommand *command);
-    int processLogout(ImapCommand *command);
-    int processAuthenticate(ImapCommand *command);
-    int processLogin(ImapCommand *command);
+     * Input - ImapCommand structure with tag, name and argument tokens of
+     * the complete command. */
+    void processCapability(ImapCommand *command);
+    void processNoop(ImapCommand *command);
+    void processLogout(ImapCommand *command);
+    void processAuthenticate(ImapCommand *command);
+    void processLogin(ImapCommand *command);
 
 
 
 private:
-    typedef int (ImapSession::*CommandParserFunction)(ImapCommand *);
-    static const std::map<std::string, CommandParserFunction> parserFunctions;
+    typedef void (ImapSession::*CommandParserFunction)(ImapCommand *);
+    struct CommandParser {
+        const char *name;
+        CommandParserFunction function;
+        unsigned int states; // Mask of states in which command is allowed
+    };
+    static const CommandParser parserFunctions[];
+    static const CommandParser *findParser(utils::StringRef name,
+            ImapSessionState state, bool *allowed);
 
     ImapSessionState state_;
-    std::string incomingData_;
+    net::InputBuffer incomingData_;
+    ImapTokenizer tokenizer_;
+    /* Position of the literal in the current command for which
+     * continuation request was sent, 0 if none */
+    size_t literalContinuationPos_;
+    /* Length of buffered data needed to finish the literal of the
+     * current command, commands aren't tokenized again until then */
+    size_t requiredLength_;
     std::string answersData_;
     std::queue<ImapCommand *> completedCommands_;
     std::mutex sessionLock_;
 
+    /* Answers queued for sending. Bytes before outgoingOffset_
+     * are already sent. */
+    std::string outgoingData_;
+    size_t outgoingOffset_;
+    size_t outputLowWatermark_;
+    size_t outputHighWatermark_;
+    bool readPaused_;
+    bool exitPending_;   // LOGOUT received, exit when output is sent
+    bool processing_;    // processData() is on the stack
+    bool notifiedWantRead_;
+    bool notifiedWantWrite_;
+
     service::Service *service_;
     net::SocketSingle *socket_;
     CallbackFunction onExitCallback_;
+    CallbackFunction onIOInterestCallback_;
 };
 
 } /* namespace imap */
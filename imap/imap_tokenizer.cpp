@@ -0,0 +1,316 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+
+#include "utils/string.h"
+#include "imap_tokenizer.h"
+
+using namespace std;
+using namespace nestor::utils;
+
+namespace nestor {
+namespace imap {
+
+bool ImapToken::isAString() const {
+    return type == ImapTokenType::ATOM || type == ImapTokenType::STRING;
+}
+
+std::string ImapToken::toString() const {
+    if (!escaped)
+        return value.toString();
+
+    string result;
+    result.reserve(value.length());
+    for (size_t i = 0; i < value.length(); i++) {
+        if (value[i] == '\\' && i + 1 < value.length())
+            i++;
+        result.push_back(value[i]);
+    }
+    return result;
+}
+
+
+/**
+ * Checks if character may be a part of atom. Brackets are checked
+ * separately, atom may contain section specification in them.
+ * Backslash is accepted for flags, e.g. \Seen.
+ */
+static inline bool isAtomChar(char c) {
+    switch (c) {
+    case ' ':
+    case '(':
+    case ')':
+    case '{':
+    case '"':
+    case 0x7f:
+        return false;
+    default:
+        return static_cast<unsigned char>(c) >= 0x20;
+    }
+}
+
+ImapTokenizer::ImapTokenizer()
+        : count_(0), commandLength_(0), position_(0), literalLength_(0),
+          requiredLength_(0), literalContinuation_(false) {
+}
+
+ImapTokenizerStatus ImapTokenizer::tokenize(StringRef data) {
+    count_ = 0;
+    commandLength_ = 0;
+    position_ = 0;
+    literalLength_ = 0;
+    requiredLength_ = 0;
+    literalContinuation_ = false;
+
+    size_t pos = 0;
+    int depth = 0;
+    bool expectSeparator = false; // Tokens must be separated by space
+
+    while (pos < data.length()) {
+        char c = data[pos];
+        ImapTokenizerStatus status;
+
+        switch (c) {
+        case '\r':
+            if (pos + 1 >= data.length())
+                return stop(ImapTokenizerStatus::UNCOMPLETED, pos);
+            if (data[pos + 1] != '\n' || depth != 0 || count_ == 0)
+                return stop(ImapTokenizerStatus::INVALID, pos);
+            commandLength_ = pos + 2;
+            return stop(ImapTokenizerStatus::COMPLETED, commandLength_);
+
+        case ' ':
+            if (!expectSeparator)
+                return stop(ImapTokenizerStatus::INVALID, pos);
+            expectSeparator = false;
+            pos++;
+            continue;
+
+        case ')':
+            if (depth == 0 || !pushToken(ImapTokenType::LIST_END, data.substr(pos, 1)))
+                return stop(ImapTokenizerStatus::INVALID, pos);
+            depth--;
+            expectSeparator = true;
+            pos++;
+            continue;
+
+        default:
+            break;
+        }
+
+        if (expectSeparator)
+            return stop(ImapTokenizerStatus::INVALID, pos);
+
+        switch (c) {
+        case '(':
+            if (!pushToken(ImapTokenType::LIST_BEGIN, data.substr(pos, 1)))
+                return stop(ImapTokenizerStatus::INVALID, pos);
+            depth++;
+            pos++;
+            continue;
+
+        case '"':
+            status = parseQuoted(data, pos);
+            break;
+
+        case '{':
+            status = parseLiteral(data, pos);
+            break;
+
+        default:
+            status = parseAtom(data, pos);
+            break;
+        }
+
+        if (status != ImapTokenizerStatus::COMPLETED)
+            return stop(status, pos);
+        expectSeparator = true;
+    }
+
+    return stop(ImapTokenizerStatus::UNCOMPLETED, pos);
+}
+
+/**
+ * Parses quoted string. pos points to the opening quote, on success
+ * it's moved after the closing one.
+ */
+ImapTokenizerStatus ImapTokenizer::parseQuoted(StringRef data, size_t &pos) {
+    size_t start = pos + 1;
+    bool escaped = false;
+
+    for (size_t i = start; i < data.length(); i++) {
+        char c = data[i];
+        if (c == '\r' || c == '\n')
+            return ImapTokenizerStatus::INVALID;
+        if (c == '\\') {
+            escaped = true;
+            i++; // Skipping escaped character
+            continue;
+        }
+        if (c == '"') {
+            if (!pushToken(ImapTokenType::STRING, data.substr(start, i - start),
+                           ImapStringType::QUOTED, escaped))
+                return ImapTokenizerStatus::INVALID;
+            pos = i + 1;
+            return ImapTokenizerStatus::COMPLETED;
+        }
+    }
+
+    return ImapTokenizerStatus::UNCOMPLETED;
+}
+
+/**
+ * Parses literal, i.e. {length}CRLF followed by length octets or
+ * its nonsynchronizing form {length+}. pos points to the opening brace,
+ * on success it's moved after the literal data.
+ */
+ImapTokenizerStatus ImapTokenizer::parseLiteral(StringRef data, size_t &pos) {
+    static const size_t MAX_LENGTH_DIGITS = 10;
+    size_t i = pos + 1;
+    size_t length = 0;
+    size_t digits = 0;
+
+    while (i < data.length() && data[i] >= '0' && data[i] <= '9') {
+        if (++digits > MAX_LENGTH_DIGITS)
+            return ImapTokenizerStatus::INVALID;
+        length = length * 10 + (data[i] - '0');
+        i++;
+    }
+
+    ImapStringType type = ImapStringType::LITERAL;
+    if (i < data.length() && data[i] == '+') {
+        type = ImapStringType::LITERAL_NONSYNC;
+        i++;
+    }
+
+    /* Literal prefix should be the last thing in the line */
+    StringRef tail = data.substr(i, 3);
+    if (digits == 0 && !tail.empty())
+        return ImapTokenizerStatus::INVALID;
+    if (tail.length() < 3)
+        return StringRef("}" CRLF).startsWith(tail) ?
+                ImapTokenizerStatus::UNCOMPLETED : ImapTokenizerStatus::INVALID;
+    if (!tail.equals("}" CRLF))
+        return ImapTokenizerStatus::INVALID;
+    i += 3;
+    literalLength_ += length;
+
+    if (data.length() - i < length) {
+        requiredLength_ = i + length;
+        /* Client sends synchronizing literal after server's continuation request */
+        literalContinuation_ = (type == ImapStringType::LITERAL && data.length() == i);
+        pos = i;
+        return ImapTokenizerStatus::UNCOMPLETED;
+    }
+
+    if (!pushToken(ImapTokenType::STRING, data.substr(i, length), type))
+        return ImapTokenizerStatus::INVALID;
+    pos = i + length;
+    return ImapTokenizerStatus::COMPLETED;
+}
+
+/**
+ * Parses atom. Atom may contain section in square brackets with any
+ * characters, e.g. BODY[HEADER.FIELDS (FROM)].
+ */
+ImapTokenizerStatus ImapTokenizer::parseAtom(StringRef data, size_t &pos) {
+    size_t i = pos;
+    while (i < data.length()) {
+        char c = data[i];
+        if (c == '[') {
+            size_t closing = i + 1;
+            while (closing < data.length() && data[closing] != ']') {
+                if (data[closing] == '\r' || data[closing] == '\n')
+                    return ImapTokenizerStatus::INVALID;
+                closing++;
+            }
+            if (closing == data.length())
+                return ImapTokenizerStatus::UNCOMPLETED;
+            i = closing + 1;
+            continue;
+        }
+        if (!isAtomChar(c))
+            break;
+        i++;
+    }
+
+    if (i == data.length())
+        return ImapTokenizerStatus::UNCOMPLETED; // Atom may continue
+    if (i == pos)
+        return ImapTokenizerStatus::INVALID;     // Not an atom character
+
+    if (!pushToken(ImapTokenType::ATOM, data.substr(pos, i - pos)))
+        return ImapTokenizerStatus::INVALID;
+    pos = i;
+    return ImapTokenizerStatus::COMPLETED;
+}
+
+bool ImapTokenizer::pushToken(ImapTokenType type, StringRef value,
+                              ImapStringType stringType, bool escaped) {
+    if (count_ == MAX_TOKENS)
+        return false;
+
+    ImapToken &token = tokens_[count_++];
+    token.type = type;
+    token.stringType = stringType;
+    token.escaped = escaped;
+    token.value = value;
+    return true;
+}
+
+ImapTokenizerStatus ImapTokenizer::stop(ImapTokenizerStatus status, size_t pos) {
+    position_ = pos;
+    return status;
+}
+
+size_t ImapTokenizer::size() const {
+    return count_;
+}
+
+const ImapToken &ImapTokenizer::operator[](size_t index) const {
+    return tokens_[index];
+}
+
+const ImapToken *ImapTokenizer::tokens() const {
+    return tokens_;
+}
+
+size_t ImapTokenizer::commandLength() const {
+    return commandLength_;
+}
+
+bool ImapTokenizer::literalContinuation() const {
+    return literalContinuation_;
+}
+
+size_t ImapTokenizer::position() const {
+    return position_;
+}
+
+size_t ImapTokenizer::literalLength() const {
+    return literalLength_;
+}
+
+size_t ImapTokenizer::requiredLength() const {
+    return requiredLength_;
+}
+
+} /* namespace imap */
+} /* namespace nestor */
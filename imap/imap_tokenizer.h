@@ -0,0 +1,130 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+
+#ifndef IMAP_TOKENIZER_H_
+#define IMAP_TOKENIZER_H_
+
+#include <string>
+#include "utils/string_ref.h"
+#include "imap_string.h"
+
+namespace nestor {
+namespace imap {
+
+enum class ImapTokenType {
+    ATOM,       // atom, number or NIL
+    STRING,     // quoted string or literal
+    LIST_BEGIN, // opening parenthesis
+    LIST_END    // closing parenthesis
+};
+
+/**
+ * Token of a command. Value refers to the tokenized data.
+ */
+struct ImapToken {
+    ImapTokenType type;
+    ImapStringType stringType; // Kind of STRING token
+    bool escaped;              // Quoted string contains escaped characters
+    utils::StringRef value;    // Atom, string content or literal data
+
+    /** @return true if token is astring, i.e. atom or string */
+    bool isAString() const;
+
+    /** @return token value with quoted string escapes resolved */
+    std::string toString() const;
+};
+
+enum class ImapTokenizerStatus {
+    COMPLETED,   // Command is tokenized
+    UNCOMPLETED, // More data is needed
+    INVALID      // Syntax error
+};
+
+/**
+ * Single pass RFC 3501 command tokenizer. Splits a command to atoms,
+ * strings (quoted and literal) and list brackets without copying: tokens
+ * refer to the tokenized data. Tokens are stored in a fixed array which
+ * is reused for every command, so tokenizing never allocates memory.
+ */
+class ImapTokenizer {
+public:
+    static const size_t MAX_TOKENS = 64;
+
+    ImapTokenizer();
+
+    /**
+     * Tokenizes command at the beginning of data.
+     * @param data Data with command line and literals.
+     * @return Status of the command.
+     */
+    ImapTokenizerStatus tokenize(utils::StringRef data);
+
+    size_t size() const;
+    const ImapToken &operator[](size_t index) const;
+    const ImapToken *tokens() const;
+
+    /** Length of completed command including the final CRLF */
+    size_t commandLength() const;
+
+    /**
+     * @return true if tokenizing stopped at synchronizing literal and
+     * client waits for continuation request to send literal data.
+     */
+    bool literalContinuation() const;
+
+    /** Position in data where tokenizing has stopped */
+    size_t position() const;
+
+    /**
+     * Total length of literal data of the command, including the literal
+     * which data is not received yet.
+     */
+    size_t literalLength() const;
+
+    /**
+     * Length of data needed to finish the literal, which data is not
+     * received yet, or 0. Tokenizing shorter data stops at the same place.
+     */
+    size_t requiredLength() const;
+
+private:
+    ImapTokenizerStatus parseQuoted(utils::StringRef data, size_t &pos);
+    ImapTokenizerStatus parseLiteral(utils::StringRef data, size_t &pos);
+    ImapTokenizerStatus parseAtom(utils::StringRef data, size_t &pos);
+    bool pushToken(ImapTokenType type, utils::StringRef value,
+                   ImapStringType stringType = ImapStringType::UNSPECIFIED,
+                   bool escaped = false);
+    ImapTokenizerStatus stop(ImapTokenizerStatus status, size_t pos);
+
+private:
+    ImapToken tokens_[MAX_TOKENS];
+    size_t count_;
+    size_t commandLength_;
+    size_t position_;
+    size_t literalLength_;
+    size_t requiredLength_;
+    bool literalContinuation_;
+};
+
+} /* namespace imap */
+} /* namespace nestor */
+
+#endif /* IMAP_TOKENIZER_H_ */
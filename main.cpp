@@ -29,6 +29,8 @@
 #include <algorithm>
 
 #include <signal.h>
+#include <pthread.h>
+#include <thread>
 #include <cstring>
 #include "net/http_client.h"
 #include "net/http_resource.h"
@@ -36,8 +38,11 @@
 #include "net/io_observer.h"
 #include "net/socket_single.h"
 #include "imap/imap_session.h"
+#include "imap/imap_reactor.h"
 #include "service/service.h"
 #include "service/channels_update_worker.h"
+#include "service/channels_update_scheduler.h"
+#include "service/sqlite_connection_pool.h"
 
 #include <unicode/ucnv.h>
 #include <unicode/utypes.h>
@@ -57,39 +62,7 @@ using namespace nestor::service;
 using namespace nestor::common;
 using namespace icu;
 
-static vector<ImapSession *> closedSessions;
-static SocketListener *listener;
-static IOObserver *observer;
-static SqliteConnection *connection;
-
-void startNewConnection(SocketListener *listener, IOObserver *observer) {
-	MAIN_LOG("Starting new conencttion");
-	SocketSingle *con = listener->accept();
-	ImapSession *session = new ImapSession(new Service(connection), con);
-	auto onRead = [session, con](int fd) {
-	    MAIN_LOG("fd " << fd   << "Ready for reading");
-	    session->processData();
-	    session->writeAnswers();
-	};
-
-	observer->append(con->descriptor(), 0, onRead, nullptr, nullptr);
-	con->setOnCloseCallback([observer](SocketSingle *s) {
-	    observer->remove(s->descriptor());
-	});
-
-	session->setOnExitCallback([](ImapSession *s) { closedSessions.push_back(s); });
-	session->writeAnswers();
-}
-
-void onSigInt(int sig) {
-    if (listener && observer) {
-        MAIN_LOG("Closing listener");
-
-        observer->remove(listener->descriptor());
-        listener->close();
-        observer->breakLoop();
-    }
-}
+static SqliteConnectionPool *database;
 
 void checkDatabase(SqliteConnection *connection) {
     MAIN_LOG("Checking Nestor database");
@@ -100,28 +73,26 @@ void checkDatabase(SqliteConnection *connection) {
     prov.createSubsriptionTable();
 }
 
-void testWorker(SqliteConnection *connection) {
-    MAIN_LOG("Testing ChannelsUpdateWorker");
+void createTestChannel(SqliteConnection *connection) {
     SqliteProvider prov(connection);
 
     Channel *channel = prov.findChannelByRssLink("http://lenta.ru/rss");
-    MAIN_LOG("Not found. Creating one");
     if (channel == nullptr) {
+        MAIN_LOG("Test channel not found. Creating one");
         channel = new Channel();
         channel->setRssLink("http://lenta.ru/rss");
         channel->setDescription("http://lenta.ru/rss");
         channel->setLink("http://lenta.ru/rss");
         channel->setTitle("http://lenta.ru/rss");
         channel->setUpdateInterval(3600);
-        time_t t = time(nullptr);
-        tm *now = localtime(&t);
-        channel->setLastUpdate(*now);
+        // Due right away, the scheduler updates it on start
+        time_t t = time(nullptr) - channel->updateInterval();
+        tm *lastUpdate = localtime(&t);
+        channel->setLastUpdate(*lastUpdate);
 
         channel->setId(prov.insertChannel(*channel));
     }
-
-    ChannelsUpdateWorker worker({channel->id()}, connection);
-    worker.run();
+    delete channel;
 }
 
 
@@ -135,11 +106,41 @@ int main(int argc, char *argv[]) {
     config->store();
 
     logger_init(config->logFile());
-    connection = new SqliteConnection(config->sqliteConfig().databasePath());
-    connection->open();
+    // Must be done before any thread uses libcurl
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    ConfigurationImap &imapConfig = config->imapConfig();
+    unsigned int cpus = thread::hardware_concurrency();
+    unsigned int reactorsCount = imapConfig.reactorThreads();
+    if (reactorsCount == 0)
+        reactorsCount = cpus > 0 ? cpus : 1;
+
+    /* Every reactor gets its own read-only connection, feeds are
+     * written through the single writer connection. */
+    ConfigurationSqlite &sqliteConfig = config->sqliteConfig();
+    unsigned int readersCount = sqliteConfig.readConnections();
+    if (readersCount == 0)
+        readersCount = reactorsCount;
+    if (readersCount < reactorsCount) {
+        /* Reactors sharing a connection would share its statement cache */
+        MAIN_LOG_LVL(WARN, "Read connections number " << readersCount << " is less than "
+                     << reactorsCount << " IMAP reactors. Using " << reactorsCount);
+        readersCount = reactorsCount;
+    }
+    database = new SqliteConnectionPool(sqliteConfig.databasePath(), readersCount);
+    database->setMmapSize(sqliteConfig.mmapSize());
+    database->setCacheSize(sqliteConfig.cacheSize());
+    database->setSynchronous(sqliteConfig.synchronous());
+    try {
+        database->open();
+    } catch (SqliteConnectionException &e) {
+        MAIN_LOG_LVL(ERROR, "Cannot open database: " << e.what());
+        delete database;
+        return -1;
+    }
 
-    checkDatabase(connection);
-    testWorker(connection);
+    checkDatabase(database->writer());
+    createTestChannel(database->writer());
 
     HttpClient client;
     HttpResource *res = client.getResource("http://lenta.ru/rss");
@@ -148,43 +149,65 @@ int main(int argc, char *argv[]) {
 
     MAIN_LOG("Starting Nestor server");
 
+    /* Signals are handled only by the main thread. Reactor threads
+     * inherit the blocked mask. */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
 
+    vector<ImapReactor *> reactors;
     try {
-    	listener = new SocketListener("localhost", 1430);
-    	listener->startListen();
+        for (unsigned int i = 0; i < reactorsCount; i++) {
+            int cpu = (imapConfig.pinThreads() && cpus > 0) ? static_cast<int>(i % cpus) : -1;
+            ImapReactor *reactor = new ImapReactor(i, imapConfig.host(), imapConfig.port(),
+                                                   database->reader(i), cpu);
+            reactors.push_back(reactor);
+            reactor->start();
+        }
     } catch (SocketIOException &e) {
     	MAIN_LOG_LVL(ERROR, "Cannot create listener: " << e.what());
+    	for (ImapReactor *reactor : reactors)
+    	    delete reactor;
     	return -1;
     }
 
-    observer = new IOObserver();
-
-    observer->append(listener->descriptor(), 0, bind(startNewConnection, listener, observer), nullptr, nullptr);
-
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = onSigInt;
-    sigaction(SIGINT, &sa, NULL);
-
-    MAIN_LOG("Nestor started");
-    while(observer->objectListenCount() > 0) {
-    	observer->wait();
-
-    	if (closedSessions.size() > 0) {
-    	    for (ImapSession *s : closedSessions)
-    	        delete s;
-    	    closedSessions.clear();
-    	}
+    /* Feeds are downloaded and stored in the scheduler thread,
+     * which is the only user of the writer connection from now on. */
+    ChannelsUpdateScheduler scheduler(database->writer());
+    ConfigurationFetch &fetchConfig = config->fetchConfig();
+    scheduler.setFetchLimits(fetchConfig.maxTransfers(), fetchConfig.maxHostTransfers());
+    scheduler.setIncrementalParse(fetchConfig.incrementalParse());
+    scheduler.setParseThreads(fetchConfig.parseThreads());
+    scheduler.setCommitLimits(fetchConfig.commitBatchSize(), fetchConfig.commitDelayMs());
+    scheduler.start();
+
+    MAIN_LOG("Nestor started with " << reactorsCount << " IMAP reactors on "
+             << imapConfig.host() << ":" << imapConfig.port());
+
+    int sig = 0;
+    sigwait(&signals, &sig);
+    MAIN_LOG("Received signal " << sig << ". Stopping reactors");
+
+    scheduler.stop();
+
+    for (ImapReactor *reactor : reactors)
+        reactor->stop();
+    for (ImapReactor *reactor : reactors) {
+        reactor->join();
+        delete reactor;
     }
+    reactors.clear();
+    scheduler.join();
 
     MAIN_LOG("Nestor finished");
 
-    connection->close();
+    database->close();
+    curl_global_cleanup();
     logger_deinit();
 
-    delete observer;
-    delete listener;
-    delete connection;
+    delete database;
 
     return 0;
 }
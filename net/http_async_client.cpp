@@ -0,0 +1,385 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <stdexcept>
+#include <memory>
+#include "common/logger.h"
+#include "utils/string.h"
+#include "http_async_client.h"
+
+using namespace std;
+using namespace nestor::utils;
+
+namespace nestor {
+namespace net {
+
+const long HttpAsyncClient::DEFAULT_MAX_HOST_CONNECTIONS;
+const size_t HttpAsyncClient::DEFAULT_MAX_TRANSFERS;
+const size_t HttpAsyncClient::DEFAULT_MAX_HOST_TRANSFERS;
+
+HttpAsyncClient::Statistics::Statistics()
+        : transfers(0), connects(0), tlsHandshakes(0), http2Transfers(0) {
+}
+
+HttpAsyncClient::HostQueue::HostQueue()
+        : active(0), ready(false) {
+}
+
+HttpAsyncClient::HttpAsyncClient(IOObserver *observer)
+        : observer_(observer), multiHandle_(nullptr), timerId_(-1),
+          maxBodySize_(HttpClient::DEFAULT_MAX_BODY_SIZE),
+          maxTransfers_(DEFAULT_MAX_TRANSFERS),
+          maxHostTransfers_(DEFAULT_MAX_HOST_TRANSFERS), pendingCount_(0) {
+    if (observer_ == nullptr)
+        throw invalid_argument("HttpAsyncClient::HttpAsyncClient: observer is nullptr");
+
+    multiHandle_ = curl_multi_init();
+    if (multiHandle_ == nullptr) {
+        string errmsg = "HttpAsyncClient::HttpAsyncClient: cannot create libcurl multi handle";
+        NET_LOG_LVL(ERROR, errmsg);
+        throw runtime_error(errmsg);
+    }
+
+    timerId_ = observer_->createTimer([this]() {
+        socketAction(CURL_SOCKET_TIMEOUT, 0);
+    });
+
+    curl_multi_setopt(multiHandle_, CURLMOPT_SOCKETFUNCTION, socketFunction);
+    curl_multi_setopt(multiHandle_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multiHandle_, CURLMOPT_TIMERFUNCTION, timerFunction);
+    curl_multi_setopt(multiHandle_, CURLMOPT_TIMERDATA, this);
+#ifdef CURLPIPE_MULTIPLEX
+    curl_multi_setopt(multiHandle_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+    setMaxHostConnections(DEFAULT_MAX_HOST_CONNECTIONS);
+}
+
+HttpAsyncClient::~HttpAsyncClient() {
+    for (Transfer *transfer : transfers_) {
+        curl_multi_remove_handle(multiHandle_, transfer->client->handle());
+        clientPool_.release(transfer->client);
+        delete transfer;
+    }
+    transfers_.clear();
+    for (auto &item : hosts_) {
+        for (Transfer *transfer : item.second.pending)
+            delete transfer;
+    }
+    hosts_.clear();
+    readyHosts_.clear();
+
+    // Removing handles closes sockets, callbacks may still come
+    for (curl_socket_t fd : sockets_)
+        observer_->remove(fd);
+    sockets_.clear();
+
+    curl_multi_cleanup(multiHandle_);
+    observer_->destroyTimer(timerId_);
+}
+
+void HttpAsyncClient::fetch(const std::string &resource, const std::string &etag,
+                            const std::string &lastModified, CompletionCallback callback,
+                            HttpClient::BodySink sink) {
+    Transfer *transfer = new Transfer();
+    transfer->client = nullptr;
+    transfer->resource = resource;
+    transfer->etag = etag;
+    transfer->lastModified = lastModified;
+    transfer->host = hostOf(resource);
+    transfer->callback = callback;
+    transfer->sink = sink;
+
+    HostQueue &queue = hosts_[transfer->host];
+    queue.pending.push_back(transfer);
+    pendingCount_++;
+    markReady(transfer->host, queue);
+    startTransfers();
+}
+
+bool HttpAsyncClient::resume(const HttpClient &client) {
+    for (Transfer *transfer : transfers_) {
+        if (transfer->client == &client) {
+            // libcurl may pass the held chunk to the sink right here
+            transfer->client->resumeBody();
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t HttpAsyncClient::activeCount() const {
+    return transfers_.size();
+}
+
+size_t HttpAsyncClient::pendingCount() const {
+    return pendingCount_;
+}
+
+void HttpAsyncClient::setMaxTransfers(size_t maxTransfers) {
+    if (maxTransfers == 0)
+        throw invalid_argument("HttpAsyncClient::setMaxTransfers: maxTransfers is 0");
+    maxTransfers_ = maxTransfers;
+    startTransfers();
+}
+
+void HttpAsyncClient::setMaxHostTransfers(size_t maxHostTransfers) {
+    if (maxHostTransfers == 0)
+        throw invalid_argument("HttpAsyncClient::setMaxHostTransfers: maxHostTransfers is 0");
+    maxHostTransfers_ = maxHostTransfers;
+    // Hosts at the old limit may go on
+    for (auto &item : hosts_)
+        markReady(item.first, item.second);
+    startTransfers();
+}
+
+/**
+ * Fills the window with pending transfers, one per host in turn.
+ */
+void HttpAsyncClient::startTransfers() {
+    vector<Transfer *> failed;
+    while (transfers_.size() < maxTransfers_ && !readyHosts_.empty()) {
+        string host = readyHosts_.front();
+        readyHosts_.pop_front();
+        auto it = hosts_.find(host);
+        if (it == hosts_.end())
+            continue;
+
+        HostQueue &queue = it->second;
+        queue.ready = false;
+        if (queue.pending.empty() || queue.active >= maxHostTransfers_)
+            continue;
+
+        Transfer *transfer = queue.pending.front();
+        queue.pending.pop_front();
+        pendingCount_--;
+        queue.active++;
+        if (!startTransfer(transfer))
+            failed.push_back(transfer);
+        markReady(host, queue);
+    }
+
+    // Callbacks may fetch again, so they are called when the queues are consistent
+    for (Transfer *transfer : failed) {
+        finishTransfer(transfer);
+        transfer->callback(transfer->resource, nullptr);
+        delete transfer;
+    }
+}
+
+bool HttpAsyncClient::startTransfer(Transfer *transfer) {
+    HttpClient *client = clientPool_.acquire();
+    client->setMaxBodySize(maxBodySize_);
+    client->setup(transfer->resource, transfer->etag, transfer->lastModified);
+    if (transfer->sink)
+        client->setBodySink(transfer->sink);
+    transfer->client = client;
+    curl_easy_setopt(client->handle(), CURLOPT_PRIVATE, transfer);
+    transfers_.insert(transfer);
+
+    // libcurl sets a zero timeout which starts the transfer from the loop
+    CURLMcode rc = curl_multi_add_handle(multiHandle_, client->handle());
+    if (rc != CURLM_OK) {
+        NET_LOG_LVL(ERROR, "HttpAsyncClient::startTransfer: cannot add " << transfer->resource
+                    << ": " << curl_multi_strerror(rc));
+        transfers_.erase(transfer);
+        clientPool_.release(client);
+        transfer->client = nullptr;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Frees the slot of the transfer in its host queue.
+ */
+void HttpAsyncClient::finishTransfer(Transfer *transfer) {
+    auto it = hosts_.find(transfer->host);
+    if (it == hosts_.end())
+        return;
+
+    HostQueue &queue = it->second;
+    queue.active--;
+    if (queue.active == 0 && queue.pending.empty())
+        hosts_.erase(it);
+    else
+        markReady(it->first, queue);
+}
+
+void HttpAsyncClient::markReady(const std::string &host, HostQueue &queue) {
+    if (!queue.ready && !queue.pending.empty() && queue.active < maxHostTransfers_) {
+        readyHosts_.push_back(host);
+        queue.ready = true;
+    }
+}
+
+/**
+ * Extracts host and port from URL, they identify an origin for limits.
+ */
+std::string HttpAsyncClient::hostOf(const std::string &url) {
+    size_t start = url.find("://");
+    start = (start == string::npos) ? 0 : start + 3;
+    size_t end = url.find_first_of("/?#", start);
+    string host = url.substr(start, end == string::npos ? string::npos : end - start);
+
+    size_t at = host.rfind('@');
+    if (at != string::npos)
+        host.erase(0, at + 1);
+    stringToLower(host);
+    return host;
+}
+
+void HttpAsyncClient::setMaxBodySize(size_t maxBodySize) {
+    maxBodySize_ = maxBodySize;
+}
+
+void HttpAsyncClient::setMaxHostConnections(long maxHostConnections) {
+    curl_multi_setopt(multiHandle_, CURLMOPT_MAX_HOST_CONNECTIONS, maxHostConnections);
+}
+
+const HttpAsyncClient::Statistics &HttpAsyncClient::statistics() const {
+    return statistics_;
+}
+
+const HttpBufferPool &HttpAsyncClient::bufferPool() const {
+    return clientPool_.bufferPool();
+}
+
+const HttpClientPool &HttpAsyncClient::clientPool() const {
+    return clientPool_;
+}
+
+int HttpAsyncClient::socketFunction(CURL *easy, curl_socket_t fd, int what,
+                                    void *userdata, void *socketdata) {
+    static_cast<HttpAsyncClient *>(userdata)->watchSocket(fd, what);
+    return 0;
+}
+
+int HttpAsyncClient::timerFunction(CURLM *multi, long timeoutMs, void *userdata) {
+    HttpAsyncClient *obj = static_cast<HttpAsyncClient *>(userdata);
+    // -1 deletes the timer, 0 asks to call socket action as soon as possible
+    if (timeoutMs < 0)
+        obj->observer_->stopTimer(obj->timerId_);
+    else
+        obj->observer_->startTimer(obj->timerId_, static_cast<unsigned int>(timeoutMs));
+    return 0;
+}
+
+/**
+ * Makes the observer watch the socket for events libcurl waits for.
+ */
+void HttpAsyncClient::watchSocket(curl_socket_t fd, int what) {
+    if (what == CURL_POLL_REMOVE) {
+        if (sockets_.erase(fd))
+            observer_->remove(fd);
+        return;
+    }
+
+    if (!sockets_.count(fd)) {
+        observer_->append(fd, 0,
+                          [this](int fd) { socketAction(fd, CURL_CSELECT_IN); },
+                          [this](int fd) { socketAction(fd, CURL_CSELECT_OUT); },
+                          nullptr);
+        sockets_.insert(fd);
+    }
+
+    observer_->modify(fd, what == CURL_POLL_IN || what == CURL_POLL_INOUT,
+                      what == CURL_POLL_OUT || what == CURL_POLL_INOUT);
+}
+
+void HttpAsyncClient::socketAction(curl_socket_t fd, int eventsBitmask) {
+    int running;
+    CURLMcode rc = curl_multi_socket_action(multiHandle_, fd, eventsBitmask, &running);
+    if (rc != CURLM_OK) {
+        NET_LOG_LVL(ERROR, "HttpAsyncClient::socketAction: curl multi socket action failed "
+                    "with code " << rc << ": " << curl_multi_strerror(rc));
+    }
+    completeTransfers();
+}
+
+/**
+ * Passes every finished transfer to its callback and refills the window.
+ */
+void HttpAsyncClient::completeTransfers() {
+    CURLMsg *msg;
+    int msgsLeft;
+    while ((msg = curl_multi_info_read(multiHandle_, &msgsLeft))) {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+
+        CURL *easy = msg->easy_handle;
+        CURLcode result = msg->data.result;
+        char *priv = nullptr;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, &priv);
+        unique_ptr<Transfer> transfer(reinterpret_cast<Transfer *>(priv));
+        transfers_.erase(transfer.get());
+        countTransfer(easy);
+        curl_multi_remove_handle(multiHandle_, easy);
+
+        HttpResource *res = nullptr;
+        if (result != CURLE_OK) {
+            NET_LOG_LVL(WARN, "HttpAsyncClient::completeTransfers: transfer of "
+                        << transfer->resource << " failed: " << curl_easy_strerror(result));
+        } else {
+            res = transfer->client->parseReceivedData();
+            if (res == nullptr) {
+                NET_LOG_LVL(WARN, "HttpAsyncClient::completeTransfers: no data received from "
+                            << transfer->resource);
+            } else {
+                res->setRequestUrl(transfer->resource);
+            }
+        }
+        clientPool_.release(transfer->client);
+        transfer->client = nullptr;
+        finishTransfer(transfer.get());
+
+        transfer->callback(transfer->resource, res);
+    }
+
+    // Finished transfers freed their slots for pending ones
+    startTransfers();
+}
+
+/**
+ * Counts connections and handshakes the finished transfer needed.
+ */
+void HttpAsyncClient::countTransfer(CURL *easy) {
+    statistics_.transfers++;
+
+    long connects = 0;
+    curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+    if (connects > 0) {
+        statistics_.connects++;
+        // Plain HTTP and reused connections have zero TLS time
+        double appConnectTime = 0;
+        curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME, &appConnectTime);
+        if (appConnectTime > 0)
+            statistics_.tlsHandshakes++;
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x073200
+    long httpVersion = 0;
+    curl_easy_getinfo(easy, CURLINFO_HTTP_VERSION, &httpVersion);
+    if (httpVersion == CURL_HTTP_VERSION_2_0)
+        statistics_.http2Transfers++;
+#endif
+}
+
+} /* namespace net */
+} /* namespace nestor */
@@ -0,0 +1,185 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef HTTP_ASYNC_CLIENT_H_
+#define HTTP_ASYNC_CLIENT_H_
+
+#include <string>
+#include <functional>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <curl/curl.h>
+#include "http_client.h"
+#include "http_client_pool.h"
+#include "http_resource.h"
+#include "io_observer.h"
+
+namespace nestor {
+namespace net {
+
+/**
+ * Downloads many resources concurrently in an IOObserver loop. libcurl
+ * sockets and timer are registered in the observer and driven by
+ * curl_multi_socket_action(), so one thread serves any number of
+ * transfers and every transfer is completed as soon as it finishes.
+ * Connections are cached by the client and multiplexed over HTTP/2 where
+ * server supports it, so the client should live as long as possible.
+ *
+ * Number of simultaneous transfers is bounded, in total and per host.
+ * Requests over the limits wait in per-host queues, hosts take turns when
+ * a transfer finishes, so one big or slow host doesn't hold the window.
+ */
+class HttpAsyncClient {
+public:
+    /** Default limit of simultaneous connections to one host */
+    static const long DEFAULT_MAX_HOST_CONNECTIONS = 6;
+    /** Default limit of simultaneous transfers */
+    static const size_t DEFAULT_MAX_TRANSFERS = 64;
+    /** Default limit of simultaneous transfers from one host */
+    static const size_t DEFAULT_MAX_HOST_TRANSFERS = 4;
+
+    /** Counters of finished transfers */
+    struct Statistics {
+        Statistics();
+
+        size_t transfers;
+        /** Transfers which opened a new connection */
+        size_t connects;
+        /** New connections with TLS handshake, resumed sessions included */
+        size_t tlsHandshakes;
+        size_t http2Transfers;
+    };
+
+    /**
+     * Called when transfer is finished.
+     * @param requestUrl Resource passed to fetch().
+     * @param resource Received resource, nullptr if transfer failed. The
+     * callback takes ownership of it.
+     */
+    typedef std::function<void(const std::string &requestUrl, HttpResource *resource)> CompletionCallback;
+
+    /**
+     * @param observer Loop to run transfers in, it must outlive the client.
+     * Transfers make progress only while the owner calls observer->wait().
+     */
+    explicit HttpAsyncClient(IOObserver *observer);
+    virtual ~HttpAsyncClient();
+
+    /**
+     * Queues GET request of the resource, it starts as soon as the limits
+     * allow. Validators of the cached copy make the request conditional,
+     * @sa HttpClient::setup().
+     * @param sink Receiver of the body while it is downloaded, optional,
+     * @sa HttpClient::setBodySink(). If it aborts the transfer, callback
+     * gets nullptr. If it pauses the transfer, the owner calls resume()
+     * later.
+     */
+    void fetch(const std::string &resource, const std::string &etag,
+               const std::string &lastModified, CompletionCallback callback,
+               HttpClient::BodySink sink = nullptr);
+
+    /**
+     * Resumes transfer paused by its body sink.
+     * @param client Client passed to the sink.
+     * @return false if the transfer of the client is not in progress.
+     */
+    bool resume(const HttpClient &client);
+
+    /** Number of transfers in progress */
+    size_t activeCount() const;
+
+    /** Number of requests waiting for their turn */
+    size_t pendingCount() const;
+
+    /** Limits of simultaneous transfers, in total and per host. Not 0. */
+    void setMaxTransfers(size_t maxTransfers);
+    void setMaxHostTransfers(size_t maxHostTransfers);
+
+    /** Limit of a response body, applies to later fetch() calls */
+    void setMaxBodySize(size_t maxBodySize);
+
+    /** Limit of simultaneous connections to one host, 0 is unlimited */
+    void setMaxHostConnections(long maxHostConnections);
+
+    const HttpBufferPool &bufferPool() const;
+    const HttpClientPool &clientPool() const;
+    const Statistics &statistics() const;
+
+private:
+    struct Transfer {
+        HttpClient *client;
+        std::string resource;
+        std::string etag;
+        std::string lastModified;
+        std::string host;
+        CompletionCallback callback;
+        HttpClient::BodySink sink;
+    };
+
+    struct HostQueue {
+        HostQueue();
+
+        std::deque<Transfer *> pending;
+        size_t active;
+        /** Host is in readyHosts_ */
+        bool ready;
+    };
+
+    static std::string hostOf(const std::string &url);
+
+    static int socketFunction(CURL *easy, curl_socket_t fd, int what,
+                              void *userdata, void *socketdata);
+    static int timerFunction(CURLM *multi, long timeoutMs, void *userdata);
+
+    void watchSocket(curl_socket_t fd, int what);
+    void socketAction(curl_socket_t fd, int eventsBitmask);
+    void completeTransfers();
+    void countTransfer(CURL *easy);
+    void startTransfers();
+    bool startTransfer(Transfer *transfer);
+    void finishTransfer(Transfer *transfer);
+    void markReady(const std::string &host, HostQueue &queue);
+
+private:
+    IOObserver *observer_;
+    CURLM *multiHandle_;
+    int timerId_;
+    /** Easy handles are reused, the multi handle keeps their connections */
+    HttpClientPool clientPool_;
+    size_t maxBodySize_;
+    size_t maxTransfers_;
+    size_t maxHostTransfers_;
+    Statistics statistics_;
+
+    /** Transfers in progress, CURLINFO_PRIVATE of their handles */
+    std::unordered_set<Transfer *> transfers_;
+    /** Hosts with active or pending transfers */
+    std::unordered_map<std::string, HostQueue> hosts_;
+    /** Hosts which may start a pending transfer, in turn order */
+    std::deque<std::string> readyHosts_;
+    size_t pendingCount_;
+    std::unordered_set<curl_socket_t> sockets_;
+};
+
+} /* namespace net */
+} /* namespace nestor */
+
+#endif /* HTTP_ASYNC_CLIENT_H_ */
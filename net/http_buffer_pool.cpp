@@ -0,0 +1,89 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include "http_buffer_pool.h"
+
+using namespace std;
+
+namespace nestor {
+namespace net {
+
+const size_t HttpBufferPool::DEFAULT_MAX_BUFFERS;
+const size_t HttpBufferPool::DEFAULT_MAX_BUFFER_CAPACITY;
+
+HttpBufferPool::HttpBufferPool(size_t maxBuffers, size_t maxBufferCapacity)
+        : maxBuffers_(maxBuffers), maxBufferCapacity_(maxBufferCapacity),
+          reuseCount_(0) {
+}
+
+HttpBufferPool::~HttpBufferPool() {
+    for (Buffer &b : buffers_)
+        delete[] b.data;
+    buffers_.clear();
+}
+
+unsigned char *HttpBufferPool::acquire(size_t minCapacity, size_t &capacity) {
+    // Best fit keeps big buffers for big responses
+    size_t best = buffers_.size();
+    for (size_t i = 0; i < buffers_.size(); i++) {
+        if (buffers_[i].capacity < minCapacity)
+            continue;
+        if (best == buffers_.size() || buffers_[i].capacity < buffers_[best].capacity)
+            best = i;
+    }
+
+    if (best == buffers_.size()) {
+        capacity = minCapacity;
+        return new unsigned char[minCapacity];
+    }
+
+    unsigned char *data = buffers_[best].data;
+    capacity = buffers_[best].capacity;
+    buffers_[best] = buffers_.back();
+    buffers_.pop_back();
+    reuseCount_++;
+    return data;
+}
+
+void HttpBufferPool::release(unsigned char *buffer, size_t capacity) {
+    if (buffer == nullptr)
+        return;
+
+    if (buffers_.size() >= maxBuffers_ || capacity > maxBufferCapacity_) {
+        delete[] buffer;
+        return;
+    }
+
+    Buffer b;
+    b.data = buffer;
+    b.capacity = capacity;
+    buffers_.push_back(b);
+}
+
+size_t HttpBufferPool::size() const {
+    return buffers_.size();
+}
+
+size_t HttpBufferPool::reuseCount() const {
+    return reuseCount_;
+}
+
+} /* namespace net */
+} /* namespace nestor */
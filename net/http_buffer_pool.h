@@ -0,0 +1,77 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef HTTP_BUFFER_POOL_H_
+#define HTTP_BUFFER_POOL_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace nestor {
+namespace net {
+
+/**
+ * Free list of HTTP receive buffers. A finished transfer gives its buffer
+ * back, so the next one doesn't allocate and grow a buffer from scratch.
+ * Not thread safe, it is shared by clients of one download loop.
+ */
+class HttpBufferPool {
+public:
+    /** Maximum number of free buffers kept */
+    static const size_t DEFAULT_MAX_BUFFERS = 16;
+    /** Bigger buffers are freed instead of keeping them in the pool */
+    static const size_t DEFAULT_MAX_BUFFER_CAPACITY = 1024 * 1024;
+
+    explicit HttpBufferPool(size_t maxBuffers = DEFAULT_MAX_BUFFERS,
+                            size_t maxBufferCapacity = DEFAULT_MAX_BUFFER_CAPACITY);
+    virtual ~HttpBufferPool();
+
+    /**
+     * Takes buffer with capacity at least minCapacity from the pool or
+     * allocates a new one.
+     * @param[out] capacity Capacity of the returned buffer.
+     */
+    unsigned char *acquire(size_t minCapacity, size_t &capacity);
+
+    /** Returns buffer allocated by acquire() to the pool */
+    void release(unsigned char *buffer, size_t capacity);
+
+    /** Number of free buffers */
+    size_t size() const;
+
+    /** Number of acquire() calls served without allocation */
+    size_t reuseCount() const;
+
+private:
+    struct Buffer {
+        unsigned char *data;
+        size_t capacity;
+    };
+
+    std::vector<Buffer> buffers_;
+    size_t maxBuffers_;
+    size_t maxBufferCapacity_;
+    size_t reuseCount_;
+};
+
+} /* namespace net */
+} /* namespace nestor */
+
+#endif /* HTTP_BUFFER_POOL_H_ */
@@ -23,10 +23,13 @@
 #include <iostream>
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 #include <curl/curl.h>
 #include "common/logger.h"
 #include "http_response_parser.h"
+#include "http_share.h"
 #include "utils/string.h"
 
 using namespace std;
@@ -36,14 +39,22 @@ namespace nestor {
 namespace net {
 
 
-HttpClient::HttpClient()
-        : recvBuffer_(nullptr), recvBufferSize_(0), resource_("") {
+const size_t HttpClient::DEFAULT_MAX_BODY_SIZE;
+const size_t HttpClient::INITIAL_BUFFER_SIZE;
+
+HttpClient::HttpClient(HttpBufferPool *pool)
+        : bufferPool_(pool), recvBuffer_(nullptr), recvBufferSize_(0),
+          recvBufferCapacity_(0), expectedLength_(0),
+          maxBodySize_(DEFAULT_MAX_BODY_SIZE), resource_(""), bodyStarted_(false),
+          streaming_(false), streamedSize_(0), requestHeaders_(nullptr) {
     handle_ = curl_easy_init();
     if (handle_ == nullptr) {
         string errmsg = "HttpClient::HttpClient: cannot initialize curl handle";
         NET_LOG_LVL(ERROR, errmsg);
         throw runtime_error(errmsg);
     }
+    // DNS cache and TLS sessions are common for all clients
+    curl_easy_setopt(handle_, CURLOPT_SHARE, HttpShare::instance()->handle());
 }
 
 HttpResource * HttpClient::getResource(const string &resource) {
@@ -55,11 +66,36 @@ HttpResource * HttpClient::getResource(const string &resource) {
     return parseReceivedData();
 }
 
-void HttpClient::setup(const std::string &resource) {
+void HttpClient::setup(const std::string &resource, const std::string &etag,
+                       const std::string &lastModified) {
     resource_ = resource;
+    discardReceivedData();
+    etag_.clear();
+    lastModified_.clear();
+    contentEncoding_.clear();
     curl_easy_setopt(handle_, CURLOPT_URL, resource.c_str());
+    // Empty string asks for all encodings libcurl was built with
+    curl_easy_setopt(handle_, CURLOPT_ACCEPT_ENCODING, "");
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    // HTTP/2 over TLS if server supports it, waiting for a connection
+    // being multiplexed instead of opening a new one
+    curl_easy_setopt(handle_, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(handle_, CURLOPT_PIPEWAIT, 1L);
+#endif
     curl_easy_setopt(handle_, CURLOPT_WRITEFUNCTION, writeFuncHelper);
     curl_easy_setopt(handle_, CURLOPT_WRITEDATA, this);
+    curl_easy_setopt(handle_, CURLOPT_HEADERFUNCTION, headerFuncHelper);
+    curl_easy_setopt(handle_, CURLOPT_HEADERDATA, this);
+    // Refused early if Content-Length is too big, writeFuncHelper checks the rest
+    curl_easy_setopt(handle_, CURLOPT_MAXFILESIZE, static_cast<long>(maxBodySize_));
+
+    curl_slist_free_all(requestHeaders_);
+    requestHeaders_ = nullptr;
+    if (!etag.empty())
+        requestHeaders_ = curl_slist_append(requestHeaders_, ("If-None-Match: " + etag).c_str());
+    if (!lastModified.empty())
+        requestHeaders_ = curl_slist_append(requestHeaders_, ("If-Modified-Since: " + lastModified).c_str());
+    curl_easy_setopt(handle_, CURLOPT_HTTPHEADER, requestHeaders_);
 }
 
 bool HttpClient::perform() {
@@ -80,47 +116,57 @@ CURL* HttpClient::handle() const {
     return handle_;
 }
 
+const std::string &HttpClient::resource() const {
+    return resource_;
+}
+
 HttpResource* HttpClient::parseReceivedData() {
-    if (recvBuffer_ == nullptr)
-        return nullptr;
+    long respCode;
+    curl_easy_getinfo(handle_, CURLINFO_RESPONSE_CODE, &respCode);
+
+    unsigned char *content;
+    if (recvBuffer_ == nullptr) {
+        if (respCode != HttpResource::CODE_NOT_MODIFIED && !streaming_)
+            return nullptr;
+        // 304 has no body and streamed body is in the sink, but they are valid answers
+        content = new unsigned char[1];
+        content[0] = 0;
+    } else if (bufferPool_ != nullptr) {
+        // Exact size copy, the grown buffer goes back for the next transfer
+        content = new unsigned char[recvBufferSize_ + 1];
+        memcpy(content, recvBuffer_, recvBufferSize_);
+        content[recvBufferSize_] = 0;
+        releaseRecvBuffer(recvBuffer_, recvBufferCapacity_);
+    } else {
+        // Buffer always has a spare byte for zero terminator
+        content = recvBuffer_;
+        content[recvBufferSize_] = 0;
+    }
 
     HttpResource *res = new HttpResource();
 
-    // moving recvBuffer_ to res
-    res->setContent(recvBuffer_);
+    res->setContent(content);
     res->setContentLength(recvBufferSize_);
     recvBuffer_ = nullptr;
     recvBufferSize_ = 0;
+    recvBufferCapacity_ = 0;
 
-    long respCode;
-    curl_easy_getinfo(handle_, CURLINFO_RESPONSE_CODE, &respCode);
     res->setCode(respCode);
-
-    char *contentType;
-    curl_easy_getinfo(handle_, CURLINFO_CONTENT_TYPE, &contentType);
-    if (contentType != nullptr) {
-        string type = contentType;
-
-        vector<string> typeParts, params;
-        split(type, ";", typeParts);
-        int typePartsSize = typeParts.size();
-
-        res->setContentType(typeParts[0]);
-
-        if (typePartsSize > 1) {
-            for (int i = 1; i < typePartsSize; i++) {
-                split(typeParts[i], "=", params);
-                if (params.size() != 2) continue;
-
-                if (stringToLowerCopy(trim(params[0])) == "charset") {
-                    res->setContentCharset(stringToLowerCopy(trim(params[1])));
-                }
-            }
-        }
-    } else {
-        res->setContentType("");
-        res->setContentCharset("");
-    }
+    res->setEtag(etag_);
+    res->setLastModified(lastModified_);
+
+    // libcurl counts body bytes as they come from network, before decoding
+    double downloaded = 0;
+    curl_easy_getinfo(handle_, CURLINFO_SIZE_DOWNLOAD, &downloaded);
+    res->setContentEncoding(contentEncoding_);
+    res->setTransferLength(static_cast<unsigned int>(downloaded));
+    res->setDecodedLength(streaming_ ? streamedSize_ : res->contentLength());
+    res->setStreamed(streaming_);
+
+    string type, charset;
+    contentType(type, charset);
+    res->setContentType(type);
+    res->setContentCharset(charset);
 
     char *url;
     curl_easy_getinfo(handle_, CURLINFO_EFFECTIVE_URL, &url);
@@ -135,36 +181,188 @@ HttpResource* HttpClient::parseReceivedData() {
     return res;
 }
 
+void HttpClient::discardReceivedData() {
+    releaseRecvBuffer(recvBuffer_, recvBufferCapacity_);
+    recvBuffer_ = nullptr;
+    recvBufferSize_ = 0;
+    recvBufferCapacity_ = 0;
+    expectedLength_ = 0;
+    bodySink_ = nullptr;
+    bodyStarted_ = false;
+    streaming_ = false;
+    streamedSize_ = 0;
+}
+
+void HttpClient::setBodySink(BodySink sink) {
+    bodySink_ = sink;
+}
+
+void HttpClient::resumeBody() {
+    CURLcode res = curl_easy_pause(handle_, CURLPAUSE_CONT);
+    if (res != CURLE_OK)
+        NET_LOG_LVL(ERROR, "HttpClient::resumeBody: " << resource_ << ": " << curl_easy_strerror(res));
+}
+
+void HttpClient::contentType(std::string &type, std::string &charset) const {
+    type.clear();
+    charset.clear();
+
+    char *contentType = nullptr;
+    curl_easy_getinfo(handle_, CURLINFO_CONTENT_TYPE, &contentType);
+    if (contentType == nullptr)
+        return;
+
+    vector<string> typeParts, params;
+    split(string(contentType), ";", typeParts);
+    int typePartsSize = typeParts.size();
+    if (typePartsSize == 0)
+        return;
+
+    type = typeParts[0];
+    for (int i = 1; i < typePartsSize; i++) {
+        split(typeParts[i], "=", params);
+        if (params.size() != 2) continue;
+
+        if (stringToLowerCopy(trim(params[0])) == "charset")
+            charset = stringToLowerCopy(trim(params[1]));
+    }
+}
+
+size_t HttpClient::maxBodySize() const {
+    return maxBodySize_;
+}
+
+void HttpClient::setMaxBodySize(size_t maxBodySize) {
+    maxBodySize_ = maxBodySize;
+    curl_easy_setopt(handle_, CURLOPT_MAXFILESIZE, static_cast<long>(maxBodySize_));
+}
+
+/**
+ * Makes receive buffer capacity at least minCapacity. Buffer starts from
+ * Content-Length if it is known and doubles, so the body is copied
+ * O(log n) times.
+ */
+void HttpClient::growRecvBuffer(size_t minCapacity) {
+    size_t capacity = recvBufferCapacity_;
+    if (capacity == 0)
+        capacity = max(INITIAL_BUFFER_SIZE, expectedLength_ + 1);
+    while (capacity < minCapacity)
+        capacity *= 2;
+    // Body never grows over the limit, so don't allocate more
+    capacity = max(min(capacity, maxBodySize_ + 1), minCapacity);
+
+    unsigned char *buffer;
+    if (bufferPool_ != nullptr) {
+        buffer = bufferPool_->acquire(capacity, capacity);
+    } else {
+        buffer = new unsigned char[capacity];
+    }
+
+    if (recvBufferSize_ > 0)
+        memcpy(buffer, recvBuffer_, recvBufferSize_);
+    releaseRecvBuffer(recvBuffer_, recvBufferCapacity_);
+    recvBuffer_ = buffer;
+    recvBufferCapacity_ = capacity;
+}
+
+void HttpClient::releaseRecvBuffer(unsigned char *buffer, size_t capacity) {
+    if (buffer == nullptr)
+        return;
+    if (bufferPool_ != nullptr)
+        bufferPool_->release(buffer, capacity);
+    else
+        delete[] buffer;
+}
+
 size_t HttpClient::writeFuncHelper(void* ptr, size_t size, size_t nmemb, void* userdata) {
     HttpClient *obj = static_cast<HttpClient *>(userdata);
-    size_t startPos = 0;
     size_t totalBytes = size * nmemb;
 
     if (totalBytes == 0) return 0;
 
-    if (obj->recvBuffer_ == nullptr) {
-        // allocating new buffer
-        obj->recvBuffer_ = new unsigned char[totalBytes];
-        obj->recvBufferSize_ = size * nmemb;
-    } else {
-        // rellocating buffer with bigger size
-        unsigned char *newRecvBuffer = new unsigned char [obj->recvBufferSize_ + totalBytes];
-        memcpy(newRecvBuffer, obj->recvBuffer_, obj->recvBufferSize_);
-        delete[] obj->recvBuffer_;
-        obj->recvBuffer_ = newRecvBuffer;
-
-        startPos = obj->recvBufferSize_;
-        obj->recvBufferSize_ += totalBytes;
+    if (obj->bodySink_ && !obj->bodyStarted_) {
+        // Headers are complete when the body starts. Non-HTTP protocols have no code.
+        long respCode = 0;
+        curl_easy_getinfo(obj->handle_, CURLINFO_RESPONSE_CODE, &respCode);
+        obj->streaming_ = (respCode == 0 || respCode / 100 == 2);
+        obj->bodyStarted_ = true;
     }
+    if (obj->streaming_) {
+        // Sink keeps the parsed feed, so the streamed body is limited too
+        if (obj->streamedSize_ + totalBytes > obj->maxBodySize_) {
+            NET_LOG_LVL(WARN, "HttpClient::writeFuncHelper: body of " << obj->resource_
+                        << " exceeds " << obj->maxBodySize_ << " bytes, aborting");
+            return 0;
+        }
+        switch (obj->bodySink_(*obj, static_cast<const char *>(ptr), totalBytes)) {
+        case SinkStatus::CONSUMED:
+            obj->streamedSize_ += totalBytes;
+            return totalBytes;
+        case SinkStatus::PAUSE:
+            // libcurl keeps the chunk and passes it again after unpause
+            return CURL_WRITEFUNC_PAUSE;
+        default:
+            return 0;
+        }
+    }
+
+    size_t required = obj->recvBufferSize_ + totalBytes;
+    if (required > obj->maxBodySize_) {
+        NET_LOG_LVL(WARN, "HttpClient::writeFuncHelper: body of " << obj->resource_
+                    << " exceeds " << obj->maxBodySize_ << " bytes, aborting");
+        // Returning less than totalBytes makes libcurl abort the transfer
+        return 0;
+    }
+
+    // One byte more for zero terminator
+    if (required + 1 > obj->recvBufferCapacity_)
+        obj->growRecvBuffer(required + 1);
+
+    memcpy(&obj->recvBuffer_[obj->recvBufferSize_], ptr, totalBytes);
+    obj->recvBufferSize_ = required;
+    return totalBytes;
+}
+
+
+size_t HttpClient::headerFuncHelper(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    HttpClient *obj = static_cast<HttpClient *>(userdata);
+    size_t totalBytes = size * nmemb;
+
+    string line(ptr, totalBytes);
+    size_t colon = line.find(':');
+    if (colon == string::npos) {
+        // Status line starts headers of the next response, e.g. after redirect
+        if (line.compare(0, 5, "HTTP/") == 0) {
+            obj->etag_.clear();
+            obj->lastModified_.clear();
+            obj->contentEncoding_.clear();
+            obj->expectedLength_ = 0;
+            obj->bodyStarted_ = false;
+        }
+        return totalBytes;
+    }
+
+    string name = line.substr(0, colon);
+    string value = line.substr(colon + 1);
+    stringToLower(trim(name));
+    trim(value);
+    if (name == "etag")
+        obj->etag_ = value;
+    else if (name == "last-modified")
+        obj->lastModified_ = value;
+    else if (name == "content-encoding")
+        obj->contentEncoding_ = stringToLowerCopy(value);
+    else if (name == "content-length")
+        obj->expectedLength_ = min<size_t>(strtoull(value.c_str(), nullptr, 10),
+                                           obj->maxBodySize_);
 
-    memcpy(&obj->recvBuffer_[startPos], ptr, totalBytes);
     return totalBytes;
 }
 
 
 HttpClient::~HttpClient() {
-    if (recvBuffer_)
-        delete[] recvBuffer_;
+    curl_slist_free_all(requestHeaders_);
+    releaseRecvBuffer(recvBuffer_, recvBufferCapacity_);
     curl_easy_cleanup(handle_);
 }
 
@@ -23,11 +23,13 @@
 #define HTTP_CLIENT_H_
 
 #include <string>
+#include <functional>
 #include <stdexcept>
 #include <vector>
 #include <netdb.h>
 #include <curl/curl.h>
 #include "http_resource.h"
+#include "http_buffer_pool.h"
 #include "socket_single.h"
 
 namespace nestor {
@@ -35,24 +37,102 @@ namespace net {
 
 class HttpClient {
 public:
-    HttpClient();
+    /** Responses with bigger body are aborted */
+    static const size_t DEFAULT_MAX_BODY_SIZE = 16 * 1024 * 1024;
+    /** First receive buffer size if response has no Content-Length */
+    static const size_t INITIAL_BUFFER_SIZE = 16 * 1024;
+
+    /**
+     * @param pool Pool to take receive buffers from and give them back,
+     * may be nullptr. Must outlive the client.
+     */
+    explicit HttpClient(HttpBufferPool *pool = nullptr);
+
+    /** What the body sink did with a chunk */
+    enum class SinkStatus {
+        CONSUMED,
+        /**
+         * Chunk is not taken, transfer is paused until resumeBody() and
+         * then the same chunk is passed again.
+         */
+        PAUSE,
+        ABORT
+    };
+
+    /** Receiver of the response body chunks */
+    typedef std::function<SinkStatus(const HttpClient &client, const char *data, size_t length)> BodySink;
 
     HttpResource *getResource(const std::string &resource);
-    void setup(const std::string &resource);
+
+    /**
+     * Prepares GET request of the resource.
+     * @param etag ETag of the cached copy, sent as If-None-Match.
+     * @param lastModified Last-Modified of the cached copy, sent as
+     * If-Modified-Since.
+     * If any validator is given, server may answer 304 Not Modified
+     * without body.
+     * Request accepts every content encoding supported by libcurl, the
+     * body is decompressed while it is received.
+     */
+    void setup(const std::string &resource, const std::string &etag = "",
+               const std::string &lastModified = "");
     bool perform();
     CURL *handle() const;
+    /** Resource passed to setup() */
+    const std::string &resource() const;
     HttpResource *parseReceivedData();
 
+    /** Drops received data and the body sink, e.g. of a failed transfer */
+    void discardReceivedData();
+
+    /**
+     * Makes body of the successful response go to the sink chunk by chunk
+     * as it is received instead of the receive buffer. Streamed body is
+     * limited by maxBodySize() as well. Bodies of other responses, e.g.
+     * 304 or errors, are buffered as usual.
+     * Sink is reset by setup(), so it is set after it.
+     */
+    void setBodySink(BodySink sink);
+
+    /** Resumes transfer paused by the body sink */
+    void resumeBody();
+
+    /** Media type and charset parameter of the response Content-Type */
+    void contentType(std::string &type, std::string &charset) const;
+
+    size_t maxBodySize() const;
+    void setMaxBodySize(size_t maxBodySize);
+
     virtual ~HttpClient();
 
 private:
     static size_t writeFuncHelper( void* ptr, size_t size, size_t nmemb, void* userdata);
+    static size_t headerFuncHelper(char* ptr, size_t size, size_t nmemb, void* userdata);
+
+    void growRecvBuffer(size_t minCapacity);
+    void releaseRecvBuffer(unsigned char *buffer, size_t capacity);
 
 private:
     CURL *handle_;
+    HttpBufferPool *bufferPool_;
     unsigned char *recvBuffer_;
     size_t recvBufferSize_;
+    size_t recvBufferCapacity_;
+    /** Content-Length of the response, 0 if unknown */
+    size_t expectedLength_;
+    size_t maxBodySize_;
     std::string resource_;
+
+    BodySink bodySink_;
+    /** Body of the current response goes to the sink, decided by its first chunk */
+    bool bodyStarted_;
+    bool streaming_;
+    size_t streamedSize_;
+
+    curl_slist *requestHeaders_;
+    std::string etag_;
+    std::string lastModified_;
+    std::string contentEncoding_;
 };
 
 } /* namespace net */
@@ -0,0 +1,77 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include "http_client_pool.h"
+
+using namespace std;
+
+namespace nestor {
+namespace net {
+
+const size_t HttpClientPool::DEFAULT_MAX_IDLE_CLIENTS;
+
+HttpClientPool::HttpClientPool(size_t maxIdleClients)
+        : maxIdleClients_(maxIdleClients), reuseCount_(0) {
+}
+
+HttpClientPool::~HttpClientPool() {
+    // Clients give their buffers back to bufferPool_, so they go first
+    for (HttpClient *client : clients_)
+        delete client;
+    clients_.clear();
+}
+
+HttpClient *HttpClientPool::acquire() {
+    if (clients_.empty())
+        return new HttpClient(&bufferPool_);
+
+    HttpClient *client = clients_.back();
+    clients_.pop_back();
+    reuseCount_++;
+    return client;
+}
+
+void HttpClientPool::release(HttpClient *client) {
+    if (client == nullptr)
+        return;
+
+    if (clients_.size() >= maxIdleClients_) {
+        delete client;
+        return;
+    }
+
+    client->discardReceivedData();
+    clients_.push_back(client);
+}
+
+size_t HttpClientPool::size() const {
+    return clients_.size();
+}
+
+size_t HttpClientPool::reuseCount() const {
+    return reuseCount_;
+}
+
+const HttpBufferPool &HttpClientPool::bufferPool() const {
+    return bufferPool_;
+}
+
+} /* namespace net */
+} /* namespace nestor */
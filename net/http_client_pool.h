@@ -0,0 +1,70 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef HTTP_CLIENT_POOL_H_
+#define HTTP_CLIENT_POOL_H_
+
+#include <cstddef>
+#include <vector>
+#include "http_client.h"
+#include "http_buffer_pool.h"
+
+namespace nestor {
+namespace net {
+
+/**
+ * Free list of HttpClient objects. Reused client keeps its curl easy
+ * handle with DNS cache and TLS session, so a new transfer doesn't pay for
+ * curl_easy_init() and handle setup. Clients share receive buffers of the
+ * pool. Not thread safe.
+ */
+class HttpClientPool {
+public:
+    /** Maximum number of idle clients kept */
+    static const size_t DEFAULT_MAX_IDLE_CLIENTS = 256;
+
+    explicit HttpClientPool(size_t maxIdleClients = DEFAULT_MAX_IDLE_CLIENTS);
+    virtual ~HttpClientPool();
+
+    /** Takes idle client or creates a new one */
+    HttpClient *acquire();
+
+    /** Returns client taken by acquire(), its received data is dropped */
+    void release(HttpClient *client);
+
+    /** Number of idle clients */
+    size_t size() const;
+
+    /** Number of acquire() calls served by an idle client */
+    size_t reuseCount() const;
+
+    const HttpBufferPool &bufferPool() const;
+
+private:
+    HttpBufferPool bufferPool_;
+    std::vector<HttpClient *> clients_;
+    size_t maxIdleClients_;
+    size_t reuseCount_;
+};
+
+} /* namespace net */
+} /* namespace nestor */
+
+#endif /* HTTP_CLIENT_POOL_H_ */
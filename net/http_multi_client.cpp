@@ -8,7 +8,8 @@ using namespace std;
 namespace nestor {
 namespace net {
 
-HttpMultiClient::HttpMultiClient() {
+HttpMultiClient::HttpMultiClient()
+        : maxBodySize_(HttpClient::DEFAULT_MAX_BODY_SIZE) {
     runningStatus_ = -1;
     finished_ = false;
     multiHandle_ = curl_multi_init();
@@ -22,21 +23,35 @@ HttpMultiClient::HttpMultiClient() {
 HttpMultiClient::~HttpMultiClient() {
     for (HttpClient *c : clients_) {
         curl_multi_remove_handle(multiHandle_, c->handle());
-        delete c;
+        clientPool_.release(c);
     }
     clients_.clear();
-    clientResources_.clear();
     curl_multi_cleanup(multiHandle_);
 }
 
 
-void HttpMultiClient::appendRequestResource(const std::string& resource) {
-    HttpClient *client = new HttpClient();
-    client->setup(resource);
-    clients_.push_back(client);
+void HttpMultiClient::appendRequestResource(const std::string& resource, const std::string &etag,
+                                            const std::string &lastModified) {
+    HttpClient *client = clientPool_.acquire();
+    client->setMaxBodySize(maxBodySize_);
+    client->setup(resource, etag, lastModified);
+    // Finished handle leads to its client without search
+    curl_easy_setopt(client->handle(), CURLOPT_PRIVATE, client);
+    clients_.insert(client);
 
     curl_multi_add_handle(multiHandle_, client->handle());
-    clientResources_.insert(make_pair(client, resource));
+}
+
+void HttpMultiClient::setMaxBodySize(size_t maxBodySize) {
+    maxBodySize_ = maxBodySize;
+}
+
+const HttpBufferPool &HttpMultiClient::bufferPool() const {
+    return clientPool_.bufferPool();
+}
+
+const HttpClientPool &HttpMultiClient::clientPool() const {
+    return clientPool_;
 }
 
 std::vector<HttpResource*>* HttpMultiClient::perform() {
@@ -63,17 +78,33 @@ std::vector<HttpResource*>* HttpMultiClient::perform() {
             int msgsLeft;
             while ((msg = curl_multi_info_read(multiHandle_, &msgsLeft))) {
                 if (msg->msg == CURLMSG_DONE) {
-                    HttpClient *doneClient = nullptr;
-                    for (HttpClient *c : clients_) {
-                        if (c->handle() == msg->easy_handle) {
-                            doneClient = c;
-                            break;
+                    char *priv = nullptr;
+                    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+                    HttpClient *doneClient = reinterpret_cast<HttpClient *>(priv);
+                    CURLcode result = msg->data.result;
+
+                    // Handle goes back to the pool, msg is invalid after removal
+                    curl_multi_remove_handle(multiHandle_, doneClient->handle());
+                    clients_.erase(doneClient);
+
+                    HttpResource *res = nullptr;
+                    if (result != CURLE_OK) {
+                        NET_LOG_LVL(WARN, "HttpMultiClient::perform: transfer of "
+                                    << doneClient->resource() << " failed: "
+                                    << curl_easy_strerror(result));
+                    } else {
+                        res = doneClient->parseReceivedData();
+                        if (res == nullptr) {
+                            NET_LOG_LVL(WARN, "HttpMultiClient::perform: no data received from "
+                                        << doneClient->resource());
+                        } else {
+                            res->setRequestUrl(doneClient->resource());
                         }
                     }
+                    clientPool_.release(doneClient);
 
-                    HttpResource *res = doneClient->parseReceivedData();
-                    res->setRequestUrl(clientResources_[doneClient]);
-                    resources->push_back(res);
+                    if (res != nullptr)
+                        resources->push_back(res);
                 }
             }
         }
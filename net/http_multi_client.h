@@ -5,9 +5,10 @@
 #include <functional>
 #include <string>
 #include <vector>
-#include <map>
+#include <unordered_set>
 #include "http_resource.h"
 #include "http_client.h"
+#include "http_client_pool.h"
 
 
 namespace nestor {
@@ -18,13 +19,27 @@ public:
     HttpMultiClient();
     virtual ~HttpMultiClient();
 
-    void appendRequestResource(const std::string &resource);
+    /**
+     * Adds resource to download. Validators of the cached copy make the
+     * request conditional, @sa HttpClient::setup().
+     */
+    void appendRequestResource(const std::string &resource, const std::string &etag = "",
+                               const std::string &lastModified = "");
     std::vector<HttpResource *> *perform();
 
+    /** Limit of a response body, applies to resources appended later */
+    void setMaxBodySize(size_t maxBodySize);
+
+    const HttpBufferPool &bufferPool() const;
+    const HttpClientPool &clientPool() const;
+
 private:
     CURLM *multiHandle_;
-    std::vector<HttpClient *> clients_;
-    std::map<HttpClient *, std::string> clientResources_;
+    /** Finished clients are reused by the next resources */
+    HttpClientPool clientPool_;
+    size_t maxBodySize_;
+    /** Clients in progress, CURLINFO_PRIVATE of their handles */
+    std::unordered_set<HttpClient *> clients_;
     int runningStatus_;
     bool finished_;
 };
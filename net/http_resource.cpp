@@ -33,7 +33,8 @@ HttpResource::HttpResource() :
     code_(0), contentLength_(0),
     content_(nullptr),
     url_(""),
-    requestUrl_("") {
+    requestUrl_(""),
+    transferLength_(0), decodedLength_(0), streamed_(false) {
 
 }
 
@@ -115,6 +116,58 @@ void HttpResource::setRequestUrl(const std::string& requestUrl) {
     requestUrl_ = requestUrl;
 }
 
+const std::string& HttpResource::etag() const {
+    return etag_;
+}
+
+void HttpResource::setEtag(const std::string& etag) {
+    etag_ = etag;
+}
+
+const std::string& HttpResource::lastModified() const {
+    return lastModified_;
+}
+
+void HttpResource::setLastModified(const std::string& lastModified) {
+    lastModified_ = lastModified;
+}
+
+bool HttpResource::notModified() const {
+    return code_ == CODE_NOT_MODIFIED;
+}
+
+const std::string& HttpResource::contentEncoding() const {
+    return contentEncoding_;
+}
+
+void HttpResource::setContentEncoding(const std::string& contentEncoding) {
+    contentEncoding_ = contentEncoding;
+}
+
+unsigned int HttpResource::transferLength() const {
+    return transferLength_;
+}
+
+void HttpResource::setTransferLength(unsigned int transferLength) {
+    transferLength_ = transferLength;
+}
+
+unsigned int HttpResource::decodedLength() const {
+    return decodedLength_;
+}
+
+void HttpResource::setDecodedLength(unsigned int decodedLength) {
+    decodedLength_ = decodedLength;
+}
+
+bool HttpResource::streamed() const {
+    return streamed_;
+}
+
+void HttpResource::setStreamed(bool streamed) {
+    streamed_ = streamed;
+}
+
 } /* namespace net */
 } /* namespace nestor */
 
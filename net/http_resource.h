@@ -29,6 +29,8 @@ namespace net {
 
 class HttpResource {
 public:
+    static const unsigned int CODE_NOT_MODIFIED = 304;
+
     HttpResource();
     virtual ~HttpResource();
 
@@ -56,6 +58,31 @@ public:
     const std::string& requestUrl() const;
     void setRequestUrl(const std::string& requestUrl);
 
+    /* ETag and Last-Modified HTTP fields. Empty if absent. */
+    const std::string& etag() const;
+    void setEtag(const std::string& etag);
+    const std::string& lastModified() const;
+    void setLastModified(const std::string& lastModified);
+
+    /* True if conditional request found the resource unchanged (304). */
+    bool notModified() const;
+
+    /* Content-Encoding HTTP field (gzip, deflate, br). Empty if absent. */
+    const std::string& contentEncoding() const;
+    void setContentEncoding(const std::string& contentEncoding);
+
+    /* Body size as transferred over network, i.e. before decompression. */
+    unsigned int transferLength() const;
+    void setTransferLength(unsigned int transferLength);
+
+    /* Body size after decompression, not changed by charset conversion. */
+    unsigned int decodedLength() const;
+    void setDecodedLength(unsigned int decodedLength);
+
+    /* True if body was passed to the body sink while received, content is empty then. */
+    bool streamed() const;
+    void setStreamed(bool streamed);
+
 private:
     std::string server_;
     std::string codeDefinition_;
@@ -68,6 +95,14 @@ private:
 
     std::string url_;
     std::string requestUrl_;
+
+    std::string etag_;
+    std::string lastModified_;
+
+    std::string contentEncoding_;
+    unsigned int transferLength_;
+    unsigned int decodedLength_;
+    bool streamed_;
 };
 
 } /* namespace net */
@@ -255,9 +255,9 @@ void HttpResponseParser::bindValues(const map<string, string>& values,
     // Content-Encoding field
     if (values.count(CONTENT_ENCODING_FIELD)) {
         string encoding = values.at(CONTENT_ENCODING_FIELD);
-        output.setServer(encoding);
+        output.setContentEncoding(stringToLowerCopy(trim(encoding)));
     } else {
-        output.setServer("");
+        output.setContentEncoding("");
     }
 }
 
@@ -0,0 +1,73 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <stdexcept>
+#include "common/logger.h"
+#include "http_share.h"
+
+using namespace std;
+
+namespace nestor {
+namespace net {
+
+HttpShare *HttpShare::instance_ = nullptr;
+mutex HttpShare::instanceLock_;
+
+HttpShare *HttpShare::instance() {
+    lock_guard<mutex> locker(instanceLock_);
+    if (instance_ == nullptr)
+        instance_ = new HttpShare();
+    return instance_;
+}
+
+HttpShare::HttpShare() {
+    handle_ = curl_share_init();
+    if (handle_ == nullptr) {
+        string errmsg = "HttpShare::HttpShare: cannot initialize curl share handle";
+        NET_LOG_LVL(ERROR, errmsg);
+        throw runtime_error(errmsg);
+    }
+
+    curl_share_setopt(handle_, CURLSHOPT_LOCKFUNC, lockFunction);
+    curl_share_setopt(handle_, CURLSHOPT_UNLOCKFUNC, unlockFunction);
+    curl_share_setopt(handle_, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(handle_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(handle_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+HttpShare::~HttpShare() {
+    curl_share_cleanup(handle_);
+}
+
+CURLSH *HttpShare::handle() const {
+    return handle_;
+}
+
+void HttpShare::lockFunction(CURL *handle, curl_lock_data data,
+                             curl_lock_access access, void *userdata) {
+    static_cast<HttpShare *>(userdata)->locks_[data].lock();
+}
+
+void HttpShare::unlockFunction(CURL *handle, curl_lock_data data, void *userdata) {
+    static_cast<HttpShare *>(userdata)->locks_[data].unlock();
+}
+
+} /* namespace net */
+} /* namespace nestor */
@@ -0,0 +1,64 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef HTTP_SHARE_H_
+#define HTTP_SHARE_H_
+
+#include <mutex>
+#include <curl/curl.h>
+
+namespace nestor {
+namespace net {
+
+/**
+ * Process-wide libcurl share object. Every HttpClient is attached to it,
+ * so resolved host names and TLS sessions are reused by all transfers
+ * of all threads, a feed host is resolved and fully handshaked once.
+ */
+class HttpShare {
+public:
+    static HttpShare *instance();
+
+    CURLSH *handle() const;
+
+private:
+    explicit HttpShare();
+    ~HttpShare();
+
+    static void lockFunction(CURL *handle, curl_lock_data data,
+                             curl_lock_access access, void *userdata);
+    static void unlockFunction(CURL *handle, curl_lock_data data, void *userdata);
+
+// static members
+private:
+    static HttpShare *instance_;
+    static std::mutex instanceLock_;
+
+// members
+private:
+    CURLSH *handle_;
+    /** One lock for every kind of the shared data */
+    std::mutex locks_[CURL_LOCK_DATA_LAST];
+};
+
+} /* namespace net */
+} /* namespace nestor */
+
+#endif /* HTTP_SHARE_H_ */
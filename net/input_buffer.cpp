@@ -0,0 +1,105 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <cstring>
+#include <stdexcept>
+#include "input_buffer.h"
+
+using namespace std;
+
+namespace nestor {
+namespace net {
+
+InputBuffer::InputBuffer(size_t initialCapacity)
+        : initialCapacity_(initialCapacity), readPos_(0), writePos_(0) {
+}
+
+const char *InputBuffer::data() const {
+    return storage_.data() + readPos_;
+}
+
+size_t InputBuffer::size() const {
+    return writePos_ - readPos_;
+}
+
+bool InputBuffer::empty() const {
+    return readPos_ == writePos_;
+}
+
+size_t InputBuffer::capacity() const {
+    return storage_.size();
+}
+
+char *InputBuffer::prepare(size_t minSpace) {
+    if (storage_.size() - writePos_ >= minSpace)
+        return storage_.data() + writePos_;
+
+    size_t dataSize = size();
+    if (readPos_ > 0) {
+        /* Moving data to the beginning, space there is free */
+        memmove(storage_.data(), storage_.data() + readPos_, dataSize);
+        readPos_ = 0;
+        writePos_ = dataSize;
+    }
+
+    if (storage_.size() - writePos_ < minSpace) {
+        size_t newCapacity = storage_.size() > 0 ? storage_.size() * 2 : initialCapacity_;
+        if (newCapacity == 0)
+            newCapacity = minSpace;
+        while (newCapacity - writePos_ < minSpace)
+            newCapacity *= 2;
+        storage_.resize(newCapacity);
+    }
+
+    return storage_.data() + writePos_;
+}
+
+size_t InputBuffer::writable() const {
+    return storage_.size() - writePos_;
+}
+
+void InputBuffer::commit(size_t n) {
+    if (n > writable())
+        throw out_of_range("InputBuffer::commit: more bytes than prepared");
+    writePos_ += n;
+}
+
+void InputBuffer::consume(size_t n) {
+    if (n > size())
+        throw out_of_range("InputBuffer::consume: more bytes than buffer has");
+    readPos_ += n;
+    if (readPos_ == writePos_)
+        readPos_ = writePos_ = 0;
+}
+
+void InputBuffer::clear() {
+    readPos_ = writePos_ = 0;
+}
+
+void InputBuffer::shrink() {
+    if (empty() && storage_.size() > initialCapacity_) {
+        vector<char> storage(initialCapacity_);
+        storage_.swap(storage);
+        readPos_ = writePos_ = 0;
+    }
+}
+
+} /* namespace net */
+} /* namespace nestor */
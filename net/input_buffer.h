@@ -0,0 +1,81 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef INPUT_BUFFER_H_
+#define INPUT_BUFFER_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace nestor {
+namespace net {
+
+/**
+ * Reusable receive buffer of a connection. Socket reads directly into the
+ * free space at the end, parser takes the data from the beginning. Data
+ * is kept contiguous, so it may be parsed in place. Consumed data is
+ * dropped in O(1), free space at the beginning is reclaimed by moving the
+ * rest of the data only when more space is needed.
+ */
+class InputBuffer {
+public:
+    static const size_t DEFAULT_CAPACITY = 4096;
+
+    explicit InputBuffer(size_t initialCapacity = DEFAULT_CAPACITY);
+
+    const char *data() const;
+    size_t size() const;
+    bool empty() const;
+    size_t capacity() const;
+
+    /**
+     * Makes at least minSpace bytes writable after the data.
+     * @return pointer to the writable space.
+     */
+    char *prepare(size_t minSpace);
+
+    /** Number of bytes which may be written to prepare() result */
+    size_t writable() const;
+
+    /** Appends n bytes written to prepare() result to the data */
+    void commit(size_t n);
+
+    /** Drops n bytes from the beginning of the data */
+    void consume(size_t n);
+
+    void clear();
+
+    /**
+     * Returns memory to the initial capacity if buffer has grown
+     * (e.g. for a big command) and is empty now.
+     */
+    void shrink();
+
+private:
+    std::vector<char> storage_;
+    size_t initialCapacity_;
+    size_t readPos_;
+    size_t writePos_;
+};
+
+} /* namespace net */
+} /* namespace nestor */
+
+#endif /* INPUT_BUFFER_H_ */
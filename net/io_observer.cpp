@@ -37,20 +37,59 @@ namespace nestor {
 namespace net {
 
 
-IOObserver::IOObserver()
-        : loop_(nullptr) {
-    eventCallbacks_.clear();
-    eventObjects_.clear();
-    eventTimers_.clear();
-    eventTimeoutsMs_.clear();
-    fdTimers_.clear();
+IOObserver::IOObserverWatcher::IOObserverWatcher(IOObserver *observer, int fd)
+        : observer(observer), fd(fd), active(false), generation(0),
+          timeoutMs(0), ioWatcher(*observer->loop_), readCallback(nullptr),
+          writeCallback(nullptr), timeoutCallback(nullptr) {
+    ioWatcher.set<IOObserverWatcher, &IOObserverWatcher::onEvent>(this);
+}
+
+void IOObserver::IOObserverWatcher::onEvent(ev::io &e, int revents) {
+    observer->eventCallbackWrapper(*this, revents);
+}
+
+
+IOObserver::IOObserverTimer::IOObserverTimer(IOObserver *observer, int id)
+        : observer(observer), id(id), used(false), timer(*observer->loop_),
+          callback(nullptr) {
+    timer.set<IOObserverTimer, &IOObserverTimer::onTimeout>(this);
+}
+
+void IOObserver::IOObserverTimer::onTimeout(ev::timer &t, int revents) {
+    /* Copy survives destroyTimer() called by the callback itself */
+    timerCallbackFunction call = callback;
+    if (call)
+        call();
+}
+
+
+IOObserver::IOObserver(unsigned int timerTickMs)
+        : activeCount_(0), loop_(nullptr), wakeUpWatcher_(nullptr),
+          tickWatcher_(nullptr), timerWheel_(nullptr) {
+    if (timerTickMs == 0)
+        throw invalid_argument("IOObserver::IOObserver: timerTickMs is 0");
 
     loop_ = new ev::dynamic_loop();
+    wakeUpWatcher_ = new ev::async(*loop_);
+    wakeUpWatcher_->set<IOObserver, &IOObserver::wakeUpCallback>(this);
+    wakeUpWatcher_->start();
+
+    timerWheel_ = new TimerWheel(timerTickMs, nowMs(), [this](TimerWheelNode *node) {
+        timeoutCallbackWrapper(*static_cast<IOObserverWatcher *>(node));
+    });
+    tickWatcher_ = new ev::timer(*loop_);
+    tickWatcher_->set<IOObserver, &IOObserver::tickCallback>(this);
 }
 
 IOObserver::~IOObserver() {
     if (loop_) {
         breakLoop();
+        // Watchers refer to the loop, so they have to go first
+        delete timerWheel_;
+        watchers_.clear();
+        timers_.clear();
+        delete tickWatcher_;
+        delete wakeUpWatcher_;
         delete loop_;
     }
 }
@@ -73,26 +112,29 @@ void IOObserver::append(int fd, unsigned int timeoutMs,
         throw invalid_argument(ossErr.str());
     }
 
-    if (eventCallbacks_.count(fd)) {
+    if (findWatcherByFd(fd) != nullptr) {
         ossErr << "IOObserver::append: fd " << fd << " is already observing";
         NET_LOG_LVL(ERROR, ossErr.str());
         throw invalid_argument(ossErr.str());
     }
 
-    ev::io *eventObject = new ev::io(*loop_);
+    IOObserverWatcher &watcher = acquireWatcher(fd);
+
     int flags = 0;
     if (readCallback)
         flags |= ev::READ;
     if (writeCallback)
         flags |= ev::WRITE;
-    eventObject->set(fd, flags);
 
-    eventObject->set<IOObserver, &IOObserver::eventCallbackWrapper>(this);
+    watcher.readCallback = readCallback;
+    watcher.writeCallback = writeCallback;
+    watcher.timeoutCallback = timeoutCallback;
+    watcher.active = true;
+    watcher.generation++;
+    activeCount_++;
 
-    IOObserverCallbacks callbacks = {readCallback, writeCallback, timeoutCallback};
-    eventCallbacks_.insert(make_pair(fd, callbacks));
-    eventObjects_.insert(make_pair(eventObject, fd));
-    eventObject->start();
+    watcher.ioWatcher.set(fd, flags);
+    watcher.ioWatcher.start();
 
     if (timeoutMs > 0) {
         if (timeoutCallback == nullptr) {
@@ -101,117 +143,242 @@ void IOObserver::append(int fd, unsigned int timeoutMs,
             return;
         }
 
-        ev::timer *eventTimeout = new ev::timer(*loop_);
-        ev_tstamp repeatSec = static_cast<ev_tstamp>(timeoutMs) / 1000.0;
-        eventTimeout->set(0.0, repeatSec);
-
-        eventTimers_.insert(make_pair(eventTimeout, fd));
-        fdTimers_.insert(make_pair(fd, eventTimeout));
-        eventTimeoutsMs_.insert(make_pair(fd, timeoutMs));
-        eventTimeout->again();
+        watcher.timeoutMs = timeoutMs;
+        armTimeout(watcher);
     }
 }
 
 void IOObserver::remove(int fd) {
     ostringstream ossErr;
-    if (eventCallbacks_.count(fd) == 0) {
+    IOObserverWatcher *watcher = findWatcherByFd(fd);
+    if (watcher == nullptr) {
         ossErr << "IOObserver::remove: fd " << fd << " wasn't appended before.";
         NET_LOG_LVL(ERROR, ossErr.str());
         throw invalid_argument(ossErr.str());
     }
 
-    ev::io *eventObject = findObjectByFd(fd);
-    ev::timer *eventTimer = fdTimers_.count(fd) > 0 ? fdTimers_[fd] : nullptr;
+    watcher->ioWatcher.stop();
+    timerWheel_->cancel(watcher);
+    watcher->active = false;
+    watcher->timeoutMs = 0;
+    activeCount_--;
+
+    /* Callback which is executing right now is kept alive
+     * by invokeCallback() and is released after return. */
+    watcher->readCallback = nullptr;
+    watcher->writeCallback = nullptr;
+    watcher->timeoutCallback = nullptr;
+}
+
+void IOObserver::modify(int fd, bool watchRead, bool watchWrite) {
+    ostringstream ossErr;
+    IOObserverWatcher *watcher = findWatcherByFd(fd);
+    if (watcher == nullptr) {
+        ossErr << "IOObserver::modify: fd " << fd << " wasn't appended before.";
+        NET_LOG_LVL(ERROR, ossErr.str());
+        throw invalid_argument(ossErr.str());
+    }
 
-    if (eventObject == nullptr) {
-        ossErr << "IOObserver::remove: cannot find event object for fd = " << fd;
+    if ((watchRead && watcher->readCallback == nullptr) ||
+            (watchWrite && watcher->writeCallback == nullptr)) {
+        ossErr << "IOObserver::modify: no callback for requested events on fd " << fd;
         NET_LOG_LVL(ERROR, ossErr.str());
-        throw runtime_error(ossErr.str());
+        throw invalid_argument(ossErr.str());
     }
 
-    eventObject->stop();
-    eventObjects_.erase(eventObject);
-    eventCallbacks_.erase(fd);
+    int flags = 0;
+    if (watchRead)
+        flags |= ev::READ;
+    if (watchWrite)
+        flags |= ev::WRITE;
 
-    delete eventObject;
+    if ((watcher->ioWatcher.events & (ev::READ | ev::WRITE)) == flags)
+        return;
 
-    eventTimeoutsMs_.erase(fd);
-    fdTimers_.erase(fd);
+    /* ev::io::set() restarts an active watcher itself */
+    watcher->ioWatcher.set(flags);
+}
 
-    if (eventTimer) {
-        eventTimer->stop();
-        eventTimers_.erase(eventTimer);
+void IOObserver::setTimeout(int fd, unsigned int timeoutMs) {
+    ostringstream ossErr;
+    IOObserverWatcher *watcher = findWatcherByFd(fd);
+    if (watcher == nullptr) {
+        ossErr << "IOObserver::setTimeout: fd " << fd << " wasn't appended before.";
+        NET_LOG_LVL(ERROR, ossErr.str());
+        throw invalid_argument(ossErr.str());
+    }
 
-        delete eventTimer;
+    if (timeoutMs > 0 && watcher->timeoutCallback == nullptr) {
+        ossErr << "IOObserver::setTimeout: no timeout callback for fd " << fd;
+        NET_LOG_LVL(ERROR, ossErr.str());
+        throw invalid_argument(ossErr.str());
     }
+
+    watcher->timeoutMs = timeoutMs;
+    armTimeout(*watcher);
 }
 
+int IOObserver::createTimer(timerCallbackFunction callback) {
+    if (callback == nullptr)
+        throw invalid_argument("IOObserver::createTimer: callback is not specified");
+
+    int id;
+    if (!freeTimers_.empty()) {
+        id = freeTimers_.back();
+        freeTimers_.pop_back();
+    } else {
+        id = static_cast<int>(timers_.size());
+        timers_.emplace_back(this, id);
+    }
 
-void IOObserver::wait() {
-    for (auto ev : eventObjects_)
-        ev.first->start();
-    for (auto tmr : eventTimers_)
-        tmr.first->again();
+    IOObserverTimer &timer = timers_[id];
+    timer.used = true;
+    timer.callback = callback;
+    return id;
+}
+
+void IOObserver::startTimer(int id, unsigned int timeoutMs) {
+    IOObserverTimer &timer = findTimer(id, "IOObserver::startTimer");
+    timer.timer.stop();
+    timer.timer.start(static_cast<ev_tstamp>(timeoutMs) / 1000.0, 0.0);
+}
 
-    loop_->run();
+void IOObserver::stopTimer(int id) {
+    findTimer(id, "IOObserver::stopTimer").timer.stop();
+}
+
+void IOObserver::destroyTimer(int id) {
+    IOObserverTimer &timer = findTimer(id, "IOObserver::destroyTimer");
+    timer.timer.stop();
+    timer.used = false;
+    timer.callback = nullptr;
+    freeTimers_.push_back(id);
+}
+
+IOObserver::IOObserverTimer &IOObserver::findTimer(int id, const char *tag) {
+    if (id < 0 || static_cast<size_t>(id) >= timers_.size() || !timers_[id].used) {
+        ostringstream ossErr;
+        ossErr << tag << ": timer " << id << " doesn't exist";
+        NET_LOG_LVL(ERROR, ossErr.str());
+        throw invalid_argument(ossErr.str());
+    }
+    return timers_[id];
+}
+
+void IOObserver::wait() {
+    loop_->run(ev::ONCE);
 }
 
 void IOObserver::breakLoop() {
     if (loop_) {
         loop_->break_loop(ev::ALL);
-        for (auto it = eventCallbacks_.begin(); it != eventCallbacks_.end(); it++)
-            remove(it->first);
+        for (IOObserverWatcher &watcher : watchers_)
+            if (watcher.active)
+                remove(watcher.fd);
     }
 }
 
-int IOObserver::objectListenCount() const {
-	return eventCallbacks_.size();
+void IOObserver::wakeUp() {
+    wakeUpWatcher_->send();
 }
 
-ev::io* IOObserver::findObjectByFd(int fd) {
-    for (auto it = eventObjects_.begin(); it != eventObjects_.end(); it++)
-        if (it->second == fd)
-            return it->first;
-    return nullptr;
+void IOObserver::wakeUpCallback(ev::async &a, int revents) {
+    /* Nothing to do: handled event makes wait() return */
 }
 
-void IOObserver::eventCallbackWrapper(ev::io& e, int revents) {
-    ev::io *object = &e;
-    if (eventObjects_.count(object) == 0) {
-        NET_LOG_LVL(ERROR, "IOObserver::eventCallbackWrapper: cannot find fd for object = " << (void *)object);
-        object->stop();
-        delete object;
+void IOObserver::tickCallback(ev::timer &t, int revents) {
+    timerWheel_->advance(nowMs());
+    if (timerWheel_->empty())
+        tickWatcher_->stop(); // Sleeping until the next timeout is set
+}
+
+/**
+ * (Re)starts countdown of the watcher timeout. O(1), so it's
+ * done on every descriptor event.
+ */
+void IOObserver::armTimeout(IOObserverWatcher &watcher) {
+    if (watcher.timeoutMs == 0 || watcher.timeoutCallback == nullptr) {
+        timerWheel_->cancel(&watcher);
         return;
     }
 
-    int fd = eventObjects_[object];
+    if (!tickWatcher_->is_active()) {
+        /* Wheel stood still while it was empty */
+        timerWheel_->advance(nowMs());
+        ev_tstamp tickSec = static_cast<ev_tstamp>(timerWheel_->tickMs()) / 1000.0;
+        tickWatcher_->start(tickSec, tickSec);
+    }
+    timerWheel_->schedule(&watcher, watcher.timeoutMs);
+}
+
+uint64_t IOObserver::nowMs() const {
+    return static_cast<uint64_t>(loop_->now() * 1000.0);
+}
+
+int IOObserver::objectListenCount() const {
+	return activeCount_;
+}
+
+IOObserver::IOObserverWatcher *IOObserver::findWatcherByFd(int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) >= watchers_.size())
+        return nullptr;
+    IOObserverWatcher &watcher = watchers_[fd];
+    return watcher.active ? &watcher : nullptr;
+}
+
+IOObserver::IOObserverWatcher &IOObserver::acquireWatcher(int fd) {
+    while (watchers_.size() <= static_cast<size_t>(fd))
+        watchers_.emplace_back(this, static_cast<int>(watchers_.size()));
+    return watchers_[fd];
+}
+
+/**
+ * Calls one of the watcher callbacks. The callback is moved out of
+ * the record for the time of the call, so it stays valid even if the
+ * callback removes or re-appends its own descriptor.
+ */
+void IOObserver::invokeCallback(IOObserverWatcher &watcher,
+                                callbackFunction IOObserverWatcher::*slot) {
+    callbackFunction callback;
+    callback.swap(watcher.*slot);
+    unsigned int generation = watcher.generation;
+
+    callback(watcher.fd);
+
+    if (watcher.active && watcher.generation == generation)
+        (watcher.*slot).swap(callback);
+}
+
+void IOObserver::eventCallbackWrapper(IOObserverWatcher &watcher, int revents) {
+    int fd = watcher.fd;
+    unsigned int generation = watcher.generation;
     NET_LOG("IOObserver::eventCallbackWrapper: event occured: fd = " << fd << "; revents = " << revents);
-    if ((revents & ev::READ) && eventCallbacks_[fd].readCallback != nullptr) {
+    if ((revents & ev::READ) && watcher.readCallback != nullptr) {
         NET_LOG("IOObserver::eventCallbackWrapper: calling read callback");
-        auto callback = eventCallbacks_[fd].readCallback;
-        callback(fd);
+        invokeCallback(watcher, &IOObserverWatcher::readCallback);
     }
-    if ((revents & ev::WRITE) && eventCallbacks_[fd].writeCallback != nullptr)
-        eventCallbacks_[fd].writeCallback(fd);
 
-    if (fdTimers_.count(fd))
-        fdTimers_[fd]->again();
+    if (!watcher.active || watcher.generation != generation)
+        return;
+
+    if ((revents & ev::WRITE) && watcher.writeCallback != nullptr)
+        invokeCallback(watcher, &IOObserverWatcher::writeCallback);
+
+    if (watcher.active && watcher.generation == generation && watcher.timeoutMs > 0)
+        armTimeout(watcher);
 }
 
-void IOObserver::timeoutCallbackWrapper(ev::timer& t, int revents) {
-    ev::timer *timer = &t;
-    if (eventTimers_.count(timer) == 0) {
-        NET_LOG_LVL(ERROR, "IOObserver::timeoutCallbackWrapper: cannot find fd for timer = " << (void *)timer);
-        timer->stop();
-        delete timer;
+void IOObserver::timeoutCallbackWrapper(IOObserverWatcher &watcher) {
+    if (!watcher.active || watcher.timeoutCallback == nullptr)
         return;
-    }
 
-    int fd = eventTimers_[timer];
-    if ((revents & ev::TIMEOUT) && eventCallbacks_[fd].timeoutCallback != nullptr)
-        eventCallbacks_[fd].timeoutCallback(fd);
+    unsigned int generation = watcher.generation;
+    NET_LOG("IOObserver::timeoutCallbackWrapper: timeout on fd = " << watcher.fd);
+    invokeCallback(watcher, &IOObserverWatcher::timeoutCallback);
 
-    timer->again();
+    /* Timeout repeats until the descriptor has events */
+    if (watcher.active && watcher.generation == generation && !watcher.scheduled())
+        armTimeout(watcher);
 }
 
 
@@ -21,12 +21,15 @@
 #ifndef IO_OBSERVER_H_
 #define IO_OBSERVER_H_
 
-#include <map>
+#include <deque>
+#include <vector>
 #include <functional>
 #include <stdexcept>
 
 #include <ev++.h>
 
+#include "timer_wheel.h"
+
 namespace nestor {
 namespace net {
 
@@ -38,9 +41,21 @@ namespace net {
 class IOObserver {
 public:
     typedef std::function<void(int)> callbackFunction;
-    IOObserver();
+    typedef std::function<void()> timerCallbackFunction;
+
+    static const unsigned int DEFAULT_TIMER_TICK_MS = 1000;
+
+    /**
+     * @param timerTickMs Resolution of descriptor timeouts. All timeouts
+     * are served by a single timer wheel which is advanced once per tick.
+     */
+    explicit IOObserver(unsigned int timerTickMs = DEFAULT_TIMER_TICK_MS);
     virtual ~IOObserver();
 
+    /**
+     * Starts observing fd. If timeoutMs is not 0, timeoutCallback is
+     * called every time fd has no events during timeoutMs.
+     */
     void append(int fd, unsigned int timeoutMs,
             callbackFunction readCallback,
             callbackFunction writeCallback,
@@ -48,34 +63,116 @@ public:
     void remove(int fd);
 
     /**
-     * Blocks execution for waiting some events
+     * Changes timeout of fd and restarts its countdown. 0 disables
+     * the timeout. Timeout callback must have been passed to append().
+     */
+    void setTimeout(int fd, unsigned int timeoutMs);
+
+    /**
+     * Changes the set of events observed on fd. Callback of every enabled
+     * event must have been passed to append().
+     */
+    void modify(int fd, bool watchRead, bool watchWrite);
+
+    /**
+     * Creates one-shot timer which is not bound to a descriptor, e.g. for
+     * libraries managing their own timeouts. Unlike descriptor timeouts it
+     * isn't rounded to the timer wheel tick.
+     * @return timer id for startTimer(), stopTimer() and destroyTimer().
+     */
+    int createTimer(timerCallbackFunction callback);
+
+    /** (Re)starts the timer, its callback is called once after timeoutMs */
+    void startTimer(int id, unsigned int timeoutMs);
+    void stopTimer(int id);
+    void destroyTimer(int id);
+
+    /**
+     * Blocks execution for waiting some events. Returns after
+     * the first loop iteration in which events were handled.
      */
     void wait();
 
     void breakLoop();
 
+    /**
+     * Makes current or next wait() call return. Unlike other
+     * methods may be called from any thread.
+     */
+    void wakeUp();
+
     int objectListenCount() const;
 
 private:
-    void eventCallbackWrapper(ev::io &e, int revents);
-    void timeoutCallbackWrapper(ev::timer &t, int revents);
+    /**
+     * Watcher record of a single descriptor. Records are stored in
+     * the table indexed by fd, so every operation on a descriptor is
+     * a direct lookup. Records are never freed while the observer is
+     * alive: libev keeps pointers to active watchers, so the table only
+     * grows and the records are reused when the descriptor number is
+     * reused by the system. Record is its own timer wheel node.
+     */
+    struct IOObserverWatcher : public TimerWheelNode {
+        explicit IOObserverWatcher(IOObserver *observer, int fd);
 
-    ev::io *findObjectByFd(int fd);
+        void onEvent(ev::io &e, int revents);
+
+        IOObserver *observer;
+        int fd;
+        bool active;
+        /* Incremented on every append(), lets a callback detect that
+         * its descriptor was removed and appended again meanwhile. */
+        unsigned int generation;
+        unsigned int timeoutMs;
+        ev::io ioWatcher;
 
-private:
-    struct IOObserverCallbacks {
         callbackFunction readCallback;
         callbackFunction writeCallback;
         callbackFunction timeoutCallback;
     };
 
-    std::map<int, IOObserverCallbacks> eventCallbacks_;
-    std::map<ev::io *, int> eventObjects_;
-    std::map<ev::timer *, int> eventTimers_;
-    std::map<int, ev::timer *> fdTimers_;
-    std::map<int, unsigned int> eventTimeoutsMs_;
+    /**
+     * One-shot timer record. Records are reused like descriptor records,
+     * freed ids are kept in the free list.
+     */
+    struct IOObserverTimer {
+        explicit IOObserverTimer(IOObserver *observer, int id);
+
+        void onTimeout(ev::timer &t, int revents);
+
+        IOObserver *observer;
+        int id;
+        bool used;
+        ev::timer timer;
+        timerCallbackFunction callback;
+    };
+
+    void eventCallbackWrapper(IOObserverWatcher &watcher, int revents);
+    void timeoutCallbackWrapper(IOObserverWatcher &watcher);
+    void invokeCallback(IOObserverWatcher &watcher,
+            callbackFunction IOObserverWatcher::*slot);
+
+    void wakeUpCallback(ev::async &a, int revents);
+    void tickCallback(ev::timer &t, int revents);
+    void armTimeout(IOObserverWatcher &watcher);
+    uint64_t nowMs() const;
+
+    IOObserverWatcher *findWatcherByFd(int fd);
+    IOObserverWatcher &acquireWatcher(int fd);
+    IOObserverTimer &findTimer(int id, const char *tag);
+
+private:
+    /* std::deque never relocates its elements on growth,
+     * which is required for the registered ev watchers. */
+    std::deque<IOObserverWatcher> watchers_;
+    int activeCount_;
+    std::deque<IOObserverTimer> timers_;
+    std::vector<int> freeTimers_;
 
     ev::dynamic_loop *loop_;
+    ev::async *wakeUpWatcher_;
+    ev::timer *tickWatcher_;
+    TimerWheel *timerWheel_;
 };
 
 } /* namespace net */
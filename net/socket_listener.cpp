@@ -31,6 +31,7 @@
 #include <cstring>
 #include <iostream>
 #include <sstream>
+#include "common/logger.h"
 
 
 using namespace std;
@@ -41,7 +42,10 @@ namespace net {
 
 SocketListener::SocketListener(std::string host, unsigned short port)
         throw (SocketIOException)
-        : host_(host), port_(port), sfd_(-1), started_(false) {
+        : host_(host), port_(port), sfd_(-1), started_(false), reusePort_(false),
+          backlog_(DEFAULT_BACKLOG), reserveFd_(-1), lastErrorLog_(0),
+          suppressedErrors_(0), acceptedCount_(0), acceptLimitCount_(0),
+          acceptErrorCount_(0), acceptDroppedCount_(0) {
 }
 
 
@@ -102,6 +106,14 @@ void SocketListener::startListen() {
             continue;
         }
 
+        if (reusePort_) {
+            res = setsockopt(sfd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+            if (res == -1) {
+                ::close(sfd_);
+                continue;
+            }
+        }
+
         res = bind(sfd_, servinfo->ai_addr, servinfo->ai_addrlen);
         if (res == 0) {
             /* We successfully bind! */
@@ -131,7 +143,7 @@ void SocketListener::startListen() {
         goto error;
     }
 
-    res = listen(sfd_, 1);
+    res = listen(sfd_, backlog_);
     if (res == -1) {
         oss_err << "SocketListener::startListen() listen error: "
                 << strerror(errno);
@@ -139,6 +151,7 @@ void SocketListener::startListen() {
     }
 
     freeaddrinfo(servinfo);
+    openReserve();
     started_ = true;
 
     return;
@@ -151,13 +164,126 @@ error:
 }
 
 SocketSingle* SocketListener::accept() {
-    if (!started_ || sfd_ < 0)
+    int confd = acceptDescriptor();
+    if (confd == -1)
         return nullptr;
+    acceptedCount_++;
+#ifdef __linux__
+    /* accept4() has already made it nonblocking */
+    return new SocketSingle(confd, 0, true, false);
+#else
+    return new SocketSingle(confd, 0, true);
+#endif
+}
+
+size_t SocketListener::acceptMany(std::vector<SocketSingle *> &connections,
+                                  size_t maxCount) {
+    size_t count = 0;
+    while (count < maxCount) {
+        SocketSingle *con = accept();
+        if (con == nullptr)
+            return count;
+        connections.push_back(con);
+        count++;
+    }
+
+    acceptLimitCount_++;
+    return count;
+}
+
+/**
+ * Accepts one connection.
+ * @return connection descriptor or -1 if there are no pending connections
+ * or they cannot be accepted now.
+ */
+int SocketListener::acceptDescriptor() {
+    if (!started_ || sfd_ < 0)
+        return -1;
+
+    while (true) {
+#ifdef __linux__
+        int confd = ::accept4(sfd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int confd = ::accept(sfd_, nullptr, nullptr);
+#endif
+        if (confd >= 0)
+            return confd;
+
+        switch (errno) {
+        case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+        case EWOULDBLOCK:
+#endif
+            return -1;
+
+        case EINTR:
+        case ECONNABORTED:
+        case EPROTO:
+            continue; // Client has gone before accepting, taking the next one
+
+        case EMFILE:
+        case ENFILE:
+            /* Level-triggered watcher would report the listener ready
+             * forever, so pending connections are rejected instead of
+             * being left in the backlog. */
+            acceptErrorCount_++;
+            logAcceptError(errno);
+            if (dropPending())
+                continue;
+            return -1;
+
+        default:
+            acceptErrorCount_++;
+            logAcceptError(errno);
+            return -1;
+        }
+    }
+}
+
+/**
+ * Closes the reserve descriptor, accepts one pending connection
+ * and closes it immediately.
+ * @return true if a connection has been dropped.
+ */
+bool SocketListener::dropPending() {
+    if (reserveFd_ < 0)
+        openReserve();
+    if (reserveFd_ < 0)
+        return false;
+
+    closeReserve();
     int confd = ::accept(sfd_, nullptr, nullptr);
-    if (confd == -1){
-        return nullptr;
+    if (confd >= 0) {
+        ::close(confd);
+        acceptDroppedCount_++;
     }
-    return new SocketSingle(confd, 0, true);
+    openReserve();
+    return confd >= 0;
+}
+
+void SocketListener::openReserve() {
+    if (reserveFd_ < 0)
+        reserveFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+void SocketListener::closeReserve() {
+    if (reserveFd_ >= 0) {
+        ::close(reserveFd_);
+        reserveFd_ = -1;
+    }
+}
+
+void SocketListener::logAcceptError(int error) {
+    time_t now = time(nullptr);
+    if (now - lastErrorLog_ < ERROR_LOG_INTERVAL) {
+        suppressedErrors_++;
+        return;
+    }
+
+    NET_LOG_LVL(ERROR, "SocketListener::accept: accept error: " << strerror(error)
+                << " (" << suppressedErrors_ << " similar errors suppressed)");
+    lastErrorLog_ = now;
+    suppressedErrors_ = 0;
 }
 
 void SocketListener::close() {
@@ -167,6 +293,7 @@ void SocketListener::close() {
        sfd_ = -1;
        started_ = false;
    }
+   closeReserve();
 }
 
 int SocketListener::descriptor() const {
@@ -177,5 +304,37 @@ void SocketListener::setPort(unsigned short port) {
     port_ = port;
 }
 
+bool SocketListener::reusePort() const {
+    return reusePort_;
+}
+
+void SocketListener::setReusePort(bool reusePort) {
+    reusePort_ = reusePort;
+}
+
+int SocketListener::backlog() const {
+    return backlog_;
+}
+
+void SocketListener::setBacklog(int backlog) {
+    backlog_ = backlog;
+}
+
+uint64_t SocketListener::acceptedCount() const {
+    return acceptedCount_;
+}
+
+uint64_t SocketListener::acceptLimitCount() const {
+    return acceptLimitCount_;
+}
+
+uint64_t SocketListener::acceptErrorCount() const {
+    return acceptErrorCount_;
+}
+
+uint64_t SocketListener::acceptDroppedCount() const {
+    return acceptDroppedCount_;
+}
+
 } /* namespace net */
 } /* namespace nestor */
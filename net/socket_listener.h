@@ -22,6 +22,9 @@
 #define SOCKET_LISTENER_H_
 
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <ctime>
 #include "socket_single.h"
 
 namespace nestor {
@@ -34,6 +37,10 @@ namespace net {
  */
 class SocketListener {
 public:
+    static const int DEFAULT_BACKLOG = 1024;
+    /** Minimal interval between accept error messages, seconds */
+    static const int ERROR_LOG_INTERVAL = 10;
+
     SocketListener(std::string host = "localhost", unsigned short port = 80)
             throw (SocketIOException);
     virtual ~SocketListener();
@@ -41,10 +48,21 @@ public:
     void startListen();
 
     /**
-     * Accept new incoming connection.
+     * Accept new incoming connection. Accepted socket is nonblocking
+     * and close-on-exec.
      * @return connected socket or nullptr if there are no connections.
      */
     SocketSingle *accept();
+
+    /**
+     * Accepts pending connections until the backlog is empty or maxCount
+     * connections are accepted. Limit keeps a connection storm from
+     * starving already established connections: remaining connections
+     * are taken on the next readiness event.
+     * @param connections Vector to append accepted sockets to.
+     * @return number of accepted connections.
+     */
+    size_t acceptMany(std::vector<SocketSingle *> &connections, size_t maxCount);
     void close();
 
     int descriptor() const;
@@ -54,11 +72,52 @@ public:
     unsigned short port() const;
     void setPort(unsigned short port);
 
+    /**
+     * Allows several listeners (e.g. one per event loop thread) to bind
+     * the same address. The kernel balances incoming connections
+     * between them. Should be set before startListen().
+     */
+    bool reusePort() const;
+    void setReusePort(bool reusePort);
+
+    /**
+     * Length of the kernel queue of not accepted connections.
+     * Should be set before startListen().
+     */
+    int backlog() const;
+    void setBacklog(int backlog);
+
+    /* Accept statistics */
+    uint64_t acceptedCount() const;
+    /** Number of acceptMany() calls stopped by maxCount */
+    uint64_t acceptLimitCount() const;
+    uint64_t acceptErrorCount() const;
+    /** Connections closed right after accept because of descriptors limit */
+    uint64_t acceptDroppedCount() const;
+
+private:
+    int acceptDescriptor();
+    bool dropPending();
+    void openReserve();
+    void closeReserve();
+    void logAcceptError(int error);
+
 private:
     std::string host_;
     unsigned short port_;
     int sfd_;
     bool started_;
+    bool reusePort_;
+    int backlog_;
+    /** Spare descriptor released to reject connections on EMFILE */
+    int reserveFd_;
+    time_t lastErrorLog_;
+    uint64_t suppressedErrors_;
+
+    uint64_t acceptedCount_;
+    uint64_t acceptLimitCount_;
+    uint64_t acceptErrorCount_;
+    uint64_t acceptDroppedCount_;
 };
 
 } /* namespace net */
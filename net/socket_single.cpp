@@ -46,7 +46,8 @@ enum SocketSelectResult {
 SocketSingle::SocketSingle(string host, unsigned short port, bool manualConnect,
         unsigned int timeoutMs, bool nonblocking)
         : host_(host), port_(port), sockFd_(-1), manualConnect_(manualConnect), connected_(
-                false), timeoutMs_(timeoutMs), nonblocking_(nonblocking) {
+                false), timeoutMs_(timeoutMs), nonblocking_(nonblocking),
+          peerClosed_(false) {
     setOnCloseCallback(nullptr);
     try {
         if (!manualConnect_)
@@ -58,13 +59,16 @@ SocketSingle::SocketSingle(string host, unsigned short port, bool manualConnect,
 }
 
 
-SocketSingle::SocketSingle(int fd, unsigned int timeoutMs, bool nonblocking)
-        : timeoutMs_(timeoutMs) {
+SocketSingle::SocketSingle(int fd, unsigned int timeoutMs, bool nonblocking,
+        bool applyMode)
+        : port_(0), sockFd_(-1), manualConnect_(true), connected_(false),
+          timeoutMs_(timeoutMs), nonblocking_(nonblocking), peerClosed_(false) {
     setOnCloseCallback(nullptr);
     if (fd >= 0) {
         connected_ = true;
         sockFd_ = fd;
-        setNonBlocking(nonblocking);
+        if (applyMode)
+            setNonBlocking(nonblocking);
     } else {
         nonblocking_ = nonblocking;
     }
@@ -199,6 +203,24 @@ void SocketSingle::write(const std::string& str) {
     write(str.c_str(), str.length());
 }
 
+size_t SocketSingle::writeSome(const char* buf, size_t buflen) {
+    ostringstream oss_err;
+
+    if (buflen == 0)
+        return 0;
+
+    // Peer may close connection at any moment, don't die from SIGPIPE
+    ssize_t res = send(sockFd_, buf, buflen, MSG_NOSIGNAL);
+    if (res < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+        oss_err << "SocketSingle::writeSome send error " << strerror(errno);
+        throw SocketIOException(oss_err.str());
+    }
+
+    return static_cast<size_t>(res);
+}
+
 size_t SocketSingle::read(char* buf, size_t buflen) {
     ostringstream oss_err;
     size_t readed = 0;
@@ -243,6 +265,29 @@ std::string SocketSingle::readAll() {
     return result;
 }
 
+size_t SocketSingle::readSome(char* buf, size_t buflen) {
+    ostringstream oss_err;
+
+    if (buflen == 0)
+        return 0;
+
+    ssize_t res = recv(sockFd_, buf, buflen, 0);
+    if (res < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+        oss_err << "SocketSingle::readSome recv error " << strerror(errno);
+        throw SocketIOException(oss_err.str());
+    }
+
+    if (res == 0)
+        peerClosed_ = true;
+    return static_cast<size_t>(res);
+}
+
+bool SocketSingle::peerClosed() const {
+    return peerClosed_;
+}
+
 void SocketSingle::setNonBlocking(bool nonblocking) {
     ostringstream oss_err;
     nonblocking_ = nonblocking;
@@ -47,8 +47,14 @@ public:
             bool manualConnect = false, unsigned int timeoutMs = 1000,
             bool nonblocking = true);
 
+    /**
+     * Wraps connected descriptor.
+     * @param applyMode If false, fd is expected to be already in the
+     * requested blocking mode (e.g. created by accept4()), which saves
+     * fcntl() calls.
+     */
     SocketSingle(int fd, unsigned int timeoutMs = 1000,
-            bool nonblocking = true);
+            bool nonblocking = true, bool applyMode = true);
 
     virtual void connect();
     virtual void close();
@@ -57,9 +63,29 @@ public:
 
     virtual void write(const std::string &str);
 
+    /**
+     * Sends as much of the buffer as the socket accepts without waiting.
+     * Throws SocketIOException on error.
+     * @return number of bytes sent. 0 if socket send buffer is full.
+     */
+    virtual size_t writeSome(const char *buf, size_t buflen);
+
     virtual size_t read(char *buf, size_t buflen);
     virtual std::string readAll();
 
+    /**
+     * Receives data which has already arrived without waiting.
+     * Throws SocketIOException on error.
+     * @return number of bytes received. 0 if there is no data or
+     * peer has closed the connection (see peerClosed()).
+     */
+    virtual size_t readSome(char *buf, size_t buflen);
+
+    /**
+     * @return true if readSome() has met the end of stream.
+     */
+    virtual bool peerClosed() const;
+
     virtual bool connected() const;
     virtual int descriptor() const;
 
@@ -83,6 +109,7 @@ private:
     bool connected_;
     unsigned int timeoutMs_;
     bool nonblocking_;
+    bool peerClosed_;
 
     CallbackFunction onCloseCallback_;
 };
@@ -0,0 +1,188 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <algorithm>
+#include <stdexcept>
+#include "timer_wheel.h"
+
+using namespace std;
+
+namespace nestor {
+namespace net {
+
+TimerWheelNode::TimerWheelNode()
+        : prev(nullptr), next(nullptr), expireTick(0) {
+}
+
+bool TimerWheelNode::scheduled() const {
+    return next != nullptr;
+}
+
+
+TimerWheel::TimerWheel(unsigned int tickMs, uint64_t nowMs, ExpireCallback callback)
+        : tickMs_(tickMs), currentTick_(0), nowMs_(nowMs), size_(0), callback_(callback) {
+    if (tickMs_ == 0)
+        throw invalid_argument("TimerWheel::TimerWheel: tickMs is 0");
+
+    currentTick_ = nowMs / tickMs_;
+    for (unsigned int level = 0; level < LEVELS; level++) {
+        for (unsigned int slot = 0; slot < SLOTS; slot++) {
+            slots_[level][slot].prev = &slots_[level][slot];
+            slots_[level][slot].next = &slots_[level][slot];
+        }
+    }
+}
+
+TimerWheel::~TimerWheel() {
+    /* Detaching nodes which are still scheduled, they may outlive the wheel */
+    for (unsigned int level = 0; level < LEVELS; level++) {
+        for (unsigned int slot = 0; slot < SLOTS; slot++) {
+            TimerWheelNode *head = &slots_[level][slot];
+            while (head->next != head)
+                unlink(head->next);
+            head->prev = head->next = nullptr;
+        }
+    }
+}
+
+void TimerWheel::schedule(TimerWheelNode *node, unsigned int timeoutMs) {
+    if (node->scheduled())
+        unlink(node);
+    else
+        size_++;
+
+    /* Current tick is rounded down from the wheel time, so the expiration
+     * is counted from the exact time. At least one tick, so the node never
+     * lands into the current slot. */
+    uint64_t expireTick = (nowMs_ + timeoutMs + tickMs_ - 1) / tickMs_;
+    node->expireTick = max(expireTick, currentTick_ + 1);
+    insert(node);
+}
+
+void TimerWheel::cancel(TimerWheelNode *node) {
+    if (!node->scheduled())
+        return;
+    unlink(node);
+    size_--;
+}
+
+void TimerWheel::advance(uint64_t nowMs) {
+    uint64_t targetTick = nowMs / tickMs_;
+    nowMs_ = max(nowMs_, nowMs);
+
+    while (currentTick_ < targetTick) {
+        if (size_ == 0) {
+            currentTick_ = targetTick;
+            break;
+        }
+
+        currentTick_++;
+        unsigned int slot = currentTick_ & (SLOTS - 1);
+        if (slot == 0)
+            cascade(1);
+
+        /* Moving expired nodes to the local list, so callback
+         * can freely schedule and cancel nodes. */
+        TimerWheelNode expired;
+        TimerWheelNode *head = &slots_[0][slot];
+        if (head->next == head)
+            continue;
+        expired.next = head->next;
+        expired.prev = head->prev;
+        expired.next->prev = &expired;
+        expired.prev->next = &expired;
+        head->next = head->prev = head;
+
+        while (expired.next != &expired) {
+            TimerWheelNode *node = expired.next;
+            unlink(node);
+            size_--;
+            if (callback_)
+                callback_(node);
+        }
+        expired.prev = expired.next = nullptr;
+    }
+}
+
+size_t TimerWheel::size() const {
+    return size_;
+}
+
+bool TimerWheel::empty() const {
+    return size_ == 0;
+}
+
+unsigned int TimerWheel::tickMs() const {
+    return tickMs_;
+}
+
+void TimerWheel::insert(TimerWheelNode *node) {
+    static const uint64_t maxDelta = (static_cast<uint64_t>(1) << (SLOT_BITS * LEVELS)) - 1;
+
+    uint64_t delta = node->expireTick - currentTick_;
+    if (delta > maxDelta) {
+        // Beyond the wheel range, clamping
+        delta = maxDelta;
+        node->expireTick = currentTick_ + delta;
+    }
+
+    unsigned int level = 0;
+    while (level < LEVELS - 1 && delta >= (static_cast<uint64_t>(1) << (SLOT_BITS * (level + 1))))
+        level++;
+
+    unsigned int slot = (node->expireTick >> (SLOT_BITS * level)) & (SLOTS - 1);
+    link(&slots_[level][slot], node);
+}
+
+/**
+ * Redistributes nodes of the current slot of the level to the
+ * lower levels. Called when all lower levels have made a full turn.
+ */
+void TimerWheel::cascade(unsigned int level) {
+    if (level >= LEVELS)
+        return;
+
+    unsigned int slot = (currentTick_ >> (SLOT_BITS * level)) & (SLOTS - 1);
+    if (slot == 0)
+        cascade(level + 1);
+
+    TimerWheelNode *head = &slots_[level][slot];
+    while (head->next != head) {
+        TimerWheelNode *node = head->next;
+        unlink(node);
+        insert(node);
+    }
+}
+
+void TimerWheel::link(TimerWheelNode *head, TimerWheelNode *node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimerWheel::unlink(TimerWheelNode *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+}
+
+} /* namespace net */
+} /* namespace nestor */
@@ -0,0 +1,114 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+namespace nestor {
+namespace net {
+
+/**
+ * Intrusive timer record. Embedded into the objects which need timeouts,
+ * so scheduling a timer never allocates memory. Node must be cancelled
+ * before destruction.
+ */
+struct TimerWheelNode {
+    TimerWheelNode();
+
+    bool scheduled() const;
+
+    TimerWheelNode *prev;
+    TimerWheelNode *next;
+    uint64_t expireTick;
+};
+
+/**
+ * Hierarchical timer wheel. Keeps any number of timers with tick
+ * precision. Scheduling, rescheduling and cancelling of a timer are O(1),
+ * expiration costs amortized O(1) per timer. Wheel doesn't measure time
+ * itself: owner calls advance() with current time, usually from a single
+ * periodic event loop timer.
+ */
+class TimerWheel {
+public:
+    typedef std::function<void(TimerWheelNode *)> ExpireCallback;
+
+    static const unsigned int LEVELS = 4;
+    static const unsigned int SLOT_BITS = 6;
+    static const unsigned int SLOTS = 1 << SLOT_BITS;
+
+    /**
+     * @param tickMs Wheel resolution. Timeouts are rounded up to it.
+     * @param nowMs Current time in milliseconds.
+     * @param callback Function called for every expired node.
+     */
+    TimerWheel(unsigned int tickMs, uint64_t nowMs, ExpireCallback callback);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    /**
+     * Schedules node to expire after timeoutMs from the current wheel
+     * time (time of the last advance() call). Expiration time is rounded
+     * up to the tick, so the node never expires early.
+     * Already scheduled node is moved to the new position.
+     * Timeouts longer than the wheel range (SLOTS^LEVELS ticks) are
+     * clamped to it.
+     */
+    void schedule(TimerWheelNode *node, unsigned int timeoutMs);
+    void cancel(TimerWheelNode *node);
+
+    /**
+     * Moves wheel time forward to nowMs and calls expire callback for
+     * every node which timeout has passed. Callback may schedule or
+     * cancel any node, including the expired one.
+     */
+    void advance(uint64_t nowMs);
+
+    size_t size() const;
+    bool empty() const;
+    unsigned int tickMs() const;
+
+private:
+    void insert(TimerWheelNode *node);
+    void cascade(unsigned int level);
+    static void link(TimerWheelNode *head, TimerWheelNode *node);
+    static void unlink(TimerWheelNode *node);
+
+private:
+    unsigned int tickMs_;
+    uint64_t currentTick_;
+    /* Time of the last advance() call, current tick is rounded down from it */
+    uint64_t nowMs_;
+    size_t size_;
+    ExpireCallback callback_;
+    /* Circular list heads */
+    TimerWheelNode slots_[LEVELS][SLOTS];
+};
+
+} /* namespace net */
+} /* namespace nestor */
+
+#endif /* TIMER_WHEEL_H_ */
@@ -0,0 +1,235 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+
+#include <ctime>
+#include <sstream>
+
+#include "utils/timestamp.h"
+#include "rss_xml_parser.h"
+#include "rss_feed_reader.h"
+
+using namespace std;
+using namespace nestor::utils;
+
+namespace nestor {
+namespace rss {
+
+const size_t RssFeedReader::CONVERT_BUFFER_SIZE;
+
+static void checkChannelField(bool present, const char *name)
+        throw (RssXmlParserException) {
+    if (!present) {
+        ostringstream oerr;
+        oerr << "Missing element \"" << name << "\" in parent \"" << RssXmlParser::CHANNEL_ITEM << "\"";
+        throw RssXmlParserException(oerr.str());
+    }
+}
+
+RssFeedReader::RssFeedReader(const std::string &charset)
+        throw (RssXmlParserException)
+        : sourceConverter_(nullptr), utf8Converter_(nullptr), pivotSource_(pivot_),
+          pivotTarget_(pivot_), convertStarted_(false), channel_(new RssChannel()),
+          hasTitle_(false), hasLink_(false), hasDescription_(false), itemTitle_(false),
+          itemLink_(false), itemText_(false), itemGuid_(false), itemPubDate_(false),
+          knownGuidLimit_(0), knownRun_(0), stopped_(false) {
+    if (charset.empty() || ucnv_compareNames(charset.c_str(), "utf-8") == 0)
+        return;
+
+    UErrorCode status = U_ZERO_ERROR;
+    sourceConverter_ = ucnv_open(charset.c_str(), &status);
+    if (U_SUCCESS(status))
+        utf8Converter_ = ucnv_open("utf-8", &status);
+    if (U_FAILURE(status)) {
+        ucnv_close(sourceConverter_);
+        ostringstream oerr;
+        oerr << "Unsupported charset \"" << charset << "\": " << u_errorName(status);
+        throw RssXmlParserException(oerr.str());
+    }
+}
+
+RssFeedReader::~RssFeedReader() {
+    ucnv_close(sourceConverter_);
+    ucnv_close(utf8Converter_);
+}
+
+void RssFeedReader::feed(const char *data, size_t length) throw (RssXmlParserException) {
+    if (stopped_)
+        return;
+    if (sourceConverter_ != nullptr)
+        convert(data, length, false);
+    else
+        parser_.feed(data, length);
+    parse();
+}
+
+RssChannel *RssFeedReader::finish() throw (RssXmlParserException) {
+    if (!stopped_) {
+        if (sourceConverter_ != nullptr)
+            convert("", 0, true);
+        parser_.finish();
+        parse();
+    }
+
+    // Required tags
+    checkChannelField(hasTitle_, RssXmlParser::TITLE_ITEM);
+    checkChannelField(hasLink_, RssXmlParser::LINK_ITEM);
+    checkChannelField(hasDescription_, RssXmlParser::DESCRIPTION_ITEM);
+
+    channel_->setOptional(optionalTags_);
+    return channel_.release();
+}
+
+unsigned int RssFeedReader::itemsCount() const {
+    return channel_ ? channel_->itemsCount() : 0;
+}
+
+void RssFeedReader::setKnownGuidLimit(unsigned int limit, KnownGuidFunction known) {
+    knownGuidLimit_ = known ? limit : 0;
+    known_ = known;
+}
+
+bool RssFeedReader::stopped() const {
+    return stopped_;
+}
+
+/**
+ * Converts the chunk to UTF-8 and feeds the result to the parser.
+ * Incomplete character at the end of the chunk waits in the converter.
+ */
+void RssFeedReader::convert(const char *data, size_t length, bool flush) {
+    char converted[CONVERT_BUFFER_SIZE];
+    const char *source = data;
+    const char *sourceLimit = data + length;
+    UErrorCode status;
+    do {
+        char *target = converted;
+        status = U_ZERO_ERROR;
+        ucnv_convertEx(utf8Converter_, sourceConverter_, &target, converted + sizeof(converted),
+                       &source, sourceLimit, pivot_, &pivotSource_, &pivotTarget_,
+                       pivot_ + CONVERT_BUFFER_SIZE, !convertStarted_, flush, &status);
+        convertStarted_ = true;
+        parser_.feed(converted, target - converted);
+    } while (status == U_BUFFER_OVERFLOW_ERROR);
+
+    if (U_FAILURE(status)) {
+        ostringstream oerr;
+        oerr << "Cannot convert feed to UTF-8: " << u_errorName(status);
+        throw RssXmlParserException(oerr.str());
+    }
+}
+
+/**
+ * Builds the channel from events of the data fed so far.
+ */
+void RssFeedReader::parse() {
+    RssStreamEvent event;
+    while (!stopped_ && (event = parser_.next()) != RssStreamEvent::END &&
+            event != RssStreamEvent::NEED_MORE) {
+        switch (event) {
+        case RssStreamEvent::CHANNEL_FIELD:
+            parseChannelField();
+            break;
+
+        case RssStreamEvent::ITEM_BEGIN:
+            item_.reset(new RssObject());
+            itemTitle_ = itemLink_ = itemText_ = itemGuid_ = itemPubDate_ = false;
+            break;
+
+        case RssStreamEvent::ITEM_FIELD:
+            parseItemField();
+            break;
+
+        case RssStreamEvent::ITEM_END:
+            completeItem();
+            break;
+
+        default:
+            break;
+        }
+    }
+}
+
+void RssFeedReader::parseChannelField() {
+    const string &name = parser_.name();
+    if (name == RssXmlParser::TITLE_ITEM) {
+        if (!hasTitle_)
+            channel_->setTitle(parser_.text());
+        hasTitle_ = true;
+    } else if (name == RssXmlParser::LINK_ITEM) {
+        if (!hasLink_)
+            channel_->setLink(parser_.text());
+        hasLink_ = true;
+    } else if (name == RssXmlParser::DESCRIPTION_ITEM) {
+        if (!hasDescription_)
+            channel_->setDescription(parser_.text());
+        hasDescription_ = true;
+    } else {
+        optionalTags_.insert(make_pair(name, parser_.text()));
+    }
+}
+
+void RssFeedReader::parseItemField() {
+    const string &name = parser_.name();
+    if (name == RssXmlParser::TITLE_ITEM && !itemTitle_) {
+        item_->setTitle(parser_.text());
+        itemTitle_ = true;
+    } else if (name == RssXmlParser::LINK_ITEM && !itemLink_) {
+        item_->setLink(parser_.text());
+        itemLink_ = true;
+    } else if (name == RssXmlParser::DESCRIPTION_ITEM && !itemText_) {
+        item_->setText(parser_.text());
+        itemText_ = true;
+    } else if (name == RssXmlParser::GUID_ITEM && !itemGuid_) {
+        item_->setGuid(parser_.text());
+        itemGuid_ = true;
+    } else if (name == RssXmlParser::PUB_DATE_ITEM && !itemPubDate_) {
+        item_->setPubDate(RFC822ToTimestamp(parser_.text()));
+        itemPubDate_ = true;
+    }
+}
+
+void RssFeedReader::completeItem() {
+    // items without required elements are skipped
+    if (!itemTitle_ || !itemLink_ || !itemText_) {
+        item_.reset();
+        return;
+    }
+    if (!itemGuid_)
+        item_->setGuid(item_->link());  // use link as default
+    if (!itemPubDate_) {
+        // setting current time
+        // Feeds are parsed by several threads
+        time_t now = time(nullptr);
+        tm tmnow;
+        localtime_r(&now, &tmnow);
+        item_->setGeneratedPubDate(tmnow);
+    }
+
+    if (knownGuidLimit_ > 0) {
+        knownRun_ = known_(item_->guid()) ? knownRun_ + 1 : 0;
+        if (knownRun_ >= knownGuidLimit_ && hasTitle_ && hasLink_ && hasDescription_)
+            stopped_ = true;
+    }
+    channel_->addItem(item_.release());
+}
+
+} /* namespace rss */
+} /* namespace nestor */
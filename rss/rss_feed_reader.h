@@ -0,0 +1,131 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef RSS_FEED_READER_H_
+#define RSS_FEED_READER_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unicode/ucnv.h>
+#include "rss_channel.h"
+#include "rss_stream_parser.h"
+
+namespace nestor {
+namespace rss {
+
+/**
+ * Resumable parse of one feed: chunks are fed as they are received and
+ * the channel with its items is built from RssStreamParser events right
+ * away, so the items are ready as soon as the last chunk is fed. Data in
+ * other charset than UTF-8 is converted with ICU chunk by chunk, a
+ * character split between chunks is completed by the next one.
+ */
+class RssFeedReader {
+public:
+    /** Size of the buffer for data converted to UTF-8 */
+    static const size_t CONVERT_BUFFER_SIZE = 4096;
+
+    /** Tells if item with the GUID is already stored */
+    typedef std::function<bool(const std::string &guid)> KnownGuidFunction;
+
+    /**
+     * @param charset Charset of the fed data, empty means UTF-8.
+     * Throws RssXmlParserException if the charset is not supported.
+     */
+    explicit RssFeedReader(const std::string &charset = "")
+            throw (RssXmlParserException);
+    virtual ~RssFeedReader();
+
+    /**
+     * Parses the chunk of the document.
+     * Throws RssXmlParserException if the document is not a valid feed.
+     */
+    void feed(const char *data, size_t length) throw (RssXmlParserException);
+
+    /**
+     * Completes the document. Items without title, link or description
+     * are skipped.
+     * Throws RssXmlParserException if the document is incomplete or the
+     * channel misses required elements.
+     * @return channel with items, caller owns it.
+     */
+    RssChannel *finish() throw (RssXmlParserException);
+
+    /** Number of items parsed so far */
+    unsigned int itemsCount() const;
+
+    /**
+     * Makes the reader stop after the given number of consecutive items
+     * with known GUIDs and ignore the rest of the document. Feeds are
+     * usually ordered newest first, so the rest are older items stored
+     * already. Known items before the stop are kept, they may be changed.
+     * Parsing doesn't stop before the required channel elements are seen.
+     * @param limit Number of known items, 0 parses the whole document.
+     */
+    void setKnownGuidLimit(unsigned int limit, KnownGuidFunction known);
+
+    /** True if parsing was stopped by known items */
+    bool stopped() const;
+
+private:
+    void convert(const char *data, size_t length, bool flush);
+    void parse();
+    void parseChannelField();
+    void parseItemField();
+    void completeItem();
+
+private:
+    RssStreamParser parser_;
+
+    /** Converters from the feed charset to UTF-8, nullptr for UTF-8 feeds */
+    UConverter *sourceConverter_;
+    UConverter *utf8Converter_;
+    /** ICU keeps the state of conversion in the pivot buffer between chunks */
+    UChar pivot_[CONVERT_BUFFER_SIZE];
+    UChar *pivotSource_;
+    UChar *pivotTarget_;
+    bool convertStarted_;
+
+    std::unique_ptr<RssChannel> channel_;
+    bool hasTitle_;
+    bool hasLink_;
+    bool hasDescription_;
+    std::map<std::string, std::string> optionalTags_;
+
+    /** Item being parsed and its fields seen so far, the first occurrence wins */
+    std::unique_ptr<RssObject> item_;
+    bool itemTitle_;
+    bool itemLink_;
+    bool itemText_;
+    bool itemGuid_;
+    bool itemPubDate_;
+
+    unsigned int knownGuidLimit_;
+    KnownGuidFunction known_;
+    /** Consecutive known items parsed last */
+    unsigned int knownRun_;
+    bool stopped_;
+};
+
+} /* namespace rss */
+} /* namespace nestor */
+#endif /* RSS_FEED_READER_H_ */
@@ -29,7 +29,7 @@ namespace nestor {
 namespace rss {
 
 RssObject::RssObject() :
-    title_(""), text_(""), link_(""), guid_("") {
+    title_(""), text_(""), link_(""), guid_(""), hasPubDate_(false) {
     memset(&pubDate_, 0, sizeof(tm));
 }
 
@@ -74,6 +74,16 @@ const std::tm& RssObject::pubDate() const {
 
 void RssObject::setPubDate(const std::tm& pubDate) {
     pubDate_ = pubDate;
+    hasPubDate_ = true;
+}
+
+void RssObject::setGeneratedPubDate(const std::tm& pubDate) {
+    pubDate_ = pubDate;
+    hasPubDate_ = false;
+}
+
+bool RssObject::hasPubDate() const {
+    return hasPubDate_;
 }
 
 
@@ -41,6 +41,14 @@ public:
     void setGuid(const std::string& guid);
     const std::tm& pubDate() const;
     void setPubDate(const std::tm& pubDate);
+    /**
+     * Sets date of item without pubDate element, e.g. time it was read.
+     */
+    void setGeneratedPubDate(const std::tm& pubDate);
+    /**
+     * False if pubDate() is generated rather than taken from the feed.
+     */
+    bool hasPubDate() const;
 
 private:
     std::string title_;
@@ -48,6 +56,7 @@ private:
     std::string link_;
     std::string guid_;
     std::tm pubDate_;
+    bool hasPubDate_;
 };
 
 } /* namespace rss */
@@ -0,0 +1,449 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "rss_stream_parser.h"
+
+using namespace std;
+
+namespace nestor {
+namespace rss {
+
+/* Depth of elements in <rss><channel><item><field> */
+static const size_t ROOT_DEPTH = 1;
+static const size_t CHANNEL_DEPTH = 2;
+static const size_t CHANNEL_FIELD_DEPTH = 3;
+static const size_t ITEM_FIELD_DEPTH = 4;
+
+static const char CDATA_BEGIN[] = "<![CDATA[";
+static const char COMMENT_BEGIN[] = "<!--";
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static void appendUtf8(string &out, unsigned long code) {
+    if (code < 0x80) {
+        out.push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+/*
+ * Decodes entity between '&' and ';'.
+ * Returns false if the entity is unknown.
+ */
+static bool decodeEntity(const char *begin, const char *end, string &out) {
+    size_t length = end - begin;
+    if (length >= 2 && begin[0] == '#') {
+        char *parsedEnd;
+        unsigned long code;
+        if (begin[1] == 'x' || begin[1] == 'X')
+            code = strtoul(begin + 2, &parsedEnd, 16);
+        else
+            code = strtoul(begin + 1, &parsedEnd, 10);
+        if (parsedEnd != end || code == 0 || code > 0x10FFFF)
+            return false;
+        appendUtf8(out, code);
+        return true;
+    }
+
+    static const struct {
+        const char *name;
+        char value;
+    } entities[] = { {"lt", '<'}, {"gt", '>'}, {"amp", '&'}, {"quot", '"'}, {"apos", '\''} };
+
+    for (auto &entity : entities) {
+        if (strlen(entity.name) == length && memcmp(entity.name, begin, length) == 0) {
+            out.push_back(entity.value);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Finds attribute value in the start tag between the element name and '>'.
+ */
+static bool findAttribute(const char *begin, const char *end, const char *name, string &value) {
+    size_t nameLength = strlen(name);
+    const char *p = begin;
+    while (p < end) {
+        while (p < end && (isSpace(*p) || *p == '/'))
+            p++;
+        const char *attrBegin = p;
+        while (p < end && *p != '=' && !isSpace(*p))
+            p++;
+        const char *attrEnd = p;
+        while (p < end && (isSpace(*p) || *p == '='))
+            p++;
+        if (p == end || (*p != '"' && *p != '\''))
+            return false;
+        char quote = *p++;
+        const char *valueBegin = p;
+        while (p < end && *p != quote)
+            p++;
+        if (p == end)
+            return false;
+        if (static_cast<size_t>(attrEnd - attrBegin) == nameLength &&
+                memcmp(attrBegin, name, nameLength) == 0) {
+            value.assign(valueBegin, p);
+            return true;
+        }
+        p++;
+    }
+    return false;
+}
+
+RssStreamParser::RssStreamParser()
+        : pos_(0), scanned_(0), finished_(false), depth_(0), version_(0.0), inChannel_(false),
+          channelSeen_(false), inItem_(false), pendingItemEnd_(false), done_(false),
+          fieldDepth_(0) {
+}
+
+void RssStreamParser::feed(const char *data, size_t length) {
+    buffer_.append(data, length);
+}
+
+void RssStreamParser::finish() {
+    finished_ = true;
+}
+
+RssStreamEvent RssStreamParser::next() throw (RssXmlParserException) {
+    if (pendingItemEnd_) {
+        pendingItemEnd_ = false;
+        inItem_ = false;
+        return RssStreamEvent::ITEM_END;
+    }
+
+    while (!done_) {
+        if (pos_ == buffer_.size()) {
+            if (finished_)
+                fail("Unexpected end of document");
+            consume(pos_);
+            return RssStreamEvent::NEED_MORE;
+        }
+
+        if (buffer_[pos_] == '<') {
+            RssStreamEvent event;
+            if (!nextMarkup(event))
+                continue;
+            if (event == RssStreamEvent::NEED_MORE) {
+                if (finished_)
+                    fail("Unexpected end of document");
+                consume(pos_);
+            }
+            return event;
+        }
+
+        /* Character data up to the next markup */
+        size_t end = buffer_.find('<', pos_);
+        bool partial = (end == string::npos);
+        if (partial) {
+            end = buffer_.size();
+            /* Entity may continue in the next chunk */
+            size_t amp = buffer_.rfind('&');
+            if (!finished_ && amp != string::npos && amp >= pos_ &&
+                    buffer_.find(';', amp) == string::npos)
+                end = amp;
+        }
+        if (fieldDepth_ != 0)
+            appendText(buffer_.data() + pos_, buffer_.data() + end);
+        pos_ = end;
+        if (partial && !finished_) {
+            consume(pos_);
+            return RssStreamEvent::NEED_MORE;
+        }
+    }
+    return RssStreamEvent::END;
+}
+
+const std::string &RssStreamParser::name() const {
+    return name_;
+}
+
+const std::string &RssStreamParser::text() const {
+    return text_;
+}
+
+double RssStreamParser::version() const {
+    return version_;
+}
+
+size_t RssStreamParser::buffered() const {
+    return buffer_.size() - pos_;
+}
+
+/*
+ * Parses markup at the current position. Returns true if it produced
+ * an event, NEED_MORE if the markup is not complete yet.
+ */
+bool RssStreamParser::nextMarkup(RssStreamEvent &event) {
+    size_t avail = buffer_.size() - pos_;
+    size_t end;
+
+    if (avail < 2) {
+        event = RssStreamEvent::NEED_MORE;
+        return true;
+    }
+
+    switch (buffer_[pos_ + 1]) {
+    case '?':
+        end = findTerminator("?>", 2);
+        if (end == string::npos)
+            break;
+        pos_ = end + 2;
+        return false;
+
+    case '/':
+        end = buffer_.find('>', pos_ + 2);
+        if (end == string::npos)
+            break;
+        return endElement(pos_ + 2, end, event);
+
+    case '!': {
+        size_t cdataLength = sizeof(CDATA_BEGIN) - 1;
+        size_t commentLength = sizeof(COMMENT_BEGIN) - 1;
+        size_t cdataCompare = min(avail, cdataLength);
+        size_t commentCompare = min(avail, commentLength);
+
+        if (buffer_.compare(pos_, cdataCompare, CDATA_BEGIN, cdataCompare) == 0) {
+            if (avail < cdataLength)
+                break;
+            end = findTerminator("]]>", cdataLength);
+            if (end == string::npos)
+                break;
+            if (fieldDepth_ != 0)
+                text_.append(buffer_, pos_ + cdataLength, end - pos_ - cdataLength);
+            pos_ = end + 3;
+            return false;
+        }
+
+        if (buffer_.compare(pos_, commentCompare, COMMENT_BEGIN, commentCompare) == 0) {
+            if (avail < commentLength)
+                break;
+            end = findTerminator("-->", commentLength);
+            if (end == string::npos)
+                break;
+            pos_ = end + 3;
+            return false;
+        }
+
+        /* DOCTYPE, possibly with internal subset */
+        end = buffer_.find('>', pos_ + 2);
+        if (end == string::npos)
+            break;
+        size_t subset = buffer_.find('[', pos_ + 2);
+        if (subset != string::npos && subset < end) {
+            end = buffer_.find(']', subset);
+            if (end != string::npos)
+                end = buffer_.find('>', end);
+            if (end == string::npos)
+                break;
+        }
+        pos_ = end + 1;
+        return false;
+    }
+
+    default:
+        /* Start tag, '>' may be inside of attribute value */
+        for (end = pos_ + 1; end < buffer_.size(); end++) {
+            char c = buffer_[end];
+            if (c == '>')
+                break;
+            if (c == '"' || c == '\'') {
+                end = buffer_.find(c, end + 1);
+                if (end == string::npos)
+                    break;
+            }
+        }
+        if (end == string::npos || end == buffer_.size())
+            break;
+        return startElement(pos_ + 1, end, event);
+    }
+
+    event = RssStreamEvent::NEED_MORE;
+    return true;
+}
+
+/*
+ * Finds terminator of the markup at the current position, starting at
+ * offset from it. Search of markup split between chunks continues where
+ * the previous one stopped, so long CDATA sections are scanned once.
+ */
+size_t RssStreamParser::findTerminator(const char *terminator, size_t offset) {
+    size_t length = strlen(terminator);
+    size_t end = buffer_.find(terminator, pos_ + max(offset, scanned_));
+    if (end != string::npos) {
+        scanned_ = 0;
+        return end;
+    }
+    /* Terminator may start in the last bytes and end in the next chunk */
+    size_t available = buffer_.size() - pos_;
+    if (available >= length)
+        scanned_ = max(scanned_, available - length + 1);
+    return string::npos;
+}
+
+bool RssStreamParser::startElement(size_t begin, size_t end, RssStreamEvent &event) {
+    bool empty = (buffer_[end - 1] == '/');
+    size_t nameEnd = begin;
+    while (nameEnd < end && !isSpace(buffer_[nameEnd]) && buffer_[nameEnd] != '/')
+        nameEnd++;
+    if (nameEnd == begin)
+        fail("Element without name");
+
+    if (depth_ == elements_.size())
+        elements_.emplace_back();
+    string &name = elements_[depth_];
+    name.assign(buffer_, begin, nameEnd - begin);
+    depth_++;
+
+    bool produced = false;
+    if (depth_ == ROOT_DEPTH) {
+        if (name != RssXmlParser::ROOT_RSS_ITEM)
+            fail("Missing root \"rss\" element");
+        string version;
+        if (findAttribute(buffer_.data() + nameEnd, buffer_.data() + end,
+                          RssXmlParser::RSS_VERSION_ATTR, version))
+            version_ = strtod(version.c_str(), nullptr);
+        if (version_ < 2.0) {
+            ostringstream oss_err;
+            oss_err << "Unsupported RSS version " << version_;
+            fail(oss_err.str());
+        }
+    } else if (depth_ == CHANNEL_DEPTH) {
+        if (!channelSeen_ && name == RssXmlParser::CHANNEL_ITEM) {
+            inChannel_ = true;
+            channelSeen_ = true;
+        }
+    } else if (inChannel_ && fieldDepth_ == 0) {
+        if (depth_ == CHANNEL_FIELD_DEPTH && name == RssXmlParser::ITEM_TAG) {
+            inItem_ = true;
+            event = RssStreamEvent::ITEM_BEGIN;
+            produced = true;
+        } else if (depth_ == CHANNEL_FIELD_DEPTH || (depth_ == ITEM_FIELD_DEPTH && inItem_)) {
+            fieldDepth_ = depth_;
+            name_ = name;
+            text_.clear();
+        }
+    }
+
+    pos_ = end + 1;
+    if (empty) {
+        if (produced) {
+            /* <item/> */
+            depth_--;
+            pendingItemEnd_ = true;
+        } else {
+            produced = closeElement(event);
+        }
+    }
+    return produced;
+}
+
+bool RssStreamParser::endElement(size_t begin, size_t end, RssStreamEvent &event) {
+    size_t nameEnd = begin;
+    while (nameEnd < end && !isSpace(buffer_[nameEnd]))
+        nameEnd++;
+    if (depth_ == 0 || elements_[depth_ - 1].compare(0, string::npos,
+            buffer_, begin, nameEnd - begin) != 0) {
+        ostringstream oss_err;
+        oss_err << "Mismatched end tag \"" << buffer_.substr(begin, nameEnd - begin) << "\"";
+        fail(oss_err.str());
+    }
+    pos_ = end + 1;
+    return closeElement(event);
+}
+
+bool RssStreamParser::closeElement(RssStreamEvent &event) {
+    size_t depth = depth_--;
+    if (depth == fieldDepth_) {
+        fieldDepth_ = 0;
+        event = inItem_ ? RssStreamEvent::ITEM_FIELD : RssStreamEvent::CHANNEL_FIELD;
+        return true;
+    }
+    if (fieldDepth_ != 0)
+        return false; // element nested into field
+
+    if (depth == CHANNEL_FIELD_DEPTH && inItem_) {
+        inItem_ = false;
+        event = RssStreamEvent::ITEM_END;
+        return true;
+    }
+    if (depth == CHANNEL_DEPTH && inChannel_) {
+        inChannel_ = false;
+        return false;
+    }
+    if (depth == ROOT_DEPTH) {
+        if (!channelSeen_)
+            fail("Missing element \"channel\" in parent \"rss\"");
+        done_ = true;
+        event = RssStreamEvent::END;
+        return true;
+    }
+    return false;
+}
+
+void RssStreamParser::appendText(const char *begin, const char *end) {
+    while (begin < end) {
+        const char *amp = static_cast<const char *>(memchr(begin, '&', end - begin));
+        if (amp == nullptr) {
+            text_.append(begin, end);
+            return;
+        }
+        text_.append(begin, amp);
+        const char *semicolon = static_cast<const char *>(memchr(amp, ';', end - amp));
+        if (semicolon == nullptr || !decodeEntity(amp + 1, semicolon, text_)) {
+            text_.push_back('&');
+            begin = amp + 1;
+            continue;
+        }
+        begin = semicolon + 1;
+    }
+}
+
+/* Drops parsed data, so only the unparsed tail stays buffered */
+void RssStreamParser::consume(size_t pos) {
+    buffer_.erase(0, pos);
+    pos_ -= pos;
+}
+
+void RssStreamParser::fail(const std::string &message) {
+    throw RssXmlParserException(message);
+}
+
+} /* namespace rss */
+} /* namespace nestor */
@@ -0,0 +1,118 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef RSS_STREAM_PARSER_H_
+#define RSS_STREAM_PARSER_H_
+
+#include <string>
+#include <vector>
+#include "rss_xml_parser.h"
+
+namespace nestor {
+namespace rss {
+
+enum class RssStreamEvent {
+    CHANNEL_FIELD, // child element of <channel> other than <item>
+    ITEM_BEGIN,    // <item> is opened
+    ITEM_FIELD,    // child element of <item>
+    ITEM_END,      // <item> is closed
+    NEED_MORE,     // buffered data is exhausted, feed more
+    END            // document is completed
+};
+
+/**
+ * Streaming pull parser of RSS 2.0 documents. Data is fed in chunks of
+ * any size and next() reports channel and item fields as soon as their
+ * closing tags are seen. No document tree is built: the parser keeps only
+ * the unparsed tail of the fed data, the names of the open elements and
+ * the text of the current field, so memory doesn't depend on the number
+ * of items in the feed.
+ *
+ * Elements nested into a field are skipped, their character data is
+ * appended to the field text. Entities and CDATA sections are decoded.
+ */
+class RssStreamParser {
+public:
+    RssStreamParser();
+
+    /** Appends data to the parsed document. */
+    void feed(const char *data, size_t length);
+
+    /** Marks the end of the document, no data will be fed after it. */
+    void finish();
+
+    /**
+     * Parses buffered data until the next event.
+     * Throws RssXmlParserException if the document is malformed or is not
+     * RSS 2.0.
+     * @return NEED_MORE if the buffered data is exhausted before finish(),
+     * END once the root element is closed.
+     */
+    RssStreamEvent next() throw (RssXmlParserException);
+
+    /** Element name of the last CHANNEL_FIELD or ITEM_FIELD event */
+    const std::string &name() const;
+
+    /** Decoded text of the last CHANNEL_FIELD or ITEM_FIELD event */
+    const std::string &text() const;
+
+    /** Value of the "version" attribute of <rss> */
+    double version() const;
+
+    /** Bytes fed but not parsed yet */
+    size_t buffered() const;
+
+private:
+    bool nextMarkup(RssStreamEvent &event);
+    size_t findTerminator(const char *terminator, size_t offset);
+    bool startElement(size_t begin, size_t end, RssStreamEvent &event);
+    bool endElement(size_t begin, size_t end, RssStreamEvent &event);
+    bool closeElement(RssStreamEvent &event);
+    void appendText(const char *begin, const char *end);
+    void consume(size_t pos);
+    [[noreturn]] void fail(const std::string &message);
+
+private:
+    std::string buffer_;
+    size_t pos_;
+    /** Bytes after pos_ already searched for the end of incomplete markup */
+    size_t scanned_;
+    bool finished_;
+
+    /** Names of the open elements, strings are reused between elements */
+    std::vector<std::string> elements_;
+    size_t depth_;
+
+    double version_;
+    bool inChannel_;
+    bool channelSeen_;
+    bool inItem_;
+    bool pendingItemEnd_;
+    bool done_;
+
+    /** Depth of the captured field element or 0 */
+    size_t fieldDepth_;
+    std::string name_;
+    std::string text_;
+};
+
+} /* namespace rss */
+} /* namespace nestor */
+#endif /* RSS_STREAM_PARSER_H_ */
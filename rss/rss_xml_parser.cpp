@@ -19,21 +19,12 @@
  *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
  */
 
-#include <tinyxml2.h>
-#include <iostream>
-#include <sstream>
-#include <unordered_set>
-#include <map>
+#include <cstring>
 
-#include "utils/string.h"
-#include "utils/timestamp.h"
 #include "rss_xml_parser.h"
-#include "common/logger.h"
+#include "rss_feed_reader.h"
 
 using namespace std;
-using namespace icu;
-using namespace tinyxml2;
-using namespace nestor::utils;
 
 namespace nestor {
 namespace rss {
@@ -48,126 +39,11 @@ const char *RssXmlParser::ITEM_TAG = "item";
 const char *RssXmlParser::GUID_ITEM = "guid";
 const char *RssXmlParser::PUB_DATE_ITEM = "pubDate";
 
-static XMLElement *getExpectedElement(XMLElement *parent, const char *name)
-        throw (RssXmlParserException) {
-    XMLElement *result = parent->FirstChildElement(name);
-    if (result == nullptr) {
-        ostringstream oerr;
-        oerr << "Missing element \"" << name << "\" in parent \"" << parent->Name() << "\"";
-        throw RssXmlParserException(oerr.str());
-    }
-    return result;
-}
-
-
-static vector<RssObject *> *parseItems(XMLElement *channel) {
-    vector<RssObject *> *items = new vector<RssObject *>();
-    XMLElement *rssItem = channel->FirstChildElement(RssXmlParser::ITEM_TAG);
-    while (rssItem != nullptr) {
-        RssObject *obj = new RssObject();
-
-        try {
-            obj->setTitle(getExpectedElement(rssItem, RssXmlParser::TITLE_ITEM)->GetText());
-            obj->setLink(getExpectedElement(rssItem, RssXmlParser::LINK_ITEM)->GetText());
-            obj->setText(getExpectedElement(rssItem, RssXmlParser::DESCRIPTION_ITEM)->GetText());
-
-            XMLElement *guid = rssItem->FirstChildElement(RssXmlParser::GUID_ITEM);
-            if (guid != nullptr)
-                obj->setGuid(guid->GetText());
-            else
-                obj->setGuid(obj->link());  // use link as default
-
-            XMLElement *pubDate = rssItem->FirstChildElement(RssXmlParser::PUB_DATE_ITEM);
-            if (pubDate != nullptr) {
-                obj->setPubDate(RFC822ToTimestamp(pubDate->GetText()));
-            } else {
-                // setting current time
-                time_t now = time(nullptr);
-                tm *tmnow = localtime(&now);
-                obj->setPubDate(*tmnow);
-            }
-        } catch (RssXmlParserException &e) {
-            delete obj;
-            rssItem = rssItem->NextSiblingElement(RssXmlParser::ITEM_TAG);
-            continue;
-        }
-
-        items->push_back(obj);
-        rssItem = rssItem->NextSiblingElement(RssXmlParser::ITEM_TAG);
-    }
-    return items;
-}
-
-
 RssChannel *RssXmlParser::parseRss(const char *rss)
         throw (RssXmlParserException) {
-    ostringstream oss_err;
-    XMLElement *root, *channel, *tmp;
-    XMLDocument doc;
-    RssChannel *rssChannel = nullptr;
-    double rssVersion;
-
-    doc.Parse(rss);
-
-    root = doc.RootElement();
-    if (strcmp(root->Name(), ROOT_RSS_ITEM) != 0)
-        throw RssXmlParserException("Missing root \"rss\" element");
-
-    rssVersion = root->DoubleAttribute(RSS_VERSION_ATTR);
-
-    if (rssVersion < 2.0) {
-        oss_err << "Unsupported RSS version " << rssVersion;
-        throw RssXmlParserException(oss_err.str());
-    }
-
-    channel = getExpectedElement(root, CHANNEL_ITEM);
-
-
-    rssChannel = new RssChannel();
-
-    // Parsing RSS <channel> tag
-    // Required tags
-    try {
-        rssChannel->setTitle(getExpectedElement(channel, TITLE_ITEM)->GetText());
-        rssChannel->setLink(getExpectedElement(channel, LINK_ITEM)->GetText());
-        rssChannel->setDescription(getExpectedElement(channel, DESCRIPTION_ITEM)->GetText());
-
-    } catch (RssXmlParserException &e) {
-        delete rssChannel;
-        throw;
-    }
-
-    // Optional tags
-    unordered_set<string> alreadyParsed = {TITLE_ITEM, LINK_ITEM, DESCRIPTION_ITEM,
-            ITEM_TAG /* will parse "item" later*/ };
-    map<string, string> optionalTags;
-
-    tmp = channel->FirstChildElement();
-    do {
-        string name;
-        if (tmp->Name())
-            name.assign(tmp->Name());
-        if (alreadyParsed.count(name)) {
-            tmp = tmp->NextSiblingElement();
-            continue;
-        }
-
-        string txt;
-        if (tmp->GetText())
-            txt.assign(tmp->GetText());
-        optionalTags.insert(make_pair(name, txt));
-        tmp = tmp->NextSiblingElement();
-    } while(tmp != nullptr);
-    cout << "here" << endl;
-    rssChannel->setOptional(optionalTags);
-
-    auto items = parseItems(channel);
-    for (auto i : *items)
-        rssChannel->addItem(i);
-
-    delete items;
-
-    return rssChannel;
+    RssFeedReader reader;
+    reader.feed(rss, strlen(rss));
+    return reader.finish();
 }
 
 } /* namespace rss */
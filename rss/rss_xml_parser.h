@@ -49,6 +49,11 @@ public:
     static const char *GUID_ITEM;
     static const char *PUB_DATE_ITEM;
 public:
+    /**
+     * Parses complete RSS 2.0 document with RssFeedReader. Items without
+     * title, link or description are skipped.
+     * @return channel with items, caller owns it.
+     */
     static RssChannel *parseRss(const char *rss)
             throw (RssXmlParserException);
 };
@@ -0,0 +1,63 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <algorithm>
+#include <functional>
+#include "channels_update_queue.h"
+
+using namespace std;
+
+namespace nestor {
+namespace service {
+
+void ChannelsUpdateQueue::push(int64_t channelId, time_t dueTime) {
+    heap_.push_back(Entry{dueTime, channelId});
+    push_heap(heap_.begin(), heap_.end(), greater<Entry>());
+}
+
+size_t ChannelsUpdateQueue::popDue(time_t now, size_t maxCount, vector<int64_t> &out) {
+    size_t count = 0;
+    while (count < maxCount && !heap_.empty() && heap_.front().dueTime <= now) {
+        pop_heap(heap_.begin(), heap_.end(), greater<Entry>());
+        out.push_back(heap_.back().channelId);
+        heap_.pop_back();
+        count++;
+    }
+    return count;
+}
+
+time_t ChannelsUpdateQueue::nextDue() const {
+    return heap_.front().dueTime;
+}
+
+bool ChannelsUpdateQueue::empty() const {
+    return heap_.empty();
+}
+
+size_t ChannelsUpdateQueue::size() const {
+    return heap_.size();
+}
+
+void ChannelsUpdateQueue::clear() {
+    heap_.clear();
+}
+
+} /* namespace service */
+} /* namespace nestor */
@@ -0,0 +1,71 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef CHANNELS_UPDATE_QUEUE_H_
+#define CHANNELS_UPDATE_QUEUE_H_
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+namespace nestor {
+namespace service {
+
+/**
+ * Min-heap of channels ordered by the time of their next update.
+ */
+class ChannelsUpdateQueue {
+public:
+    void push(int64_t channelId, std::time_t dueTime);
+
+    /**
+     * Moves channels due at the moment now, earliest first, into out.
+     * @param maxCount Maximum number of channels to move.
+     * @return Number of moved channels.
+     */
+    size_t popDue(std::time_t now, size_t maxCount, std::vector<int64_t> &out);
+
+    /**
+     * Time of the earliest update. Queue must not be empty.
+     */
+    std::time_t nextDue() const;
+
+    bool empty() const;
+    size_t size() const;
+    void clear();
+
+private:
+    struct Entry {
+        std::time_t dueTime;
+        int64_t channelId;
+
+        bool operator>(const Entry &other) const {
+            return dueTime > other.dueTime;
+        }
+    };
+
+    std::vector<Entry> heap_;
+};
+
+} /* namespace service */
+} /* namespace nestor */
+
+#endif /* CHANNELS_UPDATE_QUEUE_H_ */
@@ -0,0 +1,223 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <algorithm>
+#include <chrono>
+#include "common/logger.h"
+#include "net/http_async_client.h"
+#include "sqlite_provider.h"
+#include "channels_update_worker.h"
+#include "channels_update_scheduler.h"
+
+using namespace std;
+
+namespace nestor {
+namespace service {
+
+/* ============ ChannelsUpdateScheduler BEGIN ============ */
+const size_t ChannelsUpdateScheduler::DEFAULT_BATCH_SIZE;
+const int ChannelsUpdateScheduler::DEFAULT_JITTER_PERCENT;
+const int ChannelsUpdateScheduler::CHANNELS_RELOAD_INTERVAL_SEC;
+const int ChannelsUpdateScheduler::MIN_UPDATE_INTERVAL_SEC;
+
+ChannelsUpdateScheduler::ChannelsUpdateScheduler(SqliteConnection *connection)
+        : connection_(connection), dataProvider_(nullptr), worker_(nullptr),
+          nextReload_(0), batchSize_(DEFAULT_BATCH_SIZE),
+          jitterPercent_(DEFAULT_JITTER_PERCENT),
+          maxTransfers_(net::HttpAsyncClient::DEFAULT_MAX_TRANSFERS),
+          maxHostTransfers_(net::HttpAsyncClient::DEFAULT_MAX_HOST_TRANSFERS),
+          incrementalParse_(true), parseThreads_(0),
+          commitBatchSize_(WriteBehindQueue::DEFAULT_MAX_BATCH_SIZE),
+          commitDelayMs_(WriteBehindQueue::DEFAULT_MAX_DELAY_MS),
+          random_(random_device()()),
+          updatesCount_(0), running_(false) {
+    if (connection_ == nullptr)
+        throw invalid_argument("ChannelsUpdateScheduler::ChannelsUpdateScheduler: connection is nullptr");
+}
+
+ChannelsUpdateScheduler::~ChannelsUpdateScheduler() {
+    stop();
+    join();
+}
+
+void ChannelsUpdateScheduler::start() {
+    running_ = true;
+    thread_ = thread(&ChannelsUpdateScheduler::run, this);
+}
+
+void ChannelsUpdateScheduler::stop() {
+    if (running_.exchange(false)) {
+        lock_guard<mutex> locker(lock_);
+        wakeUp_.notify_all();
+    }
+}
+
+void ChannelsUpdateScheduler::join() {
+    if (thread_.joinable())
+        thread_.join();
+}
+
+size_t ChannelsUpdateScheduler::batchSize() const {
+    return batchSize_;
+}
+
+void ChannelsUpdateScheduler::setBatchSize(size_t batchSize) {
+    batchSize_ = batchSize > 0 ? batchSize : 1;
+}
+
+int ChannelsUpdateScheduler::jitterPercent() const {
+    return jitterPercent_;
+}
+
+void ChannelsUpdateScheduler::setJitterPercent(int jitterPercent) {
+    jitterPercent_ = max(0, min(jitterPercent, 100));
+}
+
+void ChannelsUpdateScheduler::setFetchLimits(size_t maxTransfers, size_t maxHostTransfers) {
+    maxTransfers_ = maxTransfers;
+    maxHostTransfers_ = maxHostTransfers;
+}
+
+void ChannelsUpdateScheduler::setIncrementalParse(bool incrementalParse) {
+    incrementalParse_ = incrementalParse;
+}
+
+void ChannelsUpdateScheduler::setParseThreads(size_t parseThreads) {
+    parseThreads_ = parseThreads;
+}
+
+void ChannelsUpdateScheduler::setCommitLimits(size_t maxBatchSize, unsigned int maxDelayMs) {
+    commitBatchSize_ = maxBatchSize;
+    commitDelayMs_ = maxDelayMs;
+}
+
+void ChannelsUpdateScheduler::run() {
+    SERVICE_LOG("ChannelsUpdateScheduler::run: scheduler started");
+    dataProvider_ = new SqliteProvider(connection_);
+    worker_ = new ChannelsUpdateWorker(connection_);
+    worker_->setFetchLimits(maxTransfers_, maxHostTransfers_);
+    worker_->setIncrementalParse(incrementalParse_);
+    worker_->setParseThreads(parseThreads_);
+    worker_->setCommitLimits(commitBatchSize_, commitDelayMs_);
+
+    vector<int64_t> batch;
+    while (running_) {
+        time_t now = time(nullptr);
+        if (now >= nextReload_) {
+            reloadChannels(now);
+            nextReload_ = now + CHANNELS_RELOAD_INTERVAL_SEC;
+        }
+
+        batch.clear();
+        queue_.popDue(now, batchSize_, batch);
+        // Removed channels are dropped when they become due
+        batch.erase(remove_if(batch.begin(), batch.end(), [this](int64_t id) {
+            return intervals_.find(id) == intervals_.end();
+        }), batch.end());
+
+        if (!batch.empty()) {
+            SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateScheduler::run: updating "
+                            << batch.size() << " channels, " << queue_.size()
+                            << " are waiting");
+            worker_->update(batch);
+            updatesCount_ += batch.size();
+
+            now = time(nullptr);
+            for (int64_t id : batch)
+                queue_.push(id, nextUpdateTime(intervals_[id], now));
+            // More channels may have become due during the update
+            continue;
+        }
+
+        time_t wakeUpTime = nextReload_;
+        if (!queue_.empty())
+            wakeUpTime = min(wakeUpTime, queue_.nextDue());
+
+        unique_lock<mutex> locker(lock_);
+        wakeUp_.wait_for(locker, chrono::seconds(max<time_t>(wakeUpTime - now, 1)),
+                         [this]() { return !running_; });
+    }
+
+    const PostHashIndex &index = worker_->postIndex();
+    SERVICE_LOG("ChannelsUpdateScheduler::run: scheduler finished after "
+                << updatesCount_ << " channel updates, " << worker_->notModifiedCount()
+                << " not modified. Post index hits " << index.hits() << ", misses "
+                << index.misses() << ". Feeds bytes transferred "
+                << worker_->bytesTransferred() << ", decoded " << worker_->bytesDecoded()
+                << ". Store transactions " << worker_->pipelineStatistics().transactions);
+
+    delete worker_;
+    worker_ = nullptr;
+    delete dataProvider_;
+    dataProvider_ = nullptr;
+}
+
+void ChannelsUpdateScheduler::reloadChannels(time_t now) {
+    vector<Channel *> *channels;
+    try {
+        channels = dataProvider_->getAllChannels();
+    } catch (SqliteProviderException &e) {
+        SERVICE_LOG_LVL(ERROR, "ChannelsUpdateScheduler::reloadChannels: cannot "
+                        "load channels. Message: " << e.what());
+        return;
+    }
+
+    unordered_map<int64_t, int> intervals;
+    for (Channel *channel : *channels) {
+        int interval = max(channel->updateInterval(), MIN_UPDATE_INTERVAL_SEC);
+        intervals[channel->id()] = interval;
+        if (intervals_.find(channel->id()) == intervals_.end())
+            queue_.push(channel->id(), firstUpdateTime(*channel, interval, now));
+        delete channel;
+    }
+    delete channels;
+
+    intervals_.swap(intervals);
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateScheduler::reloadChannels: "
+                    << intervals_.size() << " channels scheduled");
+}
+
+time_t ChannelsUpdateScheduler::firstUpdateTime(const Channel &channel, int interval,
+                                                time_t now) {
+    // Unchanged feeds are downloaded without touching last update time
+    tm lastUpdate = channel.lastUpdate();
+    tm lastPoll = channel.lastPoll();
+    time_t due = max(mktime(&lastUpdate), mktime(&lastPoll));
+    if (due != static_cast<time_t>(-1))
+        due += interval;
+
+    if (due == static_cast<time_t>(-1) || due <= now) {
+        /* Overdue channels, e.g. after restart, are spread over the
+         * jitter window instead of being updated all at once. */
+        uniform_int_distribution<int> spread(0, interval * jitterPercent_ / 100);
+        return now + spread(random_);
+    }
+    return due;
+}
+
+time_t ChannelsUpdateScheduler::nextUpdateTime(int interval, time_t now) {
+    int maxJitter = interval * jitterPercent_ / 100;
+    uniform_int_distribution<int> jitter(-maxJitter, maxJitter);
+    return now + interval + jitter(random_);
+}
+/* ============ ChannelsUpdateScheduler END ============== */
+
+} /* namespace service */
+} /* namespace nestor */
@@ -0,0 +1,149 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef CHANNELS_UPDATE_SCHEDULER_H_
+#define CHANNELS_UPDATE_SCHEDULER_H_
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <ctime>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "sqlite_connection.h"
+#include "channels_update_queue.h"
+
+namespace nestor {
+namespace service {
+
+class SqliteProvider;
+class ChannelsUpdateWorker;
+class Channel;
+
+/**
+ * Updates every channel each update_interval_sec in its own thread.
+ * Due channels are taken in batches, so feeds of a batch are
+ * downloaded in parallel by one HttpAsyncClient. Every next update
+ * time gets random jitter, so channels with the same interval spread
+ * over time instead of firing together.
+ */
+class ChannelsUpdateScheduler {
+public:
+    /** Maximum number of channels updated together, enough to keep
+     * the worker fetch window full */
+    static const size_t DEFAULT_BATCH_SIZE = 256;
+    /** Maximum jitter as percent of the channel update interval */
+    static const int DEFAULT_JITTER_PERCENT = 10;
+    /** How often new and removed channels are picked up */
+    static const int CHANNELS_RELOAD_INTERVAL_SEC = 60;
+    /** Lower bound for update intervals stored in the database */
+    static const int MIN_UPDATE_INTERVAL_SEC = 60;
+
+    /**
+     * @param connection Database connection for storing feeds. The
+     * scheduler thread becomes its only user.
+     */
+    explicit ChannelsUpdateScheduler(SqliteConnection *connection);
+    virtual ~ChannelsUpdateScheduler();
+
+    /**
+     * Spawns the scheduler thread.
+     */
+    void start();
+
+    /**
+     * Asks the scheduler to finish. Update in progress is completed
+     * first. May be called from any thread.
+     */
+    void stop();
+
+    /**
+     * Waits for the scheduler thread to finish.
+     */
+    void join();
+
+    size_t batchSize() const;
+    void setBatchSize(size_t batchSize);
+    int jitterPercent() const;
+    void setJitterPercent(int jitterPercent);
+
+    /**
+     * Limits of simultaneous downloads, @sa ChannelsUpdateWorker::setFetchLimits().
+     * Must be called before start().
+     */
+    void setFetchLimits(size_t maxTransfers, size_t maxHostTransfers);
+
+    /**
+     * @sa ChannelsUpdateWorker::setIncrementalParse(). Must be called
+     * before start().
+     */
+    void setIncrementalParse(bool incrementalParse);
+
+    /**
+     * @sa ChannelsUpdateWorker::setParseThreads(). Must be called
+     * before start().
+     */
+    void setParseThreads(size_t parseThreads);
+
+    /**
+     * @sa ChannelsUpdateWorker::setCommitLimits(). Must be called
+     * before start().
+     */
+    void setCommitLimits(size_t maxBatchSize, unsigned int maxDelayMs);
+
+private:
+    void run();
+    void reloadChannels(std::time_t now);
+    std::time_t firstUpdateTime(const Channel &channel, int interval, std::time_t now);
+    std::time_t nextUpdateTime(int interval, std::time_t now);
+
+private:
+    SqliteConnection *connection_;
+    SqliteProvider *dataProvider_;
+    ChannelsUpdateWorker *worker_;
+
+    ChannelsUpdateQueue queue_;
+    /** Update intervals of known channels */
+    std::unordered_map<int64_t, int> intervals_;
+    std::time_t nextReload_;
+    size_t batchSize_;
+    int jitterPercent_;
+    size_t maxTransfers_;
+    size_t maxHostTransfers_;
+    bool incrementalParse_;
+    size_t parseThreads_;
+    size_t commitBatchSize_;
+    unsigned int commitDelayMs_;
+    std::mt19937 random_;
+    size_t updatesCount_;
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::mutex lock_;
+    std::condition_variable wakeUp_;
+};
+
+} /* namespace service */
+} /* namespace nestor */
+
+#endif /* CHANNELS_UPDATE_SCHEDULER_H_ */
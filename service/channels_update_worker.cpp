@@ -1,17 +1,22 @@
 #include <vector>
+#include <deque>
 #include <map>
 #include <algorithm>
 #include <cstring>
 #include <memory>
+#include <chrono>
+#include <functional>
 #include <iostream>
 #include <unicode/unistr.h>
 #include <unicode/bytestream.h>
 #include "channels_update_worker.h"
 #include "sqlite_provider.h"
-#include "net/http_multi_client.h"
+#include "net/http_async_client.h"
+#include "net/io_observer.h"
 #include "net/http_resource.h"
 #include "rss/rss_channel.h"
 #include "rss/rss_xml_parser.h"
+#include "rss/rss_feed_reader.h"
 #include "common/logger.h"
 #include "utils/string.h"
 
@@ -23,10 +28,235 @@ using namespace nestor::rss;
 namespace nestor {
 namespace service {
 
+static const char *RSS_CONTENT_TYPE = "application/rss+xml";
+
+/**
+ * Parse state of a downloaded feed. Streamed body is received by the
+ * fetch thread and parsed by the parse threads, one at a time.
+ */
+struct FeedDownload {
+    FeedDownload(int64_t channelId, int knownGuidLimit)
+            : channelId(channelId), knownGuidLimit(max(knownGuidLimit, 0)),
+              pendingBytes(0), pausedClient(nullptr), draining(false), failed(false),
+              stopped(false), completed(nullptr) {
+    }
+
+    int64_t channelId;
+    /** @sa Channel::knownGuidLimit() */
+    unsigned int knownGuidLimit;
+    RssFeedReader::KnownGuidFunction known;
+    /** Reader the body is streamed to, nullptr if the body is buffered */
+    unique_ptr<RssFeedReader> reader;
+    /** Wakes the fetch loop up to resume the paused transfer */
+    function<void()> wakeUp;
+
+    /* Members below are guarded by the lock */
+    mutex lock;
+    /** Received chunks waiting for the reader */
+    deque<string> chunks;
+    size_t pendingBytes;
+    /** Client of the transfer paused until the chunks are parsed */
+    const HttpClient *pausedClient;
+    /** Parse job for the chunks is queued or running */
+    bool draining;
+    /** Body is not a valid feed, the transfer is aborted */
+    bool failed;
+    /** Reader has stopped at known items, the rest of the body isn't needed */
+    bool stopped;
+    /** Download which has completed while its chunks were parsed */
+    FeedJob *completed;
+    /** Why the download was aborted */
+    string error;
+
+    void configure(RssFeedReader &feedReader) {
+        feedReader.setKnownGuidLimit(knownGuidLimit, known);
+    }
+
+    /**
+     * Body sink of the transfer, called in the fetch thread. Chunk is
+     * copied for the parse threads unless too many bytes wait for them.
+     * @param schedule Set to true if the chunks need a new parse job.
+     */
+    HttpClient::SinkStatus receive(const HttpClient &client, const char *data, size_t length,
+                                   bool &schedule) {
+        schedule = false;
+        if (!reader) {
+            string type, charset;
+            client.contentType(type, charset);
+            stringToLower(trim(type));
+            if (type.compare(RSS_CONTENT_TYPE) != 0) {
+                lock_guard<mutex> locker(lock);
+                error = "wrong content type \"" + type + "\"";
+                failed = true;
+                return HttpClient::SinkStatus::ABORT;
+            }
+            reader.reset(new RssFeedReader(charset));
+            configure(*reader);
+        }
+
+        lock_guard<mutex> locker(lock);
+        if (failed)
+            return HttpClient::SinkStatus::ABORT;
+        if (stopped)
+            return HttpClient::SinkStatus::CONSUMED;
+        if (pendingBytes >= ChannelsUpdateWorker::MAX_PENDING_CHUNK_BYTES) {
+            // Parse job is queued or running, it wakes the fetch loop up
+            pausedClient = &client;
+            return HttpClient::SinkStatus::PAUSE;
+        }
+        chunks.emplace_back(data, length);
+        pendingBytes += length;
+        schedule = !draining;
+        draining = true;
+        return HttpClient::SinkStatus::CONSUMED;
+    }
+
+    /**
+     * Called in the fetch thread for the paused download.
+     * @param client Set to the client to resume, nullptr if the transfer
+     * has finished.
+     * @return false while the parse threads are behind.
+     */
+    bool resume(const HttpClient *&client) {
+        lock_guard<mutex> locker(lock);
+        client = pausedClient;
+        if (client != nullptr && !failed && !stopped
+                && pendingBytes > ChannelsUpdateWorker::MAX_PENDING_CHUNK_BYTES / 2)
+            return false;
+        pausedClient = nullptr;
+        return true;
+    }
+
+    /** Called in the fetch thread when the transfer has finished */
+    void finish() {
+        lock_guard<mutex> locker(lock);
+        pausedClient = nullptr;
+    }
+
+    /**
+     * Feeds received chunks to the reader, called in a parse thread.
+     * @return completed download if it has waited for the chunks.
+     */
+    FeedJob *parseChunks() {
+        for (;;) {
+            string chunk;
+            bool resume = false;
+            {
+                lock_guard<mutex> locker(lock);
+                if (failed || stopped) {
+                    chunks.clear();
+                    pendingBytes = 0;
+                }
+                if (chunks.empty()) {
+                    draining = false;
+                    FeedJob *job = completed;
+                    completed = nullptr;
+                    if (pausedClient != nullptr)
+                        wakeUp();
+                    return job;
+                }
+                chunk.swap(chunks.front());
+                chunks.pop_front();
+                pendingBytes -= chunk.size();
+                resume = (pausedClient != nullptr
+                          && pendingBytes <= ChannelsUpdateWorker::MAX_PENDING_CHUNK_BYTES / 2);
+            }
+            if (resume)
+                wakeUp();
+
+            try {
+                reader->feed(chunk.data(), chunk.size());
+                if (reader->stopped()) {
+                    lock_guard<mutex> locker(lock);
+                    stopped = true;
+                }
+            } catch (RssXmlParserException &e) {
+                lock_guard<mutex> locker(lock);
+                error = e.what();
+                failed = true;
+            }
+        }
+    }
+
+    /**
+     * Leaves completed download to the thread parsing its chunks.
+     * @return false if no chunks are parsed and the caller parses the job.
+     */
+    bool defer(FeedJob *job) {
+        lock_guard<mutex> locker(lock);
+        if (!draining)
+            return false;
+        completed = job;
+        return true;
+    }
+
+    bool parseFailed(string &message) {
+        lock_guard<mutex> locker(lock);
+        message = error;
+        return failed;
+    }
+};
+
+
+/**
+ * Downloaded feed passed between the pipeline stages.
+ */
+struct FeedJob {
+    FeedJob(const shared_ptr<FeedDownload> &download, HttpResource *resource)
+            : download(download), resource(resource), channel(nullptr), stopped(false) {
+    }
+
+    ~FeedJob() {
+        delete channel;
+        delete resource;
+    }
+
+    shared_ptr<FeedDownload> download;
+    HttpResource *resource;
+    /** Parsed feed, nullptr if it is not modified or is broken */
+    RssChannel *channel;
+    /** Parsing was stopped by known items */
+    bool stopped;
+};
+
+
+const size_t ChannelsUpdateWorker::PIPELINE_QUEUE_SIZE;
+
+
+static uint64_t elapsedUsec(chrono::steady_clock::time_point start) {
+    return chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - start).count();
+}
+
+
+PipelineStageStatistics::PipelineStageStatistics()
+        : items(0), busyUsec(0), blockedUsec(0), maxQueueDepth(0) {
+}
+
+
+void PipelineStageStatistics::merge(const PipelineStageStatistics &other) {
+    items += other.items;
+    busyUsec += other.busyUsec;
+    blockedUsec += other.blockedUsec;
+    maxQueueDepth = max(maxQueueDepth, other.maxQueueDepth);
+}
+
+
+PipelineStatistics::PipelineStatistics() : transactions(0) {
+}
+
 
 ChannelsUpdateWorker::ChannelsUpdateWorker(const vector<int64_t> &channelsID,
                                            SqliteConnection *connection)
-        : dataProvider_(nullptr) {
+        : dataProvider_(nullptr), observer_(nullptr), downloader_(nullptr),
+          maxTransfers_(HttpAsyncClient::DEFAULT_MAX_TRANSFERS),
+          maxHostTransfers_(HttpAsyncClient::DEFAULT_MAX_HOST_TRANSFERS),
+          incrementalParse_(true), notModifiedCount_(0), bytesTransferred_(0),
+          bytesDecoded_(0), stoppedParsesCount_(0), pausedFetchesCount_(0),
+          parseThreadsCount_(0),
+          commitBatchSize_(WriteBehindQueue::DEFAULT_MAX_BATCH_SIZE),
+          commitDelayMs_(WriteBehindQueue::DEFAULT_MAX_DELAY_MS),
+          parseQueue_(PIPELINE_QUEUE_SIZE), writeQueue_(nullptr) {
     databaseConnection_ = connection;
     channelsID_.clear();
     channelsID_.resize(channelsID.size());
@@ -34,9 +264,31 @@ ChannelsUpdateWorker::ChannelsUpdateWorker(const vector<int64_t> &channelsID,
 }
 
 
+ChannelsUpdateWorker::ChannelsUpdateWorker(SqliteConnection *connection)
+        : databaseConnection_(connection), dataProvider_(nullptr),
+          observer_(nullptr), downloader_(nullptr),
+          maxTransfers_(HttpAsyncClient::DEFAULT_MAX_TRANSFERS),
+          maxHostTransfers_(HttpAsyncClient::DEFAULT_MAX_HOST_TRANSFERS),
+          incrementalParse_(true), notModifiedCount_(0), bytesTransferred_(0),
+          bytesDecoded_(0), stoppedParsesCount_(0), pausedFetchesCount_(0),
+          parseThreadsCount_(0),
+          commitBatchSize_(WriteBehindQueue::DEFAULT_MAX_BATCH_SIZE),
+          commitDelayMs_(WriteBehindQueue::DEFAULT_MAX_DELAY_MS),
+          parseQueue_(PIPELINE_QUEUE_SIZE), writeQueue_(nullptr) {
+}
+
+
 ChannelsUpdateWorker::~ChannelsUpdateWorker() {
+    // Commits the rest, uses the provider
+    if (writeQueue_)
+        delete writeQueue_;
     if (dataProvider_)
         delete dataProvider_;
+    // Downloader uses the observer
+    if (downloader_)
+        delete downloader_;
+    if (observer_)
+        delete observer_;
 }
 
 
@@ -75,14 +327,6 @@ void ChannelsUpdateWorker::updateRssChannel(RssChannel* channel,
                                             HttpResource* resource, int64_t channelId) {
     unique_ptr<Channel> dbchannel;
 
-    try {
-        dataProvider_->beginTransaction();
-    } catch (SqliteProviderException &e) {
-        SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::updateRssChannel: cannot "
-                        "start transaction. Message: " << e.what());
-        return;
-    }
-
     try {
         dbchannel = unique_ptr<Channel>(dataProvider_->findChannelById(channelId));
     } catch (SqliteProviderException &e) {
@@ -91,16 +335,51 @@ void ChannelsUpdateWorker::updateRssChannel(RssChannel* channel,
                         << ". Message: " << e.what());
         return;
     }
+    if (!dbchannel) {
+        SERVICE_LOG_LVL(WARN, "ChannelsUpdateWorker::updateRssChannel: channel "
+                        "with id: " << channelId << " was removed");
+        return;
+    }
+
+    bool indexed;
+    {
+        lock_guard<mutex> locker(postIndexLock_);
+        indexed = postIndex_.containsChannel(channelId);
+    }
+    if (!indexed)
+        loadPostIndex(channelId);
+
+    unsigned int postNum = channel->itemsCount();
+    unsigned int storedNum = 0;
+    for (unsigned int i = 0; i < postNum; i++) {
+        RssObject *post = channel->getItem(i);
+        if (updateRssObject(*post, *dbchannel))
+            storedNum++;
+    }
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::updateRssChannel: channel "
+                    << channelId << " stored " << storedNum << " of "
+                    << postNum << " posts");
+
+    // Row of unchanged feed is not rewritten, last update is the time of the
+    // last change. Time of every download is kept by recordPoll().
+    if (storedNum == 0 && dbchannel->description() == channel->description()
+            && dbchannel->link() == channel->link() && dbchannel->title() == channel->title()
+            && dbchannel->etag() == resource->etag()
+            && dbchannel->lastModified() == resource->lastModified())
+        return;
 
     dbchannel->setDescription(channel->description());
     dbchannel->setLink(channel->link());
     dbchannel->setTitle(channel->title());
+    // Next request asks only for changes since this version
+    dbchannel->setEtag(resource->etag());
+    dbchannel->setLastModified(resource->lastModified());
 
     std::time_t now = time(nullptr);
-    std::tm *nowtm = localtime(&now);
+    std::tm nowtm;
 
-    if (nowtm != nullptr)
-        dbchannel->setLastUpdate(*nowtm);
+    if (localtime_r(&now, &nowtm) != nullptr)
+        dbchannel->setLastUpdate(nowtm);
 
     // Storing updated dbchannel
     bool rc;
@@ -117,202 +396,517 @@ void ChannelsUpdateWorker::updateRssChannel(RssChannel* channel,
         SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::updateRssChannel: error "
                         "while updating channel with id: " << channelId
                         << " Data hasn't stored.");
-        return;
     }
+}
 
-    unsigned int postNum = channel->itemsCount();
-    for (unsigned int i = 0; i < postNum; i++) {
-        RssObject *post = channel->getItem(i);
-        updateRssObject(*post, *dbchannel);
+
+/**
+ * Stores RSS post of channel feed if it is new or changed.
+ * @return true if the post was stored.
+ */
+bool ChannelsUpdateWorker::updateRssObject(RssObject &post,
+                                           Channel &channel) {
+    Post dbpost;
+    dbpost.setGuid(post.guid());
+    dbpost.setChannelId(channel.id());
+    dbpost.setLink(post.link());
+    dbpost.setTitle(post.title());
+
+    // TODO: Make Description and Text different
+    dbpost.setDescription(post.text());
+    dbpost.setText(post.text());
+
+    dbpost.setPublicationDate(post.pubDate());
+
+    {
+        lock_guard<mutex> locker(postIndexLock_);
+        // Generated date changes on every read, so it doesn't count
+        if (postIndex_.unchanged(dbpost, post.hasPubDate()))
+            return false;
     }
 
+    bool rc;
     try {
-        dataProvider_->endTransaction();
+        rc = dataProvider_->upsertPost(dbpost);
     } catch (SqliteProviderException &e) {
-        SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::updateRssChannel: cannot "
-                        "end transaction. Message: " << e.what());
-        return;
+        SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::updateRssObject: error "
+                        "while storing post with guid: " << post.guid() <<
+                        " Message: " << e.what());
+        return false;
     }
+    lock_guard<mutex> locker(postIndexLock_);
+    postIndex_.store(dbpost);
+    return rc;
 }
 
 
 /**
- * Updates RSS post of channel feed.
+ * Loads hashes of stored posts of the channel into the post index.
  */
-int64_t ChannelsUpdateWorker::updateRssObject(RssObject &post,
-                                           Channel &channel) {
-    unique_ptr<Post> dbpost(nullptr), existPost(nullptr);
+void ChannelsUpdateWorker::loadPostIndex(int64_t channelId) {
+    vector<Post *> *posts;
     try {
-        dbpost = unique_ptr<Post>(dataProvider_->findPostByGuid(post.guid()));
+        posts = dataProvider_->getPostsForChannel(channelId);
     } catch (SqliteProviderException &e) {
-        SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::updateRssObject: error "
-                        "while finding post with guid: " << post.guid() <<
-                        " Message: " << e.what());
-        return -1;
+        SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::loadPostIndex: error "
+                        "while loading posts of channel with id: " << channelId
+                        << ". Message: " << e.what());
+        return;
+    }
+    // Channel without posts
+    if (posts == nullptr)
+        posts = new vector<Post *>();
+
+    {
+        lock_guard<mutex> locker(postIndexLock_);
+        postIndex_.addChannel(channelId);
+        for (Post *post : *posts)
+            postIndex_.store(*post);
     }
+    for (Post *post : *posts)
+        delete post;
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::loadPostIndex: loaded "
+                    << posts->size() << " posts of channel " << channelId);
+    delete posts;
+}
 
 
-    bool isUpdate = true;
-    if (dbpost == nullptr || dbpost->channelId() != channel.id()) {
-        if (dbpost) {
-            isUpdate = true;
-        }
-        else {
-            isUpdate = false;
-        }
-        // Cannot find post with GUID. Storing as new post
-        if (dbpost == nullptr)
-            dbpost = unique_ptr<Post>(new Post());
+const PostHashIndex &ChannelsUpdateWorker::postIndex() const {
+    return postIndex_;
+}
+
+
+size_t ChannelsUpdateWorker::notModifiedCount() const {
+    return notModifiedCount_;
+}
+
+
+uint64_t ChannelsUpdateWorker::bytesTransferred() const {
+    return bytesTransferred_;
+}
+
+
+uint64_t ChannelsUpdateWorker::bytesDecoded() const {
+    return bytesDecoded_;
+}
+
+
+void ChannelsUpdateWorker::setFetchLimits(size_t maxTransfers, size_t maxHostTransfers) {
+    maxTransfers_ = max<size_t>(maxTransfers, 1);
+    maxHostTransfers_ = max<size_t>(maxHostTransfers, 1);
+    if (downloader_) {
+        downloader_->setMaxTransfers(maxTransfers_);
+        downloader_->setMaxHostTransfers(maxHostTransfers_);
     }
+}
 
-    dbpost->setGuid(post.guid());
-    dbpost->setChannelId(channel.id());
-    dbpost->setLink(post.link());
-    dbpost->setTitle(post.title());
 
-    // TODO: Make Description and Text different
-    dbpost->setDescription(post.text());
-    dbpost->setText(post.text());
+void ChannelsUpdateWorker::setIncrementalParse(bool incrementalParse) {
+    incrementalParse_ = incrementalParse;
+}
 
-    dbpost->setPublicationDate(post.pubDate());
 
-    bool rc;
-    int64_t ret;
+void ChannelsUpdateWorker::setParseThreads(size_t parseThreads) {
+    parseThreadsCount_ = parseThreads;
+}
 
-    if (isUpdate) {
-        try {
-            existPost = unique_ptr<Post>(dataProvider_->findPostByGuid(dbpost->guid()));
 
-            time_t oldTime, newTime;
-            tm t1 = existPost->publicationDate(), t2 = dbpost->publicationDate();
+void ChannelsUpdateWorker::setCommitLimits(size_t maxBatchSize, unsigned int maxDelayMs) {
+    commitBatchSize_ = maxBatchSize;
+    commitDelayMs_ = maxDelayMs;
+}
+
 
-            oldTime = mktime(&t1);
-            newTime = mktime(&t2);
+const PipelineStatistics &ChannelsUpdateWorker::pipelineStatistics() const {
+    return statistics_;
+}
 
-            if (abs(difftime(oldTime, newTime)) < UPDATE_POST_TIME_THRESHOLD_SEC) {
-                SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::updateRssObject: post " << existPost->guid() << " is not changed");
-                ret = existPost->id();
-                return ret;
-            }
 
-            rc = dataProvider_->updatePost(*dbpost.get());
-        } catch (SqliteProviderException &e) {
-            SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::updateRssObject: error "
-                            "while updating post with guid: " << post.guid() <<
-                            " id: " << dbpost->id() <<
-                            " Message: " << e.what());
-            return -1;
+/**
+ * Remembers the download time, the scheduler counts update interval from
+ * it, and adds size of downloaded feed to the channel traffic counters.
+ * Channel row itself is written only when the feed changes.
+ */
+void ChannelsUpdateWorker::recordPoll(HttpResource *resource, int64_t channelId) {
+    bytesTransferred_ += resource->transferLength();
+    bytesDecoded_ += resource->decodedLength();
+
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::recordPoll: url=" << resource->url()
+                    << " encoding=\"" << resource->contentEncoding() << "\" transferred="
+                    << resource->transferLength() << " decoded=" << resource->decodedLength());
+
+    time_t now = time(nullptr);
+    tm polledAt;
+    localtime_r(&now, &polledAt);
+    try {
+        dataProvider_->recordChannelPoll(channelId, polledAt, resource->transferLength(),
+                                         resource->decodedLength());
+    } catch (SqliteProviderException &e) {
+        SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::recordPoll: error while "
+                        "storing poll of channel with id: " << channelId
+                        << ". Message: " << e.what());
+    }
+}
+
+
+/**
+ * Parse stage: parses downloaded feed into job.channel.
+ */
+void ChannelsUpdateWorker::parseFeed(FeedJob &job) {
+    HttpResource *res = job.resource;
+    if (res->notModified())
+        return;
+
+    RssFeedReader *reader = job.download->reader.get();
+    if (res->streamed() && reader != nullptr) {
+        string message;
+        if (job.download->parseFailed(message)) {
+            SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::parseFeed: error while "
+                            "parsing RSS feed: url=" << res->url() <<
+                            " message=" << message);
+            return;
         }
-        if (rc) {
-            ret = dbpost->id();
-        } else {
-            SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::updateRssObject: cannot "
-                           "update post with guid: " << post.guid() <<
-                           " id: " << dbpost->id());
-            ret = -1;
+        // Items are parsed already, only the end of document is checked
+        try {
+            job.channel = reader->finish();
+            job.stopped = reader->stopped();
+        } catch (RssXmlParserException &e) {
+            SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::parseFeed: error while "
+                            "parsing RSS feed: url=" << res->url() <<
+                            " message=" << e.what());
         }
     } else {
-        try {
-            ret = dataProvider_->insertPost(*dbpost.get());
-        } catch (SqliteProviderException &e) {
-            SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::updateRssObject: error "
-                            "while inserting post with guid: " << post.guid() <<
-                            " Message: " << e.what());
-            return -1;
+        parseResource(job);
+    }
+}
+
+
+/**
+ * Parses feed buffered in the resource. job.channel is left nullptr on errors.
+ */
+void ChannelsUpdateWorker::parseResource(FeedJob &job) {
+    HttpResource *res = job.resource;
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::parseResource: start parsing url=" << res->url());
+
+    string contentType = res->contentType();
+    stringToLower(contentType);
+    trim(contentType);
+
+    if (contentType.compare(RSS_CONTENT_TYPE) != 0) {
+        SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::parseResource: wrong content type \"" << contentType << "\"");
+        return;
+    }
+
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::parseResource: checking content charset url=" << res->url());
+    convertContentCharsetIfNeed(res);
+
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::parseResource: parsing RSS feed url=" << res->url());
+    try {
+        RssFeedReader reader;
+        job.download->configure(reader);
+        reader.feed(reinterpret_cast<char *>(res->content()), res->contentLength());
+        job.channel = reader.finish();
+        job.stopped = reader.stopped();
+    } catch (RssXmlParserException &e) {
+        SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::parseResource: error while "
+                        "parsing RSS feed: url=" << res->url() <<
+                        " message=" << e.what());
+    }
+}
+
+
+/**
+ * Spawns the parse threads and the store stage.
+ */
+void ChannelsUpdateWorker::startPipeline() {
+    if (writeQueue_ == nullptr) {
+        writeQueue_ = new WriteBehindQueue(dataProvider_, PIPELINE_QUEUE_SIZE);
+        writeQueue_->setBatchLimits(commitBatchSize_, commitDelayMs_);
+        writeQueue_->start();
+    }
+
+    size_t threads = parseThreadsCount_;
+    if (threads == 0)
+        threads = max(thread::hardware_concurrency(), 1U);
+
+    // Every thread has its own counters, so they are never shared
+    parseStatistics_.assign(threads, PipelineStageStatistics());
+    for (size_t i = 0; i < threads; i++)
+        parseThreads_.push_back(thread(&ChannelsUpdateWorker::parseLoop, this,
+                                       ref(parseStatistics_[i])));
+}
+
+
+/**
+ * Waits until all queued feeds are committed and stops the parse threads.
+ * Every thread finishes on nullptr job, which is queued after the last feed.
+ */
+void ChannelsUpdateWorker::finishPipeline() {
+    FeedJob *stop = nullptr;
+    for (size_t i = 0; i < parseThreads_.size(); i++)
+        parseQueue_.push(stop);
+    for (thread &parseThread : parseThreads_)
+        parseThread.join();
+    parseThreads_.clear();
+
+    // Durability barrier: the next update and the scheduler see all stored feeds
+    writeQueue_->flush();
+
+    for (const PipelineStageStatistics &parseStatistics : parseStatistics_)
+        statistics_.parse.merge(parseStatistics);
+    parseStatistics_.clear();
+
+    WriteBehindQueue::Statistics writeStatistics = writeQueue_->statistics();
+    statistics_.store.items = writeStatistics.writes;
+    statistics_.store.busyUsec = writeStatistics.busyUsec;
+    statistics_.store.maxQueueDepth = writeStatistics.maxBacklog;
+    statistics_.transactions = writeStatistics.commits;
+}
+
+
+/**
+ * Fetch stage: passes received chunk of streamed feed to the parse threads.
+ * Transfer is paused while the threads are behind.
+ */
+HttpClient::SinkStatus ChannelsUpdateWorker::enqueueChunk(const shared_ptr<FeedDownload> &download,
+                                                          const HttpClient &client,
+                                                          const char *data, size_t length) {
+    bool schedule;
+    HttpClient::SinkStatus status = download->receive(client, data, length, schedule);
+    if (status == HttpClient::SinkStatus::PAUSE) {
+        pausedDownloads_.push_back(download);
+        pausedFetchesCount_++;
+    }
+
+    // One job parses all chunks queued by the time it runs
+    if (schedule) {
+        FeedJob *job = new FeedJob(download, nullptr);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        parseQueue_.push(job);
+        statistics_.fetch.blockedUsec += elapsedUsec(start);
+    }
+    return status;
+}
+
+
+/**
+ * Fetch stage: resumes transfers whose chunks are parsed.
+ */
+void ChannelsUpdateWorker::resumeDownloads() {
+    // Resumed transfer may pause again right away
+    vector<shared_ptr<FeedDownload>> paused;
+    paused.swap(pausedDownloads_);
+    for (const shared_ptr<FeedDownload> &download : paused) {
+        const HttpClient *client;
+        if (!download->resume(client))
+            pausedDownloads_.push_back(download);
+        else if (client != nullptr)
+            downloader_->resume(*client);
+    }
+}
+
+
+/**
+ * Fetch stage: passes downloaded feed to the parse threads.
+ */
+void ChannelsUpdateWorker::enqueueFeed(FeedJob *job) {
+    PipelineStageStatistics &statistics = statistics_.fetch;
+    statistics.items++;
+    statistics.maxQueueDepth = max(statistics.maxQueueDepth, downloader_->pendingCount());
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    parseQueue_.push(job);
+    statistics.blockedUsec += elapsedUsec(start);
+}
+
+
+void ChannelsUpdateWorker::parseLoop(PipelineStageStatistics &statistics) {
+    for (;;) {
+        FeedJob *job;
+        parseQueue_.pop(job);
+        if (job == nullptr)
+            break;
+        statistics.maxQueueDepth = max(statistics.maxQueueDepth, parseQueue_.size() + 1);
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (job->resource == nullptr) {
+            // Chunks of a streamed feed, the download may complete meanwhile
+            FeedJob *completed = job->download->parseChunks();
+            delete job;
+            statistics.busyUsec += elapsedUsec(start);
+            if (completed == nullptr)
+                continue;
+            job = completed;
+            start = chrono::steady_clock::now();
+        } else if (job->download->defer(job)) {
+            // Thread parsing the chunks finishes the feed
+            continue;
         }
+
+        parseFeed(*job);
+        statistics.busyUsec += elapsedUsec(start);
+        statistics.items++;
+
+        // Job lives until the queue releases both functions
+        shared_ptr<FeedJob> stored(job);
+        start = chrono::steady_clock::now();
+        writeQueue_->push([this, stored]() { storeFeed(*stored); },
+                          [this, stored]() { forgetFeed(*stored); });
+        statistics.blockedUsec += elapsedUsec(start);
+    }
+}
+
+
+/**
+ * Store stage, called in the WriteBehindQueue thread inside a transaction.
+ * It is the only database user while the pipeline runs.
+ */
+void ChannelsUpdateWorker::storeFeed(FeedJob &job) {
+    HttpResource *res = job.resource;
+    int64_t channelId = job.download->channelId;
+    recordPoll(res, channelId);
+
+    if (res->notModified()) {
+        SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::storeFeed: not modified url=" << res->url());
+        notModifiedCount_++;
+        return;
     }
+    if (job.stopped)
+        stoppedParsesCount_++;
+    if (job.channel == nullptr)
+        return;
 
-    return ret;
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::storeFeed: updating RSS channel url=" << res->url());
+    updateRssChannel(job.channel, res, channelId);
+}
+
+
+/**
+ * Called when the transaction of the feed is not committed.
+ */
+void ChannelsUpdateWorker::forgetFeed(FeedJob &job) {
+    // Index may hold posts which weren't committed
+    lock_guard<mutex> locker(postIndexLock_);
+    postIndex_.removeChannel(job.download->channelId);
 }
 
 
 void ChannelsUpdateWorker::run() {
-    dataProvider_ = new SqliteProvider(databaseConnection_);
-    HttpMultiClient downloader;
-    int feedsDownloadCount = 0;
-    map<string, int64_t> urlIds;
+    update(channelsID_);
+}
 
-    // Adding channels urls into downloader
-    for (int64_t channelId : channelsID_) {
+
+void ChannelsUpdateWorker::update(const std::vector<int64_t> &channelsID) {
+    if (dataProvider_ == nullptr)
+        dataProvider_ = new SqliteProvider(databaseConnection_);
+    if (observer_ == nullptr) {
+        observer_ = new IOObserver();
+        downloader_ = new HttpAsyncClient(observer_);
+        downloader_->setMaxTransfers(maxTransfers_);
+        downloader_->setMaxHostTransfers(maxHostTransfers_);
+    }
+    HttpAsyncClient::Statistics before = downloader_->statistics();
+
+    // Channels are read while the store stage is idle, it is the only database user later
+    vector<unique_ptr<Channel>> channels;
+    for (int64_t channelId : channelsID) {
         Channel *channel;
         // Errors just skipping
         try {
             channel = dataProvider_->findChannelById(channelId);
         } catch (SqliteProviderException &e) {
-            SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::run: error while finding"
+            SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::update: error while finding"
                             " channel with id: " << channelId << ". Message: "
                             << e.what());
             continue;
         }
         if (channel == nullptr) {
-            SERVICE_LOG_LVL(WARN, "ChannelsUpdateWorker::run: cannot find channel "
+            SERVICE_LOG_LVL(WARN, "ChannelsUpdateWorker::update: cannot find channel "
                             "with id: " << channelId);
             continue;
         }
-
-        downloader.appendRequestResource(channel->rssLink());
-        urlIds.insert(make_pair(channel->rssLink(), channelId));
-        feedsDownloadCount++;
-        delete channel;
+        // Stored items are looked up while the feed is parsed
+        if (channel->knownGuidLimit() > 0 && !postIndex_.containsChannel(channelId))
+            loadPostIndex(channelId);
+        channels.push_back(unique_ptr<Channel>(channel));
     }
 
-    // Perform downloading and parsing feeds.
-    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::run: starting downloading "
-                    << feedsDownloadCount << " resources");
-    vector<HttpResource *> *recved = nullptr;
-    do {
-        if (recved) {
-            for (HttpResource *res : *recved)
-                delete res;
-            delete recved;
-            recved = nullptr;
-        }
-        recved = downloader.perform();
-        if (recved == nullptr) {
-            SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::run: cannot download resources");
-            break;
-        }
-
-        SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::run: received " << recved->size() << " resources");
-
-        // While others feeds are still downloading we parse already downloaded feeds.
-        for (HttpResource *res : *recved) {
-            SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::run: start parsing url=" << res->url());
+    startPipeline();
 
-            string contentType = res->contentType();
-            stringToLower(contentType);
-            trim(contentType);
-
-            if (contentType.compare("application/rss+xml") != 0) {
-                SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::run: wrong content type \"" << contentType << "\"");
-                continue;
-            }
-
-            SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::run: checking content charset url=" << res->url());
-            convertContentCharsetIfNeed(res);
-
-            SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::run: parsing RSS feed url=" << res->url());
-            char *content = reinterpret_cast<char *>(res->content());
-            RssChannel *channel;
-            try {
-                channel = RssXmlParser::parseRss(content);
-            } catch (RssXmlParserException &e) {
-                SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::run: error while "
-                                "parsing RSS feed: url=" << res->url() <<
-                                " message=" << e.what());
-                continue;
-            }
+    // Adding channels urls into downloader
+    for (const unique_ptr<Channel> &channel : channels) {
+        int64_t channelId = channel->id();
+        shared_ptr<FeedDownload> download = make_shared<FeedDownload>(channelId,
+                                                                      channel->knownGuidLimit());
+        if (download->knownGuidLimit > 0) {
+            download->known = [this, channelId](const string &guid) {
+                lock_guard<mutex> locker(postIndexLock_);
+                return postIndex_.containsGuid(channelId, guid);
+            };
+        }
 
-            SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::run: updating RSS channel url=" << res->url());
-            updateRssChannel(channel, res, urlIds.at(res->requestUrl()));
+        // Feed is parsed by the parse threads while it is downloaded
+        HttpClient::BodySink sink;
+        if (incrementalParse_) {
+            download->wakeUp = [this]() { observer_->wakeUp(); };
+            sink = [this, download](const HttpClient &client, const char *data, size_t length) {
+                return enqueueChunk(download, client, data, length);
+            };
         }
-    } while(recved->size() > 0);
 
-    if (recved)
-        delete recved;
+        downloader_->fetch(channel->rssLink(), channel->etag(), channel->lastModified(),
+                         [this, download](const string &url, HttpResource *res) {
+            download->finish();
+            if (res != nullptr) {
+                enqueueFeed(new FeedJob(download, res));
+                return;
+            }
+            string message;
+            if (download->parseFailed(message))
+                SERVICE_LOG_LVL(ERROR, "ChannelsUpdateWorker::update: feed download aborted: url="
+                                << url << " message=" << message);
+        }, sink);
+    }
 
-    delete dataProvider_;
-    dataProvider_ = nullptr;
+    // Feeds are parsed and stored while the rest is downloaded
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::update: starting downloading "
+                    << channels.size() << " resources");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    while (downloader_->activeCount() > 0 || downloader_->pendingCount() > 0) {
+        observer_->wait();
+        resumeDownloads();
+    }
+    pausedDownloads_.clear();
+    statistics_.fetch.busyUsec += elapsedUsec(start);
+
+    finishPipeline();
+
+    const HttpAsyncClient::Statistics &after = downloader_->statistics();
+    SERVICE_LOG("ChannelsUpdateWorker::update: downloaded "
+                << after.transfers - before.transfers << " feeds with "
+                << after.connects - before.connects << " new connections, "
+                << after.tlsHandshakes - before.tlsHandshakes << " TLS handshakes, "
+                << after.http2Transfers - before.http2Transfers << " over HTTP/2");
+
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::update: post index hits "
+                    << postIndex_.hits() << ", misses " << postIndex_.misses()
+                    << ", indexed posts " << postIndex_.size()
+                    << "; bytes transferred " << bytesTransferred_
+                    << ", decoded " << bytesDecoded_ << "; parses stopped at known items "
+                    << stoppedParsesCount_ << "; fetches paused for the parse threads "
+                    << pausedFetchesCount_ << "; reused handles "
+                    << downloader_->clientPool().reuseCount());
+
+    SERVICE_LOG_LVL(DEBUG, "ChannelsUpdateWorker::update: pipeline fetch "
+                    << statistics_.fetch.items << " feeds in " << statistics_.fetch.busyUsec
+                    << " us, blocked " << statistics_.fetch.blockedUsec << " us, max pending "
+                    << statistics_.fetch.maxQueueDepth << "; parse " << statistics_.parse.items
+                    << " feeds in " << statistics_.parse.busyUsec << " us, blocked "
+                    << statistics_.parse.blockedUsec << " us, max queued "
+                    << statistics_.parse.maxQueueDepth << "; store " << statistics_.store.items
+                    << " feeds in " << statistics_.transactions << " transactions, "
+                    << statistics_.store.busyUsec << " us, max queued "
+                    << statistics_.store.maxQueueDepth);
 }
 
 } /* namespace service */
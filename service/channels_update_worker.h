@@ -4,8 +4,14 @@
 #include <vector>
 #include <cstdint>
 #include <memory>
+#include <thread>
+#include <mutex>
 
 #include "sqlite_connection.h"
+#include "post_hash_index.h"
+#include "write_behind_queue.h"
+#include "utils/bounded_queue.h"
+#include "net/http_client.h"
 
 namespace nestor {
 
@@ -14,27 +20,78 @@ namespace nestor {
  * methods */
 namespace net {
 class HttpResource;
+class IOObserver;
+class HttpAsyncClient;
 }
 namespace rss {
 class RssChannel;
 class RssObject;
+class RssFeedReader;
 }
 namespace service {
 class SqliteProvider;
 class Channel;
+struct FeedDownload;
+struct FeedJob;
 }
 
 /* ======== END =============== */
 
 namespace service {
 
+/**
+ * Counters of one stage of the update pipeline.
+ */
+struct PipelineStageStatistics {
+    PipelineStageStatistics();
+    void merge(const PipelineStageStatistics &other);
+
+    /** Feeds passed through the stage */
+    uint64_t items;
+    /** Time spent on the feeds */
+    uint64_t busyUsec;
+    /** Time spent waiting for room in the queue of the next stage */
+    uint64_t blockedUsec;
+    /** Longest backlog of the stage input seen */
+    size_t maxQueueDepth;
+};
+
+/**
+ * Counters of the update pipeline. Fetch input is the fetch window
+ * backlog, parse and store inputs are the queues between stages.
+ */
+struct PipelineStatistics {
+    PipelineStatistics();
+
+    PipelineStageStatistics fetch;
+    PipelineStageStatistics parse;
+    PipelineStageStatistics store;
+    /** Transactions committed by the store stage */
+    uint64_t transactions;
+};
+
 /**
  * Worker class for updating feeds. Update consists of downloading,
- * parsing and storing feeds.
+ * parsing and storing feeds, which run as a pipeline: the calling thread
+ * downloads, a pool of threads converts and parses and the WriteBehindQueue
+ * thread stores feeds of many channels in one transaction. Stages are
+ * linked with bounded queues, so a slow stage holds back the previous one.
  */
 class ChannelsUpdateWorker {
 public:
+    /** Capacity of the queues between stages */
+    static const size_t PIPELINE_QUEUE_SIZE = 64;
+    /**
+     * Received bytes of one streamed feed waiting for the parse threads,
+     * its download is paused over the limit.
+     */
+    static const size_t MAX_PENDING_CHUNK_BYTES = 1024 * 1024;
+
     ChannelsUpdateWorker(const std::vector<int64_t> &channelsID, SqliteConnection *connection);
+    /**
+     * Creates worker without own channels list, for update() calls.
+     */
+    explicit ChannelsUpdateWorker(SqliteConnection *connection);
     virtual ~ChannelsUpdateWorker();
 
     /**
@@ -42,24 +99,110 @@ public:
      */
     void run();
 
+    /**
+     * Downloads and stores feeds of the given channels. May be called
+     * many times, the post index is kept between calls. All feeds are
+     * downloaded concurrently, each one is parsed as soon as it arrives.
+     * Returns when all feeds are committed.
+     */
+    void update(const std::vector<int64_t> &channelsID);
+
+    const PostHashIndex &postIndex() const;
+
+    /** Number of feeds found unchanged by conditional requests */
+    size_t notModifiedCount() const;
+
+    /** Feed body bytes received from network and after decompression */
+    uint64_t bytesTransferred() const;
+    uint64_t bytesDecoded() const;
+
+    /**
+     * Limits of simultaneous downloads, in total and per host. Channels
+     * over the limits wait for their turn.
+     */
+    void setFetchLimits(size_t maxTransfers, size_t maxHostTransfers);
+
+    /**
+     * If true, which is the default, feeds are parsed chunk by chunk while
+     * they are downloaded instead of after the whole body is buffered.
+     * Chunks are parsed by the parse threads, they wait in memory while
+     * the threads are busy, up to MAX_PENDING_CHUNK_BYTES of every feed.
+     */
+    void setIncrementalParse(bool incrementalParse);
+
+    /**
+     * Number of threads parsing downloaded feeds, 0 means one per
+     * available CPU core.
+     */
+    void setParseThreads(size_t parseThreads);
+
+    /**
+     * Limits of one transaction of the store stage,
+     * @sa WriteBehindQueue::setBatchLimits().
+     */
+    void setCommitLimits(size_t maxBatchSize, unsigned int maxDelayMs);
+
+    /** Counters of all updates */
+    const PipelineStatistics &pipelineStatistics() const;
+
 private:
     std::vector<int64_t> channelsID_;
     SqliteConnection *databaseConnection_;
     SqliteProvider *dataProvider_;
+    /** Loop of the feed downloads */
+    net::IOObserver *observer_;
+    /** Kept between updates with its handles and connection cache */
+    net::HttpAsyncClient *downloader_;
+    size_t maxTransfers_;
+    size_t maxHostTransfers_;
+    bool incrementalParse_;
 
-    /**
-     * Time in seconds. If new post with same GUID have pubDate newer
-     * than stored in database more than this constant, than post will be
-     * updated, otherwise not.
-     */
-    static const int UPDATE_POST_TIME_THRESHOLD_SEC = 3600;
+    /** Stored posts, lets unchanged items skip the database */
+    PostHashIndex postIndex_;
+    size_t notModifiedCount_;
+    uint64_t bytesTransferred_;
+    uint64_t bytesDecoded_;
+    /** Feeds which parsing was stopped by known items */
+    size_t stoppedParsesCount_;
+    /** Streamed feeds paused until the parse threads catch up */
+    std::vector<std::shared_ptr<FeedDownload>> pausedDownloads_;
+    size_t pausedFetchesCount_;
+
+    /** Post index is read by the parse stage while the writer updates it */
+    std::mutex postIndexLock_;
+
+    size_t parseThreadsCount_;
+    size_t commitBatchSize_;
+    unsigned int commitDelayMs_;
+    utils::BoundedQueue<FeedJob *> parseQueue_;
+    std::vector<std::thread> parseThreads_;
+    /** Store stage, kept between updates */
+    WriteBehindQueue *writeQueue_;
+    /** Counters of every parse thread, merged when the threads finish */
+    std::vector<PipelineStageStatistics> parseStatistics_;
+    PipelineStatistics statistics_;
 
 private:
 
 
+    void startPipeline();
+    void finishPipeline();
+    net::HttpClient::SinkStatus enqueueChunk(const std::shared_ptr<FeedDownload> &download,
+                                             const net::HttpClient &client, const char *data,
+                                             size_t length);
+    void resumeDownloads();
+    void enqueueFeed(FeedJob *job);
+    void parseLoop(PipelineStageStatistics &statistics);
+    void storeFeed(FeedJob &job);
+    void forgetFeed(FeedJob &job);
+
     void convertContentCharsetIfNeed(nestor::net::HttpResource* resource);
+    void parseFeed(FeedJob &job);
+    void parseResource(FeedJob &job);
     void updateRssChannel(nestor::rss::RssChannel *channel, nestor::net::HttpResource* resource, int64_t channelId);
-    int64_t updateRssObject(nestor::rss::RssObject &post, Channel &channel);
+    bool updateRssObject(nestor::rss::RssObject &post, Channel &channel);
+    void loadPostIndex(int64_t channelId);
+    void recordPoll(nestor::net::HttpResource *resource, int64_t channelId);
 };
 
 } /* namespace service */
@@ -24,6 +24,8 @@
 #include <mutex>
 #include <cstring>
 #include <iostream>
+#include "sqlite_connection_pool.h"
+#include "write_behind_queue.h"
 #include "configuration.h"
 
 using namespace std;
@@ -37,6 +39,11 @@ const string ConfigurationSqlite::DEFAULT_DATABASE_PATH = "/var/lib/nestor/nesto
 static const string CONF_SQLITE_GLOBAL = "sqlite";
 static const string CONF_SQLITE_DB_PATH = "database_path";
 const string ConfigurationSqlite::DATABASE_PATH_CONFIG_PATH = CONF_SQLITE_GLOBAL + "." + CONF_SQLITE_DB_PATH;
+const unsigned int ConfigurationSqlite::DEFAULT_READ_CONNECTIONS = 0;
+static const string CONF_SQLITE_READ_CONNECTIONS = "read_connections";
+static const string CONF_SQLITE_MMAP_SIZE = "mmap_size";
+static const string CONF_SQLITE_CACHE_SIZE = "cache_size";
+static const string CONF_SQLITE_SYNCHRONOUS = "synchronous";
 
 ConfigurationSqlite::ConfigurationSqlite() {
     reset();
@@ -48,6 +55,10 @@ ConfigurationSqlite::~ConfigurationSqlite() {
 
 void ConfigurationSqlite::reset() {
     databasePath_ = DEFAULT_DATABASE_PATH;
+    readConnections_ = DEFAULT_READ_CONNECTIONS;
+    mmapSize_ = SqliteConnectionPool::DEFAULT_MMAP_SIZE;
+    cacheSize_ = SqliteConnectionPool::DEFAULT_CACHE_SIZE;
+    synchronous_ = SqliteConnectionPool::DEFAULT_SYNCHRONOUS;
 }
 
 string ConfigurationSqlite::databasePath() const {
@@ -63,6 +74,34 @@ void ConfigurationSqlite::load(const libconfig::Config* parser) {
     string confDbPath;
     if (parser->lookupValue(DATABASE_PATH_CONFIG_PATH, confDbPath))
         setDatabasePath(confDbPath);
+
+    int confReaders;
+    if (parser->lookupValue(CONF_SQLITE_GLOBAL + "." + CONF_SQLITE_READ_CONNECTIONS, confReaders)) {
+        if (confReaders >= 0)
+            setReadConnections(static_cast<unsigned int>(confReaders));
+        else
+            cerr << "ConfigurationSqlite::load: Invalid read connections number: " << confReaders << endl;
+    }
+
+    long long confMmapSize;
+    if (parser->lookupValue(CONF_SQLITE_GLOBAL + "." + CONF_SQLITE_MMAP_SIZE, confMmapSize)) {
+        if (confMmapSize >= 0)
+            setMmapSize(confMmapSize);
+        else
+            cerr << "ConfigurationSqlite::load: Invalid mmap size: " << confMmapSize << endl;
+    }
+
+    int confCacheSize;
+    if (parser->lookupValue(CONF_SQLITE_GLOBAL + "." + CONF_SQLITE_CACHE_SIZE, confCacheSize))
+        setCacheSize(confCacheSize);
+
+    string confSynchronous;
+    if (parser->lookupValue(CONF_SQLITE_GLOBAL + "." + CONF_SQLITE_SYNCHRONOUS, confSynchronous)) {
+        if (SqliteConnectionPool::validSynchronous(confSynchronous))
+            setSynchronous(confSynchronous);
+        else
+            cerr << "ConfigurationSqlite::load: Invalid synchronous value: " << confSynchronous << endl;
+    }
 }
 
 
@@ -83,14 +122,311 @@ void ConfigurationSqlite::store(libconfig::Config* parser) {
     Setting &group = root[CONF_SQLITE_GLOBAL];
     CHECK_AND_RECREATE(group, CONF_SQLITE_DB_PATH, Setting::TypeString);
     group[CONF_SQLITE_DB_PATH] = databasePath_;
+    CHECK_AND_RECREATE(group, CONF_SQLITE_READ_CONNECTIONS, Setting::TypeInt);
+    group[CONF_SQLITE_READ_CONNECTIONS] = static_cast<int>(readConnections_);
+    CHECK_AND_RECREATE(group, CONF_SQLITE_MMAP_SIZE, Setting::TypeInt64);
+    group[CONF_SQLITE_MMAP_SIZE] = mmapSize_;
+    CHECK_AND_RECREATE(group, CONF_SQLITE_CACHE_SIZE, Setting::TypeInt);
+    group[CONF_SQLITE_CACHE_SIZE] = cacheSize_;
+    CHECK_AND_RECREATE(group, CONF_SQLITE_SYNCHRONOUS, Setting::TypeString);
+    group[CONF_SQLITE_SYNCHRONOUS] = synchronous_;
 }
 
 void ConfigurationSqlite::setDatabasePath(string &databasePath) {
     databasePath_ = databasePath;
 }
 
+unsigned int ConfigurationSqlite::readConnections() const {
+    return readConnections_;
+}
+
+void ConfigurationSqlite::setReadConnections(unsigned int readConnections) {
+    readConnections_ = readConnections;
+}
+
+long long ConfigurationSqlite::mmapSize() const {
+    return mmapSize_;
+}
+
+void ConfigurationSqlite::setMmapSize(long long mmapSize) {
+    mmapSize_ = mmapSize;
+}
+
+int ConfigurationSqlite::cacheSize() const {
+    return cacheSize_;
+}
+
+void ConfigurationSqlite::setCacheSize(int cacheSize) {
+    cacheSize_ = cacheSize;
+}
+
+const std::string &ConfigurationSqlite::synchronous() const {
+    return synchronous_;
+}
+
+void ConfigurationSqlite::setSynchronous(const std::string &synchronous) {
+    synchronous_ = synchronous;
+}
+
 /* ============ ConfigurationSqlite END ================== */
 
+/* ============ ConfigurationImap BEGIN ================== */
+const string ConfigurationImap::DEFAULT_HOST = "localhost";
+const unsigned short ConfigurationImap::DEFAULT_PORT = 1430;
+const unsigned int ConfigurationImap::DEFAULT_REACTOR_THREADS = 0;
+const bool ConfigurationImap::DEFAULT_PIN_THREADS = false;
+static const string CONF_IMAP_GLOBAL = "imap";
+static const string CONF_IMAP_HOST = "host";
+static const string CONF_IMAP_PORT = "port";
+static const string CONF_IMAP_REACTOR_THREADS = "reactor_threads";
+static const string CONF_IMAP_PIN_THREADS = "pin_threads";
+
+ConfigurationImap::ConfigurationImap() {
+    reset();
+}
+
+ConfigurationImap::~ConfigurationImap() {
+    /* dummy for now */
+}
+
+void ConfigurationImap::reset() {
+    host_ = DEFAULT_HOST;
+    port_ = DEFAULT_PORT;
+    reactorThreads_ = DEFAULT_REACTOR_THREADS;
+    pinThreads_ = DEFAULT_PIN_THREADS;
+}
+
+void ConfigurationImap::load(const libconfig::Config* parser) {
+    if (parser == nullptr) {
+        cerr << "ConfigurationImap::load: Invalid argument: parser == nullptr" << endl;
+        return;
+    }
+
+    string confHost;
+    if (parser->lookupValue(CONF_IMAP_GLOBAL + "." + CONF_IMAP_HOST, confHost))
+        setHost(confHost);
+
+    int confPort;
+    if (parser->lookupValue(CONF_IMAP_GLOBAL + "." + CONF_IMAP_PORT, confPort)) {
+        if (confPort > 0 && confPort <= 65535)
+            setPort(static_cast<unsigned short>(confPort));
+        else
+            cerr << "ConfigurationImap::load: Invalid port: " << confPort << endl;
+    }
+
+    int confThreads;
+    if (parser->lookupValue(CONF_IMAP_GLOBAL + "." + CONF_IMAP_REACTOR_THREADS, confThreads)) {
+        if (confThreads >= 0)
+            setReactorThreads(static_cast<unsigned int>(confThreads));
+        else
+            cerr << "ConfigurationImap::load: Invalid reactor threads number: " << confThreads << endl;
+    }
+
+    bool confPin;
+    if (parser->lookupValue(CONF_IMAP_GLOBAL + "." + CONF_IMAP_PIN_THREADS, confPin))
+        setPinThreads(confPin);
+}
+
+void ConfigurationImap::store(libconfig::Config* parser) {
+    Setting &root = parser->getRoot();
+    CHECK_AND_RECREATE(root, CONF_IMAP_GLOBAL, Setting::TypeGroup);
+
+    Setting &group = root[CONF_IMAP_GLOBAL];
+    CHECK_AND_RECREATE(group, CONF_IMAP_HOST, Setting::TypeString);
+    group[CONF_IMAP_HOST] = host_;
+    CHECK_AND_RECREATE(group, CONF_IMAP_PORT, Setting::TypeInt);
+    group[CONF_IMAP_PORT] = static_cast<int>(port_);
+    CHECK_AND_RECREATE(group, CONF_IMAP_REACTOR_THREADS, Setting::TypeInt);
+    group[CONF_IMAP_REACTOR_THREADS] = static_cast<int>(reactorThreads_);
+    CHECK_AND_RECREATE(group, CONF_IMAP_PIN_THREADS, Setting::TypeBoolean);
+    group[CONF_IMAP_PIN_THREADS] = pinThreads_;
+}
+
+const std::string& ConfigurationImap::host() const {
+    return host_;
+}
+
+void ConfigurationImap::setHost(const std::string &host) {
+    host_ = host;
+}
+
+unsigned short ConfigurationImap::port() const {
+    return port_;
+}
+
+void ConfigurationImap::setPort(unsigned short port) {
+    port_ = port;
+}
+
+unsigned int ConfigurationImap::reactorThreads() const {
+    return reactorThreads_;
+}
+
+void ConfigurationImap::setReactorThreads(unsigned int reactorThreads) {
+    reactorThreads_ = reactorThreads;
+}
+
+bool ConfigurationImap::pinThreads() const {
+    return pinThreads_;
+}
+
+void ConfigurationImap::setPinThreads(bool pinThreads) {
+    pinThreads_ = pinThreads;
+}
+
+/* ============ ConfigurationImap END ==================== */
+
+/* ============ ConfigurationFetch BEGIN ================= */
+const unsigned int ConfigurationFetch::DEFAULT_MAX_TRANSFERS = 64;
+const unsigned int ConfigurationFetch::DEFAULT_MAX_HOST_TRANSFERS = 4;
+const bool ConfigurationFetch::DEFAULT_INCREMENTAL_PARSE = true;
+const unsigned int ConfigurationFetch::DEFAULT_PARSE_THREADS = 0;
+const unsigned int ConfigurationFetch::DEFAULT_COMMIT_BATCH_SIZE = WriteBehindQueue::DEFAULT_MAX_BATCH_SIZE;
+const unsigned int ConfigurationFetch::DEFAULT_COMMIT_DELAY_MS = WriteBehindQueue::DEFAULT_MAX_DELAY_MS;
+static const string CONF_FETCH_GLOBAL = "fetch";
+static const string CONF_FETCH_MAX_TRANSFERS = "max_transfers";
+static const string CONF_FETCH_MAX_HOST_TRANSFERS = "max_host_transfers";
+static const string CONF_FETCH_INCREMENTAL_PARSE = "incremental_parse";
+static const string CONF_FETCH_PARSE_THREADS = "parse_threads";
+static const string CONF_FETCH_COMMIT_BATCH_SIZE = "commit_batch_size";
+static const string CONF_FETCH_COMMIT_DELAY_MS = "commit_delay_ms";
+
+ConfigurationFetch::ConfigurationFetch() {
+    reset();
+}
+
+ConfigurationFetch::~ConfigurationFetch() {
+    /* dummy for now */
+}
+
+void ConfigurationFetch::reset() {
+    maxTransfers_ = DEFAULT_MAX_TRANSFERS;
+    maxHostTransfers_ = DEFAULT_MAX_HOST_TRANSFERS;
+    incrementalParse_ = DEFAULT_INCREMENTAL_PARSE;
+    parseThreads_ = DEFAULT_PARSE_THREADS;
+    commitBatchSize_ = DEFAULT_COMMIT_BATCH_SIZE;
+    commitDelayMs_ = DEFAULT_COMMIT_DELAY_MS;
+}
+
+void ConfigurationFetch::load(const libconfig::Config* parser) {
+    if (parser == nullptr) {
+        cerr << "ConfigurationFetch::load: Invalid argument: parser == nullptr" << endl;
+        return;
+    }
+
+    int confTransfers;
+    if (parser->lookupValue(CONF_FETCH_GLOBAL + "." + CONF_FETCH_MAX_TRANSFERS, confTransfers)) {
+        if (confTransfers > 0)
+            setMaxTransfers(static_cast<unsigned int>(confTransfers));
+        else
+            cerr << "ConfigurationFetch::load: Invalid max transfers number: " << confTransfers << endl;
+    }
+
+    if (parser->lookupValue(CONF_FETCH_GLOBAL + "." + CONF_FETCH_MAX_HOST_TRANSFERS, confTransfers)) {
+        if (confTransfers > 0)
+            setMaxHostTransfers(static_cast<unsigned int>(confTransfers));
+        else
+            cerr << "ConfigurationFetch::load: Invalid max host transfers number: " << confTransfers << endl;
+    }
+
+    bool confIncremental;
+    if (parser->lookupValue(CONF_FETCH_GLOBAL + "." + CONF_FETCH_INCREMENTAL_PARSE, confIncremental))
+        setIncrementalParse(confIncremental);
+
+    int confThreads;
+    if (parser->lookupValue(CONF_FETCH_GLOBAL + "." + CONF_FETCH_PARSE_THREADS, confThreads)) {
+        if (confThreads >= 0)
+            setParseThreads(static_cast<unsigned int>(confThreads));
+        else
+            cerr << "ConfigurationFetch::load: Invalid parse threads number: " << confThreads << endl;
+    }
+
+    int confBatchSize;
+    if (parser->lookupValue(CONF_FETCH_GLOBAL + "." + CONF_FETCH_COMMIT_BATCH_SIZE, confBatchSize)) {
+        if (confBatchSize > 0)
+            setCommitBatchSize(static_cast<unsigned int>(confBatchSize));
+        else
+            cerr << "ConfigurationFetch::load: Invalid commit batch size: " << confBatchSize << endl;
+    }
+
+    int confDelay;
+    if (parser->lookupValue(CONF_FETCH_GLOBAL + "." + CONF_FETCH_COMMIT_DELAY_MS, confDelay)) {
+        if (confDelay >= 0)
+            setCommitDelayMs(static_cast<unsigned int>(confDelay));
+        else
+            cerr << "ConfigurationFetch::load: Invalid commit delay: " << confDelay << endl;
+    }
+}
+
+void ConfigurationFetch::store(libconfig::Config* parser) {
+    Setting &root = parser->getRoot();
+    CHECK_AND_RECREATE(root, CONF_FETCH_GLOBAL, Setting::TypeGroup);
+
+    Setting &group = root[CONF_FETCH_GLOBAL];
+    CHECK_AND_RECREATE(group, CONF_FETCH_MAX_TRANSFERS, Setting::TypeInt);
+    group[CONF_FETCH_MAX_TRANSFERS] = static_cast<int>(maxTransfers_);
+    CHECK_AND_RECREATE(group, CONF_FETCH_MAX_HOST_TRANSFERS, Setting::TypeInt);
+    group[CONF_FETCH_MAX_HOST_TRANSFERS] = static_cast<int>(maxHostTransfers_);
+    CHECK_AND_RECREATE(group, CONF_FETCH_INCREMENTAL_PARSE, Setting::TypeBoolean);
+    group[CONF_FETCH_INCREMENTAL_PARSE] = incrementalParse_;
+    CHECK_AND_RECREATE(group, CONF_FETCH_PARSE_THREADS, Setting::TypeInt);
+    group[CONF_FETCH_PARSE_THREADS] = static_cast<int>(parseThreads_);
+    CHECK_AND_RECREATE(group, CONF_FETCH_COMMIT_BATCH_SIZE, Setting::TypeInt);
+    group[CONF_FETCH_COMMIT_BATCH_SIZE] = static_cast<int>(commitBatchSize_);
+    CHECK_AND_RECREATE(group, CONF_FETCH_COMMIT_DELAY_MS, Setting::TypeInt);
+    group[CONF_FETCH_COMMIT_DELAY_MS] = static_cast<int>(commitDelayMs_);
+}
+
+unsigned int ConfigurationFetch::maxTransfers() const {
+    return maxTransfers_;
+}
+
+void ConfigurationFetch::setMaxTransfers(unsigned int maxTransfers) {
+    maxTransfers_ = maxTransfers;
+}
+
+unsigned int ConfigurationFetch::maxHostTransfers() const {
+    return maxHostTransfers_;
+}
+
+void ConfigurationFetch::setMaxHostTransfers(unsigned int maxHostTransfers) {
+    maxHostTransfers_ = maxHostTransfers;
+}
+
+bool ConfigurationFetch::incrementalParse() const {
+    return incrementalParse_;
+}
+
+void ConfigurationFetch::setIncrementalParse(bool incrementalParse) {
+    incrementalParse_ = incrementalParse;
+}
+
+unsigned int ConfigurationFetch::parseThreads() const {
+    return parseThreads_;
+}
+
+void ConfigurationFetch::setParseThreads(unsigned int parseThreads) {
+    parseThreads_ = parseThreads;
+}
+
+unsigned int ConfigurationFetch::commitBatchSize() const {
+    return commitBatchSize_;
+}
+
+void ConfigurationFetch::setCommitBatchSize(unsigned int commitBatchSize) {
+    commitBatchSize_ = commitBatchSize;
+}
+
+unsigned int ConfigurationFetch::commitDelayMs() const {
+    return commitDelayMs_;
+}
+
+void ConfigurationFetch::setCommitDelayMs(unsigned int commitDelayMs) {
+    commitDelayMs_ = commitDelayMs;
+}
+
+/* ============ ConfigurationFetch END =================== */
+
 /* ============ Configuration BEGIN ====================== */
 Configuration *Configuration::instance_ = nullptr;
 recursive_mutex Configuration::instanceLock_;
@@ -153,6 +489,22 @@ void Configuration::setSqliteConfig(const ConfigurationSqlite& sqliteConfig) {
     sqliteConfig_ = sqliteConfig;
 }
 
+ConfigurationImap& Configuration::imapConfig() {
+    return imapConfig_;
+}
+
+void Configuration::setImapConfig(const ConfigurationImap& imapConfig) {
+    imapConfig_ = imapConfig;
+}
+
+ConfigurationFetch& Configuration::fetchConfig() {
+    return fetchConfig_;
+}
+
+void Configuration::setFetchConfig(const ConfigurationFetch& fetchConfig) {
+    fetchConfig_ = fetchConfig;
+}
+
 
 
 Configuration* Configuration::instance() {
@@ -174,6 +526,8 @@ void Configuration::reset() {
     setDatabaseProvider(DEFAULT_DATABASE_PROVIDER);
     setLogFile(DEFAULT_LOG_FILE);
     sqliteConfig_.reset();
+    imapConfig_.reset();
+    fetchConfig_.reset();
 }
 
 
@@ -222,6 +576,8 @@ bool Configuration::load(const std::string &configFile) {
         setLogFile(str);
 
     sqliteConfig_.load(parser_);
+    imapConfig_.load(parser_);
+    fetchConfig_.load(parser_);
 
     cout << "Configuration::load: Configuration successfully loaded from file " << configFile << endl;
     return true;
@@ -250,6 +606,8 @@ bool Configuration::store(const std::string& configFile) {
     root.add(LOG_FILE_PATH, Setting::TypeString) = logFile_;
 
     sqliteConfig_.store(parser_);
+    imapConfig_.store(parser_);
+    fetchConfig_.store(parser_);
 
     try {
         parser_->writeFile(configFile.c_str());
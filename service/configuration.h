@@ -36,6 +36,7 @@ namespace service {
 class ConfigurationSqlite {
 public:
     static const std::string DEFAULT_DATABASE_PATH;
+    static const unsigned int DEFAULT_READ_CONNECTIONS;
 
     explicit ConfigurationSqlite();
     ~ConfigurationSqlite();
@@ -48,14 +49,159 @@ public:
     std::string databasePath() const;
     void setDatabasePath(std::string &databasePath);
 
+    /**
+     * Number of read-only database connections.
+     * 0 means one connection per IMAP reactor thread. Every reactor
+     * needs its own connection, so smaller numbers are raised to the
+     * number of reactors.
+     */
+    unsigned int readConnections() const;
+    void setReadConnections(unsigned int readConnections);
+
+    /**
+     * Size of memory mapped I/O in bytes (PRAGMA mmap_size).
+     */
+    long long mmapSize() const;
+    void setMmapSize(long long mmapSize);
+
+    /**
+     * Page cache size of every connection (PRAGMA cache_size).
+     * Negative value is the size in KiB.
+     */
+    int cacheSize() const;
+    void setCacheSize(int cacheSize);
+
+    /**
+     * Write durability level (PRAGMA synchronous): OFF, NORMAL or FULL.
+     */
+    const std::string &synchronous() const;
+    void setSynchronous(const std::string &synchronous);
+
 private:
     std::string databasePath_;
+    unsigned int readConnections_;
+    long long mmapSize_;
+    int cacheSize_;
+    std::string synchronous_;
 
 // constants
 private:
     static const std::string DATABASE_PATH_CONFIG_PATH;
 };
 
+/**
+ * IMAP server specific options
+ */
+class ConfigurationImap {
+public:
+    static const std::string DEFAULT_HOST;
+    static const unsigned short DEFAULT_PORT;
+    static const unsigned int DEFAULT_REACTOR_THREADS;
+    static const bool DEFAULT_PIN_THREADS;
+
+    explicit ConfigurationImap();
+    ~ConfigurationImap();
+
+    void reset();
+
+    void load(const libconfig::Config *parser);
+    void store(libconfig::Config *parser);
+
+    const std::string& host() const;
+    void setHost(const std::string &host);
+    unsigned short port() const;
+    void setPort(unsigned short port);
+
+    /**
+     * Number of event loop threads serving IMAP connections.
+     * 0 means one thread per available CPU core.
+     */
+    unsigned int reactorThreads() const;
+    void setReactorThreads(unsigned int reactorThreads);
+
+    /**
+     * If true, every event loop thread is bound to its own CPU core.
+     */
+    bool pinThreads() const;
+    void setPinThreads(bool pinThreads);
+
+private:
+    std::string host_;
+    unsigned short port_;
+    unsigned int reactorThreads_;
+    bool pinThreads_;
+};
+
+/**
+ * Feeds downloading options
+ */
+class ConfigurationFetch {
+public:
+    static const unsigned int DEFAULT_MAX_TRANSFERS;
+    static const unsigned int DEFAULT_MAX_HOST_TRANSFERS;
+    static const bool DEFAULT_INCREMENTAL_PARSE;
+    static const unsigned int DEFAULT_PARSE_THREADS;
+    static const unsigned int DEFAULT_COMMIT_BATCH_SIZE;
+    static const unsigned int DEFAULT_COMMIT_DELAY_MS;
+
+    explicit ConfigurationFetch();
+    ~ConfigurationFetch();
+
+    void reset();
+
+    void load(const libconfig::Config *parser);
+    void store(libconfig::Config *parser);
+
+    /**
+     * Maximum number of feeds downloaded simultaneously.
+     */
+    unsigned int maxTransfers() const;
+    void setMaxTransfers(unsigned int maxTransfers);
+
+    /**
+     * Maximum number of feeds downloaded simultaneously from one host.
+     */
+    unsigned int maxHostTransfers() const;
+    void setMaxHostTransfers(unsigned int maxHostTransfers);
+
+    /**
+     * If true, feeds are parsed while they are downloaded and are never
+     * buffered in full.
+     */
+    bool incrementalParse() const;
+    void setIncrementalParse(bool incrementalParse);
+
+    /**
+     * Number of threads parsing downloaded feeds.
+     * 0 means one thread per available CPU core.
+     */
+    unsigned int parseThreads() const;
+    void setParseThreads(unsigned int parseThreads);
+
+    /**
+     * Maximum number of feeds stored in one transaction.
+     */
+    unsigned int commitBatchSize() const;
+    void setCommitBatchSize(unsigned int commitBatchSize);
+
+    /**
+     * Maximum time a stored feed waits for its transaction to be committed.
+     * Longer delays make fewer commits, but a crash loses more feeds, which
+     * are downloaded again after restart. 0 commits as soon as the stored
+     * feeds run out.
+     */
+    unsigned int commitDelayMs() const;
+    void setCommitDelayMs(unsigned int commitDelayMs);
+
+private:
+    unsigned int maxTransfers_;
+    unsigned int maxHostTransfers_;
+    bool incrementalParse_;
+    unsigned int parseThreads_;
+    unsigned int commitBatchSize_;
+    unsigned int commitDelayMs_;
+};
+
 /**
  * Singleton class. Represents config of the whole application.
  */
@@ -92,6 +238,10 @@ public:
     void setDatabaseProvider(const std::string& databaseProvider);
     ConfigurationSqlite& sqliteConfig();
     void setSqliteConfig(const ConfigurationSqlite& sqliteConfig);
+    ConfigurationImap& imapConfig();
+    void setImapConfig(const ConfigurationImap& imapConfig);
+    ConfigurationFetch& fetchConfig();
+    void setFetchConfig(const ConfigurationFetch& fetchConfig);
     const std::string& logFile() const;
     void setLogFile(const std::string& logFile);
 
@@ -109,6 +259,8 @@ private:
     std::string databaseProvider_;
     std::string logFile_;
     ConfigurationSqlite sqliteConfig_;
+    ConfigurationImap imapConfig_;
+    ConfigurationFetch fetchConfig_;
 
     libconfig::Config *parser_;
     std::string loadedConfigFile_;
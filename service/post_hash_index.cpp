@@ -0,0 +1,118 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include "utils/hash.h"
+#include "post_hash_index.h"
+
+using namespace std;
+using namespace nestor::utils;
+
+namespace nestor {
+namespace service {
+
+PostHashIndex::PostHashIndex() : size_(0), hits_(0), misses_(0) {
+}
+
+PostHashIndex::~PostHashIndex() {
+}
+
+bool PostHashIndex::containsChannel(int64_t channelId) const {
+    return channels_.find(channelId) != channels_.end();
+}
+
+void PostHashIndex::addChannel(int64_t channelId) {
+    channels_[channelId];
+}
+
+void PostHashIndex::removeChannel(int64_t channelId) {
+    auto it = channels_.find(channelId);
+    if (it == channels_.end())
+        return;
+    size_ -= it->second.size();
+    channels_.erase(it);
+}
+
+bool PostHashIndex::unchanged(const Post &post, bool compareDate) {
+    auto channel = channels_.find(post.channelId());
+    if (channel != channels_.end()) {
+        auto it = channel->second.find(guidHash(post));
+        if (it != channel->second.end() && it->second.content == contentHash(post)
+                && (!compareDate || it->second.date == dateHash(post))) {
+            hits_++;
+            return true;
+        }
+    }
+    misses_++;
+    return false;
+}
+
+bool PostHashIndex::containsGuid(int64_t channelId, const std::string &guid) const {
+    auto channel = channels_.find(channelId);
+    if (channel == channels_.end())
+        return false;
+    return channel->second.count(fnv1a64(guid)) > 0;
+}
+
+void PostHashIndex::store(const Post &post) {
+    ChannelPosts &posts = channels_[post.channelId()];
+    PostHashes hashes = {contentHash(post), dateHash(post)};
+    auto res = posts.insert(make_pair(guidHash(post), hashes));
+    if (res.second)
+        size_++;
+    else
+        res.first->second = hashes;
+}
+
+size_t PostHashIndex::hits() const {
+    return hits_;
+}
+
+size_t PostHashIndex::misses() const {
+    return misses_;
+}
+
+size_t PostHashIndex::size() const {
+    return size_;
+}
+
+uint64_t PostHashIndex::guidHash(const Post &post) {
+    return fnv1a64(post.guid());
+}
+
+uint64_t PostHashIndex::contentHash(const Post &post) {
+    // Fields are hashed with their terminating zeros, so moving text
+    // from one field to the next changes the hash.
+    uint64_t hash = FNV1A_64_OFFSET;
+    hash = fnv1a64(post.title().c_str(), post.title().length() + 1, hash);
+    hash = fnv1a64(post.link().c_str(), post.link().length() + 1, hash);
+    hash = fnv1a64(post.description().c_str(), post.description().length() + 1, hash);
+    return fnv1a64(post.text().c_str(), post.text().length() + 1, hash);
+}
+
+uint64_t PostHashIndex::dateHash(const Post &post) {
+    // Only fields stored in the database, tm_wday and others are not kept
+    const tm &date = post.publicationDate();
+    int dateFields[] = {date.tm_year, date.tm_mon, date.tm_mday,
+                        date.tm_hour, date.tm_min, date.tm_sec};
+    return fnv1a64(dateFields, sizeof(dateFields));
+}
+
+} /* namespace service */
+} /* namespace nestor */
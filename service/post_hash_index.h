@@ -0,0 +1,107 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef POST_HASH_INDEX_H_
+#define POST_HASH_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "types.h"
+
+namespace nestor {
+namespace service {
+
+/**
+ * Compact in-memory copy of stored posts: for every channel maps hash
+ * of post GUID to hashes of post content and publication date. Lets
+ * feed updates drop items which are already stored unchanged without
+ * querying the database.
+ */
+class PostHashIndex {
+public:
+    PostHashIndex();
+    virtual ~PostHashIndex();
+
+    /**
+     * Checks if posts of the channel were loaded into the index.
+     */
+    bool containsChannel(int64_t channelId) const;
+
+    /**
+     * Marks channel as loaded. Its posts are added with store().
+     */
+    void addChannel(int64_t channelId);
+
+    /**
+     * Forgets all posts of the channel, e.g. after failed transaction.
+     */
+    void removeChannel(int64_t channelId);
+
+    /**
+     * Checks if the post is stored with the same content.
+     * Counts the result as hit or miss.
+     * @param compareDate false if publication date of the post is not
+     * taken from the feed and should not be compared.
+     */
+    bool unchanged(const Post &post, bool compareDate = true);
+
+    /**
+     * Checks if post with the GUID is stored in the channel, whatever
+     * its content is. Doesn't count hits and misses.
+     */
+    bool containsGuid(int64_t channelId, const std::string &guid) const;
+
+    /**
+     * Remembers content of the stored post.
+     */
+    void store(const Post &post);
+
+    /** Number of posts found unchanged */
+    size_t hits() const;
+
+    /** Number of new or changed posts */
+    size_t misses() const;
+
+    /** Number of posts in the index */
+    size_t size() const;
+
+    static uint64_t guidHash(const Post &post);
+    static uint64_t contentHash(const Post &post);
+    static uint64_t dateHash(const Post &post);
+
+private:
+    struct PostHashes {
+        uint64_t content;
+        uint64_t date;
+    };
+    typedef std::unordered_map<uint64_t, PostHashes> ChannelPosts;
+
+    std::unordered_map<int64_t, ChannelPosts> channels_;
+    size_t size_;
+    size_t hits_;
+    size_t misses_;
+};
+
+} /* namespace service */
+} /* namespace nestor */
+
+#endif /* POST_HASH_INDEX_H_ */
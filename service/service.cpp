@@ -24,10 +24,9 @@
 namespace nestor {
 namespace service {
 
-Service::Service(const SqliteConnection *connection)
+Service::Service(SqliteConnection *connection, SqliteStatementCache *statements)
         : connection_(connection) {
-    dataProvider_ = new SqliteProvider(connection);
-    dataProvider_->prepareStatements();
+    dataProvider_ = new SqliteProvider(connection, statements);
 }
 
 Service::~Service() {
@@ -33,7 +33,13 @@ namespace service {
  */
 class Service {
 public:
-    Service(const SqliteConnection *connection);
+    /**
+     * @param connection Database connection.
+     * @param statements Compiled statements shared by the services of
+     * the calling thread. If nullptr, statements are compiled for this
+     * service only.
+     */
+    Service(SqliteConnection *connection, SqliteStatementCache *statements = nullptr);
     virtual ~Service();
 
     virtual bool authenticate(std::string login, std::string password);
@@ -41,7 +47,7 @@ public:
     virtual void onLogout();
 
 private:
-    const SqliteConnection *connection_;
+    SqliteConnection *connection_;
     SqliteProvider *dataProvider_;
 };
 
@@ -26,8 +26,9 @@ using namespace std;
 namespace nestor {
 namespace service {
 
-SqliteConnection::SqliteConnection(const std::string &fileName)
-        : fileName_(fileName), handle_(nullptr), connected_(false) {
+SqliteConnection::SqliteConnection(const std::string &fileName, bool readOnly)
+        : fileName_(fileName), handle_(nullptr), connected_(false), readOnly_(readOnly),
+          nextCallbackId_(0) {
     onCloseCallbacks_.clear();
 }
 
@@ -41,10 +42,13 @@ SqliteConnection::~SqliteConnection() {
 
 
 void SqliteConnection::open() {
-    int code = sqlite3_open(fileName_.c_str(), &handle_);
+    int flags = readOnly_ ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    int code = sqlite3_open_v2(fileName_.c_str(), &handle_, flags, nullptr);
     if (code != SQLITE_OK) {
         SERVICE_LOG_LVL(ERROR, "SqliteConnection::open: cannot connect to file: " << fileName_
                 << ". Error code: " << code << " Description: " << sqlite3_errstr(code));
+        sqlite3_close(handle_);
+        handle_ = nullptr;
         throw SqliteConnectionException(sqlite3_errstr(code));
     }
     connected_ = true;
@@ -52,8 +56,16 @@ void SqliteConnection::open() {
 
 void SqliteConnection::close() {
     if (handle_) {
-        for (auto callback: onCloseCallbacks_)
-            callback(this);
+        vector<SqliteConnectionCallback> callbacks;
+        {
+            lock_guard<mutex> locker(callbacksLock_);
+            for (auto &subscription : onCloseCallbacks_)
+                callbacks.push_back(subscription.second);
+        }
+        for (auto callback: callbacks) {
+            if (callback)
+                callback(this);
+        }
         int code = sqlite3_close(handle_);
         handle_ = nullptr;
         connected_ = false;
@@ -76,6 +88,27 @@ bool SqliteConnection::connected() const {
 }
 
 
+bool SqliteConnection::readOnly() const {
+    return readOnly_;
+}
+
+
+void SqliteConnection::execute(const std::string &sql) {
+    if (!handle_)
+        throw SqliteConnectionException("SqliteConnection::execute: database is not opened");
+
+    char *errmsg = nullptr;
+    int code = sqlite3_exec(handle_, sql.c_str(), nullptr, nullptr, &errmsg);
+    if (code != SQLITE_OK) {
+        string description = errmsg ? errmsg : sqlite3_errstr(code);
+        sqlite3_free(errmsg);
+        SERVICE_LOG_LVL(ERROR, "SqliteConnection::execute: cannot execute '" << sql
+                << "'. Error code: " << code << " Description: " << description);
+        throw SqliteConnectionException(description);
+    }
+}
+
+
 const std::string& SqliteConnection::fileName() const {
     return fileName_;
 }
@@ -86,8 +119,15 @@ void SqliteConnection::setFileName(const std::string& fileName) {
 }
 
 int SqliteConnection::subscribeOnClose(SqliteConnectionCallback callback) {
-    onCloseCallbacks_.push_back(callback);
-    return onCloseCallbacks_.size() - 1;
+    lock_guard<mutex> locker(callbacksLock_);
+    int id = nextCallbackId_++;
+    onCloseCallbacks_[id] = callback;
+    return id;
+}
+
+void SqliteConnection::unsubscribeOnClose(int id) {
+    lock_guard<mutex> locker(callbacksLock_);
+    onCloseCallbacks_.erase(id);
 }
 
 } /* namespace service */
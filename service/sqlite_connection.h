@@ -25,6 +25,8 @@
 #include <stdexcept>
 #include <functional>
 #include <vector>
+#include <map>
+#include <mutex>
 #include "sqlite3.h"
 
 namespace nestor {
@@ -38,7 +40,12 @@ class SqliteConnection {
 public:
     typedef std::function<void (SqliteConnection *)> SqliteConnectionCallback;
 
-    explicit SqliteConnection(const std::string &fileName);
+    /**
+     * @param fileName Database file.
+     * @param readOnly Open the database only for reading. Read-only
+     * connections don't create missing database file.
+     */
+    explicit SqliteConnection(const std::string &fileName, bool readOnly = false);
     virtual ~SqliteConnection();
 
     virtual void open();
@@ -46,8 +53,26 @@ public:
 
     virtual bool connected() const;
 
+    bool readOnly() const;
+
+    /**
+     * Executes SQL commands without results, e.g. PRAGMAs.
+     * Throws SqliteConnectionException on error.
+     */
+    void execute(const std::string &sql);
+
+    /**
+     * Registers callback called before the database is closed.
+     * @return Subscription id for unsubscribeOnClose().
+     */
     int subscribeOnClose(SqliteConnectionCallback callback);
 
+    /**
+     * Removes callback registered by subscribeOnClose().
+     * Negative or unknown ids are ignored.
+     */
+    void unsubscribeOnClose(int id);
+
     sqlite3 *handle() const;
 
     const std::string& fileName() const;
@@ -57,8 +82,12 @@ private:
     std::string fileName_;
     sqlite3 *handle_;
     bool connected_;
+    bool readOnly_;
 
-    std::vector<SqliteConnectionCallback> onCloseCallbacks_;
+    /** Callbacks by subscription id, called in subscription order */
+    std::map<int, SqliteConnectionCallback> onCloseCallbacks_;
+    int nextCallbackId_;
+    std::mutex callbacksLock_;
 };
 
 } /* namespace service */
@@ -0,0 +1,165 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <sstream>
+#include <stdexcept>
+#include <strings.h>
+#include "common/logger.h"
+#include "sqlite_connection_pool.h"
+
+using namespace std;
+
+namespace nestor {
+namespace service {
+
+const char * const SqliteConnectionPool::DEFAULT_SYNCHRONOUS = "NORMAL";
+
+SqliteConnectionPool::SqliteConnectionPool(const std::string &fileName, size_t readersCount)
+        : fileName_(fileName), mmapSize_(DEFAULT_MMAP_SIZE), cacheSize_(DEFAULT_CACHE_SIZE),
+          synchronous_(DEFAULT_SYNCHRONOUS) {
+    if (readersCount == 0)
+        readersCount = 1;
+
+    writer_ = new SqliteConnection(fileName_);
+    for (size_t i = 0; i < readersCount; i++)
+        readers_.push_back(new SqliteConnection(fileName_, true));
+}
+
+SqliteConnectionPool::~SqliteConnectionPool() {
+    try {
+        close();
+    } catch (SqliteConnectionException &e) {
+        SERVICE_LOG_LVL(ERROR, "SqliteConnectionPool::dtr: exception while closing database");
+    }
+
+    for (SqliteConnection *reader : readers_)
+        delete reader;
+    readers_.clear();
+    delete writer_;
+}
+
+void SqliteConnectionPool::open() {
+    try {
+        /* Writer goes first: it creates the database and the WAL
+         * files, which read-only connections cannot do. */
+        writer_->open();
+        configure(writer_);
+        enableWal();
+
+        for (SqliteConnection *reader : readers_) {
+            reader->open();
+            configure(reader);
+        }
+    } catch (SqliteConnectionException &e) {
+        close();
+        throw;
+    }
+
+    SERVICE_LOG("SqliteConnectionPool::open: opened " << fileName_ << " with "
+            << readers_.size() << " readers");
+}
+
+void SqliteConnectionPool::close() {
+    for (SqliteConnection *reader : readers_)
+        reader->close();
+    // Last connection checkpoints and removes the WAL file
+    writer_->close();
+}
+
+bool SqliteConnectionPool::connected() const {
+    return writer_->connected();
+}
+
+SqliteConnection *SqliteConnectionPool::writer() const {
+    return writer_;
+}
+
+SqliteConnection *SqliteConnectionPool::reader(size_t index) const {
+    return readers_[index % readers_.size()];
+}
+
+size_t SqliteConnectionPool::readersCount() const {
+    return readers_.size();
+}
+
+long long SqliteConnectionPool::mmapSize() const {
+    return mmapSize_;
+}
+
+void SqliteConnectionPool::setMmapSize(long long mmapSize) {
+    mmapSize_ = mmapSize;
+}
+
+int SqliteConnectionPool::cacheSize() const {
+    return cacheSize_;
+}
+
+void SqliteConnectionPool::setCacheSize(int cacheSize) {
+    cacheSize_ = cacheSize;
+}
+
+const std::string &SqliteConnectionPool::synchronous() const {
+    return synchronous_;
+}
+
+void SqliteConnectionPool::setSynchronous(const std::string &synchronous) {
+    if (!validSynchronous(synchronous))
+        throw invalid_argument("SqliteConnectionPool::setSynchronous: invalid value " + synchronous);
+    synchronous_ = synchronous;
+}
+
+bool SqliteConnectionPool::validSynchronous(const std::string &synchronous) {
+    static const char *values[] = {"OFF", "NORMAL", "FULL"};
+    for (const char *value : values) {
+        if (strcasecmp(synchronous.c_str(), value) == 0)
+            return true;
+    }
+    return false;
+}
+
+void SqliteConnectionPool::configure(SqliteConnection *connection) {
+    ostringstream oss;
+    oss << "PRAGMA busy_timeout=" << DEFAULT_BUSY_TIMEOUT_MS << ";"
+        << "PRAGMA cache_size=" << cacheSize_ << ";"
+        << "PRAGMA mmap_size=" << mmapSize_ << ";";
+    if (!connection->readOnly())
+        oss << "PRAGMA synchronous=" << synchronous_ << ";";
+    connection->execute(oss.str());
+}
+
+void SqliteConnectionPool::enableWal() {
+    // journal_mode is persistent, but the pragma reports the mode in effect
+    sqlite3_stmt *stmt = nullptr;
+    string mode;
+    if (sqlite3_prepare_v2(writer_->handle(), "PRAGMA journal_mode=WAL", -1, &stmt, NULL) == SQLITE_OK
+            && sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0)) {
+        mode = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+
+    if (strcasecmp(mode.c_str(), "wal") != 0) {
+        SERVICE_LOG_LVL(WARN, "SqliteConnectionPool::enableWal: cannot enable WAL for "
+                << fileName_ << ", journal mode is '" << mode
+                << "'. Readers may wait for the writer");
+    }
+}
+
+} /* namespace service */
+} /* namespace nestor */
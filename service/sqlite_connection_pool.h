@@ -0,0 +1,115 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef SQLITE_CONNECTION_POOL_H_
+#define SQLITE_CONNECTION_POOL_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "sqlite_connection.h"
+
+namespace nestor {
+namespace service {
+
+/**
+ * Set of connections to one database in WAL journal mode: a single
+ * writer connection and several read-only connections. In WAL mode
+ * readers see the last committed snapshot and never wait for the
+ * writer, so a long feed update transaction doesn't block IMAP
+ * sessions. Every reader should be used by one thread.
+ */
+class SqliteConnectionPool {
+public:
+    /** Default memory mapped I/O size in bytes */
+    static const long long DEFAULT_MMAP_SIZE = 256LL * 1024 * 1024;
+    /** Default page cache size. Negative value means KiB, not pages */
+    static const int DEFAULT_CACHE_SIZE = -16 * 1024;
+    /** Default time to wait for a lock before SQLITE_BUSY */
+    static const int DEFAULT_BUSY_TIMEOUT_MS = 5000;
+    /** Default PRAGMA synchronous value. WAL stays consistent with NORMAL */
+    static const char * const DEFAULT_SYNCHRONOUS;
+
+    /**
+     * @param fileName Database file.
+     * @param readersCount Number of read-only connections, at least one
+     * is created.
+     */
+    SqliteConnectionPool(const std::string &fileName, size_t readersCount);
+    virtual ~SqliteConnectionPool();
+
+    /**
+     * Opens the writer, switches the database to WAL mode and opens
+     * readers. Throws SqliteConnectionException on error.
+     */
+    void open();
+
+    /**
+     * Closes all connections. Readers are closed first.
+     */
+    void close();
+
+    bool connected() const;
+
+    /** Connection for all modifications of the database */
+    SqliteConnection *writer() const;
+
+    /**
+     * Read-only connection. Indexes wrap around, so any thread number
+     * may be passed, but threads with the same index modulo readers
+     * count share the connection.
+     */
+    SqliteConnection *reader(size_t index) const;
+    size_t readersCount() const;
+
+    long long mmapSize() const;
+    void setMmapSize(long long mmapSize);
+    int cacheSize() const;
+    void setCacheSize(int cacheSize);
+    const std::string &synchronous() const;
+    /**
+     * Sets PRAGMA synchronous value: OFF, NORMAL or FULL.
+     * Throws std::invalid_argument on other values.
+     */
+    void setSynchronous(const std::string &synchronous);
+
+    /**
+     * Checks if value may be passed to setSynchronous().
+     */
+    static bool validSynchronous(const std::string &synchronous);
+
+private:
+    void configure(SqliteConnection *connection);
+    void enableWal();
+
+private:
+    std::string fileName_;
+    SqliteConnection *writer_;
+    std::vector<SqliteConnection *> readers_;
+
+    long long mmapSize_;
+    int cacheSize_;
+    std::string synchronous_;
+};
+
+} /* namespace service */
+} /* namespace nestor */
+
+#endif /* SQLITE_CONNECTION_POOL_H_ */
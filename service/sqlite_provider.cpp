@@ -18,6 +18,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
  */
+#include <algorithm>
 #include <string>
 #include <cstring>
 #include <sstream>
@@ -31,6 +32,11 @@ using namespace nestor::utils;
 namespace nestor {
 namespace service {
 
+/* Channel row followed by its poll columns, as parseChannelRow() reads it */
+#define SELECT_CHANNELS "SELECT `ch`.*, `p`.`polled_at`, `p`.`bytes_transferred`, " \
+    "`p`.`bytes_decoded` FROM `channels` AS `ch` " \
+    "LEFT JOIN `channel_polls` AS `p` ON `p`.`channel_id` = `ch`.`channel_id` "
+
 const char *SqliteProvider::SQL_STATEMENTS[STATEMENTS_LENGTH] = {
         // --------- STATEMENT_BEGIN_TRANSACTION -----------------
         "BEGIN TRANSACTION;",
@@ -38,6 +44,9 @@ const char *SqliteProvider::SQL_STATEMENTS[STATEMENTS_LENGTH] = {
         // --------- STATEMENT_END_TRANSACTION -----------------
         "END TRANSACTION;",
         // -------------------------------------------------------
+        // --------- STATEMENT_ROLLBACK_TRANSACTION --------------
+        "ROLLBACK TRANSACTION;",
+        // -------------------------------------------------------
         // --------- STATEMENT_CREATE_USER_TABLE------------------
         "CREATE TABLE IF NOT EXISTS `users`("
         "`user_id` INTEGER PRIMARY KEY ASC AUTOINCREMENT NOT NULL,"
@@ -77,30 +86,34 @@ const char *SqliteProvider::SQL_STATEMENTS[STATEMENTS_LENGTH] = {
         "`link` VARCHAR(2048) NOT NULL,"
         "`description` VARCHAR(400) NOT NULL,"
         "`update_interval_sec` INTEGER NOT NULL DEFAULT '3600',"
-        "`last_update` TEXT);\n"
+        "`last_update` TEXT,"
+        "`etag` TEXT,"
+        "`last_modified` TEXT,"
+        "`known_guid_limit` INTEGER NOT NULL DEFAULT 0);\n"
         "CREATE INDEX IF NOT EXISTS `channels_rss_link_idx` on `channels`"
         "(`rss_link`);",
         //--------------------------------------------------------
 
         // --------- STATEMENT_FIND_CHANNEL_BY_ID-----------------
-        "SELECT * FROM `channels` WHERE `channel_id` = :channelid;",
+        SELECT_CHANNELS "WHERE `ch`.`channel_id` = :channelid;",
         //--------------------------------------------------------
 
         // --------- STATEMENT_FIND_CHANNEL_BY_RSS_LINK-----------------
-        "SELECT * FROM `channels` WHERE `rss_link` = :rss_link;",
+        SELECT_CHANNELS "WHERE `ch`.`rss_link` = :rss_link;",
         //--------------------------------------------------------
 
         // --------- STATEMENT_INSERT_NEW_CHANNEL-----------------
         "INSERT INTO `channels`(`title`, `rss_link`, `link`, `description`,"
-        "`update_interval_sec`, `last_update`) "
+        "`update_interval_sec`, `last_update`, `etag`, `last_modified`) "
         "VALUES(:title, :rss_link, :link, :description, :update_interval_sec,"
-        ":last_update);",
+        ":last_update, :etag, :last_modified);",
         //--------------------------------------------------------
 
         // --------- STATEMENT_UPDATE_CHANNEL---------------------
         "UPDATE `channels` SET `title`=:title, `rss_link`=:rss_link, "
         "`link`=:link, `description`=:description, "
-        "`update_interval_sec`=:update_interval_sec, `last_update`=:last_update "
+        "`update_interval_sec`=:update_interval_sec, `last_update`=:last_update, "
+        "`etag`=:etag, `last_modified`=:last_modified "
         "WHERE `channel_id` = :channel_id;",
         //--------------------------------------------------------
 
@@ -108,6 +121,39 @@ const char *SqliteProvider::SQL_STATEMENTS[STATEMENTS_LENGTH] = {
         "DELETE FROM `channels` WHERE `channel_id` = :channel_id;",
         //--------------------------------------------------------
 
+        // --------- STATEMENT_FIND_ALL_CHANNELS------------------
+        SELECT_CHANNELS ";",
+        //--------------------------------------------------------
+
+        // --------- STATEMENT_SET_CHANNEL_KNOWN_GUID_LIMIT-------
+        "UPDATE `channels` SET `known_guid_limit` = :known_guid_limit "
+        "WHERE `channel_id` = :channel_id;",
+        //--------------------------------------------------------
+
+        // --------- STATEMENT_CREATE_CHANNEL_POLLS_TABLE---------
+        // Written on every download, so the channel row stays untouched
+        // while the feed doesn't change
+        "CREATE TABLE IF NOT EXISTS `channel_polls`("
+        "`channel_id` INTEGER PRIMARY KEY NOT NULL,"
+        "`polled_at` TEXT NOT NULL,"
+        "`bytes_transferred` INTEGER NOT NULL DEFAULT 0,"
+        "`bytes_decoded` INTEGER NOT NULL DEFAULT 0);",
+        //--------------------------------------------------------
+
+        // --------- STATEMENT_UPDATE_CHANNEL_POLL----------------
+        "UPDATE `channel_polls` SET `polled_at` = :polled_at, "
+        "`bytes_transferred` = `bytes_transferred` + :bytes_transferred, "
+        "`bytes_decoded` = `bytes_decoded` + :bytes_decoded "
+        "WHERE `channel_id` = :channel_id;",
+        //--------------------------------------------------------
+
+        // --------- STATEMENT_INSERT_CHANNEL_POLL----------------
+        "INSERT INTO `channel_polls`(`channel_id`, `polled_at`, "
+        "`bytes_transferred`, `bytes_decoded`) "
+        "SELECT `channel_id`, :polled_at, :bytes_transferred, :bytes_decoded FROM `channels` "
+        "WHERE `channel_id` = :channel_id;",
+        //--------------------------------------------------------
+
         // --------- STATEMENT_CREATE_POST_TABLE-----------------
         "CREATE TABLE IF NOT EXISTS `posts`("
         "`post_id` INTEGER PRIMARY KEY ASC AUTOINCREMENT NOT NULL,"
@@ -121,7 +167,32 @@ const char *SqliteProvider::SQL_STATEMENTS[STATEMENTS_LENGTH] = {
         "CREATE INDEX IF NOT EXISTS `posts_guid_idx` on `posts`"
         "(`guid`);\n"
         "CREATE INDEX IF NOT EXISTS `posts_channel_id_idx` on `posts`"
-        "(`channel_id`);\n",
+        "(`channel_id`);\n"
+        // Inserting into the view stores a new post or updates a changed one
+        "CREATE VIEW IF NOT EXISTS `posts_upsert` AS SELECT `channel_id`, `guid`,"
+        "`title`, `link`, `description`, `pub_date`, `post_txt` FROM `posts`;\n"
+        "CREATE TRIGGER IF NOT EXISTS `posts_upsert_insert` INSTEAD OF INSERT "
+        "ON `posts_upsert` BEGIN "
+        "INSERT OR IGNORE INTO `posts`(`channel_id`, `guid`, `title`,"
+        "`link`, `description`, `pub_date`,`post_txt`) "
+        "VALUES(NEW.`channel_id`, NEW.`guid`, NEW.`title`, NEW.`link`,"
+        "NEW.`description`, NEW.`pub_date`, NEW.`post_txt`);"
+        "UPDATE `posts` SET `title`=NEW.`title`, `link`=NEW.`link`,"
+        "`description`=NEW.`description`, `pub_date`=NEW.`pub_date`,"
+        "`post_txt`=NEW.`post_txt` "
+        "WHERE `channel_id`=NEW.`channel_id` AND `guid`=NEW.`guid` AND "
+        "(`title` IS NOT NEW.`title` OR `link` IS NOT NEW.`link` OR "
+        "`description` IS NOT NEW.`description` OR `pub_date` IS NOT NEW.`pub_date` OR "
+        "`post_txt` IS NOT NEW.`post_txt`);"
+        "END;\n",
+        //--------------------------------------------------------
+
+        // --------- STATEMENT_CREATE_POST_GUID_INDEX-------------
+        // Older databases may hold duplicates, keeping the oldest post
+        "DELETE FROM `posts` WHERE `post_id` NOT IN "
+        "(SELECT MIN(`post_id`) FROM `posts` GROUP BY `channel_id`, `guid`);\n"
+        "CREATE UNIQUE INDEX IF NOT EXISTS `posts_channel_id_guid_idx` on `posts`"
+        "(`channel_id`, `guid`);",
         //--------------------------------------------------------
 
         // --------- STATEMENT_FIND_POST_BY_ID--------------------
@@ -154,6 +225,13 @@ const char *SqliteProvider::SQL_STATEMENTS[STATEMENTS_LENGTH] = {
         "DELETE FROM `posts` WHERE `post_id` = :post_id;",
         //--------------------------------------------------------
 
+        // --------- STATEMENT_UPSERT_POST---------------------
+        "INSERT INTO `posts_upsert`(`channel_id`, `guid`, `title`,"
+        "`link`, `description`, `pub_date`,`post_txt`) "
+        "VALUES(:channel_id, :guid, :title, :link, :description,"
+        ":pub_date, :post_txt);",
+        //--------------------------------------------------------
+
         // --------- STATEMENT_CREATE_USER_CHANNEL_TABLE---------------
         "CREATE TABLE IF NOT EXISTS `users_channels`("
         "`users_channels_id` INTEGER PRIMARY KEY ASC AUTOINCREMENT NOT NULL,"
@@ -166,7 +244,7 @@ const char *SqliteProvider::SQL_STATEMENTS[STATEMENTS_LENGTH] = {
         //--------------------------------------------------------
 
         // --------- STATEMENT_FIND_CHANNELS_BY_USER_ID-----------
-        "SELECT `ch`.* FROM `channels` AS `ch`, `user_channels` AS `usr_ch` "
+        SELECT_CHANNELS ", `user_channels` AS `usr_ch` "
         "WHERE `usr_ch`.`user_id` = :user_id AND `usr_ch`.`channel_id` = `ch`.`channel_id`;",
         //--------------------------------------------------------
 
@@ -190,8 +268,8 @@ const char *SqliteProvider::SQL_STATEMENTS[STATEMENTS_LENGTH] = {
  */
 static const string SQLITE_DATE_FORMAT_STDLIB_SYNTAX = "%Y-%m-%d %H:%M:%S";
 
-SqliteProvider::SqliteProvider(const SqliteConnection *connection)
-        : connection_(connection) {
+SqliteProvider::SqliteProvider(SqliteConnection *connection, SqliteStatementCache *cache)
+        : connection_(connection), statements_(cache), ownStatements_(false) {
     if (connection == nullptr) {
         string errmsg = "SqliteProvider::ctr: Invalid argument: connection == nullptr";
         SERVICE_LOG_LVL(ERROR, errmsg);
@@ -204,33 +282,33 @@ SqliteProvider::SqliteProvider(const SqliteConnection *connection)
         throw logic_error(errmsg);
     }
 
-    memset(compiledStatements_, 0, sizeof(sqlite3_stmt *) * STATEMENTS_LENGTH);
+    if (statements_ == nullptr) {
+        statements_ = new SqliteStatementCache(connection);
+        ownStatements_ = true;
+    } else if (statements_->connection() != connection) {
+        string errmsg = "SqliteProvider::ctr: Invalid argument: statement cache belongs to another connection";
+        SERVICE_LOG_LVL(ERROR, errmsg);
+        throw logic_error(errmsg);
+    }
 }
 
 SqliteProvider::~SqliteProvider() {
-    SERVICE_LOG_LVL(DEBUG, "SqliteProvider::~SqliteProvider: clearing statements");
-    for (int i = 0; i < STATEMENTS_LENGTH; i++) {
-        if (compiledStatements_[i]) {
-            sqlite3_finalize(compiledStatements_[i]);
-        }
+    if (ownStatements_) {
+        SERVICE_LOG_LVL(DEBUG, "SqliteProvider::~SqliteProvider: clearing statements");
+        delete statements_;
     }
-    memset(compiledStatements_, 0, sizeof(sqlite3_stmt *) * STATEMENTS_LENGTH);
+    statements_ = nullptr;
 }
 
 void SqliteProvider::prepareStatements() {
     lock_guard<recursive_mutex> locker(lock_);
-    for (int i = 0; i < STATEMENTS_LENGTH; i++) {
-        if (compiledStatements_[i] != nullptr) {
-            sqlite3_prepare_v2(connection_->handle(), SQL_STATEMENTS[i], -1,
-                    &compiledStatements_[i], NULL);
-        }
-    }
+    for (int i = 0; i < STATEMENTS_LENGTH; i++)
+        getStatement(i);
 }
 
 void SqliteProvider::beginTransaction() {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_BEGIN_TRANSACTION);
-    sqlite3_reset(stmt);
     int ret = sqlite3_step(stmt);
     if (ret != SQLITE_DONE) {
         ostringstream oss;
@@ -245,7 +323,6 @@ void SqliteProvider::beginTransaction() {
 void SqliteProvider::endTransaction() {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_END_TRANSACTION);
-    sqlite3_reset(stmt);
     int ret = sqlite3_step(stmt);
     if (ret != SQLITE_DONE) {
         ostringstream oss;
@@ -257,6 +334,20 @@ void SqliteProvider::endTransaction() {
 }
 
 
+void SqliteProvider::rollbackTransaction() {
+    lock_guard<recursive_mutex> locker(lock_);
+    sqlite3_stmt *stmt = getStatement(STATEMENT_ROLLBACK_TRANSACTION);
+    int ret = sqlite3_step(stmt);
+    if (ret != SQLITE_DONE) {
+        ostringstream oss;
+        oss << "SqliteProvider::rollbackTransaction: error while executing SQL query: code=" << ret << " msg="
+            << sqlite3_errmsg(connection_->handle());
+        SERVICE_LOG_LVL(ERROR, oss.str());
+        throw SqliteProviderException(oss.str());
+    }
+}
+
+
 void SqliteProvider::createUsersTable() {
     createTableByStatement(STATEMENT_CREATE_USER_TABLE, "SqliteProvider::createUsersTable");
 }
@@ -265,7 +356,6 @@ void SqliteProvider::createUsersTable() {
 User *SqliteProvider::findUserByName(const string& username) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_USER_BY_USERNAME);
-    sqlite3_reset(stmt);
     sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, ":username"),
                       username.c_str(), -1, SQLITE_STATIC);
     int ret = sqlite3_step(stmt);
@@ -290,7 +380,6 @@ User *SqliteProvider::findUserByName(const string& username) {
 User* SqliteProvider::findUserById(int64_t id) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_USER_BY_ID);
-    sqlite3_reset(stmt);
     sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":userid"), id);
     int ret = sqlite3_step(stmt);
     checkSqliteResult(ret, "SqliteProvider::findUserById");
@@ -319,7 +408,6 @@ User* SqliteProvider::findUserById(int64_t id) {
 int64_t SqliteProvider::insertUser(const User &user) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_INSERT_NEW_USER);
-    sqlite3_reset(stmt);
     sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, ":username"),
                       user.username().c_str(),
                       -1, SQLITE_TRANSIENT);
@@ -336,7 +424,6 @@ bool SqliteProvider::updateUser(const User &user) {
     lock_guard<recursive_mutex> locker(lock_);
 
     sqlite3_stmt *stmt = getStatement(STATEMENT_UPDATE_USER);
-    sqlite3_reset(stmt);
     sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, ":username"),
                       user.username().c_str(),
                       -1, SQLITE_TRANSIENT);
@@ -356,7 +443,6 @@ bool SqliteProvider::updateUser(const User &user) {
 void SqliteProvider::deleteUser(const User& user) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_DELETE_USER_CHANNEL);
-    sqlite3_reset(stmt);
 
     int userIdPos         = sqlite3_bind_parameter_index(stmt, ":user_id");
 
@@ -368,12 +454,18 @@ void SqliteProvider::deleteUser(const User& user) {
 
 void SqliteProvider::createChannelsTable() {
     createTableByStatement(STATEMENT_CREATE_CHANNEL_TABLE, "SqliteProvider::createChannelsTable");
+    // Columns added after the first release
+    addColumnIfMissing("channels", "etag", "TEXT", "SqliteProvider::createChannelsTable");
+    addColumnIfMissing("channels", "last_modified", "TEXT", "SqliteProvider::createChannelsTable");
+    addColumnIfMissing("channels", "known_guid_limit", "INTEGER NOT NULL DEFAULT 0",
+                       "SqliteProvider::createChannelsTable");
+    createTableByStatement(STATEMENT_CREATE_CHANNEL_POLLS_TABLE,
+                           "SqliteProvider::createChannelsTable");
 }
 
 Channel* SqliteProvider::findChannelById(int64_t id) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_CHANNEL_BY_ID);
-    sqlite3_reset(stmt);
     sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":channelid"), id);
     int ret = sqlite3_step(stmt);
     checkSqliteResult(ret, "SqliteProvider::findChannelById");
@@ -402,7 +494,6 @@ Channel* SqliteProvider::findChannelById(int64_t id) {
 Channel *SqliteProvider::findChannelByRssLink(const std::string &rssLink) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_CHANNEL_BY_RSS_LINK);
-    sqlite3_reset(stmt);
     sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, ":rss_link"), rssLink.c_str(),
                       -1, SQLITE_TRANSIENT);
     int ret = sqlite3_step(stmt);
@@ -432,7 +523,6 @@ Channel *SqliteProvider::findChannelByRssLink(const std::string &rssLink) {
 int64_t SqliteProvider::insertChannel(const Channel& channel) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_INSERT_NEW_CHANNEL);
-    sqlite3_reset(stmt);
     SERVICE_LOG_LVL(DEBUG, "SqliteProvider::insertChannel: title = " << channel.title());
     sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, ":title"),
                            channel.title().c_str(),
@@ -451,6 +541,8 @@ int64_t SqliteProvider::insertChannel(const Channel& channel) {
     sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, ":last_update"),
                       timestampToString(channel.lastUpdate(), SQLITE_DATE_FORMAT_STDLIB_SYNTAX).c_str(),
                       -1, SQLITE_TRANSIENT);
+    bindOptionalText(stmt, ":etag", channel.etag());
+    bindOptionalText(stmt, ":last_modified", channel.lastModified());
     int ret = sqlite3_step(stmt);
     SERVICE_LOG_LVL(DEBUG, "SqliteProvider::insertChannel: result code = " << ret);
     if (ret != SQLITE_OK) {
@@ -470,7 +562,6 @@ bool SqliteProvider::updateChannel(const Channel &channel) {
     int descIdx, updSecIdx, lastUpdIdx;
 
     sqlite3_stmt *stmt = getStatement(STATEMENT_UPDATE_CHANNEL);
-    sqlite3_reset(stmt);
 
     channelIdIdx = sqlite3_bind_parameter_index(stmt, ":channel_id");
     titleIdx = sqlite3_bind_parameter_index(stmt, ":title");
@@ -489,6 +580,8 @@ bool SqliteProvider::updateChannel(const Channel &channel) {
     sqlite3_bind_text(stmt, descIdx, channel.description().c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int64(stmt, updSecIdx, channel.updateInterval());
     sqlite3_bind_text(stmt, lastUpdIdx, last_upd_str.c_str(), -1, SQLITE_TRANSIENT);
+    bindOptionalText(stmt, ":etag", channel.etag());
+    bindOptionalText(stmt, ":last_modified", channel.lastModified());
     int ret = sqlite3_step(stmt);
     checkSqliteResult(ret, "SqliteProvider::updateChannel");
     int64_t rowsAffected = sqlite3_changes(connection_->handle());
@@ -499,7 +592,6 @@ bool SqliteProvider::updateChannel(const Channel &channel) {
 void SqliteProvider::deleteChannel(const Channel& channel) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_DELETE_CHANNEL);
-    sqlite3_reset(stmt);
 
     int channelIdPos    = sqlite3_bind_parameter_index(stmt, ":channel_id");
 
@@ -508,15 +600,80 @@ void SqliteProvider::deleteChannel(const Channel& channel) {
     checkSqliteResult(ret, "SqliteProvider::deleteChannel");
 }
 
+vector<Channel*>* SqliteProvider::getAllChannels() {
+    lock_guard<recursive_mutex> locker(lock_);
+    sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_ALL_CHANNELS);
+    int ret = sqlite3_step(stmt);
+    checkSqliteResult(ret, "SqliteProvider::getAllChannels");
+
+    vector<Channel *> *foundChannels = new vector<Channel *>();
+    while (ret == SQLITE_ROW) {
+        Channel *channel = new Channel();
+        try {
+            parseChannelRow(stmt, *channel);
+            foundChannels->push_back(channel);
+        } catch (logic_error &e) {
+            SERVICE_LOG_LVL(ERROR, e.what());
+            delete channel;
+        }
+        ret = sqlite3_step(stmt);
+    }
+    checkSqliteResult(ret, "SqliteProvider::getAllChannels");
+
+    return foundChannels;
+}
+
+
+bool SqliteProvider::recordChannelPoll(int64_t channelId, const std::tm &polledAt,
+                                       int64_t bytesTransferred, int64_t bytesDecoded) {
+    lock_guard<recursive_mutex> locker(lock_);
+    string polledAtStr = timestampToString(polledAt, SQLITE_DATE_FORMAT_STDLIB_SYNTAX);
+
+    // No UPSERT in this SQLite version: the row is inserted by the first poll
+    for (int statement : {STATEMENT_UPDATE_CHANNEL_POLL, STATEMENT_INSERT_CHANNEL_POLL}) {
+        sqlite3_stmt *stmt = getStatement(statement);
+        sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":channel_id"), channelId);
+        sqlite3_bind_text(stmt, sqlite3_bind_parameter_index(stmt, ":polled_at"),
+                          polledAtStr.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":bytes_transferred"),
+                           bytesTransferred);
+        sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":bytes_decoded"),
+                           bytesDecoded);
+        int ret = sqlite3_step(stmt);
+        checkSqliteResult(ret, "SqliteProvider::recordChannelPoll");
+        if (sqlite3_changes(connection_->handle()) > 0)
+            return true;
+    }
+    return false;
+}
+
+
+bool SqliteProvider::setChannelKnownGuidLimit(int64_t channelId, int knownGuidLimit) {
+    lock_guard<recursive_mutex> locker(lock_);
+    sqlite3_stmt *stmt = getStatement(STATEMENT_SET_CHANNEL_KNOWN_GUID_LIMIT);
+
+    sqlite3_bind_int64(stmt, sqlite3_bind_parameter_index(stmt, ":channel_id"), channelId);
+    sqlite3_bind_int(stmt, sqlite3_bind_parameter_index(stmt, ":known_guid_limit"),
+                     max(knownGuidLimit, 0));
+    int ret = sqlite3_step(stmt);
+    checkSqliteResult(ret, "SqliteProvider::setChannelKnownGuidLimit");
+    return sqlite3_changes(connection_->handle()) > 0;
+}
+
 void SqliteProvider::createPostsTable() {
     createTableByStatement(STATEMENT_CREATE_POST_TABLE, "SqliteProvider::createPostsTable");
+    // Posts upsert relies on the index, databases without it are migrated once
+    if (!indexExists("posts_channel_id_guid_idx", "SqliteProvider::createPostsTable")) {
+        SERVICE_LOG("SqliteProvider::createPostsTable: removing duplicate posts");
+        createTableByStatement(STATEMENT_CREATE_POST_GUID_INDEX,
+                               "SqliteProvider::createPostsTable");
+    }
 }
 
 
 Post* SqliteProvider::findPostById(int64_t id) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_POST_BY_ID);
-    sqlite3_reset(stmt);
     int postIdIdx = sqlite3_bind_parameter_index(stmt, ":post_id");
     sqlite3_bind_int64(stmt, postIdIdx, id);
     int ret = sqlite3_step(stmt);
@@ -546,7 +703,6 @@ Post* SqliteProvider::findPostById(int64_t id) {
 Post* SqliteProvider::findPostByGuid(const std::string& guid) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_POST_BY_GUID);
-    sqlite3_reset(stmt);
     int guidIdIdx = sqlite3_bind_parameter_index(stmt, ":guid");
     sqlite3_bind_text(stmt, guidIdIdx, guid.c_str(), -1, SQLITE_TRANSIENT);
     int ret = sqlite3_step(stmt);
@@ -576,7 +732,6 @@ Post* SqliteProvider::findPostByGuid(const std::string& guid) {
 vector<Post*>* SqliteProvider::getPostsForChannel(int64_t channelId) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_POST_BY_CHANNEL);
-    sqlite3_reset(stmt);
     int channelIdIdx = sqlite3_bind_parameter_index(stmt, ":channel_id");
     sqlite3_bind_int64(stmt, channelIdIdx, channelId);
     int ret = sqlite3_step(stmt);
@@ -616,7 +771,6 @@ vector<Post*>* SqliteProvider::getPostsForChannel(const Channel& channel) {
 int64_t SqliteProvider::insertPost(const Post& post) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_INSERT_NEW_POST);
-    sqlite3_reset(stmt);
 
     int channelIdPos    = sqlite3_bind_parameter_index(stmt, ":channel_id");
     int guidPos         = sqlite3_bind_parameter_index(stmt, ":guid");
@@ -642,10 +796,40 @@ int64_t SqliteProvider::insertPost(const Post& post) {
     return newId;
 }
 
+bool SqliteProvider::upsertPost(const Post& post) {
+    lock_guard<recursive_mutex> locker(lock_);
+    sqlite3_stmt *stmt = getStatement(STATEMENT_UPSERT_POST);
+
+    int channelIdPos    = sqlite3_bind_parameter_index(stmt, ":channel_id");
+    int guidPos         = sqlite3_bind_parameter_index(stmt, ":guid");
+    int titlePos        = sqlite3_bind_parameter_index(stmt, ":title");
+    int linkPos         = sqlite3_bind_parameter_index(stmt, ":link");
+    int descPos         = sqlite3_bind_parameter_index(stmt, ":description");
+    int pubDatePos      = sqlite3_bind_parameter_index(stmt, ":pub_date");
+    int postTxtPos      = sqlite3_bind_parameter_index(stmt, ":post_txt");
+
+    sqlite3_bind_int64(stmt, channelIdPos, post.channelId());
+    sqlite3_bind_text(stmt, guidPos, post.guid().c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, titlePos, post.title().c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, linkPos, post.link().c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, descPos, post.description().c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, pubDatePos,
+                      timestampToString(post.publicationDate(),
+                                        SQLITE_DATE_FORMAT_STDLIB_SYNTAX).c_str(),
+                      -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, postTxtPos, post.text().c_str(), -1, SQLITE_TRANSIENT);
+
+    /* Rows changed by the trigger are not counted by sqlite3_changes(),
+     * only by the total counter. */
+    int totalBefore = sqlite3_total_changes(connection_->handle());
+    int ret = sqlite3_step(stmt);
+    checkSqliteResult(ret, "SqliteProvider::upsertPost");
+    return sqlite3_total_changes(connection_->handle()) != totalBefore;
+}
+
 bool SqliteProvider::updatePost(const Post& post) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_UPDATE_POST);
-    sqlite3_reset(stmt);
 
     int postIdPos       = sqlite3_bind_parameter_index(stmt, ":post_id");
     int channelIdPos    = sqlite3_bind_parameter_index(stmt, ":channel_id");
@@ -677,7 +861,6 @@ bool SqliteProvider::updatePost(const Post& post) {
 void SqliteProvider::deletePost(const Post& post) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_DELETE_POST);
-    sqlite3_reset(stmt);
 
     int postIdPos    = sqlite3_bind_parameter_index(stmt, ":post_id");
 
@@ -693,7 +876,6 @@ void SqliteProvider::createSubsriptionTable() {
 vector<Channel*>* SqliteProvider::getSubscriptionsForUser(const User& user) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_CHANNELS_BY_USER_ID);
-    sqlite3_reset(stmt);
     int userIdIdx = sqlite3_bind_parameter_index(stmt, ":user_id");
     sqlite3_bind_int64(stmt, userIdIdx, user.id());
     int ret = sqlite3_step(stmt);
@@ -729,7 +911,6 @@ vector<Channel*>* SqliteProvider::getSubscriptionsForUser(const User& user) {
 std::vector<User*>* SqliteProvider::getUsersForChannel(const Channel& channel) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_FIND_CHANNELS_BY_USER_ID);
-    sqlite3_reset(stmt);
     int channelIdIdx = sqlite3_bind_parameter_index(stmt, ":channel_id");
     sqlite3_bind_int64(stmt, channelIdIdx, channel.id());
     int ret = sqlite3_step(stmt);
@@ -765,7 +946,6 @@ std::vector<User*>* SqliteProvider::getUsersForChannel(const Channel& channel) {
 void SqliteProvider::subscribeUser(const User& user, const Channel& channel) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_INSERT_NEW_USER_CHANNEL);
-    sqlite3_reset(stmt);
 
     int channelIdPos    = sqlite3_bind_parameter_index(stmt, ":channel_id");
     int userIdPos         = sqlite3_bind_parameter_index(stmt, ":user_id");
@@ -780,7 +960,6 @@ void SqliteProvider::subscribeUser(const User& user, const Channel& channel) {
 void SqliteProvider::unsubscribeUser(const User& user, const Channel& channel) {
     lock_guard<recursive_mutex> locker(lock_);
     sqlite3_stmt *stmt = getStatement(STATEMENT_DELETE_USER_CHANNEL);
-    sqlite3_reset(stmt);
 
     int channelIdPos    = sqlite3_bind_parameter_index(stmt, ":channel_id");
     int userIdPos         = sqlite3_bind_parameter_index(stmt, ":user_id");
@@ -796,11 +975,7 @@ sqlite3_stmt* SqliteProvider::getStatement(int statementCode) {
     if (statementCode < 0 || statementCode >= STATEMENTS_LENGTH)
         return nullptr;
 
-    if (compiledStatements_[statementCode] == nullptr) {
-        sqlite3_prepare_v2(connection_->handle(), SQL_STATEMENTS[statementCode],
-                -1, &compiledStatements_[statementCode], NULL);
-    }
-    return compiledStatements_[statementCode];
+    return statements_->statement(statementCode, SQL_STATEMENTS[statementCode]);
 }
 
 void SqliteProvider::checkSqliteResult(int retCode, const std::string& tag) {
@@ -845,9 +1020,9 @@ void SqliteProvider::parseChannelRow(sqlite3_stmt* stmt, Channel& out) {
     if (!stmt)
         throw logic_error("SqliteProvider::parseChannelRow: invalid argument `stmt`");
     int columns = sqlite3_column_count(stmt);
-    if (columns != 7) {
+    if (columns != 13) {
         ostringstream oss;
-        oss << "SqliteProvider::parseChannelRow: invalid column count in result set. Expected: 7. Actual: " << columns;
+        oss << "SqliteProvider::parseChannelRow: invalid column count in result set. Expected: 13. Actual: " << columns;
         throw logic_error(oss.str());
     }
 
@@ -888,6 +1063,29 @@ void SqliteProvider::parseChannelRow(sqlite3_stmt* stmt, Channel& out) {
     else {
         throw logic_error("SqliteProvider::parseChannelRow: invalid column 6 type");
     }
+
+    // Validators are NULL until the feed is downloaded
+    if (sqlite3_column_type(stmt, 7) == SQLITE_TEXT)
+        out.setEtag(string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 7))));
+    else
+        out.setEtag("");
+
+    if (sqlite3_column_type(stmt, 8) == SQLITE_TEXT)
+        out.setLastModified(string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 8))));
+    else
+        out.setLastModified("");
+
+    out.setKnownGuidLimit(sqlite3_column_int(stmt, 9));
+
+    // Poll columns are NULL for a channel which has never been downloaded
+    if (sqlite3_column_type(stmt, 10) == SQLITE_TEXT) {
+        string timestamp = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 10));
+        out.setLastPoll(stringToTimestamp(timestamp, SQLITE_DATE_FORMAT_STDLIB_SYNTAX));
+    } else {
+        out.setLastPoll(out.lastUpdate());
+    }
+    out.setBytesTransferred(sqlite3_column_int64(stmt, 11));
+    out.setBytesDecoded(sqlite3_column_int64(stmt, 12));
 }
 
 
@@ -947,19 +1145,93 @@ void SqliteProvider::parsePostRow(sqlite3_stmt* stmt, Post& out) {
 
 void SqliteProvider::createTableByStatement(int stmtIndex, const std::string& tag) {
     lock_guard<recursive_mutex> locker(lock_);
-    sqlite3_stmt *stmt = getStatement(stmtIndex);
-    sqlite3_reset(stmt);
-    int ret = sqlite3_step(stmt);
-    checkSqliteResult(ret, tag);
+    if (stmtIndex < 0 || stmtIndex >= STATEMENTS_LENGTH)
+        throw logic_error(tag + ": invalid statement index");
+
+    /* Table scripts consist of several statements, which compiled
+     * statements cannot hold. */
+    char *errmsg = nullptr;
+    int ret = sqlite3_exec(connection_->handle(), SQL_STATEMENTS[stmtIndex],
+                           nullptr, nullptr, &errmsg);
+    if (ret != SQLITE_OK) {
+        ostringstream oss;
+        oss << tag << ": error while executing SQL query: "
+            << (errmsg ? errmsg : sqlite3_errstr(ret));
+        sqlite3_free(errmsg);
+        SERVICE_LOG_LVL(ERROR, oss.str());
+        throw SqliteProviderException(oss.str());
+    }
+}
 
-    if (ret != SQLITE_DONE) {
-        string str = tag + string(": unexpected return code");
-        SERVICE_LOG_LVL(ERROR, str);
-        throw SqliteProviderException(str);
+void SqliteProvider::addColumnIfMissing(const std::string &table, const std::string &column,
+                                        const std::string &type, const std::string &tag) {
+    lock_guard<recursive_mutex> locker(lock_);
+    sqlite3_stmt *stmt = nullptr;
+    string sql = "PRAGMA table_info(`" + table + "`);";
+    int ret = sqlite3_prepare_v2(connection_->handle(), sql.c_str(), -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        ostringstream oss;
+        oss << tag << ": cannot read columns of table " << table << ": "
+            << sqlite3_errmsg(connection_->handle());
+        SERVICE_LOG_LVL(ERROR, oss.str());
+        throw SqliteProviderException(oss.str());
+    }
+
+    // Column name is the second column of table_info result
+    bool found = false;
+    while (!found && sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char *name = sqlite3_column_text(stmt, 1);
+        if (name && column == reinterpret_cast<const char *>(name))
+            found = true;
+    }
+    sqlite3_finalize(stmt);
+    if (found)
+        return;
+
+    SERVICE_LOG("SqliteProvider::addColumnIfMissing: adding column " << column
+                << " to table " << table);
+    sql = "ALTER TABLE `" + table + "` ADD COLUMN `" + column + "` " + type + ";";
+    char *errmsg = nullptr;
+    ret = sqlite3_exec(connection_->handle(), sql.c_str(), nullptr, nullptr, &errmsg);
+    if (ret != SQLITE_OK) {
+        ostringstream oss;
+        oss << tag << ": cannot add column " << column << ": "
+            << (errmsg ? errmsg : sqlite3_errstr(ret));
+        sqlite3_free(errmsg);
+        SERVICE_LOG_LVL(ERROR, oss.str());
+        throw SqliteProviderException(oss.str());
     }
 }
 
-} /* namespace service */
-} /* namespace nestor */
+bool SqliteProvider::indexExists(const std::string &index, const std::string &tag) {
+    lock_guard<recursive_mutex> locker(lock_);
+    sqlite3_stmt *stmt = nullptr;
+    const char *sql = "SELECT 1 FROM `sqlite_master` WHERE `type` = 'index' AND `name` = ?;";
+    int ret = sqlite3_prepare_v2(connection_->handle(), sql, -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        ostringstream oss;
+        oss << tag << ": cannot look up index " << index << ": "
+            << sqlite3_errmsg(connection_->handle());
+        SERVICE_LOG_LVL(ERROR, oss.str());
+        throw SqliteProviderException(oss.str());
+    }
+
+    sqlite3_bind_text(stmt, 1, index.c_str(), -1, SQLITE_TRANSIENT);
+    bool found = (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    return found;
+}
 
+void SqliteProvider::bindOptionalText(sqlite3_stmt *stmt, const char *name,
+                                      const std::string &value) {
+    int idx = sqlite3_bind_parameter_index(stmt, name);
+    if (value.empty())
+        sqlite3_bind_null(stmt, idx);
+    else
+        sqlite3_bind_text(stmt, idx, value.c_str(), -1, SQLITE_TRANSIENT);
+}
 
+} /* namespace service */
+} /* namespace nestor */
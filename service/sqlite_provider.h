@@ -25,6 +25,7 @@
 #include <mutex>
 #include <vector>
 #include "sqlite_connection.h"
+#include "sqlite_statement_cache.h"
 #include "types.h"
 
 namespace nestor {
@@ -42,7 +43,13 @@ class SqliteProviderException : public std::runtime_error {
  */
 class SqliteProvider {
 public:
-    SqliteProvider(const SqliteConnection *connection);
+    /**
+     * @param connection Opened database connection.
+     * @param cache Cache of compiled statements shared with other
+     * providers of the same thread. If nullptr, the provider uses its
+     * own private cache.
+     */
+    SqliteProvider(SqliteConnection *connection, SqliteStatementCache *cache = nullptr);
     virtual ~SqliteProvider();
 
     /**
@@ -56,7 +63,13 @@ public:
     void endTransaction();
 
     /**
-     * Compiles all SQL queries and commands.
+     * Rolls back started transaction, e.g. after it failed to commit
+     */
+    void rollbackTransaction();
+
+    /**
+     * Compiles all SQL queries and commands ahead of the first use.
+     * Not required: statements are compiled on demand otherwise.
      */
     void prepareStatements();
 
@@ -160,6 +173,35 @@ public:
      */
     void deleteChannel(const Channel &channel);
 
+    /**
+     * Returns all channels from 'channels' table.
+     * May throw SqliteProviderException.
+     * @return Heap allocated vector of Channel objects. Empty if there
+     * are no channels.
+     */
+    std::vector<Channel *> *getAllChannels();
+
+    /**
+     * Remembers when the channel feed was downloaded last time, whether
+     * it was changed or not, @sa Channel::lastPoll(), and adds downloaded
+     * feed size to the channel traffic counters.
+     * May throw SqliteProviderException.
+     * @param bytesTransferred Body bytes received from network, compressed
+     * if server applied Content-Encoding.
+     * @param bytesDecoded Body bytes after decompression.
+     * @return false if no channel was found with specified id.
+     */
+    bool recordChannelPoll(int64_t channelId, const std::tm &polledAt,
+                           int64_t bytesTransferred, int64_t bytesDecoded);
+
+    /**
+     * Sets number of consecutive stored items after which parsing of the
+     * channel feed stops, @sa Channel::knownGuidLimit().
+     * May throw SqliteProviderException.
+     * @return false if no channel was found with specified id.
+     */
+    bool setChannelKnownGuidLimit(int64_t channelId, int knownGuidLimit);
+
     /**
      * Create 'posts' table for storing RSS posts.
      * Currently, 'feeds' table entirely
@@ -219,6 +261,17 @@ public:
      */
     void deletePost(const Post &feed);
 
+    /**
+     * Stores post identified by channel id and GUID in one statement:
+     * inserts it if it is new, updates it if any field has changed
+     * and does nothing otherwise. Id field is ignored.
+     * Call it inside a transaction when storing many posts.
+     * May throw SqliteProviderException.
+     *
+     * @return true if the post was inserted or updated.
+     */
+    bool upsertPost(const Post &post);
+
     /**
      * Create table for storing user subscriptions.
      * May throw SqliteProviderException.
@@ -234,7 +287,7 @@ public:
 private:
 
     /**
-     * Returns compiled sqlite statement by index.
+     * Returns compiled and reset sqlite statement by index.
      */
     sqlite3_stmt *getStatement(int statementCode);
 
@@ -262,11 +315,27 @@ private:
 
     void createTableByStatement(int stmtIndex, const std::string &tag);
 
+    /**
+     * Adds column to existent table if it has no such column yet.
+     * Used to migrate databases created by older versions.
+     */
+    void addColumnIfMissing(const std::string &table, const std::string &column,
+                            const std::string &type, const std::string &tag);
+
+    /** Checks whether the database has the index */
+    bool indexExists(const std::string &index, const std::string &tag);
+
+    /**
+     * Binds text parameter, empty string is stored as NULL.
+     */
+    void bindOptionalText(sqlite3_stmt *stmt, const char *name, const std::string &value);
+
 private:
     enum Statements {
         // TRANSACTIONS ---------------
         STATEMENT_BEGIN_TRANSACTION = 0,
         STATEMENT_END_TRANSACTION,
+        STATEMENT_ROLLBACK_TRANSACTION,
         // USER table -----------------
         STATEMENT_CREATE_USER_TABLE,
         STATEMENT_FIND_USER_BY_USERNAME,
@@ -282,15 +351,22 @@ private:
         STATEMENT_INSERT_NEW_CHANNEL,
         STATEMENT_UPDATE_CHANNEL,
         STATEMENT_DELETE_CHANNEL,
+        STATEMENT_FIND_ALL_CHANNELS,
+        STATEMENT_SET_CHANNEL_KNOWN_GUID_LIMIT,
+        STATEMENT_CREATE_CHANNEL_POLLS_TABLE,
+        STATEMENT_UPDATE_CHANNEL_POLL,
+        STATEMENT_INSERT_CHANNEL_POLL,
 
         // POSTS table ----------------
         STATEMENT_CREATE_POST_TABLE,
+        STATEMENT_CREATE_POST_GUID_INDEX,
         STATEMENT_FIND_POST_BY_ID,
         STATEMENT_FIND_POST_BY_GUID,
         STATEMENT_FIND_POST_BY_CHANNEL,
         STATEMENT_INSERT_NEW_POST,
         STATEMENT_UPDATE_POST,
         STATEMENT_DELETE_POST,
+        STATEMENT_UPSERT_POST,
 
         // USER_CHANNEL table ---------
         STATEMENT_CREATE_USER_CHANNEL_TABLE,
@@ -303,8 +379,9 @@ private:
     static const char *SQL_STATEMENTS[STATEMENTS_LENGTH];
 
 private:
-    const SqliteConnection *connection_;
-    sqlite3_stmt *compiledStatements_[STATEMENTS_LENGTH];
+    SqliteConnection *connection_;
+    SqliteStatementCache *statements_;
+    bool ownStatements_;
 
     std::recursive_mutex lock_;
 };
@@ -0,0 +1,105 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <stdexcept>
+#include "common/logger.h"
+#include "sqlite_statement_cache.h"
+
+using namespace std;
+
+namespace nestor {
+namespace service {
+
+SqliteStatementCache::SqliteStatementCache(SqliteConnection *connection)
+        : connection_(connection), closeSubscription_(-1), compileCount_(0),
+          requestCount_(0) {
+    if (connection == nullptr) {
+        string errmsg = "SqliteStatementCache::ctr: Invalid argument: connection == nullptr";
+        SERVICE_LOG_LVL(ERROR, errmsg);
+        throw logic_error(errmsg);
+    }
+
+    // Statements must be finalized before the database can be closed
+    closeSubscription_ = connection_->subscribeOnClose(
+            [this](SqliteConnection *) { onConnectionClose(); });
+}
+
+SqliteStatementCache::~SqliteStatementCache() {
+    SERVICE_LOG_LVL(DEBUG, "SqliteStatementCache::~SqliteStatementCache: compiled "
+            << compileCount_ << " statements for " << requestCount_ << " requests");
+    connection_->unsubscribeOnClose(closeSubscription_);
+    clear();
+}
+
+sqlite3_stmt *SqliteStatementCache::statement(int index, const char *sql) {
+    if (index < 0 || sql == nullptr)
+        return nullptr;
+
+    requestCount_++;
+    if (static_cast<size_t>(index) >= statements_.size())
+        statements_.resize(index + 1, nullptr);
+
+    sqlite3_stmt *&stmt = statements_[index];
+    if (stmt == nullptr) {
+        if (!connection_->connected())
+            return nullptr;
+
+        int code = sqlite3_prepare_v2(connection_->handle(), sql, -1, &stmt, NULL);
+        if (code != SQLITE_OK) {
+            SERVICE_LOG_LVL(ERROR, "SqliteStatementCache::statement: cannot compile statement "
+                    << index << ": " << sqlite3_errmsg(connection_->handle()));
+            sqlite3_finalize(stmt);
+            stmt = nullptr;
+            return nullptr;
+        }
+        compileCount_++;
+    } else {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+    }
+    return stmt;
+}
+
+void SqliteStatementCache::clear() {
+    for (sqlite3_stmt *stmt : statements_) {
+        if (stmt)
+            sqlite3_finalize(stmt);
+    }
+    statements_.clear();
+}
+
+const SqliteConnection *SqliteStatementCache::connection() const {
+    return connection_;
+}
+
+size_t SqliteStatementCache::compileCount() const {
+    return compileCount_;
+}
+
+size_t SqliteStatementCache::requestCount() const {
+    return requestCount_;
+}
+
+void SqliteStatementCache::onConnectionClose() {
+    clear();
+}
+
+} /* namespace service */
+} /* namespace nestor */
@@ -0,0 +1,83 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef SQLITE_STATEMENT_CACHE_H_
+#define SQLITE_STATEMENT_CACHE_H_
+
+#include <cstddef>
+#include <vector>
+#include "sqlite_connection.h"
+
+namespace nestor {
+namespace service {
+
+/**
+ * Keeps compiled SQL statements of one database connection so they
+ * are compiled once and then reused by every SqliteProvider working
+ * with the cache. Statements are compiled lazily on first request and
+ * finalized when the cache is destroyed or the connection is closed.
+ *
+ * A statement can be stepped by only one user at a time, so the cache
+ * is not thread safe: every thread should own its own cache.
+ */
+class SqliteStatementCache {
+public:
+    explicit SqliteStatementCache(SqliteConnection *connection);
+    virtual ~SqliteStatementCache();
+
+    /**
+     * Returns reset statement with cleared bindings for the given index.
+     * Statement is compiled from sql on the first request.
+     * @param index Caller defined statement number.
+     * @param sql SQL text of the statement. Must be the same for the
+     * same index.
+     * @return Compiled statement or nullptr if compilation has failed.
+     */
+    sqlite3_stmt *statement(int index, const char *sql);
+
+    /**
+     * Finalizes all compiled statements.
+     */
+    void clear();
+
+    const SqliteConnection *connection() const;
+
+    /** Number of statements compiled since the cache creation */
+    size_t compileCount() const;
+
+    /** Number of statement requests served by the cache */
+    size_t requestCount() const;
+
+private:
+    void onConnectionClose();
+
+private:
+    SqliteConnection *connection_;
+    std::vector<sqlite3_stmt *> statements_;
+    int closeSubscription_;
+
+    size_t compileCount_;
+    size_t requestCount_;
+};
+
+} /* namespace service */
+} /* namespace nestor */
+
+#endif /* SQLITE_STATEMENT_CACHE_H_ */
@@ -72,6 +72,14 @@ void Channel::setLastUpdate(std::tm lastUpdate) {
     lastUpdate_ = lastUpdate;
 }
 
+std::tm Channel::lastPoll() const {
+    return lastPoll_;
+}
+
+void Channel::setLastPoll(std::tm lastPoll) {
+    lastPoll_ = lastPoll;
+}
+
 const std::string& Channel::link() const {
     return link_;
 }
@@ -104,6 +112,46 @@ void Channel::setUpdateInterval(int updateInterval) {
     updateInterval_ = updateInterval;
 }
 
+const std::string& Channel::etag() const {
+    return etag_;
+}
+
+void Channel::setEtag(const std::string& etag) {
+    etag_ = etag;
+}
+
+const std::string& Channel::lastModified() const {
+    return lastModified_;
+}
+
+void Channel::setLastModified(const std::string& lastModified) {
+    lastModified_ = lastModified;
+}
+
+long long Channel::bytesTransferred() const {
+    return bytesTransferred_;
+}
+
+void Channel::setBytesTransferred(long long bytesTransferred) {
+    bytesTransferred_ = bytesTransferred;
+}
+
+long long Channel::bytesDecoded() const {
+    return bytesDecoded_;
+}
+
+void Channel::setBytesDecoded(long long bytesDecoded) {
+    bytesDecoded_ = bytesDecoded;
+}
+
+int Channel::knownGuidLimit() const {
+    return knownGuidLimit_;
+}
+
+void Channel::setKnownGuidLimit(int knownGuidLimit) {
+    knownGuidLimit_ = knownGuidLimit;
+}
+
 
 long long Post::channelId() const {
     return channelId_;
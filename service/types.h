@@ -55,8 +55,12 @@ public:
     void setDescription(const std::string& description);
     long long id() const;
     void setId(long long id);
+    /* Time of the last change of the feed */
     std::tm lastUpdate() const;
     void setLastUpdate(std::tm lastUpdate);
+    /* Time of the last download of the feed, changed or not */
+    std::tm lastPoll() const;
+    void setLastPoll(std::tm lastPoll);
     const std::string& link() const;
     void setLink(const std::string& link);
     const std::string& rssLink() const;
@@ -66,6 +70,26 @@ public:
     int updateInterval() const;
     void setUpdateInterval(int updateInterval);
 
+    /* HTTP validators of the last downloaded feed. Empty if unknown. */
+    const std::string& etag() const;
+    void setEtag(const std::string& etag);
+    const std::string& lastModified() const;
+    void setLastModified(const std::string& lastModified);
+
+    /* Total feed body bytes received from network and after decompression. */
+    long long bytesTransferred() const;
+    void setBytesTransferred(long long bytesTransferred);
+    long long bytesDecoded() const;
+    void setBytesDecoded(long long bytesDecoded);
+
+    /*
+     * Parsing of the feed stops after this number of consecutive items which
+     * are already stored. 0 parses every item, it is kept by feeds which
+     * reorder their items.
+     */
+    int knownGuidLimit() const;
+    void setKnownGuidLimit(int knownGuidLimit);
+
 private:
     long long id_;
     std::string title_;
@@ -74,6 +98,12 @@ private:
     std::string description_;
     int updateInterval_;
     std::tm lastUpdate_;
+    std::tm lastPoll_;
+    std::string etag_;
+    std::string lastModified_;
+    long long bytesTransferred_;
+    long long bytesDecoded_;
+    int knownGuidLimit_;
 };
 
 /**
@@ -0,0 +1,212 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include "common/logger.h"
+#include "sqlite_provider.h"
+#include "write_behind_queue.h"
+
+using namespace std;
+
+namespace nestor {
+namespace service {
+
+const size_t WriteBehindQueue::DEFAULT_MAX_BATCH_SIZE;
+const unsigned int WriteBehindQueue::DEFAULT_MAX_DELAY_MS;
+const size_t WriteBehindQueue::DEFAULT_CAPACITY;
+
+WriteBehindQueue::Statistics::Statistics()
+        : writes(0), commits(0), failedCommits(0), busyUsec(0), maxBacklog(0) {
+}
+
+WriteBehindQueue::WriteBehindQueue(SqliteProvider *provider, size_t capacity)
+        : provider_(provider), capacity_(max<size_t>(capacity, 1)),
+          maxBatchSize_(DEFAULT_MAX_BATCH_SIZE), maxDelayMs_(DEFAULT_MAX_DELAY_MS),
+          queuedCount_(0), finishedCount_(0), flushWaiters_(0), running_(false) {
+    if (provider_ == nullptr)
+        throw invalid_argument("WriteBehindQueue::WriteBehindQueue: provider is nullptr");
+}
+
+WriteBehindQueue::~WriteBehindQueue() {
+    stop();
+}
+
+void WriteBehindQueue::setBatchLimits(size_t maxBatchSize, unsigned int maxDelayMs) {
+    maxBatchSize_ = max<size_t>(maxBatchSize, 1);
+    maxDelayMs_ = maxDelayMs;
+}
+
+void WriteBehindQueue::start() {
+    lock_guard<mutex> locker(lock_);
+    if (running_)
+        return;
+    running_ = true;
+    thread_ = thread(&WriteBehindQueue::run, this);
+}
+
+void WriteBehindQueue::stop() {
+    {
+        lock_guard<mutex> locker(lock_);
+        running_ = false;
+        wakeUp_.notify_all();
+    }
+    if (thread_.joinable())
+        thread_.join();
+}
+
+void WriteBehindQueue::push(WriteFunction write, AbortFunction abort) {
+    unique_lock<mutex> locker(lock_);
+    notFull_.wait(locker, [this]() { return writes_.size() < capacity_; });
+
+    Write queued = { write, abort };
+    writes_.push_back(queued);
+    queuedCount_++;
+    statistics_.maxBacklog = max(statistics_.maxBacklog, writes_.size());
+    wakeUp_.notify_one();
+}
+
+void WriteBehindQueue::flush() {
+    unique_lock<mutex> locker(lock_);
+    uint64_t target = queuedCount_;
+    if (finishedCount_ >= target)
+        return;
+
+    flushWaiters_++;
+    wakeUp_.notify_one();
+    finished_.wait(locker, [this, target]() { return finishedCount_ >= target; });
+    flushWaiters_--;
+}
+
+WriteBehindQueue::Statistics WriteBehindQueue::statistics() const {
+    lock_guard<mutex> locker(lock_);
+    return statistics_;
+}
+
+void WriteBehindQueue::run() {
+    SERVICE_LOG_LVL(DEBUG, "WriteBehindQueue::run: started, batch " << maxBatchSize_
+                    << " writes, delay " << maxDelayMs_ << " ms");
+    vector<Write> batch;
+    unique_lock<mutex> locker(lock_);
+
+    for (;;) {
+        wakeUp_.wait(locker, [this]() { return !writes_.empty() || !running_; });
+        // Queued writes are committed before the thread finishes
+        if (writes_.empty())
+            break;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        chrono::steady_clock::time_point deadline = start + chrono::milliseconds(maxDelayMs_);
+        locker.unlock();
+        bool transaction = beginTransaction();
+        locker.lock();
+
+        for (;;) {
+            while (!writes_.empty() && batch.size() < maxBatchSize_) {
+                batch.push_back(writes_.front());
+                writes_.pop_front();
+                notFull_.notify_one();
+
+                locker.unlock();
+                try {
+                    batch.back().write();
+                } catch (exception &e) {
+                    SERVICE_LOG_LVL(ERROR, "WriteBehindQueue::run: write failed. Message: "
+                                    << e.what());
+                }
+                locker.lock();
+            }
+
+            if (batch.size() >= maxBatchSize_ || flushWaiters_ > 0 || !running_)
+                break;
+            bool woken = wakeUp_.wait_until(locker, deadline, [this]() {
+                return !writes_.empty() || flushWaiters_ > 0 || !running_;
+            });
+            if (!woken)
+                break;
+        }
+
+        locker.unlock();
+        bool committed = !transaction || endTransaction();
+        if (!committed) {
+            for (Write &write : batch) {
+                if (write.abort)
+                    write.abort();
+            }
+        }
+        uint64_t busyUsec = chrono::duration_cast<chrono::microseconds>(
+                chrono::steady_clock::now() - start).count();
+        locker.lock();
+
+        statistics_.writes += batch.size();
+        statistics_.busyUsec += busyUsec;
+        if (transaction) {
+            if (committed)
+                statistics_.commits++;
+            else
+                statistics_.failedCommits++;
+        }
+        finishedCount_ += batch.size();
+        batch.clear();
+        finished_.notify_all();
+    }
+    SERVICE_LOG_LVL(DEBUG, "WriteBehindQueue::run: finished after " << statistics_.writes
+                    << " writes in " << statistics_.commits << " transactions");
+}
+
+/**
+ * If the transaction cannot be started, writes are still applied, each
+ * one is committed by itself then.
+ */
+bool WriteBehindQueue::beginTransaction() {
+    try {
+        provider_->beginTransaction();
+    } catch (SqliteProviderException &e) {
+        SERVICE_LOG_LVL(ERROR, "WriteBehindQueue::beginTransaction: cannot start "
+                        "transaction. Message: " << e.what());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Transaction which failed to commit is rolled back, so the next one can start.
+ */
+bool WriteBehindQueue::endTransaction() {
+    try {
+        provider_->endTransaction();
+        return true;
+    } catch (SqliteProviderException &e) {
+        SERVICE_LOG_LVL(ERROR, "WriteBehindQueue::endTransaction: cannot commit "
+                        "transaction. Message: " << e.what());
+    }
+    try {
+        provider_->rollbackTransaction();
+    } catch (SqliteProviderException &e) {
+        SERVICE_LOG_LVL(ERROR, "WriteBehindQueue::endTransaction: cannot roll back "
+                        "transaction. Message: " << e.what());
+    }
+    return false;
+}
+
+} /* namespace service */
+} /* namespace nestor */
@@ -0,0 +1,142 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef WRITE_BEHIND_QUEUE_H_
+#define WRITE_BEHIND_QUEUE_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace nestor {
+namespace service {
+
+class SqliteProvider;
+
+/**
+ * Stores writes of many producers in the thread of the queue. Writes are
+ * applied as they arrive inside one open transaction, which is committed
+ * when it holds maxBatchSize writes, when it is maxDelayMs old or when
+ * somebody waits in flush(). So the cost of a commit, which is an fsync
+ * with the default synchronous mode, is shared by many channel updates.
+ * Writes which are not committed yet are lost on a crash, so the limits
+ * trade ingest throughput for durability.
+ */
+class WriteBehindQueue {
+public:
+    /** Applies one update, called in the queue thread inside the transaction */
+    typedef std::function<void()> WriteFunction;
+    /** Called in the queue thread if the transaction of the write is not committed */
+    typedef std::function<void()> AbortFunction;
+
+    static const size_t DEFAULT_MAX_BATCH_SIZE = 64;
+    static const unsigned int DEFAULT_MAX_DELAY_MS = 500;
+    static const size_t DEFAULT_CAPACITY = 256;
+
+    struct Statistics {
+        Statistics();
+
+        /** Writes applied */
+        uint64_t writes;
+        /** Transactions committed */
+        uint64_t commits;
+        /** Transactions which failed to commit */
+        uint64_t failedCommits;
+        /** Time spent in transactions */
+        uint64_t busyUsec;
+        /** Longest backlog of writes waiting for the queue thread */
+        size_t maxBacklog;
+    };
+
+    /**
+     * @param provider Provider used only by the queue thread while it runs.
+     * @param capacity Maximum writes waiting for the queue thread,
+     * producers wait in push() for room.
+     */
+    explicit WriteBehindQueue(SqliteProvider *provider, size_t capacity = DEFAULT_CAPACITY);
+    virtual ~WriteBehindQueue();
+
+    /**
+     * Limits of one transaction. maxDelayMs of 0 commits as soon as no
+     * writes are waiting. Must be called before start().
+     */
+    void setBatchLimits(size_t maxBatchSize, unsigned int maxDelayMs);
+
+    /**
+     * Spawns the queue thread.
+     */
+    void start();
+
+    /**
+     * Commits remaining writes and waits for the queue thread to finish.
+     */
+    void stop();
+
+    /**
+     * Queues write, waits while the queue is full.
+     */
+    void push(WriteFunction write, AbortFunction abort = nullptr);
+
+    /**
+     * Durability barrier: waits until all writes queued before the call
+     * are committed or aborted.
+     */
+    void flush();
+
+    Statistics statistics() const;
+
+private:
+    struct Write {
+        WriteFunction write;
+        AbortFunction abort;
+    };
+
+    void run();
+    bool beginTransaction();
+    bool endTransaction();
+
+private:
+    SqliteProvider *provider_;
+    size_t capacity_;
+    size_t maxBatchSize_;
+    unsigned int maxDelayMs_;
+
+    std::deque<Write> writes_;
+    /** Number of writes queued and finished, flush() waits for them to match */
+    uint64_t queuedCount_;
+    uint64_t finishedCount_;
+    size_t flushWaiters_;
+    bool running_;
+    Statistics statistics_;
+
+    mutable std::mutex lock_;
+    std::condition_variable wakeUp_;
+    std::condition_variable notFull_;
+    std::condition_variable finished_;
+    std::thread thread_;
+};
+
+} /* namespace service */
+} /* namespace nestor */
+
+#endif /* WRITE_BEHIND_QUEUE_H_ */
@@ -0,0 +1,280 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+
+/*
+ * Microbenchmarks of hot paths. Not a part of the unit tests, run
+ * nestor_bench manually and compare the numbers between builds.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <tinyxml2.h>
+#include "imap/imap_tokenizer.h"
+#include "net/input_buffer.h"
+#include "rss/rss_stream_parser.h"
+#include "utils/string.h"
+#include "utils/timestamp.h"
+
+using namespace std;
+using namespace nestor::imap;
+using namespace nestor::net;
+using namespace nestor::rss;
+using namespace nestor::utils;
+
+/* Every heap allocation of the process is counted */
+static size_t allocationCount = 0;
+/* Heap bytes in use and the peak of them, allocations carry their size */
+static size_t allocatedBytes = 0;
+static size_t peakAllocatedBytes = 0;
+static const size_t ALLOCATION_HEADER = alignof(max_align_t);
+
+void *operator new(size_t size) {
+    allocationCount++;
+    char *p = static_cast<char *>(malloc(size + ALLOCATION_HEADER));
+    if (p == nullptr)
+        throw bad_alloc();
+    *reinterpret_cast<size_t *>(p) = size;
+    allocatedBytes += size;
+    if (allocatedBytes > peakAllocatedBytes)
+        peakAllocatedBytes = allocatedBytes;
+    return p + ALLOCATION_HEADER;
+}
+
+void operator delete(void *p) noexcept {
+    if (p == nullptr)
+        return;
+    char *block = static_cast<char *>(p) - ALLOCATION_HEADER;
+    allocatedBytes -= *reinterpret_cast<size_t *>(block);
+    free(block);
+}
+
+struct BenchResult {
+    double nsPerCommand;
+    double allocationsPerCommand;
+};
+
+static string makeCommands(size_t count) {
+    static const char *templates[] = {
+            " NOOP" CRLF,
+            " LOGIN \"user\" \"secret\"" CRLF,
+            " FETCH 1:* (FLAGS BODY[HEADER.FIELDS (FROM SUBJECT)])" CRLF,
+            " CAPABILITY" CRLF
+    };
+
+    string data;
+    char tag[32];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(tag, sizeof(tag), "a%zu", i);
+        data.append(tag);
+        data.append(templates[i % 4]);
+    }
+    return data;
+}
+
+/* Command framing as it was done before the tokenizer: line copy,
+ * heap allocated tag and name, split() and erase() of the buffer front. */
+static size_t legacyFraming(string incomingData) {
+    size_t commands = 0;
+    while (true) {
+        size_t crlfPos = incomingData.find(CRLF);
+        if (crlfPos == string::npos)
+            break;
+        string line = incomingData.substr(0, crlfPos);
+
+        string *tag = new string(line.substr(0, line.find(' ')));
+        vector<string> parts;
+        split(line, " ", parts);
+        string *name = new string(parts[1]);
+        stringToUpper(*name);
+
+        vector<string> args;
+        split(line, " ", args);
+
+        incomingData.erase(0, crlfPos + 2);
+        delete tag;
+        delete name;
+        commands++;
+    }
+    return commands;
+}
+
+static size_t tokenizerFraming(InputBuffer &buffer, ImapTokenizer &tokenizer) {
+    size_t commands = 0;
+    while (!buffer.empty()) {
+        StringRef data(buffer.data(), buffer.size());
+        if (tokenizer.tokenize(data) != ImapTokenizerStatus::COMPLETED)
+            break;
+        buffer.consume(tokenizer.commandLength());
+        commands++;
+    }
+    return commands;
+}
+
+template <typename Function>
+static BenchResult measure(size_t commands, size_t rounds, Function function) {
+    size_t allocations = allocationCount;
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; i++)
+        function();
+    auto duration = chrono::steady_clock::now() - start;
+    allocations = allocationCount - allocations;
+
+    BenchResult result;
+    result.nsPerCommand = static_cast<double>(
+            chrono::duration_cast<chrono::nanoseconds>(duration).count()) / (commands * rounds);
+    result.allocationsPerCommand = static_cast<double>(allocations) / (commands * rounds);
+    return result;
+}
+
+static void printResult(const char *name, const BenchResult &result) {
+    printf("%-28s %10.1f ns/command %8.2f allocations/command\n",
+           name, result.nsPerCommand, result.allocationsPerCommand);
+}
+
+static void benchCommandFraming() {
+    const size_t commands = 1000;
+    const size_t rounds = 200;
+    string data = makeCommands(commands);
+
+    BenchResult legacy = measure(commands, rounds, [&data]() {
+        legacyFraming(data);
+    });
+
+    InputBuffer buffer(data.size());
+    ImapTokenizer tokenizer;
+    BenchResult tokenized = measure(commands, rounds, [&data, &buffer, &tokenizer]() {
+        /* Buffer is reused between rounds as it's reused between reads */
+        char *dst = buffer.prepare(data.size());
+        data.copy(dst, data.size());
+        buffer.commit(data.size());
+        tokenizerFraming(buffer, tokenizer);
+    });
+
+    printf("IMAP command framing, %zu pipelined commands:\n", commands);
+    printResult("  substr/split (legacy)", legacy);
+    printResult("  ImapTokenizer", tokenized);
+}
+
+static string makeFeed(size_t items) {
+    string feed = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                  "<rss version=\"2.0\"><channel>\n"
+                  "<title>Bench</title><link>http://example.com/</link>"
+                  "<description>Benchmark feed</description><language>en</language>\n";
+    char item[512];
+    for (size_t i = 0; i < items; i++) {
+        snprintf(item, sizeof(item),
+                 "<item><title>Item %zu &amp; more</title>"
+                 "<link>http://example.com/posts/%zu</link>"
+                 "<description><![CDATA[<p>Post number %zu, some text to make the item "
+                 "look like a real one with a paragraph of content.</p>]]></description>"
+                 "<guid>http://example.com/posts/%zu</guid>"
+                 "<pubDate>Tue, 10 Jun 2003 04:00:00 GMT</pubDate></item>\n",
+                 i, i, i, i);
+        feed.append(item);
+    }
+    feed.append("</channel></rss>\n");
+    return feed;
+}
+
+static const char *elementText(tinyxml2::XMLElement *parent, const char *name) {
+    tinyxml2::XMLElement *element = parent->FirstChildElement(name);
+    return (element && element->GetText()) ? element->GetText() : "";
+}
+
+/* Feed parsing as it was done before RssStreamParser: tinyxml2 document
+ * walked with FirstChildElement/NextSiblingElement. */
+static RssChannel *domParse(const char *rss) {
+    tinyxml2::XMLDocument doc;
+    doc.Parse(rss);
+    tinyxml2::XMLElement *channel = doc.RootElement()->FirstChildElement(RssXmlParser::CHANNEL_ITEM);
+
+    RssChannel *rssChannel = new RssChannel(elementText(channel, RssXmlParser::TITLE_ITEM),
+                                            elementText(channel, RssXmlParser::LINK_ITEM),
+                                            elementText(channel, RssXmlParser::DESCRIPTION_ITEM));
+    tinyxml2::XMLElement *rssItem = channel->FirstChildElement(RssXmlParser::ITEM_TAG);
+    while (rssItem != nullptr) {
+        RssObject *obj = new RssObject();
+        obj->setTitle(elementText(rssItem, RssXmlParser::TITLE_ITEM));
+        obj->setLink(elementText(rssItem, RssXmlParser::LINK_ITEM));
+        obj->setText(elementText(rssItem, RssXmlParser::DESCRIPTION_ITEM));
+        obj->setGuid(elementText(rssItem, RssXmlParser::GUID_ITEM));
+        obj->setPubDate(RFC822ToTimestamp(elementText(rssItem, RssXmlParser::PUB_DATE_ITEM)));
+        rssChannel->addItem(obj);
+        rssItem = rssItem->NextSiblingElement(RssXmlParser::ITEM_TAG);
+    }
+    return rssChannel;
+}
+
+/* Events only, nothing is kept: memory the parser itself needs */
+static size_t streamEvents(const string &feed) {
+    RssStreamParser parser;
+    parser.feed(feed.data(), feed.size());
+    parser.finish();
+    size_t items = 0;
+    RssStreamEvent event;
+    while ((event = parser.next()) != RssStreamEvent::END) {
+        if (event == RssStreamEvent::ITEM_END)
+            items++;
+    }
+    return items;
+}
+
+template <typename Function>
+static void measureFeed(const char *name, const string &feed, size_t items, size_t rounds,
+                        Function function) {
+    size_t peakBase = allocatedBytes;
+    peakAllocatedBytes = allocatedBytes;
+    BenchResult result = measure(items, rounds, function);
+    printf("%-28s %10.1f ns/item %8.2f allocations/item %8.2f peak/feed size\n",
+           name, result.nsPerCommand, result.allocationsPerCommand,
+           static_cast<double>(peakAllocatedBytes - peakBase) / feed.size());
+}
+
+static void benchFeedParsing(size_t items) {
+    const size_t rounds = 10;
+    string feed = makeFeed(items);
+
+    printf("RSS feed parsing, %zu items, %zu KiB:\n", items, feed.size() / 1024);
+    measureFeed("  tinyxml2 DOM (legacy)", feed, items, rounds, [&feed]() {
+        delete domParse(feed.c_str());
+    });
+    measureFeed("  RssXmlParser::parseRss", feed, items, rounds, [&feed]() {
+        delete RssXmlParser::parseRss(feed.c_str());
+    });
+    measureFeed("  RssStreamParser events", feed, items, rounds, [&feed]() {
+        streamEvents(feed);
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    benchCommandFraming();
+    benchFeedParsing(1000);
+    benchFeedParsing(10000);
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <vector>
+#include <thread>
+#include "utils/bounded_queue.h"
+#include "bounded_queue_test.h"
+
+using namespace std;
+using namespace nestor::utils;
+
+void BoundedQueueTest::setUp(void) {
+}
+
+void BoundedQueueTest::tearDown(void) {
+}
+
+void BoundedQueueTest::testQueueFifo(void) {
+    BoundedQueue<int> queue(3);
+    CPPUNIT_ASSERT_EQUAL(size_t(4), queue.capacity());
+
+    int item = 0;
+    CPPUNIT_ASSERT(!queue.tryPop(item));
+    for (int i = 1; i <= 4; i++) {
+        item = i;
+        CPPUNIT_ASSERT(queue.tryPush(item));
+    }
+    item = 5;
+    CPPUNIT_ASSERT(!queue.tryPush(item));
+    CPPUNIT_ASSERT_EQUAL(size_t(4), queue.size());
+
+    CPPUNIT_ASSERT(queue.tryPop(item));
+    CPPUNIT_ASSERT_EQUAL(1, item);
+    // Freed slot is reused on the next lap
+    item = 5;
+    CPPUNIT_ASSERT(queue.tryPush(item));
+    for (int i = 2; i <= 5; i++) {
+        CPPUNIT_ASSERT(queue.tryPop(item));
+        CPPUNIT_ASSERT_EQUAL(i, item);
+    }
+    CPPUNIT_ASSERT_EQUAL(size_t(0), queue.size());
+}
+
+void BoundedQueueTest::testQueueThreads(void) {
+    const int producers = 3;
+    const int consumers = 3;
+    const int itemsPerProducer = 20000;
+    BoundedQueue<int> queue(16);
+
+    vector<long long> sums(consumers, 0);
+    vector<thread> threads;
+    for (int c = 0; c < consumers; c++) {
+        threads.push_back(thread([&queue, &sums, c]() {
+            for (;;) {
+                int item;
+                queue.pop(item);
+                if (item == 0)
+                    break;
+                sums[c] += item;
+            }
+        }));
+    }
+    vector<thread> producerThreads;
+    for (int p = 0; p < producers; p++) {
+        producerThreads.push_back(thread([&queue]() {
+            for (int i = 1; i <= itemsPerProducer; i++) {
+                int item = i;
+                queue.push(item);
+            }
+        }));
+    }
+    for (thread &producer : producerThreads)
+        producer.join();
+    // Zero stops a consumer
+    for (int c = 0; c < consumers; c++) {
+        int stop = 0;
+        queue.push(stop);
+    }
+    for (thread &consumer : threads)
+        consumer.join();
+
+    long long total = 0;
+    for (long long sum : sums)
+        total += sum;
+    long long expected = static_cast<long long>(producers) * itemsPerProducer * (itemsPerProducer + 1) / 2;
+    CPPUNIT_ASSERT_EQUAL(expected, total);
+    CPPUNIT_ASSERT_EQUAL(size_t(0), queue.size());
+}
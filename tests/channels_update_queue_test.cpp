@@ -0,0 +1,69 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <vector>
+#include "service/channels_update_queue.h"
+#include "channels_update_queue_test.h"
+
+using namespace std;
+using namespace nestor::service;
+
+void ChannelsUpdateQueueTest::setUp(void) {
+}
+
+void ChannelsUpdateQueueTest::tearDown(void) {
+}
+
+void ChannelsUpdateQueueTest::testQueueOrder(void) {
+    ChannelsUpdateQueue queue;
+    queue.push(1, 300);
+    queue.push(2, 100);
+    queue.push(3, 200);
+    queue.push(4, 1000);
+    CPPUNIT_ASSERT_EQUAL(time_t(100), queue.nextDue());
+
+    vector<int64_t> due;
+    CPPUNIT_ASSERT_EQUAL(size_t(0), queue.popDue(99, 10, due));
+    CPPUNIT_ASSERT_EQUAL(size_t(3), queue.popDue(300, 10, due));
+    CPPUNIT_ASSERT_EQUAL(int64_t(2), due[0]);
+    CPPUNIT_ASSERT_EQUAL(int64_t(3), due[1]);
+    CPPUNIT_ASSERT_EQUAL(int64_t(1), due[2]);
+
+    CPPUNIT_ASSERT_EQUAL(size_t(1), queue.size());
+    CPPUNIT_ASSERT_EQUAL(time_t(1000), queue.nextDue());
+}
+
+void ChannelsUpdateQueueTest::testQueueBatch(void) {
+    ChannelsUpdateQueue queue;
+    for (int64_t id = 0; id < 10; id++)
+        queue.push(id, 50 + id);
+
+    vector<int64_t> due;
+    CPPUNIT_ASSERT_EQUAL(size_t(4), queue.popDue(100, 4, due));
+    CPPUNIT_ASSERT_EQUAL(size_t(6), queue.size());
+    CPPUNIT_ASSERT_EQUAL(int64_t(3), due.back());
+
+    // Rescheduled channel goes after the waiting ones
+    queue.push(0, 200);
+    due.clear();
+    CPPUNIT_ASSERT_EQUAL(size_t(6), queue.popDue(100, 100, due));
+    CPPUNIT_ASSERT_EQUAL(int64_t(4), due.front());
+    CPPUNIT_ASSERT_EQUAL(time_t(200), queue.nextDue());
+}
@@ -0,0 +1,222 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <memory>
+#include <map>
+#include "net/http_client.h"
+#include "net/http_async_client.h"
+#include "net/io_observer.h"
+#include "net/http_buffer_pool.h"
+#include "http_client_test.h"
+
+using namespace std;
+using namespace nestor::net;
+
+void HttpClientTest::setUp(void) {
+    // Body bigger than several libcurl write chunks
+    body_.clear();
+    for (int i = 0; body_.size() < 200 * 1024; i++)
+        body_ += "<item><guid>" + to_string(i) + "</guid></item>\n";
+
+    char name[] = "/tmp/nestor_http_testXXXXXX";
+    int fd = mkstemp(name);
+    CPPUNIT_ASSERT(fd >= 0);
+    CPPUNIT_ASSERT_EQUAL(ssize_t(body_.size()), write(fd, body_.data(), body_.size()));
+    close(fd);
+    fileName_ = name;
+}
+
+void HttpClientTest::tearDown(void) {
+    unlink(fileName_.c_str());
+}
+
+void HttpClientTest::testReceiveBuffer(void) {
+    HttpClient client;
+    unique_ptr<HttpResource> res(client.getResource("file://" + fileName_));
+    CPPUNIT_ASSERT(res.get() != nullptr);
+    CPPUNIT_ASSERT_EQUAL(unsigned(body_.size()), res->contentLength());
+    CPPUNIT_ASSERT_EQUAL(unsigned(body_.size()), res->decodedLength());
+    CPPUNIT_ASSERT(memcmp(body_.data(), res->content(), body_.size()) == 0);
+    // Content is zero terminated for the parsers
+    CPPUNIT_ASSERT_EQUAL(0, int(res->content()[body_.size()]));
+}
+
+void HttpClientTest::testMaxBodySize(void) {
+    HttpClient client;
+    client.setMaxBodySize(body_.size() - 1);
+    unique_ptr<HttpResource> res(client.getResource("file://" + fileName_));
+    CPPUNIT_ASSERT(res.get() == nullptr);
+
+    client.setMaxBodySize(body_.size());
+    res.reset(client.getResource("file://" + fileName_));
+    CPPUNIT_ASSERT(res.get() != nullptr);
+    CPPUNIT_ASSERT_EQUAL(unsigned(body_.size()), res->contentLength());
+}
+
+void HttpClientTest::testBufferPool(void) {
+    HttpBufferPool pool(2, 1024 * 1024);
+    {
+        HttpClient client(&pool);
+        unique_ptr<HttpResource> res(client.getResource("file://" + fileName_));
+        CPPUNIT_ASSERT(res.get() != nullptr);
+        CPPUNIT_ASSERT(memcmp(body_.data(), res->content(), body_.size()) == 0);
+    }
+    CPPUNIT_ASSERT_EQUAL(size_t(1), pool.size());
+
+    HttpClient client(&pool);
+    unique_ptr<HttpResource> res(client.getResource("file://" + fileName_));
+    CPPUNIT_ASSERT(res.get() != nullptr);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), pool.reuseCount());
+    CPPUNIT_ASSERT(memcmp(body_.data(), res->content(), body_.size()) == 0);
+
+    // Too big buffers are not kept
+    size_t capacity;
+    unsigned char *big = pool.acquire(2 * 1024 * 1024, capacity);
+    pool.release(big, capacity);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), pool.size());
+}
+
+void HttpClientTest::testAsyncClient(void) {
+    IOObserver observer;
+    HttpAsyncClient client(&observer);
+    map<string, unsigned int> received;
+
+    auto callback = [&received](const string &url, HttpResource *res) {
+        received[url] = res ? res->contentLength() : 0;
+        delete res;
+    };
+    string url = "file://" + fileName_;
+    client.fetch(url, "", "", callback);
+    client.fetch(url + "?again", "", "", callback);
+    client.fetch(url + "_missing", "", "", callback);
+    CPPUNIT_ASSERT_EQUAL(size_t(3), client.activeCount());
+
+    for (int i = 0; i < 1000 && client.activeCount() > 0; i++)
+        observer.wait();
+
+    CPPUNIT_ASSERT_EQUAL(size_t(0), client.activeCount());
+    CPPUNIT_ASSERT_EQUAL(size_t(3), received.size());
+    CPPUNIT_ASSERT_EQUAL(unsigned(body_.size()), received[url]);
+    CPPUNIT_ASSERT_EQUAL(0u, received[url + "_missing"]);
+    CPPUNIT_ASSERT_EQUAL(size_t(3), client.statistics().transfers);
+    CPPUNIT_ASSERT_EQUAL(size_t(0), client.statistics().tlsHandshakes);
+
+    // Finished handles serve the next requests
+    CPPUNIT_ASSERT_EQUAL(size_t(3), client.clientPool().size());
+    received.clear();
+    client.fetch(url, "", "", callback);
+    for (int i = 0; i < 1000 && client.activeCount() > 0; i++)
+        observer.wait();
+    CPPUNIT_ASSERT_EQUAL(size_t(1), client.clientPool().reuseCount());
+    CPPUNIT_ASSERT_EQUAL(unsigned(body_.size()), received[url]);
+}
+
+void HttpClientTest::testFetchWindow(void) {
+    IOObserver observer;
+    HttpAsyncClient client(&observer);
+    client.setMaxTransfers(2);
+    client.setMaxHostTransfers(1);
+
+    size_t received = 0, maxActive = 0;
+    auto callback = [&](const string &url, HttpResource *res) {
+        CPPUNIT_ASSERT(res != nullptr);
+        received++;
+        maxActive = max(maxActive, client.activeCount() + 1);
+        delete res;
+    };
+
+    // All file URLs have the same empty host
+    string url = "file://" + fileName_;
+    for (int i = 0; i < 5; i++)
+        client.fetch(url, "", "", callback);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), client.activeCount());
+    CPPUNIT_ASSERT_EQUAL(size_t(4), client.pendingCount());
+
+    client.setMaxHostTransfers(3);
+    CPPUNIT_ASSERT_EQUAL(size_t(2), client.activeCount());
+    CPPUNIT_ASSERT_EQUAL(size_t(3), client.pendingCount());
+
+    for (int i = 0; i < 1000 && client.activeCount() + client.pendingCount() > 0; i++)
+        observer.wait();
+
+    CPPUNIT_ASSERT_EQUAL(size_t(5), received);
+    CPPUNIT_ASSERT(maxActive <= 2);
+    CPPUNIT_ASSERT_EQUAL(size_t(0), client.pendingCount());
+}
+
+void HttpClientTest::testBodySink(void) {
+    IOObserver observer;
+    HttpAsyncClient client(&observer);
+    client.setMaxBodySize(body_.size());
+
+    string streamed;
+    size_t chunks = 0;
+    unique_ptr<HttpResource> res;
+    auto sink = [&](const HttpClient &, const char *data, size_t length) {
+        streamed.append(data, length);
+        chunks++;
+        return HttpClient::SinkStatus::CONSUMED;
+    };
+    auto callback = [&res](const string &url, HttpResource *resource) {
+        res.reset(resource);
+    };
+
+    string url = "file://" + fileName_;
+    client.fetch(url, "", "", callback, sink);
+    for (int i = 0; i < 1000 && client.activeCount() > 0; i++)
+        observer.wait();
+
+    CPPUNIT_ASSERT(res.get() != nullptr);
+    CPPUNIT_ASSERT(res->streamed());
+    CPPUNIT_ASSERT_EQUAL(0u, res->contentLength());
+    CPPUNIT_ASSERT_EQUAL(unsigned(body_.size()), res->decodedLength());
+    CPPUNIT_ASSERT(chunks > 1);
+    CPPUNIT_ASSERT(streamed == body_);
+    CPPUNIT_ASSERT_EQUAL(size_t(0), client.bufferPool().size());
+
+    // Sink aborts the transfer
+    client.fetch(url, "", "", callback, [](const HttpClient &, const char *, size_t) {
+        return HttpClient::SinkStatus::ABORT;
+    });
+    for (int i = 0; i < 1000 && client.activeCount() > 0; i++)
+        observer.wait();
+    CPPUNIT_ASSERT(res.get() == nullptr);
+
+    // Streamed body is limited as the buffered one
+    client.setMaxBodySize(1024);
+    streamed.clear();
+    client.fetch(url, "", "", callback, sink);
+    for (int i = 0; i < 1000 && client.activeCount() > 0; i++)
+        observer.wait();
+    CPPUNIT_ASSERT(res.get() == nullptr);
+    CPPUNIT_ASSERT(streamed.size() <= 1024);
+
+    // Released handle doesn't keep the sink, the body is buffered again
+    client.setMaxBodySize(body_.size());
+    client.fetch(url, "", "", callback);
+    for (int i = 0; i < 1000 && client.activeCount() > 0; i++)
+        observer.wait();
+    CPPUNIT_ASSERT(res.get() != nullptr);
+    CPPUNIT_ASSERT(!res->streamed());
+    CPPUNIT_ASSERT_EQUAL(unsigned(body_.size()), res->contentLength());
+}
@@ -0,0 +1,57 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef HTTP_CLIENT_TEST_H_
+#define HTTP_CLIENT_TEST_H_
+
+#include <string>
+#include <cppunit/TestCase.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestSuite.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class HttpClientTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE (HttpClientTest);
+    CPPUNIT_TEST(testReceiveBuffer);
+    CPPUNIT_TEST(testMaxBodySize);
+    CPPUNIT_TEST(testBufferPool);
+    CPPUNIT_TEST(testAsyncClient);
+    CPPUNIT_TEST(testFetchWindow);
+    CPPUNIT_TEST(testBodySink);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void);
+
+protected:
+    void testReceiveBuffer(void);
+    void testMaxBodySize(void);
+    void testBufferPool(void);
+    void testAsyncClient(void);
+    void testFetchWindow(void);
+    void testBodySink(void);
+
+private:
+    std::string fileName_;
+    std::string body_;
+};
+
+#endif /* HTTP_CLIENT_TEST_H_ */
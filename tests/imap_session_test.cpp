@@ -24,6 +24,8 @@
 #include "utils/string.h"
 #include "net/socket_single.h"
 #include <string>
+#include <limits>
+#include <sstream>
 
 using namespace std;
 using namespace nestor::imap;
@@ -36,6 +38,10 @@ class DummySocket : public SocketSingle {
 public:
     string writebuf;
     string readbuf;
+    /* Bytes which writeSome() accepts before "socket buffer" is full */
+    size_t sendCapacity = numeric_limits<size_t>::max();
+    bool closedByPeer = false;
+    bool writeFails = false;
 
 public:
 
@@ -65,6 +71,15 @@ public:
         writebuf.append(str);
     }
 
+    size_t writeSome(const char *buf, size_t buflen) override {
+        if (writeFails)
+            throw SocketIOException("Broken pipe");
+        size_t len = buflen > sendCapacity ? sendCapacity : buflen;
+        writebuf.append(buf, len);
+        sendCapacity -= len;
+        return len;
+    }
+
     size_t read(char *buf, size_t buflen) override {
         size_t len = buflen > readbuf.size() ? readbuf.size() : buflen;
         copy(readbuf.begin(), readbuf.begin() + len, buf);
@@ -78,6 +93,14 @@ public:
         return cp;
     }
 
+    size_t readSome(char *buf, size_t buflen) override {
+        return read(buf, buflen);
+    }
+
+    bool peerClosed() const override {
+        return closedByPeer && readbuf.empty();
+    }
+
     bool connected() const override {
         return true;
     }
@@ -176,3 +199,160 @@ void ImapSessionTest::testLogoutCommand(void) {
     actualAnswer = dump_writebuf;
     CPPUNIT_ASSERT_EQUAL(expectedAnswer, actualAnswer);
 }
+
+void ImapSessionTest::testPartialWrite(void) {
+    string expectedAnswer = "abcd4 OK NOOP completed" CRLF;
+
+    sock->sendCapacity = 5;
+    sock->readbuf.append("abcd4 NOOP" CRLF);
+    context->processData();
+    CPPUNIT_ASSERT_EQUAL(string("abcd4"), sock->writebuf);
+    CPPUNIT_ASSERT(context->wantWrite());
+    CPPUNIT_ASSERT(context->wantRead());
+
+    sock->sendCapacity = numeric_limits<size_t>::max();
+    context->writeAnswers();
+    CPPUNIT_ASSERT_EQUAL(expectedAnswer, sock->writebuf);
+    CPPUNIT_ASSERT(!context->wantWrite());
+    sock->clearBufs();
+}
+
+void ImapSessionTest::testOutputBackpressure(void) {
+    string expectedAnswer = "a OK NOOP completed" CRLF "b OK NOOP completed" CRLF
+            "c OK NOOP completed" CRLF;
+    int interestChanges = 0;
+
+    context->setOutputWatermarks(0, 10);
+    context->setOnIOInterestCallback([&interestChanges](ImapSession *) {
+        interestChanges++;
+    });
+
+    /* Socket doesn't accept anything, session must stop after the first answer */
+    sock->sendCapacity = 0;
+    sock->readbuf.append("a NOOP" CRLF "b NOOP" CRLF "c NOOP" CRLF);
+    context->processData();
+    CPPUNIT_ASSERT(sock->writebuf.empty());
+    CPPUNIT_ASSERT(!context->wantRead());
+    CPPUNIT_ASSERT(context->wantWrite());
+    CPPUNIT_ASSERT_EQUAL(string("a OK NOOP completed" CRLF).length(), context->pendingOutput());
+    CPPUNIT_ASSERT_EQUAL(1, interestChanges);
+
+    /* Write readiness drains the backlog and resumes buffered commands */
+    sock->sendCapacity = numeric_limits<size_t>::max();
+    context->writeAnswers();
+    CPPUNIT_ASSERT_EQUAL(expectedAnswer, sock->writebuf);
+    CPPUNIT_ASSERT(context->wantRead());
+    CPPUNIT_ASSERT(!context->wantWrite());
+    CPPUNIT_ASSERT_EQUAL(2, interestChanges);
+    sock->clearBufs();
+}
+
+void ImapSessionTest::testAutologout(void) {
+    string expectedAnswer = "* BYE Autologout; idle for too long" CRLF;
+
+    context->autologout();
+    CPPUNIT_ASSERT(context->state() == ImapSessionState::EXIT);
+    CPPUNIT_ASSERT_EQUAL(expectedAnswer, dump_writebuf);
+}
+
+void ImapSessionTest::testPipelinedCommands(void) {
+    string expectedAnswer = "a1 OK NOOP completed" CRLF
+            "* CAPABILITY IMAP4rev1 LITERAL+ AUTH=PLAIN" CRLF "a2 OK CAPABILITY completed" CRLF
+            "a3 OK NOOP completed" CRLF;
+
+    /* Last command is split between reads */
+    sock->readbuf.append("a1 NOOP" CRLF "a2 capability" CRLF "a3 NO");
+    context->processData();
+    sock->readbuf.append("OP" CRLF);
+    context->processData();
+
+    CPPUNIT_ASSERT_EQUAL(expectedAnswer, sock->writebuf);
+    sock->clearBufs();
+}
+
+void ImapSessionTest::testPeerClose(void) {
+    string expectedAnswer = "a1 OK NOOP completed" CRLF;
+
+    /* Commands received before the end of stream are still answered */
+    sock->readbuf.append("a1 NOOP" CRLF);
+    sock->closedByPeer = true;
+    context->processData();
+
+    CPPUNIT_ASSERT(context->state() == ImapSessionState::EXIT);
+    CPPUNIT_ASSERT_EQUAL(expectedAnswer, dump_writebuf);
+}
+
+void ImapSessionTest::testLiteralLogin(void) {
+    string expectedAnswer = "+ Ready for literal data" CRLF "a1 OK LOGIN completed" CRLF;
+
+    sock->readbuf.append("a1 LOGIN {4}" CRLF);
+    context->processData();
+    CPPUNIT_ASSERT_EQUAL(string("+ Ready for literal data" CRLF), sock->writebuf);
+
+    sock->readbuf.append("john \"secret\"" CRLF);
+    context->processData();
+    CPPUNIT_ASSERT_EQUAL(expectedAnswer, sock->writebuf);
+    CPPUNIT_ASSERT(context->state() == ImapSessionState::AUTH);
+    sock->clearBufs();
+
+    /* Literal longer than the command line limit arrives in many segments */
+    const size_t literalLength = 100000;
+    ostringstream prefix;
+    prefix << "a2 LOGIN {" << literalLength << "}" CRLF;
+    sock->readbuf.append(prefix.str());
+    context->processData();
+    CPPUNIT_ASSERT_EQUAL(string("+ Ready for literal data" CRLF), sock->writebuf);
+    for (size_t sent = 0; sent < literalLength; sent += 10000) {
+        sock->readbuf.append(10000, 'x');
+        context->processData();
+    }
+    sock->readbuf.append(" secret" CRLF);
+    context->processData();
+    CPPUNIT_ASSERT_EQUAL(string("+ Ready for literal data" CRLF "a2 NO LOGIN Wrong state" CRLF),
+                         sock->writebuf);
+    sock->clearBufs();
+}
+
+void ImapSessionTest::testWrongState(void) {
+    string expectedAnswer = "a1 OK LOGIN completed" CRLF "a2 NO LOGIN Wrong state" CRLF
+            "a3 NO AUTHENTICATE Wrong state" CRLF "a4 OK NOOP completed" CRLF;
+
+    sock->readbuf.append("a1 LOGIN john secret" CRLF "a2 login john secret" CRLF
+                         "a3 Authenticate PLAIN" CRLF "a4 nOoP" CRLF);
+    context->processData();
+    CPPUNIT_ASSERT_EQUAL(expectedAnswer, sock->writebuf);
+    sock->clearBufs();
+}
+
+void ImapSessionTest::testInvalidCommand(void) {
+    sock->readbuf.append("a1 NOOP )" CRLF "a2 NOOP" CRLF);
+    context->processData();
+    CPPUNIT_ASSERT_EQUAL(string("a1 BAD Syntax error" CRLF "a2 OK NOOP completed" CRLF),
+                         sock->writebuf);
+    sock->clearBufs();
+
+    /* Tag starts with a letter or digit, bytes over 0x7f are neither */
+    sock->readbuf.append("\xe9 NOOP" CRLF);
+    context->processData();
+    CPPUNIT_ASSERT_EQUAL(string("\xe9 BAD Missing command" CRLF), sock->writebuf);
+    sock->clearBufs();
+
+    /* Invalid line without the end isn't buffered forever */
+    sock->readbuf.append("a3 NOOP )");
+    for (size_t sent = 0; sent <= ImapSession::MAX_COMMAND_LENGTH &&
+             context->state() != ImapSessionState::EXIT; sent += 10000) {
+        sock->readbuf.append(10000, 'x');
+        context->processData();
+    }
+    CPPUNIT_ASSERT(context->state() == ImapSessionState::EXIT);
+    CPPUNIT_ASSERT_EQUAL(string("* BAD Command line too long" CRLF), dump_writebuf);
+}
+
+void ImapSessionTest::testWriteError(void) {
+    /* Commands after the failed answer aren't run */
+    sock->writeFails = true;
+    sock->readbuf.append("a1" CRLF "a2 LOGIN {999999999}" CRLF);
+    context->processData();
+    CPPUNIT_ASSERT(context->state() == ImapSessionState::EXIT);
+    CPPUNIT_ASSERT(dump_writebuf.empty());
+}
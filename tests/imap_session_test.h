@@ -44,6 +44,15 @@ class ImapSessionTest : public CppUnit::TestFixture {
     CPPUNIT_TEST(testCapabilityCommand);
     CPPUNIT_TEST(testNoopCommand);
     CPPUNIT_TEST(testLogoutCommand);
+    CPPUNIT_TEST(testPartialWrite);
+    CPPUNIT_TEST(testOutputBackpressure);
+    CPPUNIT_TEST(testAutologout);
+    CPPUNIT_TEST(testPipelinedCommands);
+    CPPUNIT_TEST(testPeerClose);
+    CPPUNIT_TEST(testLiteralLogin);
+    CPPUNIT_TEST(testWrongState);
+    CPPUNIT_TEST(testInvalidCommand);
+    CPPUNIT_TEST(testWriteError);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -55,6 +64,15 @@ protected:
     void testCapabilityCommand(void);
     void testNoopCommand(void);
     void testLogoutCommand(void);
+    void testPartialWrite(void);
+    void testOutputBackpressure(void);
+    void testAutologout(void);
+    void testPipelinedCommands(void);
+    void testPeerClose(void);
+    void testLiteralLogin(void);
+    void testWrongState(void);
+    void testInvalidCommand(void);
+    void testWriteError(void);
 
 private:
     DummySocket *sock;
@@ -0,0 +1,120 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+
+#include "imap/imap_tokenizer.h"
+#include "imap_tokenizer_test.h"
+#include "utils/string.h"
+#include <string>
+
+using namespace std;
+using namespace nestor::imap;
+using namespace nestor::utils;
+
+void ImapTokenizerTest::setUp(void) {
+}
+
+void ImapTokenizerTest::tearDown(void) {
+}
+
+void ImapTokenizerTest::testSimpleCommand(void) {
+    ImapTokenizer tokenizer;
+    string data = "a001 NOOP" CRLF "a002 LOGOUT" CRLF;
+
+    CPPUNIT_ASSERT(tokenizer.tokenize(data) == ImapTokenizerStatus::COMPLETED);
+    CPPUNIT_ASSERT_EQUAL(size_t(2), tokenizer.size());
+    CPPUNIT_ASSERT_EQUAL(string("a001"), tokenizer[0].value.toString());
+    CPPUNIT_ASSERT_EQUAL(string("NOOP"), tokenizer[1].value.toString());
+    CPPUNIT_ASSERT(tokenizer[1].type == ImapTokenType::ATOM);
+    CPPUNIT_ASSERT_EQUAL(string("a001 NOOP" CRLF).length(), tokenizer.commandLength());
+
+    /* Tokens refer to the data, nothing is copied */
+    CPPUNIT_ASSERT(tokenizer[0].value.data() == data.data());
+}
+
+void ImapTokenizerTest::testQuotedString(void) {
+    ImapTokenizer tokenizer;
+    string data = "a1 LOGIN \"john smith\" \"pa\\\"ss\\\\\"" CRLF;
+
+    CPPUNIT_ASSERT(tokenizer.tokenize(data) == ImapTokenizerStatus::COMPLETED);
+    CPPUNIT_ASSERT_EQUAL(size_t(4), tokenizer.size());
+    CPPUNIT_ASSERT(tokenizer[2].type == ImapTokenType::STRING);
+    CPPUNIT_ASSERT(tokenizer[2].stringType == ImapStringType::QUOTED);
+    CPPUNIT_ASSERT(!tokenizer[2].escaped);
+    CPPUNIT_ASSERT_EQUAL(string("john smith"), tokenizer[2].toString());
+    CPPUNIT_ASSERT(tokenizer[3].escaped);
+    CPPUNIT_ASSERT_EQUAL(string("pa\"ss\\"), tokenizer[3].toString());
+}
+
+void ImapTokenizerTest::testLiteral(void) {
+    ImapTokenizer tokenizer;
+    string data = "a1 LOGIN {4}" CRLF "john {5+}" CRLF "pa ss" CRLF;
+
+    CPPUNIT_ASSERT(tokenizer.tokenize(data) == ImapTokenizerStatus::COMPLETED);
+    CPPUNIT_ASSERT_EQUAL(size_t(4), tokenizer.size());
+    CPPUNIT_ASSERT(tokenizer[2].stringType == ImapStringType::LITERAL);
+    CPPUNIT_ASSERT_EQUAL(string("john"), tokenizer[2].toString());
+    CPPUNIT_ASSERT(tokenizer[3].stringType == ImapStringType::LITERAL_NONSYNC);
+    CPPUNIT_ASSERT_EQUAL(string("pa ss"), tokenizer[3].toString());
+    CPPUNIT_ASSERT_EQUAL(data.length(), tokenizer.commandLength());
+}
+
+void ImapTokenizerTest::testList(void) {
+    ImapTokenizer tokenizer;
+    string data = "a1 FETCH 1:* (FLAGS BODY[HEADER.FIELDS (FROM)] (\\Seen))" CRLF;
+
+    CPPUNIT_ASSERT(tokenizer.tokenize(data) == ImapTokenizerStatus::COMPLETED);
+    CPPUNIT_ASSERT_EQUAL(size_t(10), tokenizer.size());
+    CPPUNIT_ASSERT(tokenizer[3].type == ImapTokenType::LIST_BEGIN);
+    CPPUNIT_ASSERT_EQUAL(string("BODY[HEADER.FIELDS (FROM)]"), tokenizer[5].toString());
+    CPPUNIT_ASSERT(tokenizer[6].type == ImapTokenType::LIST_BEGIN);
+    CPPUNIT_ASSERT_EQUAL(string("\\Seen"), tokenizer[7].toString());
+    CPPUNIT_ASSERT(tokenizer[8].type == ImapTokenType::LIST_END);
+    CPPUNIT_ASSERT(tokenizer[9].type == ImapTokenType::LIST_END);
+}
+
+void ImapTokenizerTest::testUncompleted(void) {
+    ImapTokenizer tokenizer;
+
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 NOO") == ImapTokenizerStatus::UNCOMPLETED);
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 NOOP\r") == ImapTokenizerStatus::UNCOMPLETED);
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 LOGIN \"jo") == ImapTokenizerStatus::UNCOMPLETED);
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 LOGIN {1") == ImapTokenizerStatus::UNCOMPLETED);
+
+    /* Synchronizing literal waits for continuation request */
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 LOGIN {4}" CRLF) == ImapTokenizerStatus::UNCOMPLETED);
+    CPPUNIT_ASSERT(tokenizer.literalContinuation());
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 LOGIN {4}" CRLF "jo") == ImapTokenizerStatus::UNCOMPLETED);
+    CPPUNIT_ASSERT(!tokenizer.literalContinuation());
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 LOGIN {4+}" CRLF) == ImapTokenizerStatus::UNCOMPLETED);
+    CPPUNIT_ASSERT(!tokenizer.literalContinuation());
+}
+
+void ImapTokenizerTest::testInvalid(void) {
+    ImapTokenizer tokenizer;
+
+    CPPUNIT_ASSERT(tokenizer.tokenize(CRLF) == ImapTokenizerStatus::INVALID);
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1  NOOP" CRLF) == ImapTokenizerStatus::INVALID);
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 (NOOP" CRLF) == ImapTokenizerStatus::INVALID);
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 NOOP)" CRLF) == ImapTokenizerStatus::INVALID);
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 \"NO" CRLF "OP\"" CRLF) == ImapTokenizerStatus::INVALID);
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 {x}" CRLF) == ImapTokenizerStatus::INVALID);
+    CPPUNIT_ASSERT(tokenizer.tokenize("a1 \"a\"b" CRLF) == ImapTokenizerStatus::INVALID);
+}
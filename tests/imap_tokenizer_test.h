@@ -0,0 +1,53 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+
+#ifndef IMAP_TOKENIZER_TEST_H_
+#define IMAP_TOKENIZER_TEST_H_
+
+#include <cppunit/TestCase.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestSuite.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class ImapTokenizerTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE (ImapTokenizerTest);
+    CPPUNIT_TEST(testSimpleCommand);
+    CPPUNIT_TEST(testQuotedString);
+    CPPUNIT_TEST(testLiteral);
+    CPPUNIT_TEST(testList);
+    CPPUNIT_TEST(testUncompleted);
+    CPPUNIT_TEST(testInvalid);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void);
+
+protected:
+    void testSimpleCommand(void);
+    void testQuotedString(void);
+    void testLiteral(void);
+    void testList(void);
+    void testUncompleted(void);
+    void testInvalid(void);
+};
+
+#endif /* IMAP_TOKENIZER_TEST_H_ */
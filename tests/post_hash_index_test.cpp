@@ -0,0 +1,127 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include "service/post_hash_index.h"
+#include "service/sqlite_provider.h"
+#include "post_hash_index_test.h"
+
+using namespace std;
+using namespace nestor::service;
+
+static Post makePost(int64_t channelId, const string &guid, const string &title) {
+    Post post;
+    post.setChannelId(channelId);
+    post.setGuid(guid);
+    post.setTitle(title);
+    post.setLink("http://example.com/" + guid);
+    post.setDescription("description");
+    post.setText("text");
+    tm date = {};
+    date.tm_year = 114;
+    date.tm_mon = 5;
+    date.tm_mday = 12;
+    date.tm_hour = 10;
+    date.tm_min = 30;
+    post.setPublicationDate(date);
+    return post;
+}
+
+void PostHashIndexTest::setUp(void) {
+}
+
+void PostHashIndexTest::tearDown(void) {
+}
+
+void PostHashIndexTest::testUnchanged(void) {
+    PostHashIndex index;
+    Post post = makePost(1, "guid", "title");
+
+    CPPUNIT_ASSERT(!index.unchanged(post));
+    index.store(post);
+    CPPUNIT_ASSERT(index.unchanged(post));
+
+    Post changed = makePost(1, "guid", "new title");
+    CPPUNIT_ASSERT(!index.unchanged(changed));
+    // Same GUID in another channel is another post
+    CPPUNIT_ASSERT(!index.unchanged(makePost(2, "guid", "title")));
+
+    index.store(changed);
+    CPPUNIT_ASSERT(index.unchanged(changed));
+    CPPUNIT_ASSERT(!index.unchanged(post));
+
+    CPPUNIT_ASSERT_EQUAL(size_t(1), index.size());
+    CPPUNIT_ASSERT_EQUAL(size_t(2), index.hits());
+    CPPUNIT_ASSERT_EQUAL(size_t(4), index.misses());
+}
+
+void PostHashIndexTest::testRemoveChannel(void) {
+    PostHashIndex index;
+    CPPUNIT_ASSERT(!index.containsChannel(1));
+    index.addChannel(1);
+    CPPUNIT_ASSERT(index.containsChannel(1));
+
+    index.store(makePost(1, "first", "title"));
+    index.store(makePost(1, "second", "title"));
+    index.store(makePost(2, "first", "title"));
+    CPPUNIT_ASSERT_EQUAL(size_t(3), index.size());
+    CPPUNIT_ASSERT(index.containsGuid(1, "second"));
+    CPPUNIT_ASSERT(!index.containsGuid(2, "second"));
+
+    index.removeChannel(1);
+    CPPUNIT_ASSERT(!index.containsGuid(1, "second"));
+    CPPUNIT_ASSERT(!index.containsChannel(1));
+    CPPUNIT_ASSERT_EQUAL(size_t(1), index.size());
+    CPPUNIT_ASSERT(!index.unchanged(makePost(1, "first", "title")));
+    CPPUNIT_ASSERT(index.unchanged(makePost(2, "first", "title")));
+}
+
+void PostHashIndexTest::testStoredPostHash(void) {
+    SqliteConnection connection(":memory:");
+    connection.open();
+    SqliteProvider prov(&connection);
+    prov.createPostsTable();
+
+    // Post read back from the database must match the parsed one
+    Post post = makePost(1, "guid", "title");
+    prov.upsertPost(post);
+    Post *stored = prov.findPostByGuid("guid");
+    CPPUNIT_ASSERT(stored != nullptr);
+    CPPUNIT_ASSERT_EQUAL(PostHashIndex::contentHash(post), PostHashIndex::contentHash(*stored));
+    CPPUNIT_ASSERT_EQUAL(PostHashIndex::guidHash(post), PostHashIndex::guidHash(*stored));
+    CPPUNIT_ASSERT_EQUAL(PostHashIndex::dateHash(post), PostHashIndex::dateHash(*stored));
+    delete stored;
+}
+
+void PostHashIndexTest::testGeneratedDate(void) {
+    PostHashIndex index;
+    index.store(makePost(1, "guid", "title"));
+
+    // Item without pubDate gets the current time on every read
+    Post reread = makePost(1, "guid", "title");
+    tm date = reread.publicationDate();
+    date.tm_year++;
+    reread.setPublicationDate(date);
+    CPPUNIT_ASSERT(!index.unchanged(reread));
+    CPPUNIT_ASSERT(index.unchanged(reread, false));
+
+    Post changed = makePost(1, "guid", "new title");
+    changed.setPublicationDate(date);
+    CPPUNIT_ASSERT(!index.unchanged(changed, false));
+}
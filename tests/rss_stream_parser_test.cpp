@@ -0,0 +1,243 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "rss/rss_stream_parser.h"
+#include "rss/rss_feed_reader.h"
+#include "rss_stream_parser_test.h"
+
+using namespace std;
+using namespace nestor::rss;
+
+static const char *FEED =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!-- generated -->\n"
+        "<rss version=\"2.0\" xmlns:atom=\"http://www.w3.org/2005/Atom\">\n"
+        "<channel>\n"
+        "  <title>News &amp; views</title>\n"
+        "  <link>http://example.com/</link>\n"
+        "  <description><![CDATA[<b>Daily</b> news [1]]]]></description>\n"
+        "  <atom:link href=\"http://example.com/rss\" rel=\"self\"/>\n"
+        "  <language>en</language>\n"
+        "  <item>\n"
+        "    <title>First &#8212; &#x41;</title>\n"
+        "    <link>http://example.com/1</link>\n"
+        "    <description>a &lt; b</description>\n"
+        "    <guid>id-1</guid>\n"
+        "    <pubDate>Tue, 10 Jun 2003 04:00:00 GMT</pubDate>\n"
+        "  </item>\n"
+        "  <item>\n"
+        "    <link>http://example.com/untitled</link>\n"
+        "    <description>skipped</description>\n"
+        "  </item>\n"
+        "  <item>\n"
+        "    <title>Second</title>\n"
+        "    <link>http://example.com/2</link>\n"
+        "    <description>text <i>with</i> markup</description>\n"
+        "  </item>\n"
+        "</channel>\n"
+        "</rss>\n";
+
+struct Event {
+    RssStreamEvent type;
+    string name;
+    string text;
+};
+
+static vector<Event> collectEvents(RssStreamParser &parser) {
+    vector<Event> events;
+    RssStreamEvent type;
+    while ((type = parser.next()) != RssStreamEvent::END && type != RssStreamEvent::NEED_MORE) {
+        Event event = { type, parser.name(), parser.text() };
+        events.push_back(event);
+    }
+    return events;
+}
+
+void RssStreamParserTest::setUp(void) {
+}
+
+void RssStreamParserTest::tearDown(void) {
+}
+
+void RssStreamParserTest::testParseRss(void) {
+    unique_ptr<RssChannel> channel(RssXmlParser::parseRss(FEED));
+
+    CPPUNIT_ASSERT_EQUAL(string("News & views"), channel->title());
+    CPPUNIT_ASSERT_EQUAL(string("http://example.com/"), channel->link());
+    CPPUNIT_ASSERT_EQUAL(string("<b>Daily</b> news [1]]"), channel->description());
+    CPPUNIT_ASSERT_EQUAL(size_t(2), channel->optional().size());
+    CPPUNIT_ASSERT_EQUAL(string("en"), channel->optional().at("language"));
+    CPPUNIT_ASSERT_EQUAL(string(""), channel->optional().at("atom:link"));
+
+    CPPUNIT_ASSERT_EQUAL(2u, channel->itemsCount());
+    RssObject *first = channel->getItem(0);
+    CPPUNIT_ASSERT_EQUAL(string("First \xE2\x80\x94 A"), first->title());
+    CPPUNIT_ASSERT_EQUAL(string("a < b"), first->text());
+    CPPUNIT_ASSERT_EQUAL(string("id-1"), first->guid());
+    CPPUNIT_ASSERT_EQUAL(103, first->pubDate().tm_year);
+    CPPUNIT_ASSERT(first->hasPubDate());
+
+    RssObject *second = channel->getItem(1);
+    CPPUNIT_ASSERT_EQUAL(string("Second"), second->title());
+    CPPUNIT_ASSERT_EQUAL(string("text with markup"), second->text());
+    // link is the default guid
+    CPPUNIT_ASSERT_EQUAL(string("http://example.com/2"), second->guid());
+    // pubDate is the time the item was read
+    CPPUNIT_ASSERT(!second->hasPubDate());
+}
+
+void RssStreamParserTest::testChunkedFeed(void) {
+    RssStreamParser whole;
+    whole.feed(FEED, strlen(FEED));
+    whole.finish();
+    vector<Event> expected = collectEvents(whole);
+    CPPUNIT_ASSERT_EQUAL(size_t(21), expected.size());
+
+    // Every chunk boundary inside of tags, entities and CDATA is resumed
+    RssStreamParser parser;
+    vector<Event> events;
+    size_t length = strlen(FEED);
+    for (size_t i = 0; i < length; i++) {
+        parser.feed(FEED + i, 1);
+        vector<Event> chunkEvents = collectEvents(parser);
+        events.insert(events.end(), chunkEvents.begin(), chunkEvents.end());
+        CPPUNIT_ASSERT(parser.buffered() < 64);
+    }
+    parser.finish();
+    CPPUNIT_ASSERT(collectEvents(parser).empty());
+    CPPUNIT_ASSERT(parser.next() == RssStreamEvent::END);
+
+    CPPUNIT_ASSERT_EQUAL(expected.size(), events.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        CPPUNIT_ASSERT(expected[i].type == events[i].type);
+        CPPUNIT_ASSERT_EQUAL(expected[i].name, events[i].name);
+        CPPUNIT_ASSERT_EQUAL(expected[i].text, events[i].text);
+    }
+}
+
+void RssStreamParserTest::testMalformedFeed(void) {
+    CPPUNIT_ASSERT_THROW(RssXmlParser::parseRss("<feed><title>x</title></feed>"),
+                         RssXmlParserException);
+    CPPUNIT_ASSERT_THROW(RssXmlParser::parseRss("<rss version=\"0.91\"><channel/></rss>"),
+                         RssXmlParserException);
+    CPPUNIT_ASSERT_THROW(RssXmlParser::parseRss("<rss version=\"2.0\"></rss>"),
+                         RssXmlParserException);
+    CPPUNIT_ASSERT_THROW(RssXmlParser::parseRss("<rss version=\"2.0\"><channel>"
+                                                "<title>t</title><link>l</link></channel></rss>"),
+                         RssXmlParserException);
+    CPPUNIT_ASSERT_THROW(RssXmlParser::parseRss("<rss version=\"2.0\"><channel></item></rss>"),
+                         RssXmlParserException);
+
+    string truncated(FEED);
+    truncated.resize(truncated.size() / 2);
+    CPPUNIT_ASSERT_THROW(RssXmlParser::parseRss(truncated.c_str()), RssXmlParserException);
+}
+
+void RssStreamParserTest::testFeedReaderCharset(void) {
+    // windows-1251, "Новости" and "Пост"
+    const char feed[] =
+            "<?xml version=\"1.0\" encoding=\"windows-1251\"?>"
+            "<rss version=\"2.0\"><channel>"
+            "<title>\xCD\xEE\xE2\xEE\xF1\xF2\xE8</title>"
+            "<link>http://example.com/</link><description>d</description>"
+            "<item><title>\xCF\xEE\xF1\xF2</title><link>http://example.com/1</link>"
+            "<description>text</description></item>"
+            "</channel></rss>";
+
+    RssFeedReader reader("windows-1251");
+    size_t length = strlen(feed);
+    for (size_t i = 0; i < length; i += 3)
+        reader.feed(feed + i, min<size_t>(3, length - i));
+    CPPUNIT_ASSERT_EQUAL(1u, reader.itemsCount());
+
+    unique_ptr<RssChannel> channel(reader.finish());
+    CPPUNIT_ASSERT_EQUAL(string("\xD0\x9D\xD0\xBE\xD0\xB2\xD0\xBE\xD1\x81\xD1\x82\xD0\xB8"),
+                         channel->title());
+    CPPUNIT_ASSERT_EQUAL(1u, channel->itemsCount());
+    CPPUNIT_ASSERT_EQUAL(string("\xD0\x9F\xD0\xBE\xD1\x81\xD1\x82"), channel->getItem(0)->title());
+
+    // UTF-8 character split between chunks
+    RssFeedReader utf8Reader;
+    string utf8Feed(FEED);
+    size_t dash = utf8Feed.find("&#8212;");
+    utf8Feed.replace(dash, 7, "\xE2\x80\x94");
+    for (size_t i = 0; i < utf8Feed.size(); i += 2)
+        utf8Reader.feed(utf8Feed.data() + i, min<size_t>(2, utf8Feed.size() - i));
+    channel.reset(utf8Reader.finish());
+    CPPUNIT_ASSERT_EQUAL(string("First \xE2\x80\x94 A"), channel->getItem(0)->title());
+
+    CPPUNIT_ASSERT_THROW(RssFeedReader("no-such-charset"), RssXmlParserException);
+}
+
+static string makeFeed(int items, bool channelFieldsFirst) {
+    string channelFields = "<title>t</title><link>l</link><description>d</description>";
+    string feed = "<rss version=\"2.0\"><channel>";
+    if (channelFieldsFirst)
+        feed += channelFields;
+    for (int i = 0; i < items; i++) {
+        string n = to_string(i);
+        feed += "<item><title>" + n + "</title><link>http://example.com/" + n +
+                "</link><description>d</description><guid>g" + n + "</guid></item>";
+    }
+    if (!channelFieldsFirst)
+        feed += channelFields;
+    return feed + "</channel></rss>";
+}
+
+void RssStreamParserTest::testKnownGuidLimit(void) {
+    unordered_set<string> stored = {"g1", "g3", "g4", "g5", "g6", "g7"};
+    auto known = [&stored](const string &guid) {
+        return stored.count(guid) > 0;
+    };
+
+    // g1 doesn't start a run long enough, g3 and g4 stop the parse
+    string feed = makeFeed(8, true);
+    RssFeedReader reader;
+    reader.setKnownGuidLimit(2, known);
+    reader.feed(feed.data(), feed.size());
+    CPPUNIT_ASSERT(reader.stopped());
+    unique_ptr<RssChannel> channel(reader.finish());
+    CPPUNIT_ASSERT_EQUAL(5u, channel->itemsCount());
+    CPPUNIT_ASSERT_EQUAL(string("g4"), channel->getItem(4)->guid());
+
+    // Channel elements after the items are still needed
+    feed = makeFeed(8, false);
+    RssFeedReader lateChannel;
+    lateChannel.setKnownGuidLimit(2, known);
+    lateChannel.feed(feed.data(), feed.size());
+    CPPUNIT_ASSERT(!lateChannel.stopped());
+    channel.reset(lateChannel.finish());
+    CPPUNIT_ASSERT_EQUAL(8u, channel->itemsCount());
+    CPPUNIT_ASSERT_EQUAL(string("t"), channel->title());
+
+    // 0 disables stopping
+    feed = makeFeed(8, true);
+    RssFeedReader whole;
+    whole.setKnownGuidLimit(0, known);
+    whole.feed(feed.data(), feed.size());
+    channel.reset(whole.finish());
+    CPPUNIT_ASSERT(!whole.stopped());
+    CPPUNIT_ASSERT_EQUAL(8u, channel->itemsCount());
+}
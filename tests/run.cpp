@@ -35,15 +35,35 @@
 #include <log4cplus/helpers/property.h>
 #include <log4cplus/asyncappender.h>
 #include "common/logger.h"
+#include "bounded_queue_test.h"
+#include "channels_update_queue_test.h"
+#include "http_client_test.h"
 #include "imap_session_test.h"
 #include "imap_string_test.h"
+#include "imap_tokenizer_test.h"
+#include "post_hash_index_test.h"
+#include "rss_stream_parser_test.h"
+#include "sqlite_connection_pool_test.h"
+#include "sqlite_provider_test.h"
+#include "timer_wheel_test.h"
+#include "write_behind_queue_test.h"
 
 using namespace std;
 using namespace log4cplus;
 using namespace nestor::common;
 
+CPPUNIT_TEST_SUITE_REGISTRATION( BoundedQueueTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( ChannelsUpdateQueueTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( HttpClientTest );
 CPPUNIT_TEST_SUITE_REGISTRATION( ImapSessionTest );
 CPPUNIT_TEST_SUITE_REGISTRATION( ImapStringTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( ImapTokenizerTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( PostHashIndexTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( RssStreamParserTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( SqliteConnectionPoolTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( SqliteProviderTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( TimerWheelTest );
+CPPUNIT_TEST_SUITE_REGISTRATION( WriteBehindQueueTest );
 
 void test_logger_init(void) {
     log4cplus::initialize();
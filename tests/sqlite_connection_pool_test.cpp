@@ -0,0 +1,113 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "service/sqlite_connection_pool.h"
+#include "service/sqlite_provider.h"
+#include "sqlite_connection_pool_test.h"
+
+using namespace std;
+using namespace nestor::service;
+
+static string queryText(SqliteConnection *connection, const char *sql) {
+    sqlite3_stmt *stmt = nullptr;
+    string result;
+    sqlite3_prepare_v2(connection->handle(), sql, -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0))
+        result = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+void SqliteConnectionPoolTest::setUp(void) {
+    char name[] = "/tmp/nestor_pool_testXXXXXX";
+    int fd = mkstemp(name);
+    CPPUNIT_ASSERT(fd >= 0);
+    close(fd);
+    fileName_ = name;
+}
+
+void SqliteConnectionPoolTest::tearDown(void) {
+    unlink(fileName_.c_str());
+    unlink((fileName_ + "-wal").c_str());
+    unlink((fileName_ + "-shm").c_str());
+}
+
+void SqliteConnectionPoolTest::testWalMode(void) {
+    SqliteConnectionPool pool(fileName_, 2);
+    pool.setCacheSize(-1024);
+    pool.setSynchronous("NORMAL");
+    pool.open();
+
+    CPPUNIT_ASSERT_EQUAL(size_t(2), pool.readersCount());
+    CPPUNIT_ASSERT(pool.reader(0) != pool.reader(1));
+    CPPUNIT_ASSERT(pool.reader(0) == pool.reader(2));
+
+    CPPUNIT_ASSERT_EQUAL(string("wal"), queryText(pool.writer(), "PRAGMA journal_mode"));
+    CPPUNIT_ASSERT_EQUAL(string("wal"), queryText(pool.reader(1), "PRAGMA journal_mode"));
+    CPPUNIT_ASSERT_EQUAL(string("-1024"), queryText(pool.reader(0), "PRAGMA cache_size"));
+    // NORMAL
+    CPPUNIT_ASSERT_EQUAL(string("1"), queryText(pool.writer(), "PRAGMA synchronous"));
+
+    CPPUNIT_ASSERT_THROW(pool.setSynchronous("SOMETIMES"), invalid_argument);
+}
+
+void SqliteConnectionPoolTest::testReadDuringWrite(void) {
+    SqliteConnectionPool pool(fileName_, 1);
+    pool.open();
+
+    SqliteProvider writer(pool.writer());
+    writer.createUsersTable();
+    User user;
+    user.setUsername("first");
+    user.setPassword("password");
+    writer.insertUser(user);
+
+    SqliteProvider reader(pool.reader(0));
+    delete reader.findUserByName("first");
+
+    // Reader sees the last commit while the writer holds its transaction
+    pool.reader(0)->execute("PRAGMA busy_timeout=0");
+    writer.beginTransaction();
+    user.setUsername("second");
+    writer.insertUser(user);
+
+    User *found = reader.findUserByName("first");
+    CPPUNIT_ASSERT(found != nullptr);
+    delete found;
+    CPPUNIT_ASSERT(reader.findUserByName("second") == nullptr);
+
+    writer.endTransaction();
+    found = reader.findUserByName("second");
+    CPPUNIT_ASSERT(found != nullptr);
+    delete found;
+}
+
+void SqliteConnectionPoolTest::testReadOnlyReaders(void) {
+    SqliteConnectionPool pool(fileName_, 1);
+    pool.open();
+
+    CPPUNIT_ASSERT(!pool.writer()->readOnly());
+    CPPUNIT_ASSERT(pool.reader(0)->readOnly());
+    CPPUNIT_ASSERT_THROW(pool.reader(0)->execute("CREATE TABLE t(a)"), SqliteConnectionException);
+    pool.writer()->execute("CREATE TABLE t(a)");
+}
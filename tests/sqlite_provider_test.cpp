@@ -0,0 +1,260 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include "service/sqlite_provider.h"
+#include "service/sqlite_statement_cache.h"
+#include "sqlite_provider_test.h"
+
+using namespace std;
+using namespace nestor::service;
+
+static Post makePost(int64_t channelId, const string &guid, const string &title) {
+    Post post;
+    post.setChannelId(channelId);
+    post.setGuid(guid);
+    post.setTitle(title);
+    post.setLink("http://example.com/" + guid);
+    post.setDescription("description");
+    post.setText("text");
+    tm date = {};
+    date.tm_year = 114;
+    date.tm_mday = 1;
+    post.setPublicationDate(date);
+    return post;
+}
+
+static Channel makeChannel(const string &rssLink) {
+    Channel channel;
+    channel.setTitle("title");
+    channel.setRssLink(rssLink);
+    channel.setLink(rssLink);
+    channel.setDescription("description");
+    channel.setUpdateInterval(3600);
+    tm date = {};
+    date.tm_year = 114;
+    date.tm_mday = 1;
+    channel.setLastUpdate(date);
+    return channel;
+}
+
+void SqliteProviderTest::setUp(void) {
+    connection_ = new SqliteConnection(":memory:");
+    connection_->open();
+
+    SqliteProvider prov(connection_);
+    prov.createUsersTable();
+    prov.createChannelsTable();
+    prov.createPostsTable();
+}
+
+void SqliteProviderTest::tearDown(void) {
+    delete connection_;
+}
+
+void SqliteProviderTest::testSharedStatementCache(void) {
+    SqliteStatementCache cache(connection_);
+
+    {
+        SqliteProvider prov(connection_, &cache);
+        User user;
+        user.setUsername("user");
+        user.setPassword("password");
+        prov.insertUser(user);
+    }
+    CPPUNIT_ASSERT_EQUAL(size_t(1), cache.compileCount());
+
+    // Next sessions reuse statements compiled by the first one
+    for (int i = 0; i < 10; i++) {
+        SqliteProvider prov(connection_, &cache);
+        User *user = prov.findUserByName("user");
+        CPPUNIT_ASSERT(user != nullptr);
+        CPPUNIT_ASSERT_EQUAL(string("password"), user->password());
+        delete user;
+    }
+    CPPUNIT_ASSERT_EQUAL(size_t(2), cache.compileCount());
+    CPPUNIT_ASSERT_EQUAL(size_t(11), cache.requestCount());
+}
+
+void SqliteProviderTest::testCloseWithCachedStatements(void) {
+    SqliteStatementCache cache(connection_);
+    SqliteProvider prov(connection_, &cache);
+    delete prov.findUserByName("nobody");
+    CPPUNIT_ASSERT_EQUAL(size_t(1), cache.compileCount());
+
+    // Unsubscribed callbacks are forgotten
+    int closeCalls = 0;
+    int first = connection_->subscribeOnClose([&closeCalls](SqliteConnection *) { closeCalls += 10; });
+    connection_->unsubscribeOnClose(first);
+    int second = connection_->subscribeOnClose([&closeCalls](SqliteConnection *) { closeCalls++; });
+    CPPUNIT_ASSERT(first != second);
+
+    // Cached statements are finalized before the database is closed
+    connection_->close();
+    CPPUNIT_ASSERT(!connection_->connected());
+    CPPUNIT_ASSERT_EQUAL(1, closeCalls);
+}
+
+void SqliteProviderTest::testUpsertPost(void) {
+    SqliteProvider prov(connection_);
+
+    CPPUNIT_ASSERT(prov.upsertPost(makePost(1, "guid", "title")));
+    Post *stored = prov.findPostByGuid("guid");
+    CPPUNIT_ASSERT(stored != nullptr);
+    int64_t id = stored->id();
+    delete stored;
+
+    // Unchanged post is not written again
+    CPPUNIT_ASSERT(!prov.upsertPost(makePost(1, "guid", "title")));
+
+    CPPUNIT_ASSERT(prov.upsertPost(makePost(1, "guid", "new title")));
+    stored = prov.findPostByGuid("guid");
+    CPPUNIT_ASSERT(stored != nullptr);
+    CPPUNIT_ASSERT_EQUAL(id, stored->id());
+    CPPUNIT_ASSERT_EQUAL(string("new title"), stored->title());
+    delete stored;
+
+    // Same GUID in another channel is another post
+    CPPUNIT_ASSERT(prov.upsertPost(makePost(2, "guid", "title")));
+    vector<Post *> *posts = prov.getPostsForChannel(1);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), posts->size());
+    for (Post *post : *posts)
+        delete post;
+    delete posts;
+}
+
+void SqliteProviderTest::testDuplicatePostsMigration(void) {
+    connection_->execute("DROP INDEX `posts_channel_id_guid_idx`;");
+    SqliteProvider prov(connection_);
+    prov.insertPost(makePost(1, "guid", "first"));
+    prov.insertPost(makePost(1, "guid", "second"));
+
+    prov.createPostsTable();
+    vector<Post *> *posts = prov.getPostsForChannel(1);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), posts->size());
+    CPPUNIT_ASSERT_EQUAL(string("first"), (*posts)[0]->title());
+    for (Post *post : *posts)
+        delete post;
+    delete posts;
+}
+
+void SqliteProviderTest::testChannelValidators(void) {
+    SqliteProvider prov(connection_);
+    Channel channel = makeChannel("http://example.com/rss");
+    channel.setId(prov.insertChannel(channel));
+
+    Channel *stored = prov.findChannelById(channel.id());
+    CPPUNIT_ASSERT(stored != nullptr);
+    CPPUNIT_ASSERT(stored->etag().empty());
+    CPPUNIT_ASSERT(stored->lastModified().empty());
+    delete stored;
+
+    channel.setEtag("\"abc\"");
+    channel.setLastModified("Sun, 01 Jun 2014 10:00:00 GMT");
+    CPPUNIT_ASSERT(prov.updateChannel(channel));
+
+    stored = prov.findChannelById(channel.id());
+    CPPUNIT_ASSERT(stored != nullptr);
+    CPPUNIT_ASSERT_EQUAL(string("\"abc\""), stored->etag());
+    CPPUNIT_ASSERT_EQUAL(string("Sun, 01 Jun 2014 10:00:00 GMT"), stored->lastModified());
+    delete stored;
+}
+
+void SqliteProviderTest::testChannelColumnsMigration(void) {
+    // Table as created by the first release
+    connection_->execute("DROP TABLE `channels`;"
+                         "CREATE TABLE `channels`("
+                         "`channel_id` INTEGER PRIMARY KEY ASC AUTOINCREMENT NOT NULL,"
+                         "`title` VARCHAR(200) NOT NULL,"
+                         "`rss_link` VARCHAR(2048) NOT NULL UNIQUE,"
+                         "`link` VARCHAR(2048) NOT NULL,"
+                         "`description` VARCHAR(400) NOT NULL,"
+                         "`update_interval_sec` INTEGER NOT NULL DEFAULT '3600',"
+                         "`last_update` TEXT);"
+                         "INSERT INTO `channels`(`title`, `rss_link`, `link`, `description`, `last_update`) "
+                         "VALUES('old', 'http://example.com/old', 'link', 'desc', '2014-01-01 00:00:00');");
+
+    SqliteProvider prov(connection_);
+    prov.createChannelsTable();
+    prov.createChannelsTable();
+
+    Channel *stored = prov.findChannelByRssLink("http://example.com/old");
+    CPPUNIT_ASSERT(stored != nullptr);
+    CPPUNIT_ASSERT_EQUAL(string("old"), stored->title());
+    CPPUNIT_ASSERT(stored->etag().empty());
+    CPPUNIT_ASSERT_EQUAL(0LL, stored->bytesTransferred());
+    CPPUNIT_ASSERT_EQUAL(0, stored->knownGuidLimit());
+    delete stored;
+}
+
+void SqliteProviderTest::testChannelTraffic(void) {
+    SqliteProvider prov(connection_);
+    Channel channel = makeChannel("http://example.com/rss");
+    channel.setId(prov.insertChannel(channel));
+
+    tm polledAt = {};
+    polledAt.tm_year = 114;
+    polledAt.tm_mday = 1;
+    CPPUNIT_ASSERT(prov.recordChannelPoll(channel.id(), polledAt, 100, 400));
+    CPPUNIT_ASSERT(prov.recordChannelPoll(channel.id(), polledAt, 50, 200));
+    CPPUNIT_ASSERT(!prov.recordChannelPoll(channel.id() + 1, polledAt, 1, 1));
+
+    Channel *stored = prov.findChannelById(channel.id());
+    CPPUNIT_ASSERT(stored != nullptr);
+    CPPUNIT_ASSERT_EQUAL(150LL, stored->bytesTransferred());
+    CPPUNIT_ASSERT_EQUAL(600LL, stored->bytesDecoded());
+    CPPUNIT_ASSERT_EQUAL(0, stored->knownGuidLimit());
+    delete stored;
+
+    CPPUNIT_ASSERT(prov.setChannelKnownGuidLimit(channel.id(), 3));
+    CPPUNIT_ASSERT(!prov.setChannelKnownGuidLimit(channel.id() + 1, 3));
+    stored = prov.findChannelById(channel.id());
+    CPPUNIT_ASSERT_EQUAL(3, stored->knownGuidLimit());
+    delete stored;
+}
+
+void SqliteProviderTest::testChannelPoll(void) {
+    SqliteProvider prov(connection_);
+    Channel channel = makeChannel("http://example.com/rss");
+    channel.setId(prov.insertChannel(channel));
+
+    // Not downloaded yet
+    Channel *stored = prov.findChannelById(channel.id());
+    CPPUNIT_ASSERT_EQUAL(114, stored->lastPoll().tm_year);
+    delete stored;
+
+    tm polledAt = {};
+    polledAt.tm_year = 114;
+    polledAt.tm_mon = 5;
+    polledAt.tm_mday = 1;
+    CPPUNIT_ASSERT(prov.recordChannelPoll(channel.id(), polledAt, 0, 0));
+    polledAt.tm_mday = 2;
+    CPPUNIT_ASSERT(prov.recordChannelPoll(channel.id(), polledAt, 0, 0));
+    CPPUNIT_ASSERT(!prov.recordChannelPoll(channel.id() + 1, polledAt, 0, 0));
+
+    vector<Channel *> *channels = prov.getAllChannels();
+    CPPUNIT_ASSERT_EQUAL(size_t(1), channels->size());
+    stored = channels->front();
+    CPPUNIT_ASSERT_EQUAL(5, stored->lastPoll().tm_mon);
+    CPPUNIT_ASSERT_EQUAL(2, stored->lastPoll().tm_mday);
+    // Last update is the time of the last change
+    CPPUNIT_ASSERT_EQUAL(0, stored->lastUpdate().tm_mon);
+    delete stored;
+    delete channels;
+}
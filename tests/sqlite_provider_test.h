@@ -0,0 +1,60 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef SQLITE_PROVIDER_TEST_H_
+#define SQLITE_PROVIDER_TEST_H_
+
+#include <cppunit/TestCase.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestSuite.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "service/sqlite_connection.h"
+
+class SqliteProviderTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE (SqliteProviderTest);
+    CPPUNIT_TEST(testSharedStatementCache);
+    CPPUNIT_TEST(testCloseWithCachedStatements);
+    CPPUNIT_TEST(testUpsertPost);
+    CPPUNIT_TEST(testDuplicatePostsMigration);
+    CPPUNIT_TEST(testChannelValidators);
+    CPPUNIT_TEST(testChannelColumnsMigration);
+    CPPUNIT_TEST(testChannelTraffic);
+    CPPUNIT_TEST(testChannelPoll);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void);
+
+protected:
+    void testSharedStatementCache(void);
+    void testCloseWithCachedStatements(void);
+    void testUpsertPost(void);
+    void testDuplicatePostsMigration(void);
+    void testChannelValidators(void);
+    void testChannelColumnsMigration(void);
+    void testChannelTraffic(void);
+    void testChannelPoll(void);
+
+private:
+    nestor::service::SqliteConnection *connection_;
+};
+
+#endif /* SQLITE_PROVIDER_TEST_H_ */
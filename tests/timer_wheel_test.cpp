@@ -0,0 +1,166 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+
+#include "net/timer_wheel.h"
+#include "timer_wheel_test.h"
+#include <vector>
+#include <cstdlib>
+
+using namespace std;
+using namespace nestor::net;
+
+struct TestTimer : public TimerWheelNode {
+    int id = 0;
+    uint64_t expectedMs = 0;
+    uint64_t firedMs = 0;
+    int fired = 0;
+};
+
+void TimerWheelTest::setUp(void) {
+}
+
+void TimerWheelTest::tearDown(void) {
+}
+
+void TimerWheelTest::testExpireOrder(void) {
+    vector<int> order;
+    TimerWheel wheel(10, 0, [&order](TimerWheelNode *node) {
+        order.push_back(static_cast<TestTimer *>(node)->id);
+    });
+    TestTimer t1, t2, t3;
+    t1.id = 1;
+    t2.id = 2;
+    t3.id = 3;
+
+    wheel.schedule(&t3, 100);
+    wheel.schedule(&t1, 15);
+    wheel.schedule(&t2, 30);
+    CPPUNIT_ASSERT_EQUAL(size_t(3), wheel.size());
+
+    wheel.advance(19);
+    CPPUNIT_ASSERT(order.empty());
+    wheel.advance(20);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), order.size());
+    wheel.advance(99);
+    CPPUNIT_ASSERT_EQUAL(size_t(2), order.size());
+    wheel.advance(1000);
+    CPPUNIT_ASSERT_EQUAL(size_t(3), order.size());
+    CPPUNIT_ASSERT_EQUAL(1, order[0]);
+    CPPUNIT_ASSERT_EQUAL(2, order[1]);
+    CPPUNIT_ASSERT_EQUAL(3, order[2]);
+    CPPUNIT_ASSERT(wheel.empty());
+    CPPUNIT_ASSERT(!t1.scheduled());
+}
+
+void TimerWheelTest::testReschedule(void) {
+    int fired = 0;
+    TimerWheel wheel(10, 0, [&fired](TimerWheelNode *) { fired++; });
+    TestTimer t;
+
+    wheel.schedule(&t, 50);
+    wheel.advance(40);
+    wheel.schedule(&t, 50);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), wheel.size());
+    wheel.advance(80);
+    CPPUNIT_ASSERT_EQUAL(0, fired);
+    wheel.advance(90);
+    CPPUNIT_ASSERT_EQUAL(1, fired);
+
+    /* Scheduled between ticks, expires not earlier than requested */
+    wheel.advance(95);
+    wheel.schedule(&t, 50);
+    wheel.advance(140);
+    CPPUNIT_ASSERT_EQUAL(1, fired);
+    wheel.advance(150);
+    CPPUNIT_ASSERT_EQUAL(2, fired);
+}
+
+void TimerWheelTest::testCancel(void) {
+    int fired = 0;
+    TimerWheel wheel(10, 0, [&fired](TimerWheelNode *) { fired++; });
+    TestTimer t1, t2;
+
+    wheel.schedule(&t1, 50);
+    wheel.schedule(&t2, 5000);
+    wheel.cancel(&t1);
+    wheel.cancel(&t2);
+    wheel.cancel(&t2);
+    CPPUNIT_ASSERT(wheel.empty());
+    wheel.advance(10000);
+    CPPUNIT_ASSERT_EQUAL(0, fired);
+}
+
+void TimerWheelTest::testCascade(void) {
+    const unsigned int tickMs = 1;
+    const uint64_t startMs = 12345;
+    const size_t count = 2000;
+    uint64_t nowMs = startMs;
+
+    TimerWheel wheel(tickMs, startMs, [&nowMs](TimerWheelNode *node) {
+        TestTimer *t = static_cast<TestTimer *>(node);
+        t->fired++;
+        t->firedMs = nowMs;
+    });
+
+    /* Timeouts on every level of the wheel */
+    vector<TestTimer> timers(count);
+    srand(42);
+    for (size_t i = 0; i < count; i++) {
+        unsigned int timeoutMs = 1 + rand() % (i % 2 ? 300000 : 5000);
+        timers[i].expectedMs = startMs + timeoutMs;
+        wheel.schedule(&timers[i], timeoutMs);
+    }
+
+    /* Uneven steps as real event loop makes */
+    while (!wheel.empty()) {
+        nowMs += 1 + rand() % 3;
+        wheel.advance(nowMs);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        CPPUNIT_ASSERT_EQUAL(1, timers[i].fired);
+        CPPUNIT_ASSERT(timers[i].firedMs >= timers[i].expectedMs);
+        CPPUNIT_ASSERT(timers[i].firedMs < timers[i].expectedMs + 3);
+    }
+}
+
+void TimerWheelTest::testRescheduleFromCallback(void) {
+    TimerWheel *wheelPtr = nullptr;
+    TestTimer periodic, other;
+    TimerWheel wheel(10, 0, [&wheelPtr, &periodic, &other](TimerWheelNode *node) {
+        TestTimer *t = static_cast<TestTimer *>(node);
+        t->fired++;
+        if (t == &periodic) {
+            wheelPtr->schedule(t, 100);
+            wheelPtr->cancel(&other);
+        }
+    });
+    wheelPtr = &wheel;
+
+    wheel.schedule(&periodic, 100);
+    wheel.schedule(&other, 100);
+    for (uint64_t now = 0; now <= 1000; now += 10)
+        wheel.advance(now);
+
+    CPPUNIT_ASSERT_EQUAL(10, periodic.fired);
+    /* Both expired in the same tick, periodic one goes first */
+    CPPUNIT_ASSERT_EQUAL(0, other.fired);
+}
@@ -0,0 +1,104 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "service/sqlite_provider.h"
+#include "service/write_behind_queue.h"
+#include "write_behind_queue_test.h"
+
+using namespace std;
+using namespace nestor::service;
+
+static void insertChannel(SqliteProvider &provider, int number) {
+    Channel channel;
+    channel.setTitle("title");
+    channel.setRssLink("http://example.com/" + to_string(number) + ".rss");
+    channel.setLink("http://example.com");
+    channel.setDescription("description");
+    channel.setUpdateInterval(3600);
+    provider.insertChannel(channel);
+}
+
+static size_t channelsCount(SqliteProvider &provider) {
+    vector<Channel *> *channels = provider.getAllChannels();
+    size_t count = channels->size();
+    for (Channel *channel : *channels)
+        delete channel;
+    delete channels;
+    return count;
+}
+
+void WriteBehindQueueTest::setUp(void) {
+    connection_ = new SqliteConnection(":memory:");
+    connection_->open();
+
+    SqliteProvider prov(connection_);
+    prov.createChannelsTable();
+}
+
+void WriteBehindQueueTest::tearDown(void) {
+    delete connection_;
+}
+
+void WriteBehindQueueTest::testGroupCommit(void) {
+    SqliteProvider provider(connection_);
+    WriteBehindQueue queue(&provider);
+    // Only the size limit and flush() commit
+    queue.setBatchLimits(4, 60000);
+    queue.start();
+
+    int aborted = 0;
+    for (int i = 0; i < 10; i++)
+        queue.push([&provider, i]() { insertChannel(provider, i); }, [&aborted]() { aborted++; });
+    queue.flush();
+
+    WriteBehindQueue::Statistics statistics = queue.statistics();
+    CPPUNIT_ASSERT_EQUAL(uint64_t(10), statistics.writes);
+    CPPUNIT_ASSERT_EQUAL(uint64_t(3), statistics.commits);
+    CPPUNIT_ASSERT_EQUAL(uint64_t(0), statistics.failedCommits);
+    CPPUNIT_ASSERT_EQUAL(0, aborted);
+    CPPUNIT_ASSERT_EQUAL(size_t(10), channelsCount(provider));
+
+    // Nothing is queued, so the barrier returns at once
+    queue.flush();
+    queue.stop();
+    CPPUNIT_ASSERT_EQUAL(uint64_t(3), queue.statistics().commits);
+}
+
+void WriteBehindQueueTest::testCommitDelay(void) {
+    SqliteProvider provider(connection_);
+    WriteBehindQueue queue(&provider);
+    queue.setBatchLimits(100, 20);
+    queue.start();
+
+    queue.push([&provider]() { insertChannel(provider, 1); });
+    queue.push([&provider]() { insertChannel(provider, 2); });
+    for (int i = 0; i < 100 && queue.statistics().commits == 0; i++)
+        this_thread::sleep_for(chrono::milliseconds(10));
+    CPPUNIT_ASSERT_EQUAL(uint64_t(1), queue.statistics().commits);
+
+    // Remaining writes are committed on stop
+    queue.push([&provider]() { insertChannel(provider, 3); });
+    queue.stop();
+    CPPUNIT_ASSERT_EQUAL(uint64_t(3), queue.statistics().writes);
+    CPPUNIT_ASSERT_EQUAL(size_t(3), channelsCount(provider));
+}
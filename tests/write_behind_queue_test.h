@@ -0,0 +1,48 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef WRITE_BEHIND_QUEUE_TEST_H_
+#define WRITE_BEHIND_QUEUE_TEST_H_
+
+#include <cppunit/TestCase.h>
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestSuite.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include "service/sqlite_connection.h"
+
+class WriteBehindQueueTest : public CppUnit::TestFixture {
+    CPPUNIT_TEST_SUITE (WriteBehindQueueTest);
+    CPPUNIT_TEST(testGroupCommit);
+    CPPUNIT_TEST(testCommitDelay);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp(void);
+    void tearDown(void);
+
+protected:
+    void testGroupCommit(void);
+    void testCommitDelay(void);
+
+private:
+    nestor::service::SqliteConnection *connection_;
+};
+
+#endif /* WRITE_BEHIND_QUEUE_TEST_H_ */
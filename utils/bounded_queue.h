@@ -0,0 +1,181 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef UTILS_BOUNDED_QUEUE_H_
+#define UTILS_BOUNDED_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <utility>
+
+namespace nestor {
+namespace utils {
+
+/**
+ * Bounded lock-free queue for any number of producers and consumers.
+ * Every slot carries a sequence number telling whether it is free for
+ * the producer of the lap or holds the item for the consumer of the lap,
+ * so threads contend only on one atomic index per side.
+ * Capacity is rounded up to a power of two.
+ */
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+            : capacity_(roundCapacity(capacity)), mask_(capacity_ - 1),
+              cells_(new Cell[capacity_]), head_(0), tail_(0) {
+        for (size_t i = 0; i < capacity_; i++)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /**
+     * Appends item unless the queue is full.
+     * @return false if the queue is full, item is left untouched then.
+     */
+    bool tryPush(T &item) {
+        Cell *cell;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = std::move(item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Takes the oldest item unless the queue is empty.
+     * @return false if the queue is empty.
+     */
+    bool tryPop(T &item) {
+        Cell *cell;
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        item = std::move(cell->item);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Appends item, waits while the queue is full.
+     */
+    void push(T &item) {
+        for (unsigned int attempt = 0; !tryPush(item); attempt++)
+            backoff(attempt);
+    }
+
+    /**
+     * Takes the oldest item, waits while the queue is empty.
+     */
+    void pop(T &item) {
+        for (unsigned int attempt = 0; !tryPop(item); attempt++)
+            backoff(attempt);
+    }
+
+    /**
+     * Number of queued items. Exact only when no other thread uses the queue.
+     */
+    size_t size() const {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+private:
+    /** Waits of blocking calls spin first, then yield, then sleep */
+    static const unsigned int SPIN_ATTEMPTS = 64;
+    static const unsigned int YIELD_ATTEMPTS = 128;
+    static const unsigned int SLEEP_USEC = 500;
+    static const size_t CACHE_LINE_SIZE = 64;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    static size_t roundCapacity(size_t capacity) {
+        size_t rounded = 2;
+        while (rounded < capacity)
+            rounded <<= 1;
+        return rounded;
+    }
+
+    static void backoff(unsigned int attempt) {
+        if (attempt < SPIN_ATTEMPTS)
+            return;
+        if (attempt < YIELD_ATTEMPTS)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(SLEEP_USEC));
+    }
+
+private:
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    /** Indexes are kept on separate cache lines, producers and consumers don't share them */
+    char headPadding_[CACHE_LINE_SIZE];
+    std::atomic<size_t> head_;
+    char tailPadding_[CACHE_LINE_SIZE];
+    std::atomic<size_t> tail_;
+};
+
+template<typename T> const unsigned int BoundedQueue<T>::SPIN_ATTEMPTS;
+template<typename T> const unsigned int BoundedQueue<T>::YIELD_ATTEMPTS;
+template<typename T> const unsigned int BoundedQueue<T>::SLEEP_USEC;
+template<typename T> const size_t BoundedQueue<T>::CACHE_LINE_SIZE;
+
+} /* namespace utils */
+} /* namespace nestor */
+
+#endif /* UTILS_BOUNDED_QUEUE_H_ */
@@ -0,0 +1,57 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef UTILS_HASH_H_
+#define UTILS_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace nestor {
+namespace utils {
+
+static const uint64_t FNV1A_64_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV1A_64_PRIME = 1099511628211ULL;
+
+/**
+ * 64-bit FNV-1a hash. Pass result of the previous call as seed to hash
+ * several pieces of data as one sequence.
+ */
+static inline uint64_t fnv1a64(const void *data, size_t length,
+                               uint64_t seed = FNV1A_64_OFFSET) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= FNV1A_64_PRIME;
+    }
+    return hash;
+}
+
+static inline uint64_t fnv1a64(const std::string &str,
+                               uint64_t seed = FNV1A_64_OFFSET) {
+    return fnv1a64(str.data(), str.length(), seed);
+}
+
+} /* namespace utils */
+} /* namespace nestor */
+
+#endif /* UTILS_HASH_H_ */
@@ -0,0 +1,145 @@
+/*
+ *  This file is part of Nestor.
+ *
+ *  Nestor - program for aggregation RSS subscriptions providing
+ *  access via IMAP interface.
+ *  Copyright (C) 2013-2014  Konstantin Zhukov
+ *
+ *  Nestor is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Nestor is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see {http://www.gnu.org/licenses/}.
+ */
+#ifndef UTILS_STRING_REF_H_
+#define UTILS_STRING_REF_H_
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <ostream>
+
+namespace nestor {
+namespace utils {
+
+/**
+ * Non-owning reference to a character sequence. Used for parsing data
+ * in place, without copying it into std::string. Referenced data must
+ * outlive the reference.
+ */
+class StringRef {
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    StringRef() : data_(nullptr), length_(0) {}
+    StringRef(const char *data, size_t length) : data_(data), length_(length) {}
+    StringRef(const char *str) : data_(str), length_(str ? strlen(str) : 0) {}
+    StringRef(const std::string &str) : data_(str.data()), length_(str.length()) {}
+
+    const char *data() const { return data_; }
+    size_t length() const { return length_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+
+    const char *begin() const { return data_; }
+    const char *end() const { return data_ + length_; }
+
+    char operator[](size_t pos) const { return data_[pos]; }
+
+    /**
+     * @return reference to the part of the string. Out of range
+     * bounds are truncated.
+     */
+    StringRef substr(size_t pos, size_t count = npos) const {
+        if (pos > length_)
+            pos = length_;
+        if (count > length_ - pos)
+            count = length_ - pos;
+        return StringRef(data_ + pos, count);
+    }
+
+    size_t find(char c, size_t pos = 0) const {
+        if (pos >= length_)
+            return npos;
+        const void *found = memchr(data_ + pos, c, length_ - pos);
+        return found ? static_cast<const char *>(found) - data_ : npos;
+    }
+
+    size_t find(StringRef str, size_t pos = 0) const {
+        if (str.empty())
+            return pos <= length_ ? pos : npos;
+        while (pos + str.length_ <= length_) {
+            size_t first = find(str.data_[0], pos);
+            if (first == npos || first + str.length_ > length_)
+                return npos;
+            if (memcmp(data_ + first, str.data_, str.length_) == 0)
+                return first;
+            pos = first + 1;
+        }
+        return npos;
+    }
+
+    bool startsWith(StringRef prefix) const {
+        return prefix.length_ <= length_ &&
+                memcmp(data_, prefix.data_, prefix.length_) == 0;
+    }
+
+    bool equals(StringRef other) const {
+        return length_ == other.length_ &&
+                (length_ == 0 || memcmp(data_, other.data_, length_) == 0);
+    }
+
+    /**
+     * ASCII case insensitive comparison, enough for protocol keywords.
+     */
+    bool equalsIgnoreCase(StringRef other) const {
+        if (length_ != other.length_)
+            return false;
+        for (size_t i = 0; i < length_; i++) {
+            char a = data_[i], b = other.data_[i];
+            if (a >= 'a' && a <= 'z')
+                a -= 'a' - 'A';
+            if (b >= 'a' && b <= 'z')
+                b -= 'a' - 'A';
+            if (a != b)
+                return false;
+        }
+        return true;
+    }
+
+    std::string toString() const {
+        return std::string(data_, length_);
+    }
+
+private:
+    const char *data_;
+    size_t length_;
+};
+
+inline bool operator==(StringRef lhs, StringRef rhs) {
+    return lhs.equals(rhs);
+}
+
+inline bool operator!=(StringRef lhs, StringRef rhs) {
+    return !lhs.equals(rhs);
+}
+
+inline std::ostream &operator<<(std::ostream &os, StringRef str) {
+    return os.write(str.data(), str.length());
+}
+
+inline std::string &operator+=(std::string &lhs, StringRef rhs) {
+    return lhs.append(rhs.data(), rhs.length());
+}
+
+} /* namespace utils */
+} /* namespace nestor */
+
+#endif /* UTILS_STRING_REF_H_ */